@@ -21,6 +21,7 @@
 
 #include "raytracelib/raytrace.h"
 #include "texture.h"
+#include "raytracelib/texture_bake.h"
 
 
 struct app_state_t;
@@ -49,21 +50,41 @@ struct render_config_t {
         max_bounces(default_max_bounces),
         scn(std::move(scene)) {}
 
-    // if this is turned on, half the threads start from the top of the screen
-    // and half from the bottom, which lets you see the general image a bit quicker.
-    // This only works if there's an even number of threads and the height of the screen
-    // is even. 
+    // if this is turned on, tiles are rendered alternately from the top and the
+    // bottom of the screen, which lets you see the general image a bit quicker.
     bool interlace = true;
 
+    // if this is turned on, finished tiles are resolved from the film straight into
+    // the locked SDL texture instead of going through the 8-bit image buffer first.
+    bool direct_present = false;
+
+    // tone mapping, exposure and dithering used to turn the film into screen pixels
+    resolve_settings_t resolve;
+
     int num_threads;
     int samples_per_pixel;
 
-    /**
-     * the maximum number of bounces a ray_t can go through. Note that this is limited
-     * by the stack size since the ray_color function is recursive. 
-     */
+    // the maximum number of bounces a ray_t can go through
     int max_bounces;
 
+    // sample the lights directly at each diffuse bounce (see render_settings_t)
+    bool next_event_estimation = true;
+    mis_heuristic_t mis = mis_heuristic_t::power;
+    bool light_tree = true;
+    bool restir = false;
+    bool path_guiding = false;
+    bool caustics = false;
+    bool radiance_cache = false;
+    bool texture_filtering = true;
+
+    // bake the procedural textures of scenes picked from now on (see bake_textures)
+    bool bake_textures = false;
+
+    // see render_settings_t
+    bool russian_roulette = true;
+    int roulette_min_depth = 3;
+    int first_bounce_splits = 1;
+
     /**
      * \brief The scaling factor for pixels.
      *  1 = window dimensions,
@@ -74,6 +95,30 @@ struct render_config_t {
     int scale=1;
 
     scene_t scn;
+
+    [[nodiscard]] render_settings_t render_settings() const {
+        render_settings_t settings;
+        settings.samples_per_pixel = samples_per_pixel;
+        settings.max_bounces = max_bounces;
+        settings.num_threads = num_threads;
+        settings.interlace = interlace;
+        settings.next_event_estimation = next_event_estimation;
+        settings.mis = mis;
+        settings.light_tree = light_tree;
+        settings.restir = restir;
+        settings.path_guiding = path_guiding;
+        settings.caustics = caustics;
+        settings.radiance_cache = radiance_cache;
+        settings.texture_filtering = texture_filtering;
+        settings.russian_roulette = russian_roulette;
+        settings.roulette_min_depth = roulette_min_depth;
+        settings.first_bounce_splits = first_bounce_splits;
+#ifndef THREADS
+        // keep tiles small so one fits comfortably in a frame's rendering budget
+        settings.tile_size = 8;
+#endif
+        return settings;
+    }
 };
 
 enum class render_state_t {
@@ -101,50 +146,54 @@ std::string render_state_to_string(const render_state_t state) {
     return "undefined";
 }
 
-#ifdef THREADS
-
 /**
- * \brief Stores the information needed for tracking
- * and managing the progress of a multi-threaded render
+ * \brief Tracks the progress of a render. The actual work is done by a renderer_t,
+ * either on its own threads (THREADS builds) or a tile at a time from the main loop.
  */
-class threaded_render_state_t {
+class render_status_t {
 public:
 
-    threaded_render_state_t() = delete;
-    threaded_render_state_t(render_state_t state): m_state(state) {}
-    ~threaded_render_state_t() {
+    render_status_t() = delete;
+    explicit render_status_t(render_state_t state): m_state(state) {}
+    ~render_status_t() {
         m_state = render_state_t::cleanup;
-        for(auto& t : m_render_threads) {
-            if(t.joinable()) {
-                t.join();
-            }
-        }
+        // the renderer cancels and joins its threads when it's destroyed
+        renderer.reset();
     }
 
-    void cancel() { m_state = render_state_t::cancelled; }
+    void cancel() {
+        m_state = render_state_t::cancelled;
+        if(renderer) {
+            renderer->cancel();
+        }
+    }
     void finish() { m_state = render_state_t::done; }
 
+    /**
+     * \brief Waits for any render threads that are still winding down (after a cancel).
+     */
+    void join() {
+#ifdef THREADS
+        if(renderer) {
+            renderer->wait();
+        }
+#endif
+    }
+
     [[nodiscard]] double time_ns() const { return m_time_ns; }
     void add_time_ns(double t) { m_time_ns += t; }
 
     [[nodiscard]] render_state_t state() const { return m_state; }
 
-    [[nodiscard]] double progress() const { return static_cast<double>(m_pixels_rendered) / m_total_pixels;}
-
-    void add_pixels_rendered(int num) { m_pixels_rendered += num; }
+    [[nodiscard]] double progress() const { return renderer ? renderer->progress() : 0.0; }
 
-    void set_total_pixels(int total) { m_total_pixels = total; }
-    
     [[nodiscard]] bool screen_needs_update() const { return m_screen_needs_update; }
     void mark_screen_for_update() { m_screen_needs_update = true; }
     void clear_update_flag() { m_screen_needs_update = false; }
-       
 
-    std::vector<std::thread> m_render_threads;
+    unique_ptr<renderer_t> renderer;
 
 protected:
-    std::atomic_int m_total_pixels = 1; // don't default to 0 to avoid divide by zero (should never happen, but better to be safe)
-    std::atomic_int m_pixels_rendered = 0;
     std::atomic_bool m_screen_needs_update = false;
 
     // not atomic because only the main thread uses this
@@ -152,54 +201,12 @@ protected:
 
     std::atomic<render_state_t> m_state = render_state_t::inactive;
 };
-typedef threaded_render_state_t render_status_t;
-
-#else
-
-class iterative_render_state_t {
-public:
-
-    iterative_render_state_t(render_state_t state): m_state(state) {}
-
-    void cancel() { m_state = render_state_t::cancelled; }
-    void finish() { m_state = render_state_t::done; }
-
-    [[nodiscard]] bool is_scanline_finished() const { return m_scanline_finished; }
-    void mark_scanline_finished() { m_scanline_finished = true; }
-    void clear_scanline_flag() { m_scanline_finished = false; }
-
-    [[nodiscard]] render_state_t state() const { return m_state; }
-
-    [[nodiscard]] double progress() const { return m_progress;}
-    void progress(double p) { m_progress = p; }
-
-    [[nodiscard]] int x() const { return m_x; }
-    void x(const int x) { m_x = x; }
-
-    [[nodiscard]] int y() const { return m_y; }
-    void y(const int y) { m_y = y; }
-
-    [[nodiscard]] double time_ns() const { return m_time_ns; }
-    void add_time_ns(double t) { m_time_ns += t; }
-
-protected:
-    int m_x = 0;
-    int m_y = 0;
-    bool m_scanline_finished = false;
-    double m_progress = 0.0;
-
-    double m_time_ns = 0.0;
-
-    render_state_t m_state = render_state_t::inactive;
-};
-typedef iterative_render_state_t render_status_t;
-#endif
 
 
 /**
  * \brief Stores most of the mutable state of the application. We're using this as a struct
- * instead of a class because both the emscripten loop function and the render_thread function
- * need to be function pointers, so using class methods would be a pain. 
+ * instead of a class because the emscripten loop function needs to be a function pointer,
+ * so using class methods would be a pain.
  */
 struct app_state_t {
     app_state_t(
@@ -208,11 +215,9 @@ struct app_state_t {
         SDL_Renderer* renderer, 
         SDL_Window* window)
         : renderer(renderer), window(window), screen(screen), cfg(std::move(config)) {
-#ifndef THREADS
-        render_status = make_unique<iterative_render_state_t>(render_state_t::inactive);
-#else 
-        render_status = make_unique<threaded_render_state_t>(render_state_t::inactive);
-#endif
+        film = make_unique<film_t>(screen->width(), screen->height());
+        dirty = make_unique<dirty_tiles_t>(screen->width(), screen->height(), screen->image()->tile_size());
+        render_status = make_unique<render_status_t>(render_state_t::inactive);
     }
 
     void handle_resize() {
@@ -221,11 +226,96 @@ struct app_state_t {
         const int scaled_width = static_cast<int>(static_cast<double>(window_width) / pow(2, cfg.scale-1));
         const int scaled_height = static_cast<int>(static_cast<double>(window_height) / pow(2, cfg.scale-1));
 
+        // a cancelled render might still be writing to the film
+        render_status->join();
+
         cfg.scn.cam.resize(scaled_width, scaled_height);
         screen->resize(scaled_width, scaled_height);
+        film = make_unique<film_t>(scaled_width, scaled_height);
+        dirty = make_unique<dirty_tiles_t>(scaled_width, scaled_height, screen->image()->tile_size());
+    }
+
+    /**
+     * \brief Uploads whatever the render has finished since the last frame.
+     */
+    void update_screen() {
+        if(!render_status->screen_needs_update()) {
+            return;
+        }
+        // clear first, so a tile finishing while we upload isn't forgotten
+        render_status->clear_update_flag();
+        if(direct_present) {
+            screen->update_texture_from_film(*film, *dirty, cfg.resolve);
+        } else {
+            screen->update_texture_sync();
+        }
+    }
+
+    /**
+     * \brief Called once the render threads are finished with the film. When presenting
+     * directly the image buffer never saw the render, so copy it across now (resizes and
+     * later uploads of the buffer would show the old test pattern otherwise).
+     */
+    void end_render(render_state_t state) {
+        if(state == render_state_t::cancelled) {
+            render_status->cancel();
+            render_status->join();
+        } else {
+            render_status->finish();
+        }
+
+        if(direct_present) {
+            update_screen();
+            screen->image()->write_region(*film, film->bounds(), cfg.resolve);
+        }
+    }
+
+    /**
+     * \brief Re-resolves the whole finished film, e.g. after the exposure or tone mapper changed.
+     */
+    void resolve_film() {
+        const render_state_t s = render_status->state();
+        if(s != render_state_t::done && s != render_state_t::cancelled) {
+            return; // nothing rendered yet, or the render threads still own the film
+        }
+        screen->image()->write_region(*film, film->bounds(), cfg.resolve);
+        screen->update_texture_sync();
+    }
+
+    void start_render() {
+        // replacing the status waits for any cancelled render that's still winding down
+        render_status = make_unique<render_status_t>(render_state_t::rendering);
+        film->clear();
+        render_gradient_pattern(*screen->image());
+        screen->update_texture_sync();
+
+        render_settings_t settings = cfg.render_settings();
+
+        // a render in groups adds to tiles it's already finished, and resolving straight
+        // from the film is only safe for tiles nothing is writing to any more
+        direct_present = cfg.direct_present && !renders_in_groups(settings);
+
+        render_callbacks_t callbacks;
+        callbacks.on_tile_complete = [this, direct = direct_present, resolve = cfg.resolve](const render_tile_t& tile) {
+            if(direct) {
+                dirty->mark(tile.region);
+            } else {
+                screen->image()->write_region(*film, tile.region, resolve);
+            }
+            render_status->mark_screen_for_update();
+        };
 
 #ifdef THREADS
-        render_status->set_total_pixels(scaled_width * scaled_height);
+        // one render thread per image tile, so they can write to the screen without locking
+        settings.tile_size = screen->image()->tile_size();
+#endif
+        // track dirt at the render's tile size so a finished tile never drags unrendered pixels along with it
+        dirty = make_unique<dirty_tiles_t>(film->width(), film->height(), settings.tile_size);
+        render_status->renderer = make_unique<renderer_t>(cfg.scn, *film, settings, callbacks);
+#ifdef THREADS
+        render_status->renderer->start(film->bounds());
+#else
+        render_status->renderer->begin(film->bounds());
 #endif
     }
 
@@ -233,6 +323,14 @@ struct app_state_t {
     SDL_Window* window;
 
     shared_ptr<streaming_image_texture_t> screen;
+    unique_ptr<film_t> film;
+
+    // tiles of the film that haven't been uploaded yet (only used with direct_present)
+    unique_ptr<dirty_tiles_t> dirty;
+
+    // whether the current render resolves into the screen texture (cfg.direct_present,
+    // unless the render comes in groups)
+    bool direct_present = false;
 
     render_config_t cfg;
 
@@ -248,120 +346,24 @@ struct app_state_t {
 // this in the main loop as long as we're within our frame-budget.
 // Once we exceed the budget, we handle ui & input and present to the
 // screen, then resume again.
-int64_t next_pixel(app_state_t& state) {
+int64_t next_tile(app_state_t& state) {
     if(state.render_status->state() != render_state_t::rendering) {
         return 0;
     }
 
     const auto start = std::chrono::system_clock::now();
 
-    const auto& cfg = state.cfg;
-    const auto& scn = state.cfg.scn;
-    const auto& cam = scn.cam;
-    auto& cs = state.render_status;
-    
-    color_t pixel_color;
-    
-    for(int s = 0; s<cfg.samples_per_pixel; s++) {
-        double u = (cs->x()+random_double()) / static_cast<double>(cam.width()-1);
-        double v = (cs->y()+random_double()) / static_cast<double>(cam.height()-1);
-        ray_t r = scn.cam.get_ray(u, v);
-        pixel_color += ray_color(r, scn, *scn.root.get(), cfg.max_bounces);
-    }
-
-    state.screen->image()->write(cs->x(), (cam.height()-1)-cs->y(), pixel_color, cfg.samples_per_pixel);
-
-    cs->x(cs->x()+1);
-
-    if(cs->x() >= cam.width()) {
-        cs->x(0);
-        cs->y(cs->y()+1);
-        cs->mark_scanline_finished();
-    }
-
-    cs->progress(static_cast<double>(cs->x() + cs->y() * state.screen->width()) / static_cast<double>(state.screen->width()*state.screen->height()));
-
-    if(cs->y() >= cam.height()) {
-        cs->finish();
-        cs->progress(1.0);
+    if(!state.render_status->renderer->render_next_tile()) {
+        state.end_render(render_state_t::done);
     }
 
     const auto finish = std::chrono::system_clock::now();
     const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count();
-    cs->add_time_ns(static_cast<double>(ns));
+    state.render_status->add_time_ns(static_cast<double>(ns));
     return ns;
 }
 #endif
 
-#ifdef THREADS
-// This is the multi-threaded version of rendering. Each render thread handles
-// a subset of the scan lines. To keep it simple, we just use a base and offset.
-// So, if we had 4 threads, the first thread would handle lines (0, 4, 8, 12, ...) then
-// the second thread will handle (1, 5, 9, 13, ...) and the third thread would handle
-// (2, 6, 10, 14, ...) and so on.
-void render_thread(app_state_t* state, int base, int offset) {
-    std::stringstream msg;
-    msg << "starting thread, base: " << base << ", offset: " << offset << std::endl;
-    std::cout << msg.str();
-
-    const auto& config = state->cfg;
-    
-    SDL_Delay(static_cast<int>(random_double(0, 250))); // stagger the thread timing a bit so they're not writing to the buffer all at the same time
-
-    const auto& scn = config.scn;
-    const auto& cam = scn.cam;
-    auto scanline = std::make_unique<color_t[]>(state->screen->width());
-
-    bool done = false;
-
-    //for(int y = base; y < cam.height(); y += offset) {
-    int y = base;
-    while(!done) {
-
-        if(offset > 0) {
-            if(y > cam.height()-1) {
-                done = true;
-                break;
-            }
-        } else {
-            if(y < 0) {
-                done = true;
-                break;
-            }
-        }
-
-        for(int x = 0; x < cam.width(); x++) {
-            color_t pixel_color;
-    
-            for(int s = 0; s<config.samples_per_pixel; s++) {
-                const double u = (x+random_double()) / static_cast<double>(cam.width()-1);
-                const double v = (y+random_double()) / static_cast<double>(cam.height()-1);
-                ray_t r = scn.cam.get_ray(u, v);
-                pixel_color += ray_color(r, scn, *scn.root.get(), config.max_bounces);
-            }
-            scanline[x] = pixel_color;
-
-            if(g_quit_program 
-                || state->render_status->state() == render_state_t::cancelled
-                || state->render_status->state() == render_state_t::cleanup) {
-                return;
-            }
-        }
-        state->screen->image()->write_line_sync((cam.height()-1) - y, scanline.get(), config.samples_per_pixel);
-        state->render_status->add_pixels_rendered(state->screen->width());
-        state->render_status->mark_screen_for_update();
-
-        if(g_quit_program 
-            || state->render_status->state() == render_state_t::cancelled
-            || state->render_status->state() == render_state_t::cleanup) {
-            break;
-        }
-
-        y += offset;
-    }
-}
-#endif
-
 // Helper to display a little (?) mark which shows a tooltip when hovered.
 static void help_marker(const char* desc)
 {
@@ -390,24 +392,18 @@ void loop_fn(void* arg) {
     constexpr uint64_t rendering_budget = 30 * 1000000; 
 
     while(state->render_status->state() == render_state_t::rendering && time_spent_rendering < rendering_budget) {
-        time_spent_rendering += next_pixel(*state);
+        time_spent_rendering += next_tile(*state);
     }
 
-    if(state->render_status->is_scanline_finished()) {
-        state->render_status->clear_scanline_flag();
-        state->screen->update_texture_sync();
-    }
+    state->update_screen();
 
 #else
     const auto start = std::chrono::system_clock::now();
 
-    if(state->render_status->screen_needs_update()) {
-        state->screen->update_texture_sync();
-        state->render_status->clear_update_flag();
-    }
+    state->update_screen();
 
-    if(state->render_status->progress() >= 1.0) {
-        state->render_status->finish();
+    if(state->render_status->state() == render_state_t::rendering && state->render_status->renderer->done()) {
+        state->end_render(render_state_t::done);
     }
 
 #endif
@@ -457,24 +453,43 @@ void loop_fn(void* arg) {
         ImGui::BeginDisabled(state->render_status->state() == render_state_t::rendering);
 
         static int current_scene = 7;
-        const char* scenes[] {"Random Spheres", "Test Scene", "Earth", "Two Perlin Spheres", "Simple Light", "Simple Box", "Cornell Box",  "All Test"};
+        const char* scenes[] {"Random Spheres", "Test Scene", "Earth", "Two Perlin Spheres", "Simple Light", "Simple Box", "Cornell Box",  "All Test", "Glossy Lights", "Display Wall", "Sunny Day"};
         if(ImGui::Combo("Scene", &current_scene, scenes, sizeof(scenes) / sizeof(const char*))) {
-            if(current_scene == 7) {
-                state->cfg.scn = random_scene(state->screen->width(), state->screen->height());
-            } else if(current_scene == 1) {
-                state->cfg.scn = three_spheres_scene(state->screen->width(), state->screen->height());
-            } else if(current_scene == 2) {
-                state->cfg.scn = earth_scene(state->screen->width(), state->screen->height());
-            } else if(current_scene == 3) {
-                state->cfg.scn = two_perlin_spheres_scene(state->screen->width(), state->screen->height());
-            } else if(current_scene == 4) {
-                state->cfg.scn = simple_light(state->screen->width(), state->screen->height());
-            } else if(current_scene == 5) {
-                state->cfg.scn = simple_box(state->screen->width(), state->screen->height());
-            } else if(current_scene == 6) {
-                state->cfg.scn = cornell_box(state->screen->width(), state->screen->height());
-            } else if(current_scene == 7) {
-                state->cfg.scn = all_test(state->screen->width(), state->screen->height());
+            // built in an arena of its own, which the scene takes once it's made
+            auto arena = make_shared<scene_arena_t>();
+            std::optional<scene_t> built;
+            {
+                const arena_scope_t in_arena(arena.get());
+                if(current_scene == 7) {
+                    built = random_scene(state->screen->width(), state->screen->height());
+                } else if(current_scene == 1) {
+                    built = three_spheres_scene(state->screen->width(), state->screen->height());
+                } else if(current_scene == 2) {
+                    built = earth_scene(state->screen->width(), state->screen->height());
+                } else if(current_scene == 3) {
+                    built = two_perlin_spheres_scene(state->screen->width(), state->screen->height());
+                } else if(current_scene == 4) {
+                    built = simple_light(state->screen->width(), state->screen->height());
+                } else if(current_scene == 5) {
+                    built = simple_box(state->screen->width(), state->screen->height());
+                } else if(current_scene == 6) {
+                    built = cornell_box(state->screen->width(), state->screen->height());
+                } else if(current_scene == 7) {
+                    built = all_test(state->screen->width(), state->screen->height());
+                } else if(current_scene == 8) {
+                    built = glossy_lights(state->screen->width(), state->screen->height());
+                } else if(current_scene == 9) {
+                    built = display_wall(state->screen->width(), state->screen->height());
+                } else if(current_scene == 10) {
+                    built = sunny_day(state->screen->width(), state->screen->height());
+                }
+            }
+            if(built) {
+                built->arena = std::move(arena);
+                state->cfg.scn = std::move(*built);
+            }
+            if(state->cfg.bake_textures) {
+                bake_textures(state->cfg.scn, {}, std::max(1, state->cfg.num_threads));
             }
             
         }
@@ -492,14 +507,15 @@ void loop_fn(void* arg) {
 #ifdef THREADS
         ImGui::SliderInt("Threads", &state->cfg.num_threads, 1, static_cast<int>(processor_count));
 
-        bool can_interlace = state->cfg.num_threads % 2 != 0 || state->screen->height() % 2 != 0;
-        ImGui::BeginDisabled(can_interlace);
         ImGui::Checkbox("Interlaced Rendering", &state->cfg.interlace);
-        ImGui::EndDisabled();
         ImGui::SameLine();
         help_marker("If enabled, renders from top and bottom simultaneously to resolve the image more quickly. Does not affect final quality.");
 #endif
 
+        ImGui::Checkbox("Resolve Directly Into Texture", &state->cfg.direct_present);
+        ImGui::SameLine();
+        help_marker("If enabled, finished tiles are converted straight into the screen texture, skipping the intermediate image buffer copy. Ignored with ReSTIR, Path Guiding, Caustics or Radiance Cache, which add to tiles again after they're finished.");
+
         if(ImGui::SliderInt("Pixel Scale", &state->cfg.scale, 1, 4)) {
             state->render_status = make_unique<render_status_t>(render_state_t::inactive);
             state->handle_resize();
@@ -517,6 +533,78 @@ void loop_fn(void* arg) {
         ImGui::SameLine();
         help_marker("More samples results in higher quality, but slower render times.");
 
+        ImGui::Checkbox("Sample Lights Directly", &state->cfg.next_event_estimation);
+        ImGui::SameLine();
+        help_marker("Aims a shadow ray at a light from every diffuse surface a path hits. Scenes lit by small lights clean up with far fewer samples.");
+
+        const char* heuristics[] = { "None", "Balance", "Power" };
+        int mis = static_cast<int>(state->cfg.mis);
+        if(ImGui::Combo("MIS Heuristic", &mis, heuristics, sizeof(heuristics) / sizeof(const char*))) {
+            state->cfg.mis = static_cast<mis_heuristic_t>(mis);
+        }
+        ImGui::SameLine();
+        help_marker("How light sampling and bounced rays share the work of finding lights. Balance or Power keep glossy reflections of big lights clean; None only trusts light sampling.");
+
+        ImGui::Checkbox("Light Tree", &state->cfg.light_tree);
+        ImGui::SameLine();
+        help_marker("Picks which light to sample by how much it's likely to add at each point, instead of at random. Makes a big difference in scenes with lots of lights.");
+
+        ImGui::Checkbox("ReSTIR", &state->cfg.restir);
+        ImGui::SameLine();
+        help_marker("Lights what each pixel sees first by resampling many candidate lights, reusing the picks of neighbouring pixels and of earlier samples. Direct light looks almost clean after a few samples per pixel.");
+
+        ImGui::Checkbox("Bake Textures", &state->cfg.bake_textures);
+        ImGui::SameLine();
+        help_marker("Works out marble and checker textures ahead of time, for the surfaces the camera sees, and looks them up instead while rendering. Faster samples, slightly softer patterns. Applies to scenes picked after it's turned on.");
+
+        ImGui::Checkbox("Path Guiding", &state->cfg.path_guiding);
+        ImGui::SameLine();
+        help_marker("Learns where light comes from throughout the scene while the render runs, and aims later bounces at it. Helps most in rooms lit through small openings and in smoke. Has no effect with ReSTIR.");
+
+        ImGui::Checkbox("Caustics", &state->cfg.caustics);
+        ImGui::SameLine();
+        help_marker("Traces photons from the lights through glass and mirrors each sample, so the bright patterns they focus onto other surfaces come out smooth instead of as scattered fireflies.");
+
+        ImGui::Checkbox("Radiance Cache", &state->cfg.radiance_cache);
+        ImGui::SameLine();
+        help_marker("Remembers how much light each patch of wall sends back, and ends paths there after their first bounce instead of following them further. Much faster previews of rooms lit by bouncing light, slightly blurred.");
+
+        ImGui::Checkbox("Texture Filtering", &state->cfg.texture_filtering);
+        ImGui::SameLine();
+        help_marker("Averages image textures over what each pixel covers, using smaller copies of the image for surfaces far away. Stops distant textures from shimmering and sparkling, and they converge in fewer samples.");
+
+        ImGui::Checkbox("Russian Roulette", &state->cfg.russian_roulette);
+        ImGui::SameLine();
+        help_marker("Randomly ends paths that have become too dim to matter, and boosts the ones that continue to make up for it. Same image on average, less time per sample.");
+
+        ImGui::SliderInt("Roulette Start", &state->cfg.roulette_min_depth, 0, 10);
+        ImGui::SameLine();
+        help_marker("How many bounces a path always gets before Russian roulette can end it.");
+
+        ImGui::SliderInt("First Bounce Splits", &state->cfg.first_bounce_splits, 1, 16);
+        ImGui::SameLine();
+        help_marker("Continues each camera ray's first hit with this many paths. Helps when camera rays are expensive, e.g. with depth of field.");
+
+        // these only change how the film is displayed, so a finished render is just resolved again
+        bool resolve_changed = false;
+        const char* tonemappers[] = { "Clamp", "Reinhard", "ACES Filmic" };
+        int tonemap = static_cast<int>(state->cfg.resolve.tonemap);
+        if(ImGui::Combo("Tone Mapping", &tonemap, tonemappers, sizeof(tonemappers) / sizeof(const char*))) {
+            state->cfg.resolve.tonemap = static_cast<tonemap_t>(tonemap);
+            resolve_changed = true;
+        }
+        ImGui::SameLine();
+        help_marker("How brightness above 1.0 is brought into range. Clamp clips it, Reinhard and ACES roll it off smoothly.");
+
+        resolve_changed |= ImGui::SliderFloat("Exposure", &state->cfg.resolve.exposure, -5.0f, 5.0f, "%.1f stops");
+        resolve_changed |= ImGui::Checkbox("Dither", &state->cfg.resolve.dither);
+        ImGui::SameLine();
+        help_marker("Adds a faint ordered pattern that hides banding in smooth, dark gradients.");
+
+        if(resolve_changed) {
+            state->resolve_film();
+        }
+
         ImGui::EndDisabled();
 
         
@@ -536,25 +624,7 @@ void loop_fn(void* arg) {
         ImGui::BeginDisabled(state->render_status->state() == render_state_t::rendering);
         if (ImGui::Button("Render")) {
             std::cout << "start render" << std::endl;
-            render_gradient_pattern(*state->screen->image());
-            state->render_status = make_unique<render_status_t>(render_state_t::rendering);
-
-#ifdef THREADS
-            state->render_status->set_total_pixels(state->screen->width() * state->screen->height());
-
-            bool can_interlace = state->cfg.num_threads % 2 == 0 && state->screen->height() % 2 == 0;
-            can_interlace &= state->cfg.interlace;
-
-            for(int i = 0; i<state->cfg.num_threads; i++) {
-                int num_threads = state->cfg.num_threads;
-
-                if(i%2 == 0 || !can_interlace) {
-                    state->render_status->m_render_threads.emplace_back(&render_thread, state, i, num_threads);
-                } else {
-                    state->render_status->m_render_threads.emplace_back(&render_thread, state, state->screen->height()-i, -num_threads);
-                }
-            }
-#endif
+            state->start_render();
         } 
         ImGui::EndDisabled();
         
@@ -563,7 +633,7 @@ void loop_fn(void* arg) {
         ImGui::BeginDisabled(state->render_status->state() != render_state_t::rendering);
 
         if (ImGui::Button("Cancel")) {
-            state->render_status->cancel();
+            state->end_render(render_state_t::cancelled);
         }
 
         ImGui::EndDisabled();
@@ -600,25 +670,6 @@ void loop_fn(void* arg) {
 #endif
 }
 
-// This is the naieve/simple ray trace (not iterative or threaded, so blocks the interface)
-void raytrace_all_linear(const render_config_t& config, const shared_ptr<image_buffer_t>& screen) {
-    for(int y = screen->height()-1; y>=0; --y) {
-        std::cout << "\rScanlines remaining: " << (screen->height()-1) - y << std::endl;
-        for(int x = screen->width()-1; x>=0; --x) {
-            color_t pixel_color;
-
-            for(int s = 0; s<config.samples_per_pixel; s++) {
-                double u = (x+random_double()) / static_cast<double>(screen->width()-1);
-                double v = (y+random_double()) / static_cast<double>(screen->height()-1);
-                ray_t r = config.scn.cam.get_ray(u, v);
-                pixel_color += ray_color(r, config.scn, config.scn.entities, config.max_bounces);
-            }
-
-            screen->write(x, (screen->height()-1)-y, pixel_color, config.samples_per_pixel);
-        }
-    }
-}
-
 int main(int argc, char* argv[])
 {
     //print cwd
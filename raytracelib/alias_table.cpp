@@ -0,0 +1,63 @@
+#include "alias_table.h"
+
+#include <algorithm>
+
+alias_table_t::alias_table_t(const std::vector<double>& weights) {
+    const int n = static_cast<int>(weights.size());
+    m_bins.resize(n);
+    if(n == 0) {
+        return;
+    }
+
+    m_total = 0.0;
+    for(const double w : weights) {
+        m_total += w;
+    }
+
+    // each bin's weight relative to the average, so a bin that's exactly full is 1
+    std::vector<double> scaled(n);
+    for(int i = 0; i < n; i++) {
+        m_bins[i].pmf = m_total > 0.0 ? weights[i] / m_total : 1.0 / n;
+        scaled[i] = m_bins[i].pmf * n;
+    }
+
+    std::vector<int> under, over;
+    for(int i = 0; i < n; i++) {
+        (scaled[i] < 1.0 ? under : over).push_back(i);
+    }
+
+    // top up every underfull bin from an overfull one
+    while(!under.empty() && !over.empty()) {
+        const int small = under.back();
+        under.pop_back();
+        const int large = over.back();
+        over.pop_back();
+
+        m_bins[small].keep = scaled[small];
+        m_bins[small].alias = large;
+
+        scaled[large] -= 1.0 - scaled[small];
+        (scaled[large] < 1.0 ? under : over).push_back(large);
+    }
+
+    // whatever's left is full, give or take rounding
+    for(const int i : under) {
+        m_bins[i].keep = 1.0;
+        m_bins[i].alias = i;
+    }
+    for(const int i : over) {
+        m_bins[i].keep = 1.0;
+        m_bins[i].alias = i;
+    }
+}
+
+int alias_table_t::sample(double u, double& pmf) const {
+    const int n = static_cast<int>(m_bins.size());
+    const double scaled = u * n;
+    const int bin = std::min(static_cast<int>(scaled), n - 1);
+
+    // what's left of u after picking the bin decides between it and its alias
+    const int index = scaled - bin < m_bins[bin].keep ? bin : m_bins[bin].alias;
+    pmf = m_bins[index].pmf;
+    return index;
+}
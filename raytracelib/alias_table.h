@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+/**
+ * \brief Picks an index with probability proportional to its weight in constant time,
+ * using Walker's alias method (built with Vose's algorithm).
+ *
+ * Every bin holds one index with some probability and the index it's an alias for
+ * otherwise, so a pick is one lookup and one comparison however many entries there are.
+ */
+class alias_table_t {
+public:
+    alias_table_t() = default;
+
+    /**
+     * \brief Builds the table. Weights must not be negative. If they're all zero every
+     * index is equally likely.
+     */
+    explicit alias_table_t(const std::vector<double>& weights);
+
+    /**
+     * \brief Picks an index.
+     * \param u a uniform random number in [0, 1)
+     * \param pmf set to the probability of the returned index
+     */
+    int sample(double u, double& pmf) const;
+
+    /**
+     * \brief The probability sample() returns index.
+     */
+    [[nodiscard]] double pmf(int index) const { return m_bins[index].pmf; }
+
+    [[nodiscard]] size_t size() const { return m_bins.size(); }
+    [[nodiscard]] bool empty() const { return m_bins.empty(); }
+
+    /**
+     * \brief The sum of the weights the table was built from.
+     */
+    [[nodiscard]] double total() const { return m_total; }
+
+protected:
+    struct bin_t {
+        // chance of keeping this bin's own index rather than taking the alias
+        double keep = 1.0;
+        int alias = 0;
+        double pmf = 0.0;
+    };
+
+    std::vector<bin_t> m_bins;
+    double m_total = 0.0;
+};
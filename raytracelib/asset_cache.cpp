@@ -0,0 +1,93 @@
+#include "asset_cache.h"
+
+asset_cache_t::asset_cache_t(int threads)
+    : m_pool(threads) {
+}
+
+asset_cache_t& asset_cache_t::instance() {
+    static asset_cache_t cache;
+    return cache;
+}
+
+asset_cache_t::image_future_t asset_cache_t::start_image(const std::string& path, texture_format_t format) {
+    auto promise = make_shared<std::promise<shared_ptr<const image_texture_t>>>();
+    image_future_t load;
+    {
+        std::lock_guard lock(m_mutex);
+        m_stats.requests++;
+        const image_key_t key(path, format);
+        if(auto found = m_images.find(key); found != m_images.end()) {
+            m_stats.hits++;
+            return found->second;
+        }
+        load = promise->get_future().share();
+        m_images.emplace(key, load);
+        m_stats.images_loaded++;
+    }
+
+    // handed over outside the lock, since without THREADS it runs right here
+    m_pool.submit([this, promise, path, format] {
+        const auto start = std::chrono::steady_clock::now();
+        auto texture = make_shared<image_texture_t>(path.c_str(), format);
+        add_load_time(std::chrono::steady_clock::now() - start);
+        promise->set_value(std::move(texture));
+    });
+    return load;
+}
+
+shared_ptr<const image_texture_t> asset_cache_t::image(const std::string& path, texture_format_t format) {
+    const image_future_t load = start_image(path, format);
+    auto texture = load.get();
+    if(texture->levels() == 0) {
+        // so the next scene tries the file again, unless someone already has
+        std::lock_guard lock(m_mutex);
+        auto found = m_images.find(image_key_t(path, format));
+        if(found != m_images.end() && found->second.get() == texture) {
+            m_images.erase(found);
+        }
+    }
+    return texture;
+}
+
+void asset_cache_t::prefetch(const std::string& path, texture_format_t format) {
+    start_image(path, format);
+}
+
+shared_ptr<const perlin_t> asset_cache_t::perlin(uint64_t seed) {
+    // the tables are quick to make, so they're made right here
+    std::lock_guard lock(m_mutex);
+    m_stats.requests++;
+    auto& tables = m_perlins[seed];
+    if(tables) {
+        m_stats.hits++;
+        return tables;
+    }
+    tables = make_shared<const perlin_t>(seed);
+    m_stats.noise_tables_built++;
+    return tables;
+}
+
+void asset_cache_t::clear() {
+    std::map<image_key_t, image_future_t> images;
+    {
+        std::lock_guard lock(m_mutex);
+        images.swap(m_images);
+        m_perlins.clear();
+    }
+    // outside the lock, since the loads take it to add their time
+    for(auto& [key, load] : images) {
+        load.wait();
+    }
+    std::lock_guard lock(m_mutex);
+    m_stats = {};
+}
+
+asset_cache_stats_t asset_cache_t::stats() const {
+    std::lock_guard lock(m_mutex);
+    return m_stats;
+}
+
+void asset_cache_t::add_load_time(std::chrono::steady_clock::duration time) {
+    std::lock_guard lock(m_mutex);
+    m_stats.load_seconds += std::chrono::duration<double>(time).count();
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include "perlin.h"
+#include "texture.h"
+#include "worker_pool.h"
+
+/**
+ * \brief What the asset cache has done since it was made (or cleared).
+ */
+struct asset_cache_stats_t {
+    // assets asked for, and how many were already loaded or being loaded
+    uint64_t requests = 0;
+    uint64_t hits = 0;
+
+    uint64_t images_loaded = 0;
+    uint64_t noise_tables_built = 0;
+
+    // time spent decoding images, summed across the threads doing it
+    double load_seconds = 0.0;
+};
+
+/**
+ * \brief Textures and noise tables shared by everything in the process, so building a
+ * scene again (switching scenes, another render job) picks up the ones already made
+ * instead of decoding images and generating tables again. Assets are keyed by their
+ * path and the parameters they were made with, and don't change once made, so every
+ * scene can hold the same one.
+ *
+ * Images are decoded on the cache's own threads. Asking for an asset someone else is
+ * already loading waits for that load rather than starting another, and prefetch()
+ * starts loads without waiting, so a scene can ask for all its images first and have
+ * them decode side by side. Thread safe.
+ */
+class asset_cache_t {
+public:
+    explicit asset_cache_t(int threads = 0);
+
+    // the process' cache
+    static asset_cache_t& instance();
+
+    /**
+     * \brief An image texture, loaded the first time it's asked for. A file that
+     * couldn't be read gives an empty texture, and is tried again next time. It's
+     * const since every scene that asks for it gets the same one.
+     */
+    shared_ptr<const image_texture_t> image(const std::string& path, texture_format_t format = texture_format_t::rgb_float);
+
+    /**
+     * \brief Starts loading an image (if it isn't already) without waiting for it.
+     */
+    void prefetch(const std::string& path, texture_format_t format = texture_format_t::rgb_float);
+
+    /**
+     * \brief The noise tables made from seed (see perlin_t(uint64_t)).
+     */
+    shared_ptr<const perlin_t> perlin(uint64_t seed = 0);
+
+    /**
+     * \brief Forgets every asset (scenes holding one keep it alive) and the stats.
+     * Waits for loads under way to finish first.
+     */
+    void clear();
+
+    [[nodiscard]] asset_cache_stats_t stats() const;
+
+protected:
+    using image_key_t = std::pair<std::string, texture_format_t>;
+    using image_future_t = std::shared_future<shared_ptr<const image_texture_t>>;
+
+    // the load of an image, started if it isn't under way or done
+    image_future_t start_image(const std::string& path, texture_format_t format);
+
+    void add_load_time(std::chrono::steady_clock::duration time);
+
+    mutable std::mutex m_mutex;
+    std::map<image_key_t, image_future_t> m_images;
+    std::map<uint64_t, shared_ptr<const perlin_t>> m_perlins;
+    asset_cache_stats_t m_stats;
+
+    // last, so it finishes its loads before the tables above go away
+    worker_pool_t m_pool;
+};
@@ -1,21 +1,25 @@
 #include "box.h"
+#include "material.h"
+#include "scene_arena.h"
 
 box_t::box_t(dvec3_t center, dquat rotation, double width, double height, double depth, const shared_ptr<material_t>& mat):
-    m_center(center), m_rotation(rotation), m_width(width), m_height(height), m_depth(depth)
+    m_center(center), m_rotation(rotation), m_width(width), m_height(height), m_depth(depth), m_material(mat)
 {
     auto w2 = width/2;
     auto h2 = height/2;
     auto d2 = depth/2;
     auto r90y = glm::angleAxis<double, glm::highp>(glm::radians(90.0), {0.0, 1.0, 0.0});
     auto r90x = glm::angleAxis<double, glm::highp>(glm::radians(90.0), {1.0, 0.0, 0.0});
+    auto r180y = glm::angleAxis<double, glm::highp>(glm::radians(180.0), {0.0, 1.0, 0.0});
 
-    // all planes in local space
-    m_front = make_shared<rect_t>(width, height, dvec3_t{0, 0, d2}, glm::quat(), mat);
-    m_back = make_shared<rect_t>(width, height, dvec3_t{0, 0, -d2}, glm::quat(), mat);
-    m_left = make_shared<rect_t>(depth, height, dvec3_t{-w2, 0, 0}, r90y, mat);
-    m_right = make_shared<rect_t>(depth, height,dvec3_t{w2, 0, 0}, r90y, mat);
-    m_top = make_shared<rect_t>(width, depth, dvec3_t{0, h2, 0}, r90x, mat);
-    m_bottom = make_shared<rect_t>(width, depth, dvec3_t{0, -h2, 0}, r90x, mat);
+    // all planes in local space, each turned so its normal points out of the box (which
+    // dielectrics need to tell rays going in from rays coming out)
+    m_front = make_object<rect_t>(width, height, dvec3_t{0, 0, d2}, glm::quat(), mat);
+    m_back = make_object<rect_t>(width, height, dvec3_t{0, 0, -d2}, r180y, mat);
+    m_left = make_object<rect_t>(depth, height, dvec3_t{-w2, 0, 0}, glm::inverse(r90y), mat);
+    m_right = make_object<rect_t>(depth, height,dvec3_t{w2, 0, 0}, r90y, mat);
+    m_top = make_object<rect_t>(width, depth, dvec3_t{0, h2, 0}, glm::inverse(r90x), mat);
+    m_bottom = make_object<rect_t>(width, depth, dvec3_t{0, -h2, 0}, r90x, mat);
 
     m_sides.add(m_front);
     m_sides.add(m_back);
@@ -55,11 +59,39 @@ bool box_t::hit(const ray_t& r, double t_min, double t_max, hit_record_t& out) c
     if(hit) {
         out.p = transform_point(out.p, m_cached_transform);
         out.normal = transform_vec(out.normal, m_cached_transform);
+        out.dpdu = transform_vec(out.dpdu, m_cached_transform);
+        out.dpdv = transform_vec(out.dpdv, m_cached_transform);
     }
     
     return hit;
 }
 
+bool box_t::interval(const ray_t& r, double& t_enter, double& t_exit) const {
+    // a slab test in local space, where the box is axis aligned around the origin
+    const ray_t local_ray = r.transformed(m_cached_inverse_transform);
+    const dvec3_t half_size(m_width / 2, m_height / 2, m_depth / 2);
+    t_enter = -infinity;
+    t_exit = infinity;
+    for(int a = 0; a < 3; a++) {
+        const double inv = 1.0 / local_ray.direction()[a];
+        double t0 = (-half_size[a] - local_ray.origin()[a]) * inv;
+        double t1 = (half_size[a] - local_ray.origin()[a]) * inv;
+        if(inv < 0.0) {
+            std::swap(t0, t1);
+        }
+        t_enter = std::max(t_enter, t0);
+        t_exit = std::min(t_exit, t1);
+        if(t_exit <= t_enter) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool box_t::is_specular() const {
+    return m_material && m_material->is_specular();
+}
+
 bool box_t::bounding_box(double time0, double time1, aabb_t& output_box) const {
     output_box = m_cached_bb;
     return true;
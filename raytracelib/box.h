@@ -11,6 +11,14 @@ public:
 
     bool hit(const ray_t& r, double t_min, double t_max, hit_record_t& rec) const override;
     bool bounding_box(double time0, double time1, aabb_t& output_box) const override;
+    bool interval(const ray_t& r, double& t_enter, double& t_exit) const override;
+    [[nodiscard]] bool is_specular() const override;
+
+    // width, height and depth
+    [[nodiscard]] dvec3_t size() const { return {m_width, m_height, m_depth}; }
+    [[nodiscard]] const dmat4_t& transform() const { return m_cached_transform; }
+    [[nodiscard]] const dmat4_t& inverse_transform() const { return m_cached_inverse_transform; }
+    [[nodiscard]] const shared_ptr<material_t>& material() const { return m_material; }
 
 protected:
 
@@ -1,4 +1,5 @@
 #include "bvh_node.h"
+#include "scene_arena.h"
 
 #include <algorithm>
 
@@ -67,8 +68,8 @@ bvh_node_t::bvh_node_t(const std::vector<shared_ptr<hittable_t>>& src_objects, s
         std::sort(objects.begin() + start, objects.begin() + end, comparator);
 
         auto mid = start + object_span/2;
-        left = make_shared<bvh_node_t>(objects, start, mid, time0, time1);
-        right = make_shared<bvh_node_t>(objects, mid, end, time0, time1);
+        left = make_object<bvh_node_t>(objects, start, mid, time0, time1);
+        right = make_object<bvh_node_t>(objects, mid, end, time0, time1);
     }
 
     aabb_t box_left, box_right;
@@ -91,3 +92,13 @@ bool bvh_node_t::hit(const ray_t& r, double t_min, double t_max, hit_record_t& r
 
     return hit_left || hit_right;
 }
+
+double bvh_node_t::transmittance(const ray_t& r, double t_min, double t_max) const {
+    if (!box.hit(r, t_min, t_max))
+        return 1.0;
+
+    const double through_left = left->transmittance(r, t_min, t_max);
+    if (through_left <= 0.0)
+        return 0.0;
+    return through_left * right->transmittance(r, t_min, t_max);
+}
@@ -23,6 +23,8 @@ class bvh_node_t : public hittable_t {
 
         virtual bool bounding_box(double time0, double time1, aabb_t& output_box) const override;
 
+        [[nodiscard]] double transmittance(const ray_t& r, double t_min, double t_max) const override;
+
     public:
         shared_ptr<hittable_t> left;
         shared_ptr<hittable_t> right;
@@ -1,5 +1,7 @@
 #include "camera.h"
 
+#include <algorithm>
+
 using glm::normalize;
 using glm::cross;
 
@@ -49,6 +51,20 @@ ray_t camera_t::get_ray(double s, double t) const {
     );
 }
 
+ray_t camera_t::get_ray(double s, double t, ray_differential_t& differential) const {
+    const dvec3_t rd = m_lens_radius * random_in_unit_disk();
+    const dvec3_t origin = m_origin + m_u * rd.x + m_v * rd.y;
+    const dvec3_t direction = m_lower_left_corner + s*m_horizontal + t*m_vertical - origin;
+
+    // the renderer spreads s and t over width - 1 and height - 1 pixels
+    differential.rx_origin = origin;
+    differential.rx_direction = direction + m_horizontal / static_cast<double>(std::max(1, m_width - 1));
+    differential.ry_origin = origin;
+    differential.ry_direction = direction + m_vertical / static_cast<double>(std::max(1, m_height - 1));
+
+    return ray_t(origin, direction, random_double(m_time0, m_time1));
+}
+
 void camera_t::resize(int width, int height) {
     m_width = width;
     m_height = height;
@@ -20,8 +20,18 @@ public:
 
     [[nodiscard]] ray_t get_ray(double s, double t) const;
 
+    /**
+     * \brief get_ray, and the rays one pixel across and one up from it (through the
+     * same point on the lens).
+     */
+    [[nodiscard]] ray_t get_ray(double s, double t, ray_differential_t& differential) const;
+
     [[nodiscard]] int width() const { return m_width; }
     [[nodiscard]] int height() const { return m_height; }
+    [[nodiscard]] point3 origin() const { return m_origin; }
+
+    // the angle a pixel spans vertically, in radians
+    [[nodiscard]] double pixel_angle() const { return degrees_to_radians(m_vfov) / m_height; }
 
     void resize(int width, int height);
 
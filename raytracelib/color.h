@@ -39,6 +39,13 @@ struct color_t
     }
 };
 
+/**
+ * \brief Perceived brightness of a linear (Rec. 709 primaries) color.
+ */
+inline double luminance(const color_t& c) {
+    return 0.2126 * c.r + 0.7152 * c.g + 0.0722 * c.b;
+}
+
 inline color_t operator*(const color_t& c, const double t) {
     return {c.r * t, c.g * t, c.b * t, c.a};
 }
@@ -1,46 +1,51 @@
 #include "constant_medium.h"
 
+#include <algorithm>
+
 bool constant_medium_t::hit(const ray_t& r, double t_min, double t_max, hit_record_t& rec) const {
-    // Print occasional samples when debugging. To enable, set enableDebug true.
+#ifndef NDEBUG
+    // Print occasional samples when debugging. To enable, set enableDebug true. Not in
+    // release builds, where even deciding not to print costs a random number per hit.
     const bool enableDebug = true;
     const bool debugging = enableDebug && random_double() < 0.00001;
+#endif
 
-    hit_record_t rec1, rec2;
-
-    if (!boundary->hit(r, -infinity, infinity, rec1))
-        return false;
-
-    if (!boundary->hit(r, rec1.t+0.0001, infinity, rec2))
+    double t_enter, t_exit;
+    if (!boundary->interval(r, t_enter, t_exit))
         return false;
 
+#ifndef NDEBUG
     if (debugging) {
-        std::cerr << "\nt_min=" << rec1.t << ", t_max=" << rec2.t << '\n';
+        std::cerr << "\nt_min=" << t_enter << ", t_max=" << t_exit << '\n';
     }
+#endif
 
-    if (rec1.t < t_min) rec1.t = t_min;
-    if (rec2.t > t_max) rec2.t = t_max;
+    if (t_enter < t_min) t_enter = t_min;
+    if (t_exit > t_max) t_exit = t_max;
 
-    if (rec1.t >= rec2.t)
+    if (t_enter >= t_exit)
         return false;
 
-    if (rec1.t < 0)
-        rec1.t = 0;
+    if (t_enter < 0)
+        t_enter = 0;
 
-    const auto ray_length = r.direction().length();
-    const auto distance_inside_boundary = (rec2.t - rec1.t) * ray_length;
+    const auto ray_length = length(r.direction());
+    const auto distance_inside_boundary = (t_exit - t_enter) * ray_length;
     const auto hit_distance = neg_inv_density * log(random_double());
 
     if (hit_distance > distance_inside_boundary)
         return false;
 
-    rec.t = rec1.t + hit_distance / ray_length;
+    rec.t = t_enter + hit_distance / ray_length;
     rec.p = r.at(rec.t);
 
+#ifndef NDEBUG
     if (debugging) {
         std::cerr << "hit_distance = " <<  hit_distance << '\n'
                   << "rec.t = " <<  rec.t << '\n'
                   << "rec.p = " <<  rec.p << '\n';
     }
+#endif
 
     rec.normal = dvec3_t(1,0,0);  // arbitrary
     rec.front_face = true;     // also arbitrary
@@ -48,3 +53,17 @@ bool constant_medium_t::hit(const ray_t& r, double t_min, double t_max, hit_reco
 
     return true;
 }
+
+double constant_medium_t::transmittance(const ray_t& r, double t_min, double t_max) const {
+    // Beer-Lambert through the part of the boundary between t_min and t_max
+    double t_enter, t_exit;
+    if (!boundary->interval(r, t_enter, t_exit))
+        return 1.0;
+
+    t_enter = std::max(t_enter, t_min);
+    t_exit = std::min(t_exit, t_max);
+    if (t_enter >= t_exit)
+        return 1.0;
+
+    return exp((t_exit - t_enter) * length(r.direction()) / neg_inv_density);
+}
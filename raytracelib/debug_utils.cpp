@@ -1,21 +1,23 @@
 #include <iostream>
+#include <vector>
 #include "types.h"
 #include "debug_utils.h"
 
 void render_gradient_pattern(image_buffer_t& buffer) {
-#ifdef THREADS
-    std::lock_guard guard(*buffer.mutex());
-#endif
+    // build a row at a time in the film's layout (rgb + sample count) and resolve it
+    // like a render, rather than converting every pixel on its own
+    std::vector<glm::vec4> row(buffer.width());
     for (int y = 0; y < buffer.height(); y++)
     {
+        const float g = static_cast<float>(y) / static_cast<float>(buffer.height() - 1);
+        constexpr float b = 0.25f;
         for (int x = 0; x < buffer.width(); x++)
         {
-            const double r = static_cast<double>(x) / static_cast<double>(buffer.width() - 1);
-            const double g = static_cast<double>(y) / static_cast<double>(buffer.height() - 1);
-            constexpr double b = 0.25;
-            constexpr double a = 1.0;
-
-            buffer.write(x, y, {r,g,b,a}, 1);
+            const float r = static_cast<float>(x) / static_cast<float>(buffer.width() - 1);
+            row[x] = {r, g, b, 1.0f};
         }
+        resolve_pixels(row.data(), buffer.width(), buffer.width(), 1, 0, y,
+                       buffer.data() + static_cast<size_t>(y) * buffer.pitch(), buffer.pitch());
     }
+    buffer.publish_all();
 }
@@ -0,0 +1,59 @@
+#include "dirty_tiles.h"
+
+#include <algorithm>
+
+dirty_tiles_t::dirty_tiles_t(int width, int height, int tile_size):
+    m_width(width), m_height(height), m_tile_size(std::max(1, tile_size)) {
+    m_tiles_x = (m_width + m_tile_size - 1) / m_tile_size;
+    m_tiles_y = (m_height + m_tile_size - 1) / m_tile_size;
+    m_dirty = std::make_unique<std::atomic_bool[]>(static_cast<size_t>(m_tiles_x) * m_tiles_y);
+}
+
+void dirty_tiles_t::mark(const render_region_t& region) {
+    if(region.empty()) {
+        return;
+    }
+    for(int ty = region.y0 / m_tile_size; ty <= (region.y1 - 1) / m_tile_size; ty++) {
+        for(int tx = region.x0 / m_tile_size; tx <= (region.x1 - 1) / m_tile_size; tx++) {
+            m_dirty[ty * m_tiles_x + tx].store(true, std::memory_order_release);
+        }
+    }
+}
+
+void dirty_tiles_t::mark_all() {
+    mark({0, 0, m_width, m_height});
+}
+
+std::vector<render_region_t> dirty_tiles_t::take() {
+    std::vector<int> tiles;
+    for(int i = 0; i < m_tiles_x * m_tiles_y; i++) {
+        if(m_dirty[i].exchange(false, std::memory_order_acq_rel)) {
+            tiles.push_back(i);
+        }
+    }
+    return merge_tile_rows(std::move(tiles), m_tiles_x, m_tile_size, m_width, m_height);
+}
+
+std::vector<render_region_t> merge_tile_rows(std::vector<int> tiles, int tiles_x, int tile_size, int width, int height) {
+    std::sort(tiles.begin(), tiles.end());
+
+    std::vector<render_region_t> regions;
+    for(size_t i = 0; i < tiles.size();) {
+        const int first = tiles[i];
+        int last = first;
+        // extend the run while the next tile is the right hand neighbour on the same row
+        while(i + 1 < tiles.size() && tiles[i + 1] == last + 1 && (last + 1) % tiles_x != 0) {
+            last = tiles[++i];
+        }
+        i++;
+
+        const int ty = first / tiles_x;
+        regions.push_back({
+            (first % tiles_x) * tile_size,
+            ty * tile_size,
+            std::min(((last % tiles_x) + 1) * tile_size, width),
+            std::min((ty + 1) * tile_size, height)
+        });
+    }
+    return regions;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "film.h"
+
+/**
+ * \brief Tracks which tiles of an image have changed since the presenter last
+ * looked. Render threads mark tiles as they finish them and the presenter takes
+ * the set; both sides only use atomics.
+ */
+class dirty_tiles_t {
+public:
+    dirty_tiles_t(int width, int height, int tile_size);
+
+    void mark(const render_region_t& region);
+    void mark_all();
+
+    /**
+     * \brief Returns the dirty tiles and clears them. Horizontally adjacent tiles
+     * are merged into one rectangle, so a finished row of tiles is one upload.
+     */
+    std::vector<render_region_t> take();
+
+    [[nodiscard]] int tile_size() const { return m_tile_size; }
+
+protected:
+    int m_width;
+    int m_height;
+    int m_tile_size;
+    int m_tiles_x;
+    int m_tiles_y;
+    std::unique_ptr<std::atomic_bool[]> m_dirty;
+};
+
+/**
+ * \brief Merges a set of tiles (indices into a tiles_x wide grid) into rectangles,
+ * joining runs of horizontally adjacent tiles.
+ */
+std::vector<render_region_t> merge_tile_rows(std::vector<int> tiles, int tiles_x, int tile_size, int width, int height);
@@ -0,0 +1,147 @@
+#include "environment.h"
+
+#include <algorithm>
+#include <iostream>
+#include "stb_image.h"
+
+environment_map_t::environment_map_t(int width, int height, std::vector<glm::vec3> pixels, double intensity)
+    : m_width(width), m_height(height), m_pixels(std::move(pixels)) {
+    for(auto& p : m_pixels) {
+        p = glm::max(p * static_cast<float>(intensity), glm::vec3(0.0f));
+    }
+
+    // each pixel's weight is its brightness times the solid angle it covers, which
+    // shrinks towards the poles
+    std::vector<double> row_weights(m_height);
+    std::vector<double> weights(m_width);
+    m_columns.reserve(m_height);
+    for(int y = 0; y < m_height; y++) {
+        const double sin_theta = sin(g_pi * (y + 0.5) / m_height);
+        for(int x = 0; x < m_width; x++) {
+            const glm::vec3& p = pixel(x, y);
+            weights[x] = luminance(color_t(p.r, p.g, p.b)) * sin_theta;
+        }
+        m_columns.emplace_back(weights);
+        row_weights[y] = m_columns.back().total();
+    }
+    m_rows = alias_table_t(row_weights);
+}
+
+std::shared_ptr<environment_map_t> environment_map_t::load(const std::string& filename, double intensity) {
+    int width = 0, height = 0, components = 0;
+    float* data = stbi_loadf(filename.c_str(), &width, &height, &components, 3);
+    if(data == nullptr) {
+        std::cerr << "ERROR: Could not load environment map '" << filename << "'.\n";
+        return nullptr;
+    }
+
+    std::vector<glm::vec3> pixels(static_cast<size_t>(width) * height);
+    for(size_t i = 0; i < pixels.size(); i++) {
+        pixels[i] = glm::vec3(data[i * 3], data[i * 3 + 1], data[i * 3 + 2]);
+    }
+    stbi_image_free(data);
+
+    return std::make_shared<environment_map_t>(width, height, std::move(pixels), intensity);
+}
+
+std::shared_ptr<environment_map_t> environment_map_t::sky(int width, int height, const dvec3_t& sun_direction,
+                                                          double sun_radius, double sun_radiance) {
+    const dvec3_t sun = normalize(sun_direction);
+    const double cos_sun = cos(degrees_to_radians(sun_radius));
+    const glm::dvec3 horizon(0.85, 0.9, 1.0);
+    const glm::dvec3 zenith(0.25, 0.45, 0.9);
+    const glm::dvec3 ground(0.12, 0.11, 0.1);
+    const glm::dvec3 sun_color(1.0, 0.95, 0.85);
+
+    // the sun's edge is anti-aliased by averaging a few points per pixel
+    constexpr int supersamples = 4;
+
+    std::vector<glm::vec3> pixels(static_cast<size_t>(width) * height);
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x++) {
+            glm::dvec3 sum(0.0);
+            for(int sy = 0; sy < supersamples; sy++) {
+                for(int sx = 0; sx < supersamples; sx++) {
+                    const dvec2_t uv((x + (sx + 0.5) / supersamples) / width, (y + (sy + 0.5) / supersamples) / height);
+                    const dvec3_t d = uv_to_direction(uv);
+                    if(dot(d, sun) >= cos_sun) {
+                        sum += sun_color * sun_radiance;
+                    } else if(d.y >= 0.0) {
+                        sum += glm::mix(horizon, zenith, sqrt(d.y));
+                    } else {
+                        sum += ground;
+                    }
+                }
+            }
+            pixels[static_cast<size_t>(y) * width + x] = glm::vec3(sum / static_cast<double>(supersamples * supersamples));
+        }
+    }
+
+    return std::make_shared<environment_map_t>(width, height, std::move(pixels));
+}
+
+dvec2_t environment_map_t::direction_to_uv(const dvec3_t& direction) {
+    const dvec3_t d = normalize(direction);
+    const double phi = atan2(d.x, -d.z);
+    const double theta = acos(std::clamp(d.y, -1.0, 1.0));
+    return {0.5 + phi / (2.0 * g_pi), theta / g_pi};
+}
+
+dvec3_t environment_map_t::uv_to_direction(const dvec2_t& uv) {
+    const double phi = (uv.x - 0.5) * 2.0 * g_pi;
+    const double theta = uv.y * g_pi;
+    const double sin_theta = sin(theta);
+    return {sin_theta * sin(phi), cos(theta), -sin_theta * cos(phi)};
+}
+
+void environment_map_t::pixel_at(const dvec2_t& uv, int& x, int& y) const {
+    x = std::clamp(static_cast<int>(uv.x * m_width), 0, m_width - 1);
+    y = std::clamp(static_cast<int>(uv.y * m_height), 0, m_height - 1);
+}
+
+color_t environment_map_t::radiance(const dvec3_t& direction) const {
+    int x, y;
+    pixel_at(direction_to_uv(direction), x, y);
+    const glm::vec3& p = pixel(x, y);
+    return {p.r, p.g, p.b};
+}
+
+bool environment_map_t::sample(environment_sample_t& sample) const {
+    if(m_rows.empty() || m_rows.total() <= 0.0) {
+        return false;
+    }
+
+    double row_pmf, column_pmf;
+    const int y = m_rows.sample(random_double(), row_pmf);
+    const int x = m_columns[y].sample(random_double(), column_pmf);
+
+    // anywhere inside the pixel
+    const dvec2_t uv((x + random_double()) / m_width, (y + random_double()) / m_height);
+    const double sin_theta = sin(uv.y * g_pi);
+    if(sin_theta <= 0.0) {
+        return false;
+    }
+
+    // from a density over the image to one over solid angle
+    sample.direction = uv_to_direction(uv);
+    sample.pdf = row_pmf * column_pmf * m_width * m_height / (2.0 * g_pi * g_pi * sin_theta);
+    const glm::vec3& p = pixel(x, y);
+    sample.radiance = color_t(p.r, p.g, p.b);
+    return true;
+}
+
+double environment_map_t::pdf(const dvec3_t& direction) const {
+    if(m_rows.empty() || m_rows.total() <= 0.0) {
+        return 0.0;
+    }
+
+    const dvec2_t uv = direction_to_uv(direction);
+    const double sin_theta = sin(uv.y * g_pi);
+    if(sin_theta <= 0.0) {
+        return 0.0;
+    }
+
+    int x, y;
+    pixel_at(uv, x, y);
+    return m_rows.pmf(y) * m_columns[y].pmf(x) * m_width * m_height / (2.0 * g_pi * g_pi * sin_theta);
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "alias_table.h"
+#include "color.h"
+#include "types.h"
+
+/**
+ * \brief A direction picked on the environment for next event estimation.
+ */
+struct environment_sample_t {
+    dvec3_t direction;
+    color_t radiance;
+
+    // probability density of the direction, per unit solid angle
+    double pdf = 0.0;
+};
+
+/**
+ * \brief Light arriving from infinitely far away in every direction, stored as an HDR
+ * latitude-longitude image: u goes once around the horizon (with -z in the middle of
+ * the image) and v from straight up (the top row) to straight down.
+ *
+ * Directions are importance sampled in proportion to the pixels' luminance (times
+ * the solid angle they cover), by picking a row from a marginal alias table and a
+ * column from that row's conditional one. Lookups are nearest pixel, so sample() and
+ * pdf() agree exactly with radiance().
+ */
+class environment_map_t {
+public:
+    environment_map_t() = delete;
+
+    /**
+     * \param pixels width * height linear RGB pixels, row by row from the top
+     * \param intensity scales every pixel
+     */
+    environment_map_t(int width, int height, std::vector<glm::vec3> pixels, double intensity = 1.0);
+
+    /**
+     * \brief Loads an HDR (or any other stb_image format) lat-long image.
+     * \return the map, or null if the file couldn't be loaded
+     */
+    static std::shared_ptr<environment_map_t> load(const std::string& filename, double intensity = 1.0);
+
+    /**
+     * \brief A clear sky that fades from a pale horizon to a deeper blue overhead, a
+     * dark ground below the horizon, and a sun.
+     * \param sun_direction towards the sun
+     * \param sun_radius the sun's angular radius in degrees (the real one is about 0.27)
+     * \param sun_radiance the sun's radiance (the sky overhead is about 0.6)
+     */
+    static std::shared_ptr<environment_map_t> sky(int width, int height, const dvec3_t& sun_direction,
+                                                  double sun_radius = 1.0, double sun_radiance = 2000.0);
+
+    /**
+     * \brief The light arriving from direction (i.e. travelling along -direction).
+     */
+    [[nodiscard]] color_t radiance(const dvec3_t& direction) const;
+
+    /**
+     * \brief Picks a direction in proportion to the light arriving from it.
+     * \return false if the map is black
+     */
+    bool sample(environment_sample_t& sample) const;
+
+    /**
+     * \brief The density sample() picks direction with, per unit solid angle.
+     */
+    [[nodiscard]] double pdf(const dvec3_t& direction) const;
+
+    [[nodiscard]] int width() const { return m_width; }
+    [[nodiscard]] int height() const { return m_height; }
+
+    /**
+     * \brief Maps a direction to lat-long texture coordinates (both 0 to 1).
+     */
+    static dvec2_t direction_to_uv(const dvec3_t& direction);
+    static dvec3_t uv_to_direction(const dvec2_t& uv);
+
+protected:
+    [[nodiscard]] const glm::vec3& pixel(int x, int y) const { return m_pixels[static_cast<size_t>(y) * m_width + x]; }
+    void pixel_at(const dvec2_t& uv, int& x, int& y) const;
+
+    int m_width;
+    int m_height;
+    std::vector<glm::vec3> m_pixels;
+
+    // picks a row, then a column within it
+    alias_table_t m_rows;
+    std::vector<alias_table_t> m_columns;
+};
@@ -0,0 +1,18 @@
+#include "film.h"
+
+film_t::film_t(int width, int height): m_width(width), m_height(height) {
+    m_pixels.resize(static_cast<size_t>(width) * height, glm::vec4(0.0f));
+}
+
+void film_t::clear() {
+    std::fill(m_pixels.begin(), m_pixels.end(), glm::vec4(0.0f));
+}
+
+color_t film_t::resolve(int x, int y) const {
+    const glm::vec4& p = m_pixels[index(x, y)];
+    if(p.a <= 0.0f) {
+        return {0, 0, 0};
+    }
+    const double inv = 1.0 / p.a;
+    return {p.r * inv, p.g * inv, p.b * inv};
+}
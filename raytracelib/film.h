@@ -0,0 +1,74 @@
+#pragma once
+#include <vector>
+#include <glm/vec4.hpp>
+#include "types.h"
+#include "color.h"
+
+/**
+ * \brief A rectangle of pixels, [x0, x1) x [y0, y1). y = 0 is the top row.
+ */
+struct render_region_t {
+    int x0 = 0;
+    int y0 = 0;
+    int x1 = 0;
+    int y1 = 0;
+
+    [[nodiscard]] int width() const { return x1 - x0; }
+    [[nodiscard]] int height() const { return y1 - y0; }
+    [[nodiscard]] int64_t area() const { return static_cast<int64_t>(width()) * height(); }
+    [[nodiscard]] bool empty() const { return x1 <= x0 || y1 <= y0; }
+    [[nodiscard]] bool contains(int x, int y) const { return x >= x0 && x < x1 && y >= y0 && y < y1; }
+};
+
+/**
+ * \brief Accumulates radiance samples per pixel. Each pixel keeps a running sum
+ * of its samples plus a sample count, so progressive passes just keep adding to it.
+ * Writes to different pixels never touch the same memory, so render threads that
+ * work on separate tiles can write without locking.
+ */
+class film_t {
+public:
+    film_t(int width, int height);
+
+    void clear();
+
+    /**
+     * \brief Adds the sum of num_samples samples to a pixel.
+     */
+    void add(int x, int y, const color_t& sample_sum, int num_samples) {
+        glm::vec4& p = m_pixels[index(x, y)];
+        p.r += static_cast<float>(sample_sum.r);
+        p.g += static_cast<float>(sample_sum.g);
+        p.b += static_cast<float>(sample_sum.b);
+        p.a += static_cast<float>(num_samples);
+    }
+
+    /**
+     * \brief The sum of all samples in a pixel (not divided by the sample count).
+     */
+    [[nodiscard]] color_t sum(int x, int y) const {
+        const glm::vec4& p = m_pixels[index(x, y)];
+        return {p.r, p.g, p.b};
+    }
+
+    [[nodiscard]] int samples(int x, int y) const { return static_cast<int>(m_pixels[index(x, y)].a); }
+
+    /**
+     * \brief The average of the samples in a pixel (black if it has none).
+     */
+    [[nodiscard]] color_t resolve(int x, int y) const;
+
+    [[nodiscard]] const glm::vec4* data() const { return m_pixels.data(); }
+    [[nodiscard]] int width() const { return m_width; }
+    [[nodiscard]] int height() const { return m_height; }
+    [[nodiscard]] render_region_t bounds() const { return {0, 0, m_width, m_height}; }
+
+protected:
+    [[nodiscard]] size_t index(int x, int y) const { return static_cast<size_t>(y) * m_width + x; }
+
+    int m_width;
+    int m_height;
+
+    // rgb = sum of samples, a = sample count
+    std::vector<glm::vec4> m_pixels;
+};
@@ -0,0 +1,292 @@
+#include "grid_medium.h"
+#include "scene_arena.h"
+
+#include <algorithm>
+
+namespace {
+    // below this, ratio tracking plays Russian roulette with the transmittance, since
+    // the rest of the ray can hardly matter
+    constexpr double roulette_transmittance = 0.1;
+}
+
+density_grid_t::density_grid_t(int nx, int ny, int nz, const std::vector<float>& voxels)
+    : m_size(std::max(1, nx), std::max(1, ny), std::max(1, nz)) {
+    build(voxels);
+}
+
+density_grid_t::density_grid_t(int nx, int ny, int nz, const std::function<float(const dvec3_t&)>& density)
+    : m_size(std::max(1, nx), std::max(1, ny), std::max(1, nz)) {
+    std::vector<float> voxels(static_cast<size_t>(m_size.x) * m_size.y * m_size.z);
+    size_t i = 0;
+    for(int z = 0; z < m_size.z; z++) {
+        for(int y = 0; y < m_size.y; y++) {
+            for(int x = 0; x < m_size.x; x++) {
+                voxels[i++] = density((dvec3_t(x, y, z) + 0.5) / dvec3_t(m_size));
+            }
+        }
+    }
+    build(voxels);
+}
+
+void density_grid_t::build(const std::vector<float>& voxels) {
+    if(voxels.size() != static_cast<size_t>(m_size.x) * m_size.y * m_size.z) {
+        std::cerr << "ERROR: density grid expects " << m_size.x * m_size.y * m_size.z << " voxels, got " << voxels.size() << "\n";
+    }
+    auto source = [&](int x, int y, int z) {
+        if(x >= m_size.x || y >= m_size.y || z >= m_size.z) {
+            return 0.0f;
+        }
+        const size_t i = (static_cast<size_t>(z) * m_size.y + y) * m_size.x + x;
+        return i < voxels.size() ? voxels[i] : 0.0f;
+    };
+
+    m_bricks = (m_size + (brick_size - 1)) / brick_size;
+    m_brick_table.assign(static_cast<size_t>(m_bricks.x) * m_bricks.y * m_bricks.z, brick_t());
+    m_data.clear();
+
+    std::vector<float> brick(brick_voxels);
+    for(int bz = 0; bz < m_bricks.z; bz++) {
+        for(int by = 0; by < m_bricks.y; by++) {
+            for(int bx = 0; bx < m_bricks.x; bx++) {
+                int i = 0;
+                for(int z = 0; z < brick_size; z++) {
+                    for(int y = 0; y < brick_size; y++) {
+                        for(int x = 0; x < brick_size; x++) {
+                            brick[i++] = source(bx * brick_size + x, by * brick_size + y, bz * brick_size + z);
+                        }
+                    }
+                }
+
+                brick_t& b = m_brick_table[brick_index(bx, by, bz)];
+                b.value = brick[0];
+                if(std::any_of(brick.begin(), brick.end(), [&](float v) { return v != brick[0]; })) {
+                    b.offset = static_cast<int32_t>(m_data.size());
+                    m_data.insert(m_data.end(), brick.begin(), brick.end());
+                }
+            }
+        }
+    }
+    m_data.shrink_to_fit();
+    build_majorants();
+}
+
+void density_grid_t::build_majorants() {
+    // lookups in a brick interpolate between the voxels around it too
+    m_majorants.assign(m_brick_table.size(), 0.0f);
+    m_max = 0.0f;
+    for(int bz = 0; bz < m_bricks.z; bz++) {
+        for(int by = 0; by < m_bricks.y; by++) {
+            for(int bx = 0; bx < m_bricks.x; bx++) {
+                float majorant = 0.0f;
+                for(int z = bz * brick_size - 1; z <= (bz + 1) * brick_size; z++) {
+                    for(int y = by * brick_size - 1; y <= (by + 1) * brick_size; y++) {
+                        for(int x = bx * brick_size - 1; x <= (bx + 1) * brick_size; x++) {
+                            majorant = std::max(majorant, voxel(x, y, z));
+                        }
+                    }
+                }
+                m_majorants[brick_index(bx, by, bz)] = majorant;
+                m_max = std::max(m_max, majorant);
+            }
+        }
+    }
+}
+
+float density_grid_t::voxel(int x, int y, int z) const {
+    if(x < 0 || y < 0 || z < 0 || x >= m_size.x || y >= m_size.y || z >= m_size.z) {
+        return 0.0f;
+    }
+    const brick_t& b = m_brick_table[brick_index(x / brick_size, y / brick_size, z / brick_size)];
+    if(b.offset < 0) {
+        return b.value;
+    }
+    const int local = ((z % brick_size) * brick_size + (y % brick_size)) * brick_size + (x % brick_size);
+    return m_data[b.offset + local];
+}
+
+float density_grid_t::lookup(const dvec3_t& p) const {
+    // voxel centers are at +0.5
+    const dvec3_t f = p - 0.5;
+    const dvec3_t base = floor(f);
+    const dvec3_t w = f - base;
+    const int x = static_cast<int>(base.x);
+    const int y = static_cast<int>(base.y);
+    const int z = static_cast<int>(base.z);
+
+    double result = 0.0;
+    for(int corner = 0; corner < 8; corner++) {
+        const int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+        const double weight = (dx ? w.x : 1.0 - w.x) * (dy ? w.y : 1.0 - w.y) * (dz ? w.z : 1.0 - w.z);
+        if(weight > 0.0) {
+            result += weight * voxel(x + dx, y + dy, z + dz);
+        }
+    }
+    return static_cast<float>(result);
+}
+
+float density_grid_t::brick_max(int bx, int by, int bz) const {
+    return m_majorants[brick_index(bx, by, bz)];
+}
+
+size_t density_grid_t::memory_bytes() const {
+    return m_brick_table.capacity() * sizeof(brick_t) + (m_data.capacity() + m_majorants.capacity()) * sizeof(float);
+}
+
+grid_medium_t::grid_medium_t(const aabb_t& bounds, shared_ptr<density_grid_t> grid, double density_scale, const color_t& albedo)
+    : m_bounds(bounds),
+      m_grid(std::move(grid)),
+      m_density_scale(density_scale),
+      m_phase_function(make_object<isotropic_material_t>(albedo)) {
+    m_voxel_scale = dvec3_t(m_grid->size()) / (m_bounds.max() - m_bounds.min());
+}
+
+bool grid_medium_t::bounding_box(double time0, double time1, aabb_t& output_box) const {
+    output_box = m_bounds;
+    return true;
+}
+
+bool grid_medium_t::clip(const ray_t& r, double& t_min, double& t_max) const {
+    for(int a = 0; a < 3; a++) {
+        const double inv = 1.0 / r.direction()[a];
+        double t0 = (m_bounds.min()[a] - r.origin()[a]) * inv;
+        double t1 = (m_bounds.max()[a] - r.origin()[a]) * inv;
+        if(inv < 0.0) {
+            std::swap(t0, t1);
+        }
+        t_min = std::max(t0, t_min);
+        t_max = std::min(t1, t_max);
+        if(t_max <= t_min) {
+            return false;
+        }
+    }
+    return true;
+}
+
+double grid_medium_t::density(const point3& p) const {
+    return m_grid->lookup((p - m_bounds.min()) * m_voxel_scale) * m_density_scale;
+}
+
+template<typename visit_t>
+bool grid_medium_t::traverse(const ray_t& r, double t0, double t1, const visit_t& visit) const {
+    // majorants are per unit distance, and t is in units of the ray's direction
+    const double speed = length(r.direction());
+    const glm::ivec3 bricks = m_grid->bricks();
+
+    if(!m_majorant_grid) {
+        return visit(t0, t1, m_grid->max() * m_density_scale * speed);
+    }
+
+    // in units of bricks from here on
+    const dvec3_t scale = m_voxel_scale / static_cast<double>(density_grid_t::brick_size);
+    const dvec3_t origin = (r.origin() - m_bounds.min()) * scale;
+    const dvec3_t direction = r.direction() * scale;
+    const dvec3_t start = origin + direction * t0;
+
+    glm::ivec3 cell;
+    glm::ivec3 step;
+    dvec3_t t_next, t_delta;
+    for(int a = 0; a < 3; a++) {
+        cell[a] = std::clamp(static_cast<int>(floor(start[a])), 0, bricks[a] - 1);
+        if(direction[a] > 0.0) {
+            step[a] = 1;
+            t_delta[a] = 1.0 / direction[a];
+            t_next[a] = t0 + (cell[a] + 1 - start[a]) * t_delta[a];
+        } else if(direction[a] < 0.0) {
+            step[a] = -1;
+            t_delta[a] = -1.0 / direction[a];
+            t_next[a] = t0 + (start[a] - cell[a]) * t_delta[a];
+        } else {
+            step[a] = 0;
+            t_delta[a] = infinity;
+            t_next[a] = infinity;
+        }
+    }
+
+    double t = t0;
+    while(t < t1) {
+        const int axis = t_next.x < t_next.y ? (t_next.x < t_next.z ? 0 : 2) : (t_next.y < t_next.z ? 1 : 2);
+        const double exit = std::min(t_next[axis], t1);
+        const double majorant = m_grid->brick_max(cell.x, cell.y, cell.z) * m_density_scale * speed;
+        if(exit > t && !visit(t, exit, majorant)) {
+            return false;
+        }
+        t = exit;
+        cell[axis] += step[axis];
+        if(cell[axis] < 0 || cell[axis] >= bricks[axis]) {
+            break;
+        }
+        t_next[axis] += t_delta[axis];
+    }
+    return true;
+}
+
+bool grid_medium_t::hit(const ray_t& r, double t_min, double t_max, hit_record_t& rec) const {
+    if(!clip(r, t_min, t_max)) {
+        return false;
+    }
+
+    // delta tracking: each brick's stretch of the ray is crossed in exponential steps
+    // as if it were as dense as its majorant
+    const double speed = length(r.direction());
+    double collision = -1.0;
+    traverse(r, t_min, t_max, [&](double t0, double t1, double majorant) {
+        if(majorant <= 0.0) {
+            return true;
+        }
+        double t = t0;
+        while(true) {
+            t -= log(1.0 - random_double()) / majorant;
+            if(t >= t1) {
+                return true;
+            }
+            if(random_double() * majorant < density(r.at(t)) * speed) {
+                collision = t;
+                return false;
+            }
+        }
+    });
+    if(collision < 0.0) {
+        return false;
+    }
+
+    rec.t = collision;
+    rec.p = r.at(collision);
+    rec.normal = dvec3_t(1, 0, 0);   // arbitrary
+    rec.front_face = true;
+    rec.uv = dvec2_t(0, 0);
+    rec.mat = m_phase_function;
+    rec.object = this;
+    return true;
+}
+
+double grid_medium_t::transmittance(const ray_t& r, double t_min, double t_max) const {
+    if(!clip(r, t_min, t_max)) {
+        return 1.0;
+    }
+
+    // ratio tracking: the same tentative collisions, each scaling the transmittance by
+    // the chance it wasn't real
+    const double speed = length(r.direction());
+    double result = 1.0;
+    traverse(r, t_min, t_max, [&](double t0, double t1, double majorant) {
+        if(majorant <= 0.0) {
+            return true;
+        }
+        double t = t0;
+        while(true) {
+            t -= log(1.0 - random_double()) / majorant;
+            if(t >= t1) {
+                return true;
+            }
+            result *= std::max(0.0, 1.0 - density(r.at(t)) * speed / majorant);
+            if(result < roulette_transmittance) {
+                if(random_double() * roulette_transmittance >= result) {
+                    result = 0.0;
+                    return false;
+                }
+                result = roulette_transmittance;
+            }
+        }
+    });
+    return result;
+}
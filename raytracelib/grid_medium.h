@@ -0,0 +1,135 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "hittable.h"
+#include "material.h"
+
+/**
+ * \brief Densities on a grid of voxels, kept in bricks of brick_size^3. A brick that's
+ * the same value all the way through (usually empty space) is stored as just that
+ * value, so a grid costs memory where there's detail rather than where there's space.
+ */
+class density_grid_t {
+public:
+    static constexpr int brick_size = 8;
+
+    /**
+     * \brief A grid of nx * ny * nz voxels.
+     * \param voxels the densities, x fastest then y then z
+     */
+    density_grid_t(int nx, int ny, int nz, const std::vector<float>& voxels);
+
+    /**
+     * \brief A grid of nx * ny * nz voxels, with each set to density at its center
+     * (given in [0, 1]^3 over the grid).
+     */
+    density_grid_t(int nx, int ny, int nz, const std::function<float(const dvec3_t&)>& density);
+
+    /**
+     * \brief The density of a voxel, or 0 outside the grid.
+     */
+    [[nodiscard]] float voxel(int x, int y, int z) const;
+
+    /**
+     * \brief The density at p (in voxels, so the grid covers [0, n)), interpolated
+     * between voxel centers.
+     */
+    [[nodiscard]] float lookup(const dvec3_t& p) const;
+
+    /**
+     * \brief The largest density lookup() can return anywhere in a brick.
+     */
+    [[nodiscard]] float brick_max(int bx, int by, int bz) const;
+
+    // the largest density anywhere in the grid
+    [[nodiscard]] float max() const { return m_max; }
+
+    [[nodiscard]] glm::ivec3 size() const { return m_size; }
+    [[nodiscard]] glm::ivec3 bricks() const { return m_bricks; }
+    [[nodiscard]] size_t stored_bricks() const { return m_data.size() / brick_voxels; }
+    [[nodiscard]] size_t memory_bytes() const;
+
+protected:
+    static constexpr int brick_voxels = brick_size * brick_size * brick_size;
+
+    struct brick_t {
+        // where the brick's voxels start in m_data, or -1 if every voxel is value
+        int32_t offset = -1;
+        float value = 0.0f;
+    };
+
+    void build(const std::vector<float>& voxels);
+    void build_majorants();
+
+    [[nodiscard]] int brick_index(int bx, int by, int bz) const {
+        return (bz * m_bricks.y + by) * m_bricks.x + bx;
+    }
+
+    glm::ivec3 m_size;
+    glm::ivec3 m_bricks;
+    std::vector<brick_t> m_brick_table;
+    std::vector<float> m_data;
+    std::vector<float> m_majorants;
+    float m_max = 0.0f;
+};
+
+/**
+ * \brief Smoke, fog or cloud whose density varies through a box, given by a density
+ * grid stretched over it. Light scatters off it isotropically.
+ *
+ * Free paths through it are sampled by delta tracking: tentative collisions are
+ * picked as if the medium were as dense as a majorant, and each is real with
+ * probability density / majorant. The majorant is per brick of the grid, found by
+ * stepping through the bricks along the ray (3D DDA), so thin parts of the medium are
+ * crossed in a few long steps instead of the short ones its densest part would need,
+ * and empty bricks are skipped outright. Shadow rays use ratio tracking through the
+ * same bricks, which weighs the light by how likely each tentative collision was to be
+ * real instead of stopping at one, so penumbrae through smoke aren't black or white.
+ */
+class grid_medium_t : public hittable_t {
+public:
+    /**
+     * \param bounds the box the grid is stretched over
+     * \param density_scale the density (per unit distance) of a voxel holding 1
+     */
+    grid_medium_t(const aabb_t& bounds, shared_ptr<density_grid_t> grid, double density_scale, const color_t& albedo);
+
+    bool hit(const ray_t& r, double t_min, double t_max, hit_record_t& rec) const override;
+    bool bounding_box(double time0, double time1, aabb_t& output_box) const override;
+    [[nodiscard]] double transmittance(const ray_t& r, double t_min, double t_max) const override;
+
+    /**
+     * \brief With false, one majorant for the whole grid (its densest voxel) is used
+     * instead of the per brick ones. For comparisons.
+     */
+    void set_majorant_grid(bool enabled) { m_majorant_grid = enabled; }
+
+    [[nodiscard]] const density_grid_t& grid() const { return *m_grid; }
+
+protected:
+    /**
+     * \brief Steps along r from t0 to t1 through the grid's bricks, calling visit with
+     * each stretch of the ray and its majorant (per unit of t). Stops early if visit
+     * returns false.
+     * \return false if visit stopped it
+     */
+    template<typename visit_t>
+    bool traverse(const ray_t& r, double t0, double t1, const visit_t& visit) const;
+
+    // where along r the box is, clipped to [t_min, t_max]
+    bool clip(const ray_t& r, double& t_min, double& t_max) const;
+
+    // the density (per unit distance) at a point
+    [[nodiscard]] double density(const point3& p) const;
+
+    aabb_t m_bounds;
+    shared_ptr<density_grid_t> m_grid;
+    double m_density_scale;
+    shared_ptr<material_t> m_phase_function;
+
+    // world units to voxels
+    dvec3_t m_voxel_scale;
+    bool m_majorant_grid = true;
+};
@@ -1,6 +1,63 @@
 #include "hittable.h"
 #include "ray.h"
 
+double hittable_t::transmittance(const ray_t& r, double t_min, double t_max) const {
+    hit_record_t rec{};
+    return hit(r, t_min, t_max, rec) ? 0.0 : 1.0;
+}
+
+bool hittable_t::interval(const ray_t& r, double& t_enter, double& t_exit) const {
+    hit_record_t rec1{}, rec2{};
+    if(!hit(r, -infinity, infinity, rec1) || !hit(r, rec1.t + 0.0001, infinity, rec2)) {
+        return false;
+    }
+    t_enter = rec1.t;
+    t_exit = rec2.t;
+    return true;
+}
+
+void hit_record_t::set_uv_differentials(const ray_differential_t& differential) {
+    duv_dx = dvec2_t(0, 0);
+    duv_dy = dvec2_t(0, 0);
+    dpdx = dvec3_t(0, 0, 0);
+    dpdy = dvec3_t(0, 0, 0);
+
+    // where the neighbouring rays meet the plane tangent to the surface at p
+    const double d = dot(normal, p);
+    const double x_den = dot(normal, differential.rx_direction);
+    const double y_den = dot(normal, differential.ry_direction);
+    if(x_den == 0.0 || y_den == 0.0) {
+        return;
+    }
+    const dvec3_t offset_x = differential.rx_origin + differential.rx_direction * ((d - dot(normal, differential.rx_origin)) / x_den) - p;
+    const dvec3_t offset_y = differential.ry_origin + differential.ry_direction * ((d - dot(normal, differential.ry_origin)) / y_den) - p;
+    if(!std::isfinite(offset_x.x + offset_x.y + offset_x.z + offset_y.x + offset_y.y + offset_y.z)) {
+        return;
+    }
+    dpdx = offset_x;
+    dpdy = offset_y;
+
+    // the du, dv that best explain each offset as du * dpdu + dv * dpdv (least squares)
+    const double uu = dot(dpdu, dpdu);
+    const double uv_dot = dot(dpdu, dpdv);
+    const double vv = dot(dpdv, dpdv);
+    const double det = uu * vv - uv_dot * uv_dot;
+    if(!(det > 0.0)) {
+        return;
+    }
+    auto solve = [&](const dvec3_t& offset) {
+        const double pu = dot(dpdu, offset);
+        const double pv = dot(dpdv, offset);
+        return dvec2_t((vv * pu - uv_dot * pv) / det, (uu * pv - uv_dot * pu) / det);
+    };
+    const dvec2_t dx = solve(offset_x);
+    const dvec2_t dy = solve(offset_y);
+    if(std::isfinite(dx.x + dx.y + dy.x + dy.y)) {
+        duv_dx = dx;
+        duv_dy = dy;
+    }
+}
+
 void hit_record_t::set_face_normal(const ray_t& r, const dvec3_t& outward_normal) {
     front_face = dot(r.direction(), outward_normal) < 0;
     normal = front_face ? outward_normal :-outward_normal;
@@ -1,9 +1,12 @@
 #pragma once
 #include "aabb.h"
 #include "types.h"
+#include "color.h"
 
 class ray_t;
+struct ray_differential_t;
 class material_t;
+class hittable_t;
 
 struct hit_record_t {
     point3 p;
@@ -13,11 +16,70 @@ struct hit_record_t {
     // texture coords
     dvec2_t uv;
 
+    // how p moves with the texture coords, where the shape knows (zero where it doesn't)
+    dvec3_t dpdu {0, 0, 0};
+    dvec3_t dpdv {0, 0, 0};
+
+    // how far the texture coords move one pixel across and one pixel up, for filtering
+    // textures over a pixel. Zero (no filtering) unless set_uv_differentials was called.
+    dvec2_t duv_dx {0, 0};
+    dvec2_t duv_dy {0, 0};
+
+    // how far p moves one pixel across and one pixel up (along the surface), for
+    // filtering textures of position. Zero unless set_uv_differentials was called.
+    dvec3_t dpdx {0, 0, 0};
+    dvec3_t dpdy {0, 0, 0};
+
     shared_ptr<material_t> mat;
 
+    // the primitive that was hit, if it's one that can be a light (rects and spheres)
+    const hittable_t* object = nullptr;
+
     bool front_face;
 
     void set_face_normal(const ray_t& r, const dvec3_t& outward_normal);
+
+    /**
+     * \brief Sets dpdx and dpdy from where the differential's rays meet the plane the
+     * surface is in at p, and duv_dx and duv_dy from them (which needs dpdu and dpdv).
+     */
+    void set_uv_differentials(const ray_differential_t& differential);
+};
+
+/**
+ * \brief A point picked on a light for next event estimation.
+ */
+struct light_sample_t {
+    point3 p;
+    dvec3_t normal;
+    dvec2_t uv;
+
+    // the light leaving the point (towards the origin)
+    color_t emitted;
+
+    // probability density of picking this point, per unit solid angle as seen from the origin
+    double pdf = 0.0;
+};
+
+/**
+ * \brief Conservative bounds on where a light is, how much it emits and which way,
+ * for building light_bvh_t.
+ */
+struct light_bounds_t {
+    aabb_t box;
+
+    // total emitted power. Only its size relative to other lights matters.
+    double power = 0.0;
+
+    // every normal on the light is within acos(cos_theta_o) of axis...
+    dvec3_t axis {0, 0, 1};
+    double cos_theta_o = 1.0;
+
+    // ...and light leaves at most acos(cos_theta_e) away from its normal (90 degrees for diffuse emitters)
+    double cos_theta_e = 0.0;
+
+    // emits from the back as well as the front
+    bool two_sided = false;
 };
 
 /**
@@ -27,4 +89,59 @@ class hittable_t {
     public:
         virtual bool hit(const ray_t& r, double t_min, double t_max, hit_record_t& rec) const = 0;
         virtual bool bounding_box(double time0, double time1, aabb_t& output_box) const = 0;
+
+        /**
+         * \brief How much light gets through along r from t_min to t_max: 0 if a surface
+         * is in the way, and anything from 0 to 1 through participating media (an
+         * estimate, so it's right on average). The default goes by hit(), which for
+         * media that scatter at random is 0 or 1.
+         */
+        [[nodiscard]] virtual double transmittance(const ray_t& r, double t_min, double t_max) const;
+
+        /**
+         * \brief Where the line through r is inside the shape: from t_enter to t_exit
+         * (t_enter is negative if r starts inside). For convex shapes this is one query,
+         * without the normals and texture coordinates hit() works out. The default finds
+         * the first two crossings with hit(), which is also what non-convex shapes get.
+         * \return false if the line misses the shape
+         */
+        virtual bool interval(const ray_t& r, double& t_enter, double& t_exit) const;
+
+        /**
+         * \brief True for shapes that emit light and can be sampled with sample_light,
+         * which puts them in the scene's light list.
+         */
+        [[nodiscard]] virtual bool is_area_light() const { return false; }
+
+        /**
+         * \brief Picks a point on the shape that's visible from origin.
+         * \return false if there's nothing to sample (e.g. origin is inside the shape)
+         */
+        virtual bool sample_light(const point3& origin, double time, light_sample_t& sample) const { return false; }
+
+        /**
+         * \brief The density sample_light would pick the point direction leads to
+         * from origin with (per unit solid angle), or 0 if direction misses the shape.
+         */
+        [[nodiscard]] virtual double light_pdf(const point3& origin, const dvec3_t& direction, double time) const { return 0.0; }
+
+        /**
+         * \brief Bounds for the light tree, over the scene's whole time range.
+         * \return false if the shape isn't a light
+         */
+        virtual bool light_bounds(light_bounds_t& bounds) const { return false; }
+
+        /**
+         * \brief True for shapes with a specular material (see material_t::is_specular),
+         * which caustic photons are aimed at.
+         */
+        [[nodiscard]] virtual bool is_specular() const { return false; }
+
+        /**
+         * \brief Picks a point uniformly over the shape's surface, for light leaving it
+         * rather than arriving somewhere. sample.pdf is per unit area, and sample.normal
+         * faces the side the light leaves from.
+         * \return false if the shape isn't a light
+         */
+        virtual bool sample_emission(double time, light_sample_t& sample) const { return false; }
 };
\ No newline at end of file
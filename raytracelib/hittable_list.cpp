@@ -24,6 +24,16 @@ bool hittable_list_t::hit(const ray_t& r, double t_min, double t_max, hit_record
     return hit_anything;
 }
 
+double hittable_list_t::transmittance(const ray_t& r, double t_min, double t_max) const {
+    double result = 1.0;
+    for (const auto& object : objects) {
+        result *= object->transmittance(r, t_min, t_max);
+        if (result <= 0.0)
+            return 0.0;
+    }
+    return result;
+}
+
 bool hittable_list_t::bounding_box(double time0, double time1, aabb_t& output_box) const {
     if (objects.empty()) return false;
 
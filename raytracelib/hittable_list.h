@@ -22,6 +22,8 @@ class hittable_list_t : public hittable_t {
         virtual bool bounding_box(
             double time0, double time1, aabb_t& output_box) const override;
 
+        [[nodiscard]] double transmittance(const ray_t& r, double t_min, double t_max) const override;
+
     public:
         vector<shared_ptr<hittable_t>> objects;
 };
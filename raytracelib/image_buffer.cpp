@@ -1,33 +1,39 @@
 #include "image_buffer.h"
+#include <algorithm>
+#include <cstring>
 
 constexpr int num_channels = 4;
 using glm::clamp;
 
-image_buffer_t::image_buffer_t(const uint32_t width, const uint32_t height): m_w(width), m_h(height) {
+image_buffer_t::image_buffer_t(const uint32_t width, const uint32_t height, int tile_size):
+    m_w(width), m_h(height), m_tile_size(std::max(1, tile_size)) {
     m_buffer = std::make_unique<uint8_t[]>(m_w * m_h * num_channels);
+    init_tiles();
 }
 
-image_buffer_t::image_buffer_t(const image_buffer_t& src): m_w(src.width()), m_h(src.height()) {
+image_buffer_t::image_buffer_t(const image_buffer_t& src): m_w(src.width()), m_h(src.height()), m_tile_size(src.tile_size()) {
     m_buffer = std::make_unique<uint8_t[]>(src.width() * src.height() * num_channels);
     memcpy(m_buffer.get(), src.data(), src.width() * src.height() * num_channels);
+    init_tiles();
+    publish_all();
+}
+
+void image_buffer_t::init_tiles() {
+    m_tiles_x = (m_w + m_tile_size - 1) / m_tile_size;
+    m_tiles_y = (m_h + m_tile_size - 1) / m_tile_size;
+    m_tiles = std::make_unique<tile_state_t[]>(tile_count());
 }
 
 void image_buffer_t::write(const uint32_t x, const uint32_t y, const color_t& color, int samples_per_pixel) {
     const size_t base_index = x * num_channels + y * m_w * num_channels;
 
-    auto r = color.r;
-    auto g = color.g;
-    auto b = color.b;
-
-    const auto scale = 1.0 / static_cast<double>(samples_per_pixel);
-    r = sqrt(r * scale);
-    g = sqrt(g * scale);
-    b = sqrt(b * scale);
+    uint8_t rgb[3];
+    resolve_color(color / static_cast<double>(samples_per_pixel), rgb);
 
     m_buffer[base_index] = static_cast<uint8_t>(color.a * 255);
-    m_buffer[base_index + 1] = static_cast<uint8_t>(clamp(b, 0.0, 0.999) * 256);
-    m_buffer[base_index + 2] = static_cast<uint8_t>(clamp(g, 0.0, 0.999) * 256);
-    m_buffer[base_index + 3] = static_cast<uint8_t>(clamp(r, 0.0, 0.999) * 256);
+    m_buffer[base_index + 1] = rgb[2];
+    m_buffer[base_index + 2] = rgb[1];
+    m_buffer[base_index + 3] = rgb[0];
 }
 
 void image_buffer_t::write_raw(const uint32_t x, const uint32_t y, const color_t& color) {
@@ -42,6 +48,23 @@ void image_buffer_t::write_raw(const uint32_t x, const uint32_t y, const color_t
     m_buffer[base_index + 3] = static_cast<uint8_t>(clamp(r, 0.0, 0.999) * 256);
 }
 
+void image_buffer_t::resample_from(const image_buffer_t& src) {
+    // source column for every destination column, so the inner loop is just copies
+    std::vector<int> src_x(m_w);
+    for(int x = 0; x < m_w; x++) {
+        src_x[x] = static_cast<int>(static_cast<int64_t>(x) * src.width() / m_w);
+    }
+
+    for(int y = 0; y < m_h; y++) {
+        const int sy = static_cast<int>(static_cast<int64_t>(y) * src.height() / m_h);
+        const uint8_t* in = src.data() + static_cast<size_t>(sy) * src.pitch();
+        uint8_t* out = m_buffer.get() + static_cast<size_t>(y) * pitch();
+        for(int x = 0; x < m_w; x++) {
+            memcpy(out + x * num_channels, in + src_x[x] * num_channels, num_channels);
+        }
+    }
+}
+
 color_t image_buffer_t::read(const double x, const double y) const {
     const int ix = static_cast<int>(x * (m_w-1));
     const int iy = static_cast<int>(y * (m_h-1));
@@ -56,15 +79,97 @@ color_t image_buffer_t::read(const double x, const double y) const {
     return c;
 }
 
-#ifdef THREADS
-void image_buffer_t::write_line_sync(const uint32_t y, const color_t data[], int samples_per_pixel) {
-    std::lock_guard guard(m_mutex);
+render_region_t image_buffer_t::tile_region(int tile) const {
+    const int tx = tile % m_tiles_x;
+    const int ty = tile / m_tiles_x;
+    return {
+        tx * m_tile_size,
+        ty * m_tile_size,
+        std::min((tx + 1) * m_tile_size, m_w),
+        std::min((ty + 1) * m_tile_size, m_h)
+    };
+}
 
-    for(int x = 0; x < m_w; x++) {
-        write(x, y, data[x], samples_per_pixel);
+// Each tile is guarded by a seqlock: the sequence number is odd while the tile is
+// being written, and a reader that sees it change during its copy throws the copy away.
+void image_buffer_t::begin_tile_write(int tile) {
+    auto& seq = m_tiles[tile].sequence;
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void image_buffer_t::end_tile_write(int tile) {
+    auto& t = m_tiles[tile];
+    t.sequence.store(t.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    t.epoch.store(m_epoch.fetch_add(1, std::memory_order_acq_rel) + 1, std::memory_order_release);
+}
+
+void image_buffer_t::write_region(const film_t& film, const render_region_t& region, const resolve_settings_t& settings) {
+    const int tx0 = region.x0 / m_tile_size;
+    const int ty0 = region.y0 / m_tile_size;
+    const int tx1 = (region.x1 - 1) / m_tile_size;
+    const int ty1 = (region.y1 - 1) / m_tile_size;
+
+    for(int ty = ty0; ty <= ty1; ty++) {
+        for(int tx = tx0; tx <= tx1; tx++) {
+            const int tile = ty * m_tiles_x + tx;
+            const render_region_t tr = tile_region(tile);
+
+            const render_region_t part = {
+                std::max(tr.x0, region.x0), std::max(tr.y0, region.y0),
+                std::min(tr.x1, region.x1), std::min(tr.y1, region.y1)
+            };
+
+            begin_tile_write(tile);
+            resolve_film_region(film, part, m_buffer.get() + (part.y0 * m_w + part.x0) * num_channels, pitch(), settings);
+            end_tile_write(tile);
+        }
+    }
+}
+
+void image_buffer_t::publish_all() {
+    for(int tile = 0; tile < tile_count(); tile++) {
+        begin_tile_write(tile);
+        end_tile_write(tile);
     }
 }
 
-#endif
+int image_buffer_t::sync_to(uint8_t* dst, int dst_pitch, std::vector<uint64_t>& seen_epochs, std::vector<int>* copied) const {
+    if(static_cast<int>(seen_epochs.size()) != tile_count()) {
+        seen_epochs.assign(tile_count(), 0);
+    }
+
+    int num_copied = 0;
+    for(int tile = 0; tile < tile_count(); tile++) {
+        const auto& t = m_tiles[tile];
+        const uint64_t tile_epoch = t.epoch.load(std::memory_order_acquire);
+        if(tile_epoch <= seen_epochs[tile]) {
+            continue;
+        }
+
+        const uint32_t before = t.sequence.load(std::memory_order_acquire);
+        if(before & 1) {
+            continue; // being written right now, get it next time
+        }
+
+        const render_region_t r = tile_region(tile);
+        const size_t row_bytes = static_cast<size_t>(r.width()) * num_channels;
+        for(int y = r.y0; y < r.y1; y++) {
+            memcpy(dst + y * dst_pitch + r.x0 * num_channels, m_buffer.get() + (y * m_w + r.x0) * num_channels, row_bytes);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(t.sequence.load(std::memory_order_relaxed) != before) {
+            continue; // a writer got in while we were copying, the copy might be torn
+        }
+
+        seen_epochs[tile] = tile_epoch;
+        num_copied++;
+        if(copied) {
+            copied->push_back(tile);
+        }
+    }
+    return num_copied;
+}
 
 int image_buffer_t::pitch() const { return m_w * num_channels; }
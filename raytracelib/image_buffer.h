@@ -1,49 +1,103 @@
 #pragma once
+#include <atomic>
 #include <memory>
+#include <vector>
 #include "types.h"
 #include "color.h"
+#include "film.h"
+#include "resolve.h"
 
-#ifdef THREADS
-#include <thread>
-#include <mutex>
-#endif
-
-
+/**
+ * \brief An 8-bit RGBA image (in SDL_PIXELFORMAT_RGBA8888 byte order) that render
+ * threads write to while the UI thread presents it, without any locks.
+ *
+ * The image is split into tile_size x tile_size tiles. Each tile has a sequence
+ * number (odd while a writer is in the middle of it) and the epoch it was last
+ * published at. Writers never wait for anything, and the presenter just skips
+ * any tile that's being written and picks it up on the next sync. This needs
+ * at most one writer per tile at a time, which renderer_t guarantees as long
+ * as its tiles line up with ours (i.e. use the same tile size).
+ */
 class image_buffer_t
 {
 public:
+    static constexpr int default_tile_size = 32;
+
     image_buffer_t() = delete;
 
-    image_buffer_t(const uint32_t width, const uint32_t height);
+    image_buffer_t(const uint32_t width, const uint32_t height, int tile_size = default_tile_size);
     image_buffer_t(const image_buffer_t& src);
 
+    // these don't publish anything, call publish_all() after using them
     void write(const uint32_t x, const uint32_t y, const color_t& color, int samples_per_pixel=1);
-
     void write_raw(const uint32_t x, const uint32_t y, const color_t& color);
+
+    /**
+     * \brief Nearest neighbour resamples src (of any size) into this image, copying
+     * the 8-bit pixels as they are.
+     */
+    void resample_from(const image_buffer_t& src);
+
     color_t read(const double x, const double y) const;
 
-#ifdef THREADS
-    void write_line_sync(const uint32_t y, const color_t data[], int samples_per_pixel);
-    std::mutex* mutex() { return &m_mutex; }
-    
-#endif
+    /**
+     * \brief Resolves the film's pixels inside region to 8-bit and publishes the
+     * tiles it covers. Safe to call from several threads at once as long as
+     * their regions don't share a tile.
+     */
+    void write_region(const film_t& film, const render_region_t& region, const resolve_settings_t& settings = {});
+
+    /**
+     * \brief Marks every tile as changed. For single threaded bulk writes
+     * (test patterns, resizes) made with write/write_raw/resample_from.
+     */
+    void publish_all();
+
+    /**
+     * \brief Copies every tile published since seen_epochs says we last looked
+     * into dst (which has the same dimensions as this image). Tiles a writer is
+     * busy with are skipped and stay pending, so this never blocks the writers.
+     * \param seen_epochs per tile epochs of the copy in dst, updated as tiles are copied
+     * \param copied if not null, the indices of the tiles that were copied get appended
+     * \return the number of tiles copied
+     */
+    int sync_to(uint8_t* dst, int dst_pitch, std::vector<uint64_t>& seen_epochs, std::vector<int>* copied = nullptr) const;
 
     [[nodiscard]] uint8_t* data() const { return m_buffer.get(); }
     [[nodiscard]] int pitch() const;
     [[nodiscard]] int width() const { return m_w; }
     [[nodiscard]] int height() const { return m_h; }
-    
+
+    [[nodiscard]] int tile_size() const { return m_tile_size; }
+    [[nodiscard]] int tiles_x() const { return m_tiles_x; }
+    [[nodiscard]] int tiles_y() const { return m_tiles_y; }
+    [[nodiscard]] int tile_count() const { return m_tiles_x * m_tiles_y; }
+    [[nodiscard]] render_region_t tile_region(int tile) const;
+
+    /**
+     * \brief The latest epoch any tile has been published at.
+     */
+    [[nodiscard]] uint64_t epoch() const { return m_epoch.load(std::memory_order_acquire); }
 
 protected:
+    // padded out to a cache line so writers on neighbouring tiles don't fight over it
+    struct alignas(64) tile_state_t {
+        std::atomic<uint32_t> sequence = 0;
+        std::atomic<uint64_t> epoch = 0;
+    };
+
+    void init_tiles();
+    void begin_tile_write(int tile);
+    void end_tile_write(int tile);
+
     int m_w;
     int m_h;
 
     std::unique_ptr<uint8_t[]> m_buffer;
 
-#ifdef THREADS
-    std::mutex m_mutex;
-#endif
-
+    int m_tile_size;
+    int m_tiles_x = 0;
+    int m_tiles_y = 0;
+    std::unique_ptr<tile_state_t[]> m_tiles;
+    std::atomic<uint64_t> m_epoch = 0;
 };
-
-
@@ -0,0 +1,149 @@
+#include "image_io.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+
+namespace {
+    uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0) {
+        static const auto table = [] {
+            std::vector<uint32_t> t(256);
+            for(uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for(int k = 0; k < 8; k++) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                t[n] = c;
+            }
+            return t;
+        }();
+
+        crc = ~crc;
+        for(size_t i = 0; i < length; i++) {
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    void push_u32_be(std::vector<uint8_t>& out, uint32_t v) {
+        out.push_back(static_cast<uint8_t>(v >> 24));
+        out.push_back(static_cast<uint8_t>(v >> 16));
+        out.push_back(static_cast<uint8_t>(v >> 8));
+        out.push_back(static_cast<uint8_t>(v));
+    }
+
+    void write_chunk(std::ofstream& file, const char type[4], const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> chunk;
+        push_u32_be(chunk, static_cast<uint32_t>(data.size()));
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        push_u32_be(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+        file.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+    }
+}
+
+bool write_pfm(const std::string& filename, int width, int height, const color_t pixels[]) {
+    std::ofstream file(filename, std::ios::binary);
+    if(!file) {
+        std::cerr << "ERROR: Could not open '" << filename << "' for writing.\n";
+        return false;
+    }
+
+    // a negative scale means little endian, which is what every platform we build on uses
+    file << "PF\n" << width << " " << height << "\n-1.0\n";
+
+    // PFM stores the bottom row first
+    std::vector<float> row(static_cast<size_t>(width) * 3);
+    for(int y = height - 1; y >= 0; y--) {
+        for(int x = 0; x < width; x++) {
+            const color_t& c = pixels[y * width + x];
+            row[x * 3 + 0] = static_cast<float>(c.r);
+            row[x * 3 + 1] = static_cast<float>(c.g);
+            row[x * 3 + 2] = static_cast<float>(c.b);
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size() * sizeof(float)));
+    }
+
+    return static_cast<bool>(file);
+}
+
+bool write_png(const std::string& filename, int width, int height, const uint8_t rgb[]) {
+    std::ofstream file(filename, std::ios::binary);
+    if(!file) {
+        std::cerr << "ERROR: Could not open '" << filename << "' for writing.\n";
+        return false;
+    }
+
+    constexpr uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    std::vector<uint8_t> header;
+    push_u32_be(header, width);
+    push_u32_be(header, height);
+    header.push_back(8); // bit depth
+    header.push_back(2); // color type: RGB
+    header.push_back(0); // compression
+    header.push_back(0); // filter
+    header.push_back(0); // interlace
+    write_chunk(file, "IHDR", header);
+
+    // Each scanline is prefixed with its filter type (0 = none). We don't bother
+    // compressing, the image goes into the zlib stream as "stored" deflate blocks.
+    const size_t line_size = static_cast<size_t>(width) * 3 + 1;
+    std::vector<uint8_t> raw(line_size * height);
+    for(int y = 0; y < height; y++) {
+        raw[y * line_size] = 0;
+        memcpy(&raw[y * line_size + 1], &rgb[static_cast<size_t>(y) * width * 3], line_size - 1);
+    }
+
+    std::vector<uint8_t> zlib;
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+
+    constexpr size_t max_block = 65535;
+    size_t offset = 0;
+    bool last = false;
+    while(!last) {
+        const size_t block = std::min(max_block, raw.size() - offset);
+        last = offset + block >= raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(static_cast<uint8_t>(block));
+        zlib.push_back(static_cast<uint8_t>(block >> 8));
+        zlib.push_back(static_cast<uint8_t>(~block));
+        zlib.push_back(static_cast<uint8_t>(~block >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + block);
+        offset += block;
+    }
+
+    uint32_t a = 1, b = 0;
+    for(const uint8_t v : raw) {
+        a = (a + v) % 65521;
+        b = (b + a) % 65521;
+    }
+    push_u32_be(zlib, (b << 16) | a);
+
+    write_chunk(file, "IDAT", zlib);
+    write_chunk(file, "IEND", {});
+
+    return static_cast<bool>(file);
+}
+
+bool write_image(const std::string& filename, int width, int height, const color_t pixels[], const resolve_settings_t& settings) {
+    const auto extension = std::filesystem::path(filename).extension().string();
+
+    if(extension == ".pfm") {
+        return write_pfm(filename, width, height, pixels);
+    }
+
+    if(extension == ".png") {
+        std::vector<uint8_t> rgb(static_cast<size_t>(width) * height * 3);
+        for(size_t i = 0; i < static_cast<size_t>(width) * height; i++) {
+            resolve_color(pixels[i], &rgb[i * 3], settings);
+        }
+        return write_png(filename, width, height, rgb.data());
+    }
+
+    std::cerr << "ERROR: Unsupported image format '" << extension << "' (use .png or .pfm).\n";
+    return false;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include "types.h"
+#include "color.h"
+#include "resolve.h"
+
+/**
+ * \brief Writes linear HDR pixels to a PFM (portable float map) file.
+ * \param pixels width*height colors, top row first
+ * \return true if the file was written
+ */
+bool write_pfm(const std::string& filename, int width, int height, const color_t pixels[]);
+
+/**
+ * \brief Writes 8-bit RGB pixels to an (uncompressed) PNG file.
+ * \param rgb width*height*3 bytes, top row first
+ * \return true if the file was written
+ */
+bool write_png(const std::string& filename, int width, int height, const uint8_t rgb[]);
+
+/**
+ * \brief Writes linear pixels to disk, picking the format from the file extension.
+ * .pfm files get the raw values, .png files are tone mapped and sRGB encoded with
+ * settings, the same way the preview is.
+ * \param pixels width*height colors, top row first
+ * \return true if the file was written
+ */
+bool write_image(const std::string& filename, int width, int height, const color_t pixels[],
+                 const resolve_settings_t& settings = {});
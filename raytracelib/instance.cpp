@@ -20,11 +20,21 @@ bool instance_t::hit(const ray_t& r, double t_min, double t_max, hit_record_t& r
         rec = local_rec;
         rec.p = transform_point(local_rec.p, m_transform);
         rec.normal = transform_vec(local_rec.normal, m_transform);
+        rec.dpdu = transform_vec(local_rec.dpdu, m_transform);
+        rec.dpdv = transform_vec(local_rec.dpdv, m_transform);
         return true;
     }
     return false;
 }
 
+double instance_t::transmittance(const ray_t& r, double t_min, double t_max) const {
+    return m_source->transmittance(r.transformed(m_inverse), t_min, t_max);
+}
+
+bool instance_t::interval(const ray_t& r, double& t_enter, double& t_exit) const {
+    return m_source->interval(r.transformed(m_inverse), t_enter, t_exit);
+}
+
 bool instance_t::bounding_box(double time0, double time1, aabb_t& output_box) const {
     output_box = m_aabb;
     return true;
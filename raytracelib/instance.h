@@ -7,6 +7,13 @@ public:
 
     bool hit(const ray_t& r, double t_min, double t_max, hit_record_t& rec) const override;
     bool bounding_box(double time0, double time1, aabb_t& output_box) const override;
+    [[nodiscard]] double transmittance(const ray_t& r, double t_min, double t_max) const override;
+    bool interval(const ray_t& r, double& t_enter, double& t_exit) const override;
+    [[nodiscard]] bool is_specular() const override { return m_source->is_specular(); }
+
+    [[nodiscard]] const shared_ptr<hittable_t>& source() const { return m_source; }
+    [[nodiscard]] const dmat4_t& transform() const { return m_transform; }
+    [[nodiscard]] const dmat4_t& inverse_transform() const { return m_inverse; }
 
 protected:
     shared_ptr<hittable_t> m_source;
@@ -0,0 +1,341 @@
+#include "light_bvh.h"
+
+#include <algorithm>
+
+namespace {
+    // buckets per axis when looking for the cheapest split
+    constexpr int split_buckets = 12;
+
+    // past this depth nodes are split down the middle, which keeps the tree from
+    // degenerating into a list when the lights are spread out very unevenly
+    constexpr int max_cost_split_depth = 48;
+
+    double safe_sqrt(double x) {
+        return sqrt(std::max(0.0, x));
+    }
+
+    double safe_acos(double x) {
+        return acos(std::clamp(x, -1.0, 1.0));
+    }
+
+    // cos(max(0, a - b)), from the sines and cosines of a and b
+    double cos_sub_clamped(double sin_a, double cos_a, double sin_b, double cos_b) {
+        if(cos_a > cos_b) {
+            return 1.0;
+        }
+        return cos_a * cos_b + sin_a * sin_b;
+    }
+
+    // sin(max(0, a - b)), from the sines and cosines of a and b
+    double sin_sub_clamped(double sin_a, double cos_a, double sin_b, double cos_b) {
+        if(cos_a > cos_b) {
+            return 0.0;
+        }
+        return sin_a * cos_b - cos_a * sin_b;
+    }
+
+    // rotates v around the unit vector axis (Rodrigues' formula)
+    dvec3_t rotate(const dvec3_t& v, const dvec3_t& axis, double angle) {
+        const double c = cos(angle);
+        const double s = sin(angle);
+        return v * c + cross(axis, v) * s + axis * (dot(axis, v) * (1.0 - c));
+    }
+
+    point3 box_center(const aabb_t& box) {
+        return (box.min() + box.max()) * 0.5;
+    }
+
+    double surface_area(const aabb_t& box) {
+        const dvec3_t d = box.max() - box.min();
+        return 2.0 * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    /**
+     * \brief The smallest cone (around a new axis) holding both cones.
+     */
+    void union_cones(const dvec3_t& axis_a, double cos_a, const dvec3_t& axis_b, double cos_b, dvec3_t& axis, double& cos_theta) {
+        const double theta_a = safe_acos(cos_a);
+        const double theta_b = safe_acos(cos_b);
+        const double theta_d = safe_acos(dot(axis_a, axis_b));
+
+        // one of them already holds the other
+        if(std::min(theta_d + theta_b, g_pi) <= theta_a) {
+            axis = axis_a;
+            cos_theta = cos_a;
+            return;
+        }
+        if(std::min(theta_d + theta_a, g_pi) <= theta_b) {
+            axis = axis_b;
+            cos_theta = cos_b;
+            return;
+        }
+
+        const double theta_o = (theta_a + theta_d + theta_b) * 0.5;
+        const dvec3_t w = cross(axis_a, axis_b);
+        if(theta_o >= g_pi || length2(w) < 1e-20) {
+            axis = axis_a;
+            cos_theta = -1.0; // every direction
+            return;
+        }
+
+        // swing a's axis towards b's until the cone just covers both
+        axis = normalize(rotate(axis_a, normalize(w), theta_o - theta_a));
+        cos_theta = cos(theta_o);
+    }
+
+    // which of the split buckets along axis the bounds' center falls in
+    int bucket_of(const light_bounds_t& b, const aabb_t& centroids, int axis) {
+        const double t = (box_center(b.box)[axis] - centroids.min()[axis]) / (centroids.max()[axis] - centroids.min()[axis]);
+        return std::clamp(static_cast<int>(t * split_buckets), 0, split_buckets - 1);
+    }
+
+    light_bounds_t merge(const light_bounds_t& a, const light_bounds_t& b) {
+        light_bounds_t result;
+        result.box = surrounding_box(a.box, b.box);
+        result.power = a.power + b.power;
+        union_cones(a.axis, a.cos_theta_o, b.axis, b.cos_theta_o, result.axis, result.cos_theta_o);
+        result.cos_theta_e = std::min(a.cos_theta_e, b.cos_theta_e);
+        result.two_sided = a.two_sided || b.two_sided;
+        return result;
+    }
+
+    /**
+     * \brief The surface area orientation heuristic: how expensive a node with these
+     * bounds is likely to be, from its power, spatial extent and the solid angle its
+     * light goes out into. The split minimizing the children's total wins.
+     */
+    double split_cost(const light_bounds_t& b, double aspect) {
+        const double theta_o = safe_acos(b.cos_theta_o);
+        const double theta_e = safe_acos(b.cos_theta_e);
+        const double theta_w = std::min(theta_o + theta_e, g_pi);
+        const double sin_o = safe_sqrt(1.0 - b.cos_theta_o * b.cos_theta_o);
+        const double orientation = 2.0 * g_pi * (1.0 - b.cos_theta_o)
+            + g_pi / 2.0 * (2.0 * theta_w * sin_o - cos(theta_o - 2.0 * theta_w) - 2.0 * theta_o * sin_o + b.cos_theta_o);
+        return b.power * orientation * surface_area(b.box) * aspect;
+    }
+}
+
+void light_bvh_t::build(const std::vector<shared_ptr<hittable_t>>& lights) {
+    m_nodes.clear();
+    m_depth = 0;
+    m_leaf_of_light.assign(lights.size(), -1);
+
+    m_build.clear();
+    for(size_t i = 0; i < lights.size(); i++) {
+        light_bounds_t bounds;
+        if(lights[i]->light_bounds(bounds)) {
+            bounds.axis = normalize(bounds.axis);
+            m_build.emplace_back(static_cast<int>(i), bounds);
+        }
+    }
+
+    if(!m_build.empty()) {
+        m_nodes.reserve(m_build.size() * 2 - 1);
+        build_node(0, static_cast<int>(m_build.size()), -1, 1);
+    }
+
+    m_build.clear();
+    m_build.shrink_to_fit();
+}
+
+int light_bvh_t::build_node(int start, int end, int parent, int depth) {
+    m_depth = std::max(m_depth, depth);
+
+    const int index = static_cast<int>(m_nodes.size());
+    m_nodes.emplace_back();
+    m_nodes[index].parent = parent;
+
+    if(end - start == 1) {
+        m_nodes[index].bounds = m_build[start].second;
+        m_nodes[index].light = m_build[start].first;
+        m_leaf_of_light[m_build[start].first] = index;
+        return index;
+    }
+
+    light_bounds_t bounds = m_build[start].second;
+    aabb_t centroids(box_center(bounds.box), box_center(bounds.box));
+    for(int i = start + 1; i < end; i++) {
+        bounds = merge(bounds, m_build[i].second);
+        const point3 c = box_center(m_build[i].second.box);
+        centroids = surrounding_box(centroids, aabb_t(c, c));
+    }
+
+    // find the cheapest bucket boundary on any axis
+    int best_axis = -1;
+    int best_split = -1;
+    double best_cost = infinity;
+    const dvec3_t extent = bounds.box.max() - bounds.box.min();
+    const double longest = std::max({extent.x, extent.y, extent.z});
+    const dvec3_t centroid_extent = centroids.max() - centroids.min();
+
+    for(int axis = 0; axis < 3 && depth < max_cost_split_depth; axis++) {
+        if(centroid_extent[axis] <= 0.0) {
+            continue;
+        }
+
+        light_bounds_t buckets[split_buckets];
+        bool used[split_buckets] = {};
+        for(int i = start; i < end; i++) {
+            const int b = bucket_of(m_build[i].second, centroids, axis);
+            buckets[b] = used[b] ? merge(buckets[b], m_build[i].second) : m_build[i].second;
+            used[b] = true;
+        }
+
+        // splitting across a thin axis makes long, thin children, which bound badly
+        const double aspect = extent[axis] > 0.0 ? longest / extent[axis] : infinity;
+
+        for(int split = 0; split < split_buckets - 1; split++) {
+            light_bounds_t below, above;
+            bool any_below = false, any_above = false;
+            for(int b = 0; b <= split; b++) {
+                if(used[b]) {
+                    below = any_below ? merge(below, buckets[b]) : buckets[b];
+                    any_below = true;
+                }
+            }
+            for(int b = split + 1; b < split_buckets; b++) {
+                if(used[b]) {
+                    above = any_above ? merge(above, buckets[b]) : buckets[b];
+                    any_above = true;
+                }
+            }
+            if(!any_below || !any_above) {
+                continue;
+            }
+
+            const double cost = split_cost(below, aspect) + split_cost(above, aspect);
+            if(cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = split;
+            }
+        }
+    }
+
+    int mid = (start + end) / 2;
+    if(best_axis >= 0) {
+        const auto first_above = std::partition(m_build.begin() + start, m_build.begin() + end, [&](const auto& entry) {
+            return bucket_of(entry.second, centroids, best_axis) <= best_split;
+        });
+        const int split_at = static_cast<int>(first_above - m_build.begin());
+        if(split_at > start && split_at < end) {
+            mid = split_at;
+        }
+    } else if(longest > 0.0) {
+        // no useful split (all the centers in one spot, or too deep), halve along the longest axis
+        const int axis = extent.x == longest ? 0 : extent.y == longest ? 1 : 2;
+        std::nth_element(m_build.begin() + start, m_build.begin() + mid, m_build.begin() + end, [axis](const auto& a, const auto& b) {
+            return box_center(a.second.box)[axis] < box_center(b.second.box)[axis];
+        });
+    }
+
+    build_node(start, mid, index, depth + 1);
+    const int second = build_node(mid, end, index, depth + 1);
+
+    m_nodes[index].bounds = bounds;
+    m_nodes[index].second_child = second;
+    return index;
+}
+
+double light_bvh_t::importance(int node, const point3& p, const dvec3_t& n) const {
+    const light_bounds_t& b = m_nodes[node].bounds;
+
+    const point3 center = box_center(b.box);
+    const double radius_squared = length2(b.box.max() - b.box.min()) * 0.25;
+    const dvec3_t from_center = p - center;
+    const double center_distance_squared = length2(from_center);
+
+    // clamped so the estimate doesn't blow up close to (or inside) the bounds
+    const double d2 = std::max(center_distance_squared, radius_squared);
+
+    // angle between the normal cone's axis and p
+    double cos_w = dot(from_center, b.axis) / sqrt(d2);
+    if(b.two_sided) {
+        cos_w = fabs(cos_w);
+    }
+    const double sin_w = safe_sqrt(1.0 - cos_w * cos_w);
+
+    // half the angle the bounds' bounding sphere covers as seen from p
+    double cos_b = -1.0;
+    if(center_distance_squared > radius_squared) {
+        cos_b = safe_sqrt(1.0 - radius_squared / center_distance_squared);
+    }
+    const double sin_b = safe_sqrt(1.0 - cos_b * cos_b);
+
+    // the smallest angle between p and any normal that could be in the bounds
+    const double sin_o = safe_sqrt(1.0 - b.cos_theta_o * b.cos_theta_o);
+    const double cos_x = cos_sub_clamped(sin_w, cos_w, sin_o, b.cos_theta_o);
+    const double sin_x = sin_sub_clamped(sin_w, cos_w, sin_o, b.cos_theta_o);
+    const double cos_p = cos_sub_clamped(sin_x, cos_x, sin_b, cos_b);
+    if(cos_p <= b.cos_theta_e) {
+        return 0.0; // all the light goes the other way
+    }
+
+    double result = b.power * cos_p / d2;
+
+    // the smallest angle between the surface normal (either side) and the bounds
+    if(length2(n) > 0.0 && center_distance_squared > 0.0) {
+        const double cos_i = fabs(dot(n, from_center)) / (length(n) * sqrt(center_distance_squared));
+        const double sin_i = safe_sqrt(1.0 - cos_i * cos_i);
+        result *= cos_sub_clamped(sin_i, cos_i, sin_b, cos_b);
+    }
+
+    return std::max(result, 0.0);
+}
+
+int light_bvh_t::pick(const point3& p, const dvec3_t& n, double u, double& pmf) const {
+    pmf = 0.0;
+    if(m_nodes.empty() || importance(0, p, n) <= 0.0) {
+        return -1;
+    }
+
+    int node = 0;
+    double probability = 1.0;
+    while(m_nodes[node].light < 0) {
+        const int first = node + 1;
+        const int second = m_nodes[node].second_child;
+        const double first_importance = importance(first, p, n);
+        const double second_importance = importance(second, p, n);
+        const double total = first_importance + second_importance;
+        if(total <= 0.0) {
+            return -1;
+        }
+
+        // pick a child, and stretch u back over [0, 1) for the next level down
+        const double p_first = first_importance / total;
+        if(u < p_first) {
+            node = first;
+            probability *= p_first;
+            u = std::min(u / p_first, 1.0 - 1e-16);
+        } else {
+            node = second;
+            probability *= second_importance / total;
+            u = std::min((u - p_first) / (1.0 - p_first), 1.0 - 1e-16);
+        }
+    }
+
+    pmf = probability;
+    return m_nodes[node].light;
+}
+
+double light_bvh_t::pmf(const point3& p, const dvec3_t& n, int light) const {
+    if(light < 0 || light >= static_cast<int>(m_leaf_of_light.size()) || m_leaf_of_light[light] < 0) {
+        return 0.0;
+    }
+
+    // walk up to the root, multiplying in the chance of taking each branch on the way
+    double probability = 1.0;
+    int node = m_leaf_of_light[light];
+    while(m_nodes[node].parent >= 0) {
+        const int parent = m_nodes[node].parent;
+        const int sibling = node == parent + 1 ? m_nodes[parent].second_child : parent + 1;
+        const double node_importance = importance(node, p, n);
+        if(node_importance <= 0.0) {
+            return 0.0;
+        }
+        probability *= node_importance / (node_importance + importance(sibling, p, n));
+        node = parent;
+    }
+
+    return importance(0, p, n) > 0.0 ? probability : 0.0;
+}
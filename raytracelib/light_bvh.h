@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+#include "hittable.h"
+
+/**
+ * \brief A binary tree over the scene's lights, for picking a light in proportion to
+ * roughly how much it could contribute at a shading point, instead of uniformly.
+ *
+ * Every node bounds its lights' positions (a box), their total power and the
+ * directions they face (a cone of normals plus how far past the normals they emit).
+ * Picking walks down from the root, choosing between the two children at random in
+ * proportion to an importance estimate from those bounds, so the cost grows with the
+ * depth of the tree rather than the number of lights. The estimate is conservative:
+ * it's only ever zero when no light under the node could reach the point.
+ *
+ * Follows "Importance Sampling of Many Lights with Adaptive Tree Splitting" (Conty
+ * Estevez and Kulla 2018), in the form pbrt-v4 uses.
+ */
+class light_bvh_t {
+public:
+    /**
+     * \brief Builds the tree. Lights that can't report their bounds are never picked.
+     */
+    void build(const std::vector<shared_ptr<hittable_t>>& lights);
+
+    /**
+     * \brief Picks a light for the shading point p.
+     * \param n the surface normal at p (either side), or zero for points in a medium
+     * \param u a uniform random number in [0, 1)
+     * \param pmf set to the probability the returned light was picked with
+     * \return the light's index in the list the tree was built from, or -1 if none
+     * of them can reach p
+     */
+    int pick(const point3& p, const dvec3_t& n, double u, double& pmf) const;
+
+    /**
+     * \brief The probability pick() returns the given light for p and n.
+     */
+    [[nodiscard]] double pmf(const point3& p, const dvec3_t& n, int light) const;
+
+    [[nodiscard]] bool empty() const { return m_nodes.empty(); }
+    [[nodiscard]] size_t node_count() const { return m_nodes.size(); }
+    [[nodiscard]] int depth() const { return m_depth; }
+
+protected:
+    struct node_t {
+        light_bounds_t bounds;
+
+        // the light for leaves, otherwise -1 (and the children are this node + 1 and second_child)
+        int light = -1;
+        int second_child = -1;
+        int parent = -1;
+    };
+
+    // builds the subtree over m_build[start, end) and returns its root
+    int build_node(int start, int end, int parent, int depth);
+
+    [[nodiscard]] double importance(int node, const point3& p, const dvec3_t& n) const;
+
+    std::vector<node_t> m_nodes;
+
+    // the leaf for every light, or -1
+    std::vector<int> m_leaf_of_light;
+    int m_depth = 0;
+
+    // (light index, bounds) pairs, only used while building
+    std::vector<std::pair<int, light_bounds_t>> m_build;
+};
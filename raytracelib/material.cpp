@@ -3,23 +3,165 @@
 #include "ray.h"
 #include "color.h"
 
-bool lambertian_material_t::scatter(const ray_t& r_in, const hit_record_t& rec, color_t& attenuation, ray_t& scattered) const {
-    auto scatter_direction = rec.normal + random_unit_vector();
+namespace {
+    // GGX (Trowbridge-Reitz) normal distribution, for a microfacet normal at cos_h to the surface normal
+    double ggx_d(double cos_h, double alpha) {
+        const double a2 = alpha * alpha;
+        const double d = cos_h * cos_h * (a2 - 1.0) + 1.0;
+        return a2 / (g_pi * d * d);
+    }
+
+    // Smith masking for one direction at cosine cos_v to the surface normal
+    double ggx_g1(double cos_v, double alpha) {
+        const double a2 = alpha * alpha;
+        return 2.0 * cos_v / (cos_v + sqrt(a2 + (1.0 - a2) * cos_v * cos_v));
+    }
+
+    color_t schlick_fresnel(const color_t& f0, double cosine) {
+        const double m = pow(1.0 - cosine, 5);
+        return {
+            f0.r + (1.0 - f0.r) * m,
+            f0.g + (1.0 - f0.g) * m,
+            f0.b + (1.0 - f0.b) * m
+        };
+    }
+}
+
+bool material_t::sample(const ray_t& r_in, const hit_record_t& rec, bsdf_sample_t& sample) const {
+    ray_t scattered;
+    if(!scatter(r_in, rec, sample.weight, scattered)) {
+        return false;
+    }
+    sample.direction = scattered.direction();
+    sample.pdf = 0.0;
+    sample.specular = true;
+    return true;
+}
 
-    if(near_zero(scatter_direction)) {
-        scatter_direction = rec.normal;
+double material_t::average_emitted_luminance(const point3& p) const {
+    constexpr int grid = 4;
+    double sum = 0.0;
+    for(int y = 0; y < grid; y++) {
+        for(int x = 0; x < grid; x++) {
+            sum += luminance(emitted((x + 0.5) / grid, (y + 0.5) / grid, p));
+        }
     }
+    return sum / (grid * grid);
+}
 
-    scattered = ray_t(rec.p, scatter_direction, r_in.time());
-    attenuation = m_albedo->value(rec.uv.x, rec.uv.y, rec.p);
+bool lambertian_material_t::scatter(const ray_t& r_in, const hit_record_t& rec, color_t& attenuation, ray_t& scattered) const {
+    bsdf_sample_t s;
+    if(!sample(r_in, rec, s)) {
+        return false;
+    }
+    scattered = ray_t(rec.p, s.direction, r_in.time());
+    attenuation = s.weight;
     return true;
 }
 
+bool lambertian_material_t::sample(const ray_t& r_in, const hit_record_t& rec, bsdf_sample_t& sample) const {
+    sample.direction = onb_t(rec.normal).local(random_cosine_direction());
+    sample.pdf = pdf(r_in, rec, sample.direction);
+    if(sample.pdf <= 0) {
+        return false; // grazing the surface
+    }
+    sample.weight = m_program.evaluate(rec.uv.x, rec.uv.y, rec.p, rec.duv_dx, rec.duv_dy, rec.dpdx, rec.dpdy);
+    sample.specular = false;
+    return true;
+}
+
+color_t lambertian_material_t::eval(const ray_t& r_in, const hit_record_t& rec, const dvec3_t& direction) const {
+    const double cosine = dot(rec.normal, normalize(direction));
+    if(cosine <= 0) {
+        return color_t(0, 0, 0);
+    }
+    return m_program.evaluate(rec.uv.x, rec.uv.y, rec.p, rec.duv_dx, rec.duv_dy, rec.dpdx, rec.dpdy) * (cosine / g_pi);
+}
+
+double lambertian_material_t::pdf(const ray_t& r_in, const hit_record_t& rec, const dvec3_t& direction) const {
+    const double cosine = dot(rec.normal, normalize(direction));
+    return cosine > 0 ? cosine / g_pi : 0.0;
+}
+
 bool metal_material_t::scatter(const ray_t& r_in, const hit_record_t& rec, color_t& attenuation, ray_t& scattered) const {
-    const dvec3_t reflected = reflect(normalize(r_in.direction()), rec.normal);
-    scattered = ray_t(rec.p, reflected + m_fuzz*random_in_unit_sphere(), r_in.time());
-    attenuation = m_albedo;
-    return (dot(scattered.direction(), rec.normal) > 0);
+    bsdf_sample_t s;
+    if(!sample(r_in, rec, s)) {
+        return false;
+    }
+    scattered = ray_t(rec.p, s.direction, r_in.time());
+    attenuation = s.weight;
+    return true;
+}
+
+bool metal_material_t::sample(const ray_t& r_in, const hit_record_t& rec, bsdf_sample_t& sample) const {
+    const dvec3_t wo = -normalize(r_in.direction());
+    const double cos_o = dot(rec.normal, wo);
+    if(cos_o <= 0) {
+        return false;
+    }
+
+    if(m_fuzz <= 0) {
+        sample.direction = reflect(-wo, rec.normal);
+        sample.weight = schlick_fresnel(m_albedo, cos_o);
+        sample.pdf = 0.0;
+        sample.specular = true;
+        return true;
+    }
+
+    // pick a microfacet normal with density D(h) * cos(h)
+    const double alpha = m_fuzz;
+    const double r1 = random_double();
+    const double phi = 2.0 * g_pi * random_double();
+    const double cos_h = sqrt((1.0 - r1) / (1.0 + (alpha * alpha - 1.0) * r1));
+    const double sin_h = sqrt(std::max(0.0, 1.0 - cos_h * cos_h));
+    const dvec3_t h = onb_t(rec.normal).local(cos(phi) * sin_h, sin(phi) * sin_h, cos_h);
+
+    const double o_dot_h = dot(wo, h);
+    const dvec3_t wi = 2.0 * o_dot_h * h - wo;
+    const double cos_i = dot(rec.normal, wi);
+    if(o_dot_h <= 0 || cos_i <= 0) {
+        return false; // reflected into the surface
+    }
+
+    sample.direction = wi;
+    sample.pdf = ggx_d(cos_h, alpha) * cos_h / (4.0 * o_dot_h);
+    // f * cos / pdf, with D cancelling out
+    sample.weight = schlick_fresnel(m_albedo, o_dot_h) * (ggx_g1(cos_o, alpha) * ggx_g1(cos_i, alpha) * o_dot_h / (cos_o * cos_h));
+    sample.specular = false;
+    return true;
+}
+
+color_t metal_material_t::eval(const ray_t& r_in, const hit_record_t& rec, const dvec3_t& direction) const {
+    const dvec3_t wo = -normalize(r_in.direction());
+    const dvec3_t wi = normalize(direction);
+    const double cos_o = dot(rec.normal, wo);
+    const double cos_i = dot(rec.normal, wi);
+    if(m_fuzz <= 0 || cos_o <= 0 || cos_i <= 0) {
+        return color_t(0, 0, 0);
+    }
+
+    const dvec3_t h = normalize(wo + wi);
+    const double alpha = m_fuzz;
+    const double d = ggx_d(dot(rec.normal, h), alpha);
+    const double g = ggx_g1(cos_o, alpha) * ggx_g1(cos_i, alpha);
+    // f * cos_i = F D G / (4 cos_o cos_i) * cos_i
+    return schlick_fresnel(m_albedo, dot(wo, h)) * (d * g / (4.0 * cos_o));
+}
+
+double metal_material_t::pdf(const ray_t& r_in, const hit_record_t& rec, const dvec3_t& direction) const {
+    const dvec3_t wo = -normalize(r_in.direction());
+    const dvec3_t wi = normalize(direction);
+    if(m_fuzz <= 0 || dot(rec.normal, wi) <= 0) {
+        return 0.0;
+    }
+
+    const dvec3_t h = normalize(wo + wi);
+    const double cos_h = dot(rec.normal, h);
+    const double o_dot_h = dot(wo, h);
+    if(cos_h <= 0 || o_dot_h <= 0) {
+        return 0.0;
+    }
+    return ggx_d(cos_h, m_fuzz) * cos_h / (4.0 * o_dot_h);
 }
 
 bool dielectric_material_t::scatter(
@@ -3,7 +3,25 @@
 #include "color.h"
 #include "ray.h"
 #include "texture.h"
+#include "texture_program.h"
 #include "hittable.h"
+#include "scene_arena.h"
+
+/**
+ * \brief A direction picked by material_t::sample, and what it does to the path.
+ */
+struct bsdf_sample_t {
+    dvec3_t direction;
+
+    // what to multiply the path throughput by: bsdf * cosine / pdf
+    color_t weight;
+
+    // probability density of the direction (per solid angle). Meaningless for specular samples.
+    double pdf = 0.0;
+
+    // a perfect mirror/refraction direction, which light sampling could never have produced
+    bool specular = false;
+};
 
 class material_t {
 public:
@@ -13,6 +31,61 @@ public:
         return color_t(0,0,0);
     }
 
+    [[nodiscard]] virtual bool is_emissive() const { return false; }
+
+    /**
+     * \brief Roughly the average luminance emitted, from a grid of texture coordinates
+     * around p. Used to weight lights against each other.
+     */
+    [[nodiscard]] double average_emitted_luminance(const point3& p) const;
+
+    /**
+     * \brief True for materials that scatter inside a volume (participating media),
+     * where the hit record's normal doesn't mean anything.
+     */
+    [[nodiscard]] virtual bool is_volumetric() const { return false; }
+
+    /**
+     * \brief True if light arriving from any direction can be scattered towards the
+     * viewer (i.e. the material isn't purely specular), so eval and pdf mean something
+     * and it's worth sampling the lights directly.
+     */
+    [[nodiscard]] virtual bool samples_lights() const { return false; }
+
+    /**
+     * \brief True for materials that only reflect or refract perfectly (glass, mirrors),
+     * which is what focuses light into caustics.
+     */
+    [[nodiscard]] bool is_specular() const { return !samples_lights() && !is_emissive() && !is_volumetric(); }
+
+    /**
+     * \brief True for materials that scatter light the same way whichever way it's
+     * seen from (ideal diffuse), so the light they send back doesn't depend on r_in.
+     */
+    [[nodiscard]] virtual bool is_diffuse() const { return false; }
+
+    /**
+     * \brief How much of the light arriving from direction gets scattered back along
+     * r_in, including the cosine term. Only meaningful when samples_lights() is true.
+     */
+    [[nodiscard]] virtual color_t eval(const ray_t& r_in, const hit_record_t& rec, const dvec3_t& direction) const {
+        return color_t(0,0,0);
+    }
+
+    /**
+     * \brief The density sample() picks direction with, per unit solid angle.
+     */
+    [[nodiscard]] virtual double pdf(const ray_t& r_in, const hit_record_t& rec, const dvec3_t& direction) const {
+        return 0.0;
+    }
+
+    /**
+     * \brief Picks the direction the path continues in. The default goes through scatter
+     * and treats the result as specular, which suits the materials that don't have a pdf.
+     * \return false if the path is absorbed
+     */
+    virtual bool sample(const ray_t& r_in, const hit_record_t& rec, bsdf_sample_t& sample) const;
+
     virtual bool scatter(
             const ray_t& r_in, const hit_record_t& rec, color_t& attenuation, ray_t& scattered
         ) const = 0;
@@ -20,18 +93,37 @@ public:
 
 class lambertian_material_t : public material_t {
 public:
-    explicit lambertian_material_t(const color_t& a) : m_albedo(make_shared<solid_color_t>(a)) {}
-    lambertian_material_t(const shared_ptr<texture_t>& a) : m_albedo(a) {}
+    explicit lambertian_material_t(const color_t& a) : lambertian_material_t(make_object<solid_color_t>(a)) {}
+    lambertian_material_t(const shared_ptr<const texture_t>& a) : m_albedo(a), m_program(a) {}
 
     bool scatter(
         const ray_t& r_in, const hit_record_t& rec, color_t& attenuation, ray_t& scattered
     ) const override;
 
-    [[nodiscard]] shared_ptr<texture_t> albedo() const { return m_albedo; }
+    // cosine weighted, so the weight is just the albedo
+    bool sample(const ray_t& r_in, const hit_record_t& rec, bsdf_sample_t& sample) const override;
+
+    [[nodiscard]] bool samples_lights() const override { return true; }
+    [[nodiscard]] bool is_diffuse() const override { return true; }
+    [[nodiscard]] color_t eval(const ray_t& r_in, const hit_record_t& rec, const dvec3_t& direction) const override;
+    [[nodiscard]] double pdf(const ray_t& r_in, const hit_record_t& rec, const dvec3_t& direction) const override;
+
+    [[nodiscard]] shared_ptr<const texture_t> albedo() const { return m_albedo; }
+    void set_albedo(shared_ptr<const texture_t> albedo) {
+        m_program = texture_program_t(albedo);
+        m_albedo = std::move(albedo);
+    }
 protected:
-    shared_ptr<texture_t> m_albedo;
+    shared_ptr<const texture_t> m_albedo;
+
+    // m_albedo, compiled
+    texture_program_t m_program;
 };
 
+/**
+ * \brief A conductor. fuzz = 0 is a perfect mirror, anything else is a GGX microfacet
+ * surface with fuzz as its roughness (alpha), so light sampling works on it too.
+ */
 class metal_material_t : public material_t {
 public:
     explicit metal_material_t(const color_t& albedo, const double fuzz) : m_albedo(albedo), m_fuzz(fuzz < 1 ? fuzz : 1) {}
@@ -40,6 +132,13 @@ public:
         const ray_t& r_in, const hit_record_t& rec, color_t& attenuation, ray_t& scattered
     ) const override;
 
+    // samples the microfacet normal distribution, then reflects about the picked normal
+    bool sample(const ray_t& r_in, const hit_record_t& rec, bsdf_sample_t& sample) const override;
+
+    [[nodiscard]] bool samples_lights() const override { return m_fuzz > 0; }
+    [[nodiscard]] color_t eval(const ray_t& r_in, const hit_record_t& rec, const dvec3_t& direction) const override;
+    [[nodiscard]] double pdf(const ray_t& r_in, const hit_record_t& rec, const dvec3_t& direction) const override;
+
     [[nodiscard]] color_t albedo() const { return m_albedo; }
 protected:
     color_t m_albedo;
@@ -63,8 +162,8 @@ private:
 
 class diffuse_light : public material_t  {
     public:
-        diffuse_light(shared_ptr<texture_t> a) : emit(a) {}
-        diffuse_light(color_t c) : emit(make_shared<solid_color_t>(c)) {}
+        diffuse_light(shared_ptr<const texture_t> a) : m_emit(a), m_program(a) {}
+        diffuse_light(color_t c) : diffuse_light(make_object<solid_color_t>(c)) {}
 
         bool scatter(
             const ray_t& r_in, const hit_record_t& rec, color_t& attenuation, ray_t& scattered
@@ -73,26 +172,67 @@ class diffuse_light : public material_t  {
         }
 
         [[nodiscard]] color_t emitted(double u, double v, const point3& p) const override {
-            return emit->value(u, v, p);
+            return m_program.evaluate(u, v, p, {0, 0}, {0, 0}, {0, 0, 0}, {0, 0, 0});
         }
 
-    public:
-        shared_ptr<texture_t> emit;
+        [[nodiscard]] bool is_emissive() const override { return true; }
+
+        [[nodiscard]] shared_ptr<const texture_t> emit() const { return m_emit; }
+        void set_emit(shared_ptr<const texture_t> emit) {
+            m_program = texture_program_t(emit);
+            m_emit = std::move(emit);
+        }
+
+    protected:
+        shared_ptr<const texture_t> m_emit;
+
+        // m_emit, compiled
+        texture_program_t m_program;
 };
 
 class isotropic_material_t : public material_t {
     public:
-        isotropic_material_t(color_t c) : albedo(make_shared<solid_color_t>(c)) {}
-        isotropic_material_t(shared_ptr<texture_t> a) : albedo(a) {}
+        isotropic_material_t(color_t c) : isotropic_material_t(make_object<solid_color_t>(c)) {}
+        isotropic_material_t(shared_ptr<const texture_t> a) : m_albedo(a), m_program(a) {}
 
         virtual bool scatter(
             const ray_t& r_in, const hit_record_t& rec, color_t& attenuation, ray_t& scattered
         ) const override {
-            scattered = ray_t(rec.p, random_in_unit_sphere(), r_in.time());
-            attenuation = albedo->value(rec.uv.x, rec.uv.y, rec.p);
+            scattered = ray_t(rec.p, random_unit_vector(), r_in.time());
+            attenuation = m_program.evaluate(rec.uv.x, rec.uv.y, rec.p, {0, 0}, {0, 0}, {0, 0, 0}, {0, 0, 0});
             return true;
         }
 
-    public:
-        shared_ptr<texture_t> albedo;
+        bool sample(const ray_t& r_in, const hit_record_t& rec, bsdf_sample_t& sample) const override {
+            sample.direction = random_unit_vector();
+            sample.weight = m_program.evaluate(rec.uv.x, rec.uv.y, rec.p, {0, 0}, {0, 0}, {0, 0, 0}, {0, 0, 0});
+            sample.pdf = 1.0 / (4.0 * g_pi);
+            sample.specular = false;
+            return true;
+        }
+
+        [[nodiscard]] bool samples_lights() const override { return true; }
+
+        [[nodiscard]] bool is_volumetric() const override { return true; }
+
+        [[nodiscard]] double pdf(const ray_t& r_in, const hit_record_t& rec, const dvec3_t& direction) const override {
+            return 1.0 / (4.0 * g_pi);
+        }
+
+        // scatters evenly in every direction, so there's no cosine term
+        [[nodiscard]] color_t eval(const ray_t& r_in, const hit_record_t& rec, const dvec3_t& direction) const override {
+            return m_program.evaluate(rec.uv.x, rec.uv.y, rec.p, {0, 0}, {0, 0}, {0, 0, 0}, {0, 0, 0}) * (1.0 / (4.0 * g_pi));
+        }
+
+        [[nodiscard]] shared_ptr<const texture_t> albedo() const { return m_albedo; }
+        void set_albedo(shared_ptr<const texture_t> albedo) {
+            m_program = texture_program_t(albedo);
+            m_albedo = std::move(albedo);
+        }
+
+    protected:
+        shared_ptr<const texture_t> m_albedo;
+
+        // m_albedo, compiled
+        texture_program_t m_program;
 };
\ No newline at end of file
@@ -0,0 +1,310 @@
+#include "path_guide.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+
+#ifdef THREADS
+#include <thread>
+#endif
+
+namespace {
+    // (cos theta, phi) in the unit square, and back
+    dvec2_t direction_to_square(const dvec3_t& d) {
+        const double cos_theta = std::clamp(d.z, -1.0, 1.0);
+        double phi = atan2(d.y, d.x);
+        if(phi < 0.0) {
+            phi += 2.0 * g_pi;
+        }
+        return {std::clamp((cos_theta + 1.0) * 0.5, 0.0, 1.0), std::clamp(phi / (2.0 * g_pi), 0.0, 1.0)};
+    }
+
+    dvec3_t square_to_direction(const dvec2_t& uv) {
+        const double cos_theta = 2.0 * uv.x - 1.0;
+        const double sin_theta = sqrt(std::max(0.0, 1.0 - cos_theta * cos_theta));
+        const double phi = 2.0 * g_pi * uv.y;
+        return {sin_theta * cos(phi), sin_theta * sin(phi), cos_theta};
+    }
+
+    // which quadrant uv is in, and uv within it
+    int quadrant(dvec2_t& uv) {
+        int q = 0;
+        if(uv.x >= 0.5) {
+            q |= 1;
+            uv.x -= 0.5;
+        }
+        if(uv.y >= 0.5) {
+            q |= 2;
+            uv.y -= 0.5;
+        }
+        uv *= 2.0;
+        return q;
+    }
+}
+
+directional_tree_t::directional_tree_t() : m_nodes(1) {}
+
+void directional_tree_t::record(const dvec3_t& direction, float value) {
+    dvec2_t uv = direction_to_square(direction);
+    int node = 0;
+    while(true) {
+        const int q = quadrant(uv);
+        std::atomic_ref<float>(m_nodes[node].sum[q]).fetch_add(value, std::memory_order_relaxed);
+        node = m_nodes[node].child[q];
+        if(node == 0) {
+            return;
+        }
+    }
+}
+
+dvec3_t directional_tree_t::sample(double& pdf) const {
+    dvec2_t origin(0.0, 0.0);
+    double size = 1.0;
+    double density = 1.0;
+    int node = 0;
+    while(true) {
+        const node_t& n = m_nodes[node];
+        const float total = n.total();
+
+        // pick a quadrant in proportion to its energy
+        int q = 3;
+        if(total > 0.0f) {
+            double u = random_double() * total;
+            for(int i = 0; i < 3; i++) {
+                if(u < n.sum[i]) {
+                    q = i;
+                    break;
+                }
+                u -= n.sum[i];
+            }
+            // rounding can run u past the last non-empty quadrant
+            while(n.sum[q] <= 0.0f && q > 0) {
+                q--;
+            }
+            density *= 4.0 * n.sum[q] / total;
+        } else {
+            q = std::min(3, static_cast<int>(random_double() * 4.0));
+        }
+
+        size *= 0.5;
+        origin += dvec2_t(q & 1 ? size : 0.0, q & 2 ? size : 0.0);
+        node = n.child[q];
+        if(node == 0) {
+            break;
+        }
+    }
+
+    // from a density over the square to one over solid angle (4 pi of it)
+    pdf = density / (4.0 * g_pi);
+    return square_to_direction(origin + dvec2_t(random_double(), random_double()) * size);
+}
+
+double directional_tree_t::pdf(const dvec3_t& direction) const {
+    dvec2_t uv = direction_to_square(direction);
+    double density = 1.0;
+    int node = 0;
+    while(true) {
+        const node_t& n = m_nodes[node];
+        const float total = n.total();
+        const int q = quadrant(uv);
+        if(total > 0.0f) {
+            density *= 4.0 * n.sum[q] / total;
+        }
+        node = n.child[q];
+        if(node == 0 || density <= 0.0) {
+            break;
+        }
+    }
+    return density / (4.0 * g_pi);
+}
+
+double directional_tree_t::total() const {
+    return m_nodes[0].total();
+}
+
+size_t directional_tree_t::node_bytes() {
+    return sizeof(node_t);
+}
+
+directional_tree_t directional_tree_t::refined(double fraction, int max_depth, size_t max_nodes) const {
+    directional_tree_t tree;
+    const double total = this->total();
+    if(total <= 0.0) {
+        return tree;
+    }
+    const double threshold = fraction * total;
+
+    // breadth first, so running out of nodes leaves the coarse levels complete. A
+    // node's sums include everything below it, and cells this tree never subdivided
+    // spread their energy evenly over their quadrants.
+    struct pending_t {
+        int node;           // in the new tree
+        int source;         // in this tree, or -1 if this tree's cell was a leaf
+        double energy[4];   // of the new node's quadrants
+        int depth;
+    };
+    std::deque<pending_t> queue;
+    pending_t root {0, 0, {}, 1};
+    for(int q = 0; q < 4; q++) {
+        root.energy[q] = m_nodes[0].sum[q];
+    }
+    queue.push_back(root);
+
+    while(!queue.empty()) {
+        const pending_t p = queue.front();
+        queue.pop_front();
+        if(p.depth >= max_depth) {
+            continue;
+        }
+        for(int q = 0; q < 4; q++) {
+            if(p.energy[q] <= threshold || tree.m_nodes.size() >= max_nodes) {
+                continue;
+            }
+
+            const int child = static_cast<int>(tree.m_nodes.size());
+            tree.m_nodes.emplace_back();
+            tree.m_nodes[p.node].child[q] = child;
+
+            pending_t next {child, -1, {}, p.depth + 1};
+            const int source_child = p.source >= 0 ? m_nodes[p.source].child[q] : 0;
+            for(int c = 0; c < 4; c++) {
+                next.energy[c] = source_child != 0 ? m_nodes[source_child].sum[c] : p.energy[q] * 0.25;
+            }
+            next.source = source_child != 0 ? source_child : -1;
+            queue.push_back(next);
+        }
+    }
+    return tree;
+}
+
+void directional_tree_t::scale(float factor) {
+    for(auto& n : m_nodes) {
+        for(float& s : n.sum) {
+            s *= factor;
+        }
+    }
+}
+
+path_guide_t::path_guide_t(const aabb_t& bounds, path_guide_settings_t settings)
+    : m_settings(settings), m_nodes(1), m_leaves(1) {
+    // a cube around the scene, so cells stay roughly cube shaped as they're halved
+    const dvec3_t center = (bounds.min() + bounds.max()) * 0.5;
+    const dvec3_t extent = bounds.max() - bounds.min();
+    const double half = 0.5 * std::max({extent.x, extent.y, extent.z}) * 1.001 + 1e-6;
+    m_bounds = aabb_t(center - dvec3_t(half), center + dvec3_t(half));
+    m_nodes[0].leaf = 0;
+}
+
+int path_guide_t::leaf_index(const point3& p) const {
+    dvec3_t local = (p - m_bounds.min()) / (m_bounds.max() - m_bounds.min());
+    int node = 0;
+    int axis = 0;
+    while(m_nodes[node].child != 0) {
+        // halve along the axis, and rescale that coordinate into the half p is in
+        int side = 0;
+        if(local[axis] >= 0.5) {
+            side = 1;
+            local[axis] -= 0.5;
+        }
+        local[axis] *= 2.0;
+        node = m_nodes[node].child + side;
+        axis = (axis + 1) % 3;
+    }
+    return m_nodes[node].leaf;
+}
+
+void path_guide_t::record(const point3& p, const dvec3_t& direction, float value) {
+    if(!(value > 0.0f) || !std::isfinite(value)) {
+        return;
+    }
+    leaf_t& leaf = m_leaves[leaf_index(p)];
+    leaf.building.record(direction, value);
+    std::atomic_ref<uint32_t>(leaf.records).fetch_add(1, std::memory_order_relaxed);
+}
+
+const directional_tree_t* path_guide_t::distribution(const point3& p) const {
+    if(m_iteration == 0) {
+        return nullptr;
+    }
+    const leaf_t& leaf = m_leaves[leaf_index(p)];
+    return leaf.sampling.total() > 0.0 ? &leaf.sampling : nullptr;
+}
+
+bool path_guide_t::has_records() const {
+    return std::any_of(m_leaves.begin(), m_leaves.end(), [](const leaf_t& leaf) { return leaf.records > 0; });
+}
+
+size_t path_guide_t::memory_bytes() const {
+    size_t bytes = m_nodes.capacity() * sizeof(spatial_node_t) + m_leaves.capacity() * sizeof(leaf_t);
+    for(const auto& leaf : m_leaves) {
+        bytes += leaf.sampling.memory_bytes() + leaf.building.memory_bytes();
+    }
+    return bytes;
+}
+
+void path_guide_t::refine(int threads) {
+    // split busy cells, as far down as they stay busy, while there's room. Each split
+    // adds a leaf with copies of the parent's trees, so that's what it costs.
+    const double threshold = m_settings.split_threshold * sqrt(pow(2.0, m_iteration));
+    size_t bytes = memory_bytes();
+    std::vector<int> pending;
+    for(int i = 0; i < static_cast<int>(m_nodes.size()); i++) {
+        if(m_nodes[i].child == 0) {
+            pending.push_back(i);
+        }
+    }
+    while(!pending.empty()) {
+        const int node = pending.back();
+        pending.pop_back();
+        const int leaf = m_nodes[node].leaf;
+        const size_t cost = 2 * sizeof(spatial_node_t) + sizeof(leaf_t) +
+                            m_leaves[leaf].sampling.memory_bytes() + m_leaves[leaf].building.memory_bytes();
+        if(m_leaves[leaf].records <= threshold || bytes + cost > m_settings.max_bytes) {
+            continue;
+        }
+        bytes += cost;
+
+        // each half gets half of what was recorded
+        m_leaves[leaf].building.scale(0.5f);
+        m_leaves[leaf].records /= 2;
+        const int first = static_cast<int>(m_nodes.size());
+        m_nodes.push_back({0, leaf});
+        m_nodes.push_back({0, static_cast<int>(m_leaves.size())});
+        m_leaves.push_back(m_leaves[leaf]);
+        m_nodes[node].child = first;
+        m_nodes[node].leaf = -1;
+        pending.push_back(first);
+        pending.push_back(first + 1);
+    }
+
+    // whatever room is left is shared out between the leaves' new recording trees
+    const size_t leaves = m_leaves.size();
+    const size_t spare = m_settings.max_bytes > bytes ? m_settings.max_bytes - bytes : 0;
+    const size_t max_nodes = std::max<size_t>(1, spare / leaves / (2 * directional_tree_t::node_bytes()));
+
+    auto refine_leaves = [&](size_t first, size_t step) {
+        for(size_t i = first; i < leaves; i += step) {
+            leaf_t& leaf = m_leaves[i];
+            leaf.sampling = std::move(leaf.building);
+            leaf.building = leaf.sampling.refined(m_settings.subdivide_fraction, m_settings.max_directional_depth, max_nodes);
+            leaf.records = 0;
+        }
+    };
+
+#ifdef THREADS
+    threads = std::clamp(threads, 1, static_cast<int>(leaves));
+    std::vector<std::thread> workers;
+    for(int t = 1; t < threads; t++) {
+        workers.emplace_back(refine_leaves, t, threads);
+    }
+    refine_leaves(0, threads);
+    for(auto& w : workers) {
+        w.join();
+    }
+#else
+    (void)threads;
+    refine_leaves(0, 1);
+#endif
+
+    m_iteration++;
+}
@@ -0,0 +1,147 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "aabb.h"
+#include "types.h"
+
+/**
+ * \brief A distribution over the sphere of directions, as a quadtree over the
+ * (cos theta, phi) square, which maps area to solid angle evenly. Each node keeps the
+ * energy that went through its four quadrants, and quadrants with a large share of it
+ * are subdivided further, so the tree is finest where most light comes from.
+ */
+class directional_tree_t {
+public:
+    directional_tree_t();
+
+    /**
+     * \brief Adds value to the cells around direction. Thread safe against other
+     * record() calls (the tree's shape doesn't change while recording).
+     */
+    void record(const dvec3_t& direction, float value);
+
+    /**
+     * \brief Picks a direction in proportion to the recorded energy.
+     * \param pdf set to the density of the direction, per unit solid angle
+     */
+    dvec3_t sample(double& pdf) const;
+
+    /**
+     * \brief The density sample() picks direction with, per unit solid angle.
+     */
+    [[nodiscard]] double pdf(const dvec3_t& direction) const;
+
+    /**
+     * \brief Everything recorded in the tree.
+     */
+    [[nodiscard]] double total() const;
+
+    /**
+     * \brief An empty tree subdivided wherever this one's cells hold more than
+     * fraction of its energy, down to max_depth levels and at most max_nodes nodes.
+     */
+    [[nodiscard]] directional_tree_t refined(double fraction, int max_depth, size_t max_nodes) const;
+
+    /**
+     * \brief Scales everything recorded (used when a spatial cell is split in two).
+     */
+    void scale(float factor);
+
+    [[nodiscard]] size_t node_count() const { return m_nodes.size(); }
+    [[nodiscard]] size_t memory_bytes() const { return m_nodes.capacity() * node_bytes(); }
+    static size_t node_bytes();
+
+protected:
+    struct node_t {
+        // the quadrants are (u < 0.5, v < 0.5), (u >= 0.5, v < 0.5), (u < 0.5, v >= 0.5), (u >= 0.5, v >= 0.5)
+        float sum[4] = {0, 0, 0, 0};
+
+        // the node each quadrant is subdivided by, or 0 if it's a leaf (the root is never a child)
+        int child[4] = {0, 0, 0, 0};
+
+        [[nodiscard]] float total() const { return sum[0] + sum[1] + sum[2] + sum[3]; }
+    };
+
+    std::vector<node_t> m_nodes;
+};
+
+/**
+ * \brief Limits for path_guide_t.
+ */
+struct path_guide_settings_t {
+    // a spatial cell is split once an iteration records more than this many times
+    // sqrt(2^iteration) path vertices in it (so cells get finer as the estimates get better)
+    int split_threshold = 4000;
+
+    // directional cells holding more than this share of their tree's energy are subdivided
+    double subdivide_fraction = 0.01;
+    int max_directional_depth = 16;
+
+    // the spatial and directional trees together stay under this
+    size_t max_bytes = 64u << 20;
+};
+
+/**
+ * \brief Learns where light comes from, throughout the scene, while a progressive
+ * render runs, so later samples can be aimed at it ("Practical Path Guiding for
+ * Efficient Light-Transport Simulation", Müller et al. 2017).
+ *
+ * The scene's bounding box is split by a kd-tree (halving cells along x, y and z in
+ * turn), and every leaf holds two directional trees: one that the current iteration
+ * samples from, and one it records the radiance paths find into. refine() runs
+ * between iterations: busy cells are split, the recorded trees become the sampled
+ * ones, and fresh recording trees are laid out where the recorded energy is. The
+ * leaves are refined in parallel.
+ */
+class path_guide_t {
+public:
+    explicit path_guide_t(const aabb_t& bounds, path_guide_settings_t settings = {});
+
+    /**
+     * \brief Records radiance arriving at p from direction (already divided by the
+     * density the direction was sampled with). Thread safe against other record() calls.
+     */
+    void record(const point3& p, const dvec3_t& direction, float value);
+
+    /**
+     * \brief The distribution to sample at p, or null if nothing has been learnt there yet.
+     */
+    [[nodiscard]] const directional_tree_t* distribution(const point3& p) const;
+
+    /**
+     * \brief Ends an iteration: splits busy spatial cells and swaps in what was recorded.
+     * Must not run at the same time as anything else.
+     * \param threads how many threads to refine the leaves with
+     */
+    void refine(int threads);
+
+    // whether anything's been recorded since the last refine()
+    [[nodiscard]] bool has_records() const;
+
+    [[nodiscard]] int iteration() const { return m_iteration; }
+    [[nodiscard]] size_t leaf_count() const { return m_leaves.size(); }
+    [[nodiscard]] size_t memory_bytes() const;
+
+protected:
+    struct spatial_node_t {
+        // the first of the two children (the second follows it), or 0 for a leaf
+        int child = 0;
+        int leaf = -1;
+    };
+
+    struct leaf_t {
+        directional_tree_t sampling;
+        directional_tree_t building;
+        uint32_t records = 0;
+    };
+
+    // finds the leaf containing p
+    [[nodiscard]] int leaf_index(const point3& p) const;
+
+    aabb_t m_bounds;
+    path_guide_settings_t m_settings;
+    std::vector<spatial_node_t> m_nodes;
+    std::vector<leaf_t> m_leaves;
+    int m_iteration = 0;
+};
@@ -1,119 +1,186 @@
 #include "perlin.h"
 
-double trilinear_interp(double c[2][2][2], double u, double v, double w) {
-    auto accum = 0.0;
-    for (int i=0; i < 2; i++) {
-        for (int j=0; j < 2; j++) {
-            for (int k=0; k < 2; k++) {
-                accum += (i*u + (1-i)*(1-u))*
-                    (j*v + (1-j)*(1-v))*
-                    (k*w + (1-k)*(1-w))*c[i][j][k];
-            }
-        }
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PERLIN_SSE2
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // the lattice cell a coordinate is in, and where in it (0 to 1)
+    void lattice(double x, int& cell, float& frac) {
+        // floor() is a library call without SSE4.1
+        int64_t f = static_cast<int64_t>(x);
+        f -= x < static_cast<double>(f) ? 1 : 0;
+        cell = static_cast<int>(f & 255);
+        frac = static_cast<float>(x - static_cast<double>(f));
     }
-
-    return accum;
 }
 
-double perlin_interp(dvec3_t c[2][2][2], double u, double v, double w) {
-    auto uu = u*u*(3-2*u);
-    auto vv = v*v*(3-2*v);
-    auto ww = w*w*(3-2*w);
-    auto accum = 0.0;
-
-    for (int i=0; i < 2; i++)
-        for (int j=0; j < 2; j++)
-            for (int k=0; k < 2; k++) {
-                dvec3_t weight_v(u-i, v-j, w-k);
-                accum += (i*uu + (1-i)*(1-uu))
-                       * (j*vv + (1-j)*(1-vv))
-                       * (k*ww + (1-k)*(1-ww))
-                       * dot(c[i][j][k], weight_v);
-            }
-
-    return accum;
+perlin_t::perlin_t() {
+    generate();
 }
 
+perlin_t::perlin_t(uint64_t seed) {
+    // the thread's random numbers, started from seed while the tables are made
+    const uint64_t saved = random_state();
+    seed_random(seed);
+    generate();
+    random_state() = saved;
+}
 
-perlin_t::perlin_t() {
-    ranvec = new dvec3_t[point_count];
+void perlin_t::generate() {
     for (int i = 0; i < point_count; ++i) {
-        ranvec[i] = glm::normalize(
+        const dvec3_t g = glm::normalize(
             dvec3_t(
                 random_double(-1, 1),
                 random_double(-1, 1),
                 random_double(-1, 1)
                 ));
+        gradients[i] = {{static_cast<float>(g.x), static_cast<float>(g.y), static_cast<float>(g.z), 0.0f}};
     }
 
-    perm_x = perlin_generate_perm();
-    perm_y = perlin_generate_perm();
-    perm_z = perlin_generate_perm();
+    perlin_generate_perm(perm_x);
+    perlin_generate_perm(perm_y);
+    perlin_generate_perm(perm_z);
 }
 
-perlin_t::~perlin_t() {
-    delete[] ranvec;
-    delete[] perm_x;
-    delete[] perm_y;
-    delete[] perm_z;
+void perlin_t::noise_lanes(const point3 points[lanes], float out[lanes]) const {
+    // each lane's cell, and where in it. The position is smoothed (Hermite) before
+    // it's used for the offsets from the corners, and again for the weights, which
+    // is how this noise has always looked.
+    alignas(16) float fx[lanes], fy[lanes], fz[lanes];
+    int ix[lanes], iy[lanes], iz[lanes];
+    auto hermite = [](float t) { return t * t * (3.0f - 2.0f * t); };
+    for (int l = 0; l < lanes; l++) {
+        lattice(points[l].x, ix[l], fx[l]);
+        lattice(points[l].y, iy[l], fy[l]);
+        lattice(points[l].z, iz[l], fz[l]);
+        fx[l] = hermite(fx[l]);
+        fy[l] = hermite(fy[l]);
+        fz[l] = hermite(fz[l]);
+    }
+
+    // the permutations of each lane's cell and the next one along, which the corners'
+    // hashes are made of
+    uint8_t hx[2][lanes], hy[2][lanes], hz[2][lanes];
+    for (int l = 0; l < lanes; l++) {
+        for (int d = 0; d < 2; d++) {
+            hx[d][l] = perm_x[(ix[l] + d) & 255];
+            hy[d][l] = perm_y[(iy[l] + d) & 255];
+            hz[d][l] = perm_z[(iz[l] + d) & 255];
+        }
+    }
+
+    // the gradient at a corner of a lane's cell
+    auto gradient = [&](int l, int di, int dj, int dk) -> const gradient_t& {
+        return gradients[hx[di][l] ^ hy[dj][l] ^ hz[dk][l]];
+    };
+
+#ifdef PERLIN_SSE2
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 u = _mm_load_ps(fx), v = _mm_load_ps(fy), w = _mm_load_ps(fz);
+    auto smooth = [&](__m128 t) {
+        return _mm_mul_ps(_mm_mul_ps(t, t), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_add_ps(t, t)));
+    };
+    const __m128 su = smooth(u), sv = smooth(v), sw = smooth(w);
+    const __m128 su_weights[2] = {_mm_sub_ps(one, su), su};
+    const __m128 sv_weights[2] = {_mm_sub_ps(one, sv), sv};
+    const __m128 sw_weights[2] = {_mm_sub_ps(one, sw), sw};
+    const __m128 u_offsets[2] = {u, _mm_sub_ps(u, one)};
+    const __m128 v_offsets[2] = {v, _mm_sub_ps(v, one)};
+    const __m128 w_offsets[2] = {w, _mm_sub_ps(w, one)};
+
+    __m128 accum = _mm_setzero_ps();
+    for (int corner = 0; corner < 8; corner++) {
+        const int di = corner & 1, dj = (corner >> 1) & 1, dk = corner >> 2;
+        // a gradient per lane, turned into x, y and z of every lane
+        __m128 gx = _mm_load_ps(gradient(0, di, dj, dk).v);
+        __m128 gy = _mm_load_ps(gradient(1, di, dj, dk).v);
+        __m128 gz = _mm_load_ps(gradient(2, di, dj, dk).v);
+        __m128 unused = _mm_load_ps(gradient(3, di, dj, dk).v);
+        _MM_TRANSPOSE4_PS(gx, gy, gz, unused);
+        const __m128 dot = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(gx, u_offsets[di]), _mm_mul_ps(gy, v_offsets[dj])),
+            _mm_mul_ps(gz, w_offsets[dk]));
+        const __m128 weight = _mm_mul_ps(_mm_mul_ps(su_weights[di], sv_weights[dj]), sw_weights[dk]);
+        accum = _mm_add_ps(accum, _mm_mul_ps(weight, dot));
+    }
+    _mm_storeu_ps(out, accum);
+#else
+    for (int l = 0; l < lanes; l++) {
+        const float su = hermite(fx[l]), sv = hermite(fy[l]), sw = hermite(fz[l]);
+        const float u_weights[2] = {1.0f - su, su};
+        const float v_weights[2] = {1.0f - sv, sv};
+        const float w_weights[2] = {1.0f - sw, sw};
+        float accum = 0.0f;
+        for (int corner = 0; corner < 8; corner++) {
+            const int di = corner & 1, dj = (corner >> 1) & 1, dk = corner >> 2;
+            const float* g = gradient(l, di, dj, dk).v;
+            const float dot = g[0] * (fx[l] - di) + g[1] * (fy[l] - dj) + g[2] * (fz[l] - dk);
+            accum += u_weights[di] * v_weights[dj] * w_weights[dk] * dot;
+        }
+        out[l] = accum;
+    }
+#endif
 }
 
 double perlin_t::noise(const point3& p) const {
-    auto u = p.x - floor(p.x);
-    auto v = p.y - floor(p.y);
-    auto w = p.z - floor(p.z);
-
-    u = u*u*(3-2*u);
-    v = v*v*(3-2*v);
-    w = w*w*(3-2*w);
-
-    auto i = static_cast<int>(floor(p.x));
-    auto j = static_cast<int>(floor(p.y));
-    auto k = static_cast<int>(floor(p.z));
-    dvec3_t c[2][2][2];
-
-    for (int di=0; di < 2; di++)
-        for (int dj=0; dj < 2; dj++)
-            for (int dk=0; dk < 2; dk++)
-                c[di][dj][dk] = ranvec[
-                    perm_x[(i+di) & 255] ^
-                    perm_y[(j+dj) & 255] ^
-                    perm_z[(k+dk) & 255]
-                ];
-
-    return perlin_interp(c, u, v, w);
+    const point3 points[lanes] = {p, p, p, p};
+    float values[lanes];
+    noise_lanes(points, values);
+    return values[0];
 }
 
-double perlin_t::turb(const point3& p, int depth) const {
+double perlin_t::turb(const point3& p, int depth, double footprint) const {
     auto accum = 0.0;
-    auto temp_p = p;
-    auto weight = 1.0;
+    point3 points[lanes];
+    double weights[lanes];
+    float values[lanes];
 
-    for (int i = 0; i < depth; i++) {
-        accum += weight * noise(temp_p);
-        weight *= 0.5;
-        temp_p *= 2;
+    auto weight = 1.0;
+    auto frequency = 1.0;
+    for (int octave = 0; octave < depth; octave += lanes) {
+        int count = 0;
+        for (; count < lanes && octave + count < depth; count++) {
+            // fully there while the lattice is coarser than twice the footprint, gone
+            // once it's as fine as the footprint
+            const double fade = std::clamp(2.0 - 2.0 * footprint * frequency, 0.0, 1.0);
+            if (fade <= 0.0) {
+                break;
+            }
+            points[count] = p * frequency;
+            weights[count] = weight * fade;
+            weight *= 0.5;
+            frequency *= 2.0;
+        }
+        // the lanes past the last octave just repeat it
+        if (count == 0) {
+            break;
+        }
+        for (int l = count; l < lanes; l++) {
+            points[l] = points[count - 1];
+        }
+        noise_lanes(points, values);
+        for (int l = 0; l < count; l++) {
+            accum += weights[l] * values[l];
+        }
+        if (count < lanes) {
+            break;
+        }
     }
 
     return fabs(accum);
 }
 
-int* perlin_t::perlin_generate_perm() {
-    auto p = new int[point_count];
-
-    for (int i = 0; i < perlin_t::point_count; i++)
-        p[i] = i;
-
-    permute(p, point_count);
-
-    return p;
-}
+void perlin_t::perlin_generate_perm(std::array<uint8_t, point_count>& p) {
+    for (int i = 0; i < point_count; i++)
+        p[i] = static_cast<uint8_t>(i);
 
-void perlin_t::permute(int* p, int n) {
-    for (int i = n-1; i > 0; i--) {
+    for (int i = point_count-1; i > 0; i--) {
         int target = random_int(0, i);
-        int tmp = p[i];
-        p[i] = p[target];
-        p[target] = tmp;
+        std::swap(p[i], p[target]);
     }
 }
@@ -1,25 +1,52 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include "types.h"
 
+/**
+ * \brief Perlin noise: random gradients at the points of an integer lattice, smoothly
+ * interpolated in between. The gradients are kept as floats, and the noise is worked
+ * out four points at a time (in the four lanes of SSE2 registers where there's SSE2),
+ * so turb() does four octaves in one go.
+ */
 class perlin_t {
 public:
     perlin_t();
 
-    ~perlin_t();
+    /**
+     * \brief Tables made from seed rather than the thread's random numbers, so the same
+     * seed always gives the same noise.
+     */
+    explicit perlin_t(uint64_t seed);
 
     double noise(const point3& p) const;
 
-    double turb(const point3& p, int depth = 7) const;
+    /**
+     * \brief depth octaves of noise, each twice the frequency and half the weight of the
+     * one before, summed and made positive. Octaves whose lattice is finer than
+     * footprint (how far apart the points a pixel covers are, 0 for a single point)
+     * would only average out over the pixel, so they're faded out and skipped.
+     */
+    double turb(const point3& p, int depth = 7, double footprint = 0.0) const;
 
 private:
     static const int point_count = 256;
-    dvec3_t* ranvec;
-    int* perm_x;
-    int* perm_y;
-    int* perm_z;
+    static const int lanes = 4;
 
-    static int* perlin_generate_perm();
+    void generate();
 
-    static void permute(int* p, int n);
+    // the noise at lanes points
+    void noise_lanes(const point3 points[lanes], float out[lanes]) const;
+
+    // x, y, z and a 0, so a gradient is one aligned load
+    struct alignas(16) gradient_t {
+        float v[4];
+    };
+    std::array<gradient_t, point_count> gradients;
+    std::array<uint8_t, point_count> perm_x;
+    std::array<uint8_t, point_count> perm_y;
+    std::array<uint8_t, point_count> perm_z;
+
+    static void perlin_generate_perm(std::array<uint8_t, point_count>& p);
 };
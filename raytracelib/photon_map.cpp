@@ -0,0 +1,334 @@
+#include "photon_map.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+#ifdef THREADS
+#include <thread>
+#endif
+
+#include "environment.h"
+
+namespace {
+    // each pass's radius is the last one's times sqrt((passes + alpha) / (passes + 1))
+    constexpr double alpha = 2.0 / 3.0;
+
+    // photons on surfaces turned further than this (a cosine) from the one being
+    // estimated belong to something else, like the other side of a corner
+    constexpr float same_surface = 0.7f;
+
+    // photons stuck between mirrors give up after this many bounces
+    constexpr int max_photon_bounces = 16;
+
+    /**
+     * \brief Where the photons are aimed: a sphere around everything specular.
+     */
+    struct target_t {
+        point3 center;
+        double radius = 0.0;
+
+        // how far back to start photons from the environment, to be outside the scene
+        double scene_distance = 0.0;
+    };
+
+    /**
+     * \brief How the lights are picked: the environment (or background) with
+     * environment_probability, otherwise one of the scene's lights by its power.
+     */
+    struct emitters_t {
+        double environment_probability = 0.0;
+        std::vector<double> cdf;
+    };
+
+    [[nodiscard]] double light_pmf(const emitters_t& emitters, int index) {
+        return (emitters.cdf[index] - (index > 0 ? emitters.cdf[index - 1] : 0.0)) / emitters.cdf.back();
+    }
+
+    /**
+     * \brief Starts a photon off: where from, which way, and how much power it carries
+     * (before dividing by the number of photons).
+     */
+    bool start_photon(const scene_t& scene, const emitters_t& emitters, const target_t& target, ray_t& ray, color_t& power) {
+        const double time = random_double();
+        if(random_double() < emitters.environment_probability) {
+            dvec3_t towards;
+            color_t radiance;
+            double pdf;
+            if(scene.environment) {
+                environment_sample_t s;
+                if(!scene.environment->sample(s) || s.pdf <= 0.0) {
+                    return false;
+                }
+                towards = s.direction;
+                radiance = s.radiance;
+                pdf = s.pdf;
+            } else {
+                towards = random_unit_vector();
+                radiance = scene.background;
+                pdf = 1.0 / (4.0 * g_pi);
+            }
+
+            // through a disk facing the light that covers the target, starting from
+            // outside the scene so anything in the way still casts its shadow
+            const onb_t basis(towards);
+            const double r = target.radius * sqrt(random_double());
+            const double phi = 2.0 * g_pi * random_double();
+            const point3 through = target.center + basis.local(r * cos(phi), r * sin(phi), 0.0);
+            ray = ray_t(through + towards * target.scene_distance, -towards, time);
+            power = radiance * (g_pi * target.radius * target.radius / (pdf * emitters.environment_probability));
+            return true;
+        }
+
+        if(emitters.cdf.empty()) {
+            return false;
+        }
+        const auto it = std::upper_bound(emitters.cdf.begin(), emitters.cdf.end(), random_double() * emitters.cdf.back());
+        const int index = std::min(static_cast<int>(it - emitters.cdf.begin()), static_cast<int>(emitters.cdf.size()) - 1);
+        light_sample_t s;
+        if(!scene.lights[index]->sample_emission(time, s) || s.pdf <= 0.0) {
+            return false;
+        }
+
+        // into the cone the target covers, or the whole hemisphere from inside it
+        dvec3_t direction;
+        double direction_pdf;
+        const dvec3_t to_target = target.center - s.p;
+        const double distance_squared = length2(to_target);
+        const double radius_squared = target.radius * target.radius;
+        if(distance_squared > radius_squared) {
+            const double cos_theta_max = sqrt(1.0 - radius_squared / distance_squared);
+            const double z = 1.0 + random_double() * (cos_theta_max - 1.0);
+            const double phi = 2.0 * g_pi * random_double();
+            const double sin_theta = sqrt(std::max(0.0, 1.0 - z * z));
+            direction = onb_t(to_target).local(cos(phi) * sin_theta, sin(phi) * sin_theta, z);
+            direction_pdf = 1.0 / (2.0 * g_pi * (1.0 - cos_theta_max));
+        } else {
+            direction = onb_t(s.normal).local(random_cosine_direction());
+            direction_pdf = dot(s.normal, direction) / g_pi;
+        }
+
+        const double cosine = dot(s.normal, direction);
+        if(cosine <= 0.0 || direction_pdf <= 0.0) {
+            return false;
+        }
+        const double pick = light_pmf(emitters, index) * (1.0 - emitters.environment_probability);
+        ray = ray_t(s.p, direction, time);
+        power = s.emitted * (cosine / (s.pdf * direction_pdf * pick));
+        return true;
+    }
+}
+
+void photon_map_t::emit(const scene_t& scene, const render_settings_t& settings) {
+    m_nearest = static_cast<size_t>(std::max(1, settings.caustic_nearest));
+    if(m_passes > 0) {
+        m_radius *= sqrt((m_passes + alpha) / (m_passes + 1.0));
+    }
+    m_passes++;
+    m_photons.clear();
+
+    target_t target;
+    aabb_t specular_box;
+    bool any_specular = false;
+    for(const auto& obj : scene.entities.objects) {
+        aabb_t box;
+        if(!obj->is_specular() || !obj->bounding_box(0, 1, box)) {
+            continue;
+        }
+        specular_box = any_specular ? surrounding_box(specular_box, box) : box;
+        any_specular = true;
+    }
+    aabb_t scene_box;
+    if(!any_specular || !scene.root || !scene.root->bounding_box(0, 1, scene_box)) {
+        return; // nothing to focus light, so no caustics
+    }
+    target.center = (specular_box.min() + specular_box.max()) * 0.5;
+    target.radius = 0.5 * length(specular_box.max() - specular_box.min());
+    const point3 scene_center = (scene_box.min() + scene_box.max()) * 0.5;
+    target.scene_distance = length(scene_center - target.center) + length(scene_box.max() - scene_box.min());
+
+    emitters_t emitters;
+    double total = 0.0;
+    for(const auto& light : scene.lights) {
+        light_bounds_t bounds;
+        total += light->light_bounds(bounds) ? std::max(0.0, bounds.power) : 0.0;
+        emitters.cdf.push_back(total);
+    }
+    if(total <= 0.0) {
+        emitters.cdf.clear();
+    }
+    const bool sky = scene.environment || luminance(scene.background) > 0.0;
+    emitters.environment_probability = sky ? (emitters.cdf.empty() ? 1.0 : 0.5) : 0.0;
+    if(!sky && emitters.cdf.empty()) {
+        return;
+    }
+
+    // every photon that was started counts, wherever it ended up
+    const int count = std::max(1, settings.caustic_photons);
+    const double scale = 1.0 / count;
+    auto trace = [&](int photons, std::vector<photon_t>& out) {
+        for(int i = 0; i < photons; i++) {
+            ray_t ray;
+            color_t power;
+            if(!start_photon(scene, emitters, target, ray, power)) {
+                continue;
+            }
+            power = power * scale;
+
+            // through specular surfaces only, until it lands somewhere diffuse
+            for(int bounce = 0; bounce < max_photon_bounces; bounce++) {
+                hit_record_t rec{};
+                if(!scene.root->hit(ray, 0.001, infinity, rec)) {
+                    break;
+                }
+                if(receives(*rec.mat)) {
+                    if(bounce > 0) {
+                        photon_t photon;
+                        photon.p = glm::vec3(rec.p);
+                        photon.direction = glm::vec3(normalize(ray.direction()));
+                        photon.normal = glm::vec3(rec.normal);
+                        photon.power = glm::vec3(power.r, power.g, power.b);
+                        out.push_back(photon);
+                    }
+                    break;
+                }
+                bsdf_sample_t s;
+                if(!rec.mat->sample(ray, rec, s) || !s.specular) {
+                    break;
+                }
+                power = power * s.weight;
+                ray = ray_t(rec.p, s.direction, ray.time());
+            }
+        }
+    };
+
+#ifdef THREADS
+    const int threads = std::clamp(settings.num_threads, 1, count);
+    std::vector<std::vector<photon_t>> found(threads);
+    std::vector<std::thread> workers;
+    for(int t = 1; t < threads; t++) {
+        workers.emplace_back(trace, count / threads, std::ref(found[t]));
+    }
+    trace(count / threads + count % threads, found[0]);
+    for(auto& w : workers) {
+        w.join();
+    }
+    size_t stored = 0;
+    for(const auto& f : found) {
+        stored += f.size();
+    }
+    m_photons.reserve(stored);
+    for(const auto& f : found) {
+        m_photons.insert(m_photons.end(), f.begin(), f.end());
+    }
+#else
+    trace(count, m_photons);
+#endif
+
+    build(0, m_photons.size());
+
+    // the first pass's radius is twice the typical distance to the nearest photons
+    // (unless it's been set), so sparse areas still get estimates
+    if(m_radius <= 0.0 && !m_photons.empty()) {
+        m_radius = settings.caustic_radius;
+    }
+    if(m_radius <= 0.0 && !m_photons.empty()) {
+        std::vector<float> distances;
+        const size_t step = std::max<size_t>(1, m_photons.size() / 256);
+        neighbours_t found_near;
+        for(size_t i = 0; i < m_photons.size(); i += step) {
+            float max_distance2 = std::numeric_limits<float>::max();
+            found_near.clear();
+            nearest(m_photons[i].p, m_photons[i].normal, 0, m_photons.size(), max_distance2, found_near);
+            distances.push_back(sqrt(found_near.front().first));
+        }
+        std::nth_element(distances.begin(), distances.begin() + distances.size() / 2, distances.end());
+        m_radius = std::max(2.0 * distances[distances.size() / 2], 1e-6 * target.radius);
+    }
+}
+
+void photon_map_t::build(size_t begin, size_t end) {
+    if(end - begin <= 1) {
+        return;
+    }
+
+    glm::vec3 lo(std::numeric_limits<float>::max());
+    glm::vec3 hi(std::numeric_limits<float>::lowest());
+    for(size_t i = begin; i < end; i++) {
+        lo = glm::min(lo, m_photons[i].p);
+        hi = glm::max(hi, m_photons[i].p);
+    }
+    const glm::vec3 extent = hi - lo;
+    const uint8_t axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+    const size_t mid = begin + (end - begin) / 2;
+    std::nth_element(m_photons.begin() + begin, m_photons.begin() + mid, m_photons.begin() + end,
+                     [axis](const photon_t& a, const photon_t& b) { return a.p[axis] < b.p[axis]; });
+    m_photons[mid].axis = axis;
+    build(begin, mid);
+    build(mid + 1, end);
+}
+
+void photon_map_t::nearest(const glm::vec3& p, const glm::vec3& normal, size_t begin, size_t end,
+                           float& max_distance2, neighbours_t& found) const {
+    if(begin >= end) {
+        return;
+    }
+    const size_t mid = begin + (end - begin) / 2;
+    const photon_t& photon = m_photons[mid];
+
+    const glm::vec3 offset = p - photon.p;
+    const float distance2 = glm::dot(offset, offset);
+    if(distance2 < max_distance2 && glm::dot(normal, photon.normal) > same_surface) {
+        found.emplace_back(distance2, static_cast<uint32_t>(mid));
+        std::push_heap(found.begin(), found.end());
+        if(found.size() > m_nearest) {
+            std::pop_heap(found.begin(), found.end());
+            found.pop_back();
+        }
+        if(found.size() == m_nearest) {
+            max_distance2 = found.front().first;
+        }
+    }
+
+    // the side p is on first, then the other if it's within reach
+    const float d = p[photon.axis] - photon.p[photon.axis];
+    const bool below = d < 0.0f;
+    nearest(p, normal, below ? begin : mid + 1, below ? mid : end, max_distance2, found);
+    if(d * d < max_distance2) {
+        nearest(p, normal, below ? mid + 1 : begin, below ? end : mid, max_distance2, found);
+    }
+}
+
+color_t photon_map_t::estimate(const ray_t& r_in, const hit_record_t& rec) const {
+    if(m_photons.empty() || m_radius <= 0.0) {
+        return {0, 0, 0};
+    }
+
+    thread_local neighbours_t found;
+    found.clear();
+    float max_distance2 = static_cast<float>(m_radius * m_radius);
+    nearest(glm::vec3(rec.p), glm::vec3(rec.normal), 0, m_photons.size(), max_distance2, found);
+    if(found.empty()) {
+        return {0, 0, 0};
+    }
+
+    // power per unit area, over the disk out to the farthest photon found (or the
+    // whole radius if there weren't enough to fill it). That photon sits on the disk's
+    // edge rather than inside it, so it's left out.
+    const bool full = found.size() == m_nearest && m_nearest > 1;
+    const double radius2 = full ? found.front().first : m_radius * m_radius;
+    const double area = g_pi * std::max(radius2, 1e-6 * m_radius * m_radius);
+    color_t sum(0, 0, 0);
+    for(size_t i = full ? 1 : 0; i < found.size(); i++) {
+        const photon_t& photon = m_photons[found[i].second];
+        const dvec3_t from = -dvec3_t(photon.direction);
+        const double cosine = dot(rec.normal, from);
+        if(cosine <= 0.0) {
+            continue;
+        }
+        // eval includes the cosine, which the photon's power already accounts for
+        sum += rec.mat->eval(r_in, rec, from) * color_t(photon.power.x, photon.power.y, photon.power.z) * (1.0 / cosine);
+    }
+    return sum * (1.0 / area);
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "material.h"
+#include "renderer.h"
+#include "scene.h"
+
+/**
+ * \brief Caustics by photon mapping. Each pass traces photons from the lights (and
+ * the environment or background) through glass and mirrors, and keeps the ones that
+ * then land on a diffuse surface: exactly the light that backward tracing only finds
+ * by a path from a diffuse surface happening to refract its way onto a small light.
+ * The path tracer asks for a density estimate from the nearest photons at every
+ * diffuse hit instead, and leaves those paths out.
+ *
+ * Photons are aimed at the bounds of the specular shapes (nothing else can start a
+ * caustic), traced in parallel, and kept in a kd-tree. The estimate uses the
+ * settings.caustic_nearest nearest photons within a radius that shrinks a little each
+ * pass (progressive photon mapping, Knaus and Zwicker 2011), so averaging the passes
+ * converges on the right answer rather than a blurred one.
+ */
+class photon_map_t {
+public:
+    /**
+     * \brief Replaces the photons with a new pass of settings.caustic_photons, traced on
+     * settings.num_threads threads, and shrinks the radius.
+     */
+    void emit(const scene_t& scene, const render_settings_t& settings);
+
+    /**
+     * \brief The caustic light arriving at rec and scattered back along r_in.
+     */
+    [[nodiscard]] color_t estimate(const ray_t& r_in, const hit_record_t& rec) const;
+
+    /**
+     * \brief True for the materials photons are stored on and estimates are made at.
+     */
+    [[nodiscard]] static bool receives(const material_t& mat) { return mat.samples_lights() && !mat.is_volumetric(); }
+
+    [[nodiscard]] size_t photon_count() const { return m_photons.size(); }
+    [[nodiscard]] int passes() const { return m_passes; }
+    [[nodiscard]] double radius() const { return m_radius; }
+    [[nodiscard]] size_t memory_bytes() const { return m_photons.capacity() * sizeof(photon_t); }
+
+protected:
+    struct photon_t {
+        glm::vec3 p;
+
+        // which way it was travelling, and the normal of the surface it landed on
+        // (facing the side it arrived from)
+        glm::vec3 direction;
+        glm::vec3 normal;
+        glm::vec3 power;
+
+        // the axis the kd-tree splits at this photon
+        uint8_t axis = 0;
+    };
+
+    // (squared distance, photon index), kept as a max heap
+    using neighbours_t = std::vector<std::pair<float, uint32_t>>;
+
+    /**
+     * \brief Makes [begin, end) of m_photons a balanced kd-tree, with the median of the
+     * widest axis in the middle.
+     */
+    void build(size_t begin, size_t end);
+
+    /**
+     * \brief Collects up to m_nearest photons within sqrt(max_distance2) of p, on
+     * surfaces facing the same way as normal. max_distance2 shrinks to the farthest
+     * one kept once there are m_nearest.
+     */
+    void nearest(const glm::vec3& p, const glm::vec3& normal, size_t begin, size_t end,
+                 float& max_distance2, neighbours_t& found) const;
+
+    std::vector<photon_t> m_photons;
+    size_t m_nearest = 32;
+    double m_radius = 0.0;
+    int m_passes = 0;
+};
@@ -0,0 +1,626 @@
+#include "primitive_store.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "box.h"
+#include "constant_medium.h"
+#include "hittable_list.h"
+#include "instance.h"
+#include "rect.h"
+#include "sphere.h"
+
+namespace {
+    // buckets per axis when looking for the cheapest split
+    constexpr int split_buckets = 12;
+
+    // past this depth nodes are split down the middle (see light_bvh_t)
+    constexpr int max_cost_split_depth = 48;
+
+    // nodes with this many shapes or fewer are leaves
+    constexpr size_t max_leaf_size = 2;
+
+    // deep enough for max_cost_split_depth, then halving any number of shapes
+    constexpr int max_stack = 128;
+
+    point3 box_center(const aabb_t& box) {
+        return (box.min() + box.max()) * 0.5;
+    }
+
+    double surface_area(const aabb_t& box) {
+        const dvec3_t d = box.max() - box.min();
+        return 2.0 * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    int bucket_of(const aabb_t& box, const aabb_t& centroids, int axis) {
+        const double t = (box_center(box)[axis] - centroids.min()[axis]) / (centroids.max()[axis] - centroids.min()[axis]);
+        return std::clamp(static_cast<int>(t * split_buckets), 0, split_buckets - 1);
+    }
+
+    // aabb_t::hit, with the direction's reciprocal worked out once per ray
+    bool hits_box(const aabb_t& box, const point3& origin, const dvec3_t& inv_direction, double t_min, double t_max) {
+        const point3 lo = box.min();
+        const point3 hi = box.max();
+        for(int a = 0; a < 3; a++) {
+            double t0 = (lo[a] - origin[a]) * inv_direction[a];
+            double t1 = (hi[a] - origin[a]) * inv_direction[a];
+            if(inv_direction[a] < 0.0) {
+                std::swap(t0, t1);
+            }
+            t_min = t0 > t_min ? t0 : t_min;
+            t_max = t1 < t_max ? t1 : t_max;
+            if(t_max <= t_min) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // the top level shapes, with lists opened up
+    void collect(const std::vector<shared_ptr<hittable_t>>& objects, std::vector<shared_ptr<hittable_t>>& out) {
+        for(const auto& object : objects) {
+            if(auto list = dynamic_cast<const hittable_list_t*>(object.get())) {
+                collect(list->objects, out);
+            } else if(object) {
+                out.push_back(object);
+            }
+        }
+    }
+
+    // A box_t's faces are rect_ts turned to face out of the box along each axis: the
+    // normal they report and which way their texture coordinates run, in the box's space
+    struct box_face_t {
+        dvec3_t normal;
+        dvec3_t u_axis, v_axis;
+
+        // the box's sides the face's width and height are along
+        int u_size, v_size;
+    };
+
+    // the negative then the positive side of each axis
+    constexpr box_face_t box_faces[6] = {
+        {{-1, 0, 0}, {0, 0, 1}, {0, 1, 0}, 2, 1},   // left, turned -90 degrees about y
+        {{1, 0, 0}, {0, 0, -1}, {0, 1, 0}, 2, 1},   // right, turned 90 degrees about y
+        {{0, -1, 0}, {1, 0, 0}, {0, 0, 1}, 0, 2},   // bottom, turned 90 degrees about x
+        {{0, 1, 0}, {1, 0, 0}, {0, 0, -1}, 0, 2},   // top, turned -90 degrees about x
+        {{0, 0, -1}, {-1, 0, 0}, {0, 1, 0}, 0, 1},  // back, turned 180 degrees about y
+        {{0, 0, 1}, {1, 0, 0}, {0, 1, 0}, 0, 1},    // front
+    };
+
+    ray_t transformed(const ray_t& r, const dmat4_t& transform) {
+        return {transform_point(r.origin(), transform), transform_vec(r.direction(), transform), r.time()};
+    }
+}
+
+primitive_store_t::primitive_store_t(const std::vector<shared_ptr<hittable_t>>& objects, double time0, double time1) {
+    std::vector<shared_ptr<hittable_t>> top;
+    collect(objects, top);
+    for(const auto& object : top) {
+        aabb_t box;
+        if(!object->bounding_box(time0, time1, box)) {
+            std::cerr << "No bounding box in primitive_store constructor.\n";
+            continue;
+        }
+        m_build.emplace_back(add(object), box);
+    }
+
+    if(!m_build.empty()) {
+        m_nodes.reserve(m_build.size() * 2);
+        build_node(0, m_build.size(), 1);
+    }
+    m_build.clear();
+    m_build.shrink_to_fit();
+}
+
+uint32_t primitive_store_t::add_material(const shared_ptr<material_t>& material) {
+    m_materials.push_back(material);
+    return static_cast<uint32_t>(m_materials.size() - 1);
+}
+
+primitive_store_t::primitive_ref_t primitive_store_t::add(const shared_ptr<hittable_t>& object) {
+    m_objects.push_back(object);
+    const hittable_t* source = object.get();
+
+    if(auto sphere = dynamic_cast<const ::sphere_t*>(source)) {
+        sphere_data_t s;
+        s.center0 = sphere->center();
+        s.moving = sphere->moving();
+        s.center1 = s.moving ? sphere->center(sphere->time1()) : s.center0;
+        s.time0 = sphere->time0();
+        s.time1 = sphere->time1();
+        s.radius = sphere->radius();
+        s.material = add_material(sphere->material());
+        s.source = source;
+        m_spheres.push_back(s);
+        return {kind_t::sphere, static_cast<uint32_t>(m_spheres.size() - 1)};
+    }
+    if(auto rect = dynamic_cast<const ::rect_t*>(source)) {
+        const dmat4_t transform = rect->transform();
+        rect_data_t q;
+        q.center = transform_point(point3(0, 0, 0), transform);
+        q.normal = transform_vec(dvec3_t(0, 0, 1), transform);
+        q.u_axis = transform_vec(dvec3_t(1, 0, 0), transform);
+        q.v_axis = transform_vec(dvec3_t(0, 1, 0), transform);
+        q.width = rect->width();
+        q.height = rect->height();
+        q.material = add_material(rect->material());
+        q.source = source;
+        m_rects.push_back(q);
+        return {kind_t::rect, static_cast<uint32_t>(m_rects.size() - 1)};
+    }
+    if(auto box = dynamic_cast<const ::box_t*>(source)) {
+        box_data_t b;
+        b.transform = box->transform();
+        b.inverse = box->inverse_transform();
+        b.half_size = box->size() * 0.5;
+        b.material = add_material(box->material());
+        m_boxes.push_back(b);
+        return {kind_t::box, static_cast<uint32_t>(m_boxes.size() - 1)};
+    }
+    if(auto instance = dynamic_cast<const ::instance_t*>(source)) {
+        instance_data_t i;
+        i.transform = instance->transform();
+        i.inverse = instance->inverse_transform();
+        i.source = add(instance->source());
+        m_instances.push_back(i);
+        return {kind_t::instance, static_cast<uint32_t>(m_instances.size() - 1)};
+    }
+    if(auto medium = dynamic_cast<const constant_medium_t*>(source)) {
+        medium_data_t m;
+        m.boundary = add(medium->boundary);
+        m.neg_inv_density = medium->neg_inv_density;
+        m.material = add_material(medium->phase_function);
+        m.source = source;
+        m_media.push_back(m);
+        return {kind_t::medium, static_cast<uint32_t>(m_media.size() - 1)};
+    }
+
+    m_others.push_back(source);
+    return {kind_t::other, static_cast<uint32_t>(m_others.size() - 1)};
+}
+
+uint32_t primitive_store_t::build_node(size_t start, size_t end, int depth) {
+    m_depth = std::max(m_depth, depth);
+
+    const auto index = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.emplace_back();
+
+    aabb_t bounds = m_build[start].second;
+    aabb_t centroids(box_center(bounds), box_center(bounds));
+    for(size_t i = start + 1; i < end; i++) {
+        bounds = surrounding_box(bounds, m_build[i].second);
+        const point3 c = box_center(m_build[i].second);
+        centroids = surrounding_box(centroids, aabb_t(c, c));
+    }
+    m_nodes[index].box = bounds;
+
+    if(end - start <= max_leaf_size) {
+        m_nodes[index].first = static_cast<uint32_t>(m_leaf_refs.size());
+        m_nodes[index].count = static_cast<uint16_t>(end - start);
+        for(size_t i = start; i < end; i++) {
+            m_leaf_refs.push_back(m_build[i].first);
+        }
+        return index;
+    }
+
+    // find the cheapest bucket boundary on any axis, by surface area
+    int best_axis = -1;
+    int best_split = -1;
+    double best_cost = infinity;
+    const dvec3_t centroid_extent = centroids.max() - centroids.min();
+    for(int axis = 0; axis < 3 && depth < max_cost_split_depth; axis++) {
+        if(centroid_extent[axis] <= 0.0) {
+            continue;
+        }
+
+        aabb_t buckets[split_buckets];
+        size_t counts[split_buckets] = {};
+        for(size_t i = start; i < end; i++) {
+            const int b = bucket_of(m_build[i].second, centroids, axis);
+            buckets[b] = counts[b] > 0 ? surrounding_box(buckets[b], m_build[i].second) : m_build[i].second;
+            counts[b]++;
+        }
+
+        for(int split = 0; split < split_buckets - 1; split++) {
+            aabb_t below, above;
+            size_t count_below = 0, count_above = 0;
+            for(int b = 0; b < split_buckets; b++) {
+                if(counts[b] == 0) {
+                    continue;
+                }
+                aabb_t& side = b <= split ? below : above;
+                size_t& count = b <= split ? count_below : count_above;
+                side = count > 0 ? surrounding_box(side, buckets[b]) : buckets[b];
+                count += counts[b];
+            }
+            if(count_below == 0 || count_above == 0) {
+                continue;
+            }
+
+            const double cost = surface_area(below) * count_below + surface_area(above) * count_above;
+            if(cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = split;
+            }
+        }
+    }
+
+    size_t mid = (start + end) / 2;
+    int axis = centroid_extent.x >= centroid_extent.y && centroid_extent.x >= centroid_extent.z ? 0
+             : centroid_extent.y >= centroid_extent.z ? 1 : 2;
+    bool split = false;
+    if(best_axis >= 0) {
+        const auto first_above = std::partition(m_build.begin() + start, m_build.begin() + end, [&](const auto& entry) {
+            return bucket_of(entry.second, centroids, best_axis) <= best_split;
+        });
+        const auto split_at = static_cast<size_t>(first_above - m_build.begin());
+        if(split_at > start && split_at < end) {
+            mid = split_at;
+            axis = best_axis;
+            split = true;
+        }
+    }
+    if(!split) {
+        // no useful split (all the centers in one spot, or too deep), halve along the longest axis
+        std::nth_element(m_build.begin() + start, m_build.begin() + mid, m_build.begin() + end, [axis](const auto& a, const auto& b) {
+            return box_center(a.second)[axis] < box_center(b.second)[axis];
+        });
+    }
+
+    build_node(start, mid, depth + 1);
+    const uint32_t second = build_node(mid, end, depth + 1);
+    m_nodes[index].first = second;
+    m_nodes[index].axis = static_cast<uint8_t>(axis);
+    return index;
+}
+
+bool primitive_store_t::hit(const ray_t& r, double t_min, double t_max, hit_record_t& rec) const {
+    if(m_nodes.empty()) {
+        return false;
+    }
+    const point3 origin = r.origin();
+    const dvec3_t inv_direction = 1.0 / r.direction();
+
+    uint32_t stack[max_stack];
+    int top = 0;
+    uint32_t node = 0;
+    bool hit_anything = false;
+    while(true) {
+        const node_t& n = m_nodes[node];
+        if(hits_box(n.box, origin, inv_direction, t_min, t_max)) {
+            if(n.count == 0) {
+                // the nearer child first, so the further one is more likely culled
+                if(inv_direction[n.axis] < 0.0) {
+                    stack[top++] = node + 1;
+                    node = n.first;
+                } else {
+                    stack[top++] = n.first;
+                    node = node + 1;
+                }
+                continue;
+            }
+            for(uint32_t i = n.first; i < n.first + n.count; i++) {
+                if(hit_primitive(m_leaf_refs[i], r, t_min, t_max, rec)) {
+                    hit_anything = true;
+                    t_max = rec.t;
+                }
+            }
+        }
+        if(top == 0) {
+            break;
+        }
+        node = stack[--top];
+    }
+    return hit_anything;
+}
+
+double primitive_store_t::transmittance(const ray_t& r, double t_min, double t_max) const {
+    if(m_nodes.empty()) {
+        return 1.0;
+    }
+    const point3 origin = r.origin();
+    const dvec3_t inv_direction = 1.0 / r.direction();
+
+    uint32_t stack[max_stack];
+    int top = 0;
+    uint32_t node = 0;
+    double result = 1.0;
+    while(true) {
+        const node_t& n = m_nodes[node];
+        if(hits_box(n.box, origin, inv_direction, t_min, t_max)) {
+            if(n.count == 0) {
+                stack[top++] = n.first;
+                node = node + 1;
+                continue;
+            }
+            for(uint32_t i = n.first; i < n.first + n.count; i++) {
+                result *= primitive_transmittance(m_leaf_refs[i], r, t_min, t_max);
+                if(result <= 0.0) {
+                    return 0.0;
+                }
+            }
+        }
+        if(top == 0) {
+            break;
+        }
+        node = stack[--top];
+    }
+    return result;
+}
+
+bool primitive_store_t::bounding_box(double time0, double time1, aabb_t& output_box) const {
+    if(m_nodes.empty()) {
+        return false;
+    }
+    output_box = m_nodes[0].box;
+    return true;
+}
+
+size_t primitive_store_t::count(kind_t kind) const {
+    switch(kind) {
+        case kind_t::sphere: return m_spheres.size();
+        case kind_t::rect: return m_rects.size();
+        case kind_t::box: return m_boxes.size();
+        case kind_t::instance: return m_instances.size();
+        case kind_t::medium: return m_media.size();
+        case kind_t::other: return m_others.size();
+    }
+    return 0;
+}
+
+bool primitive_store_t::hit_primitive(primitive_ref_t ref, const ray_t& r, double t_min, double t_max, hit_record_t& rec) const {
+    switch(ref.kind) {
+        case kind_t::sphere:
+            return hit_sphere(m_spheres[ref.index], r, t_min, t_max, rec);
+        case kind_t::rect:
+            return hit_rect(m_rects[ref.index], r, t_min, t_max, rec);
+        case kind_t::box:
+            return hit_box(m_boxes[ref.index], r, t_min, t_max, rec);
+        case kind_t::instance: {
+            const instance_data_t& i = m_instances[ref.index];
+            if(!hit_primitive(i.source, transformed(r, i.inverse), t_min, t_max, rec)) {
+                return false;
+            }
+            rec.p = transform_point(rec.p, i.transform);
+            rec.normal = transform_vec(rec.normal, i.transform);
+            rec.dpdu = transform_vec(rec.dpdu, i.transform);
+            rec.dpdv = transform_vec(rec.dpdv, i.transform);
+            return true;
+        }
+        case kind_t::medium:
+            return hit_medium(m_media[ref.index], r, t_min, t_max, rec);
+        case kind_t::other:
+            return m_others[ref.index]->hit(r, t_min, t_max, rec);
+    }
+    return false;
+}
+
+bool primitive_store_t::hit_sphere(const sphere_data_t& s, const ray_t& r, double t_min, double t_max, hit_record_t& rec) const {
+    const point3 center = s.moving ? s.center0 + ((r.time() - s.time0) / (s.time1 - s.time0)) * (s.center1 - s.center0) : s.center0;
+    const dvec3_t oc = r.origin() - center;
+    const double a = length2(r.direction());
+    const double half_b = dot(oc, r.direction());
+    const double c = length2(oc) - s.radius * s.radius;
+
+    const double discriminant = half_b * half_b - a * c;
+    if(discriminant < 0) {
+        return false;
+    }
+    const double sqrtd = sqrt(discriminant);
+
+    // the nearest root in range
+    double root = (-half_b - sqrtd) / a;
+    if(root < t_min || t_max < root) {
+        root = (-half_b + sqrtd) / a;
+        if(root < t_min || t_max < root) {
+            return false;
+        }
+    }
+
+    rec.t = root;
+    rec.p = r.at(rec.t);
+    const dvec3_t local = rec.p - center;
+    const dvec3_t outward_normal = local / s.radius;
+    rec.set_face_normal(r, outward_normal);
+    rec.uv = get_sphere_uv(outward_normal);
+
+    // as sphere_t::hit
+    const double rho = std::max(1e-9 * s.radius, sqrt(local.x * local.x + local.z * local.z));
+    rec.dpdu = 2 * g_pi * dvec3_t(local.z, 0, -local.x);
+    rec.dpdv = g_pi * dvec3_t(-local.x * local.y / rho, rho, -local.z * local.y / rho);
+    rec.mat = m_materials[s.material];
+    rec.object = s.source;
+    return true;
+}
+
+bool primitive_store_t::hit_rect(const rect_data_t& q, const ray_t& r, double t_min, double t_max, hit_record_t& rec) const {
+    const double t = dot(q.center - r.origin(), q.normal) / dot(r.direction(), q.normal);
+    if(!(t >= t_min && t <= t_max)) {
+        return false;
+    }
+    const point3 p = r.at(t);
+    const dvec3_t offset = p - q.center;
+    const double x = dot(offset, q.u_axis);
+    const double y = dot(offset, q.v_axis);
+    if(fabs(x) > q.width * 0.5 || fabs(y) > q.height * 0.5) {
+        return false;
+    }
+
+    rec.t = t;
+    rec.p = p;
+    rec.uv = dvec2_t(x / q.width + 0.5, y / q.height + 0.5);
+    rec.set_face_normal(r, q.normal);
+    rec.dpdu = q.u_axis * q.width;
+    rec.dpdv = q.v_axis * q.height;
+    rec.mat = m_materials[q.material];
+    rec.object = q.source;
+    return true;
+}
+
+bool primitive_store_t::hit_box(const box_data_t& b, const ray_t& r, double t_min, double t_max, hit_record_t& rec) const {
+    // a slab test in the box's space, keeping which side the ray goes in and out by
+    const ray_t local_ray = transformed(r, b.inverse);
+    const point3 origin = local_ray.origin();
+    const dvec3_t direction = local_ray.direction();
+    double t_enter = -infinity, t_exit = infinity;
+    int enter_axis = 0, exit_axis = 0;
+    for(int a = 0; a < 3; a++) {
+        const double inv = 1.0 / direction[a];
+        double t0 = (-b.half_size[a] - origin[a]) * inv;
+        double t1 = (b.half_size[a] - origin[a]) * inv;
+        if(inv < 0.0) {
+            std::swap(t0, t1);
+        }
+        if(t0 > t_enter) {
+            t_enter = t0;
+            enter_axis = a;
+        }
+        if(t1 < t_exit) {
+            t_exit = t1;
+            exit_axis = a;
+        }
+        if(t_exit < t_enter) {
+            return false;
+        }
+    }
+
+    // the first face in range, as the nearest of the six rects would be. Rays go in
+    // through the side they're heading away from, and out through the other.
+    double t;
+    int face_index;
+    if(t_enter >= t_min && t_enter <= t_max) {
+        t = t_enter;
+        face_index = enter_axis * 2 + (direction[enter_axis] < 0.0 ? 1 : 0);
+    } else if(t_exit >= t_min && t_exit <= t_max) {
+        t = t_exit;
+        face_index = exit_axis * 2 + (direction[exit_axis] > 0.0 ? 1 : 0);
+    } else {
+        return false;
+    }
+
+    const box_face_t& face = box_faces[face_index];
+    const point3 local_point = origin + t * direction;
+    const dvec3_t size = b.half_size * 2.0;
+    rec.t = t;
+    rec.p = transform_point(local_point, b.transform);
+    rec.uv = dvec2_t(dot(local_point, face.u_axis) / size[face.u_size] + 0.5, dot(local_point, face.v_axis) / size[face.v_size] + 0.5);
+    rec.set_face_normal(r, transform_vec(face.normal, b.transform));
+    rec.dpdu = transform_vec(face.u_axis * size[face.u_size], b.transform);
+    rec.dpdv = transform_vec(face.v_axis * size[face.v_size], b.transform);
+    rec.mat = m_materials[b.material];
+    rec.object = nullptr;
+    return true;
+}
+
+bool primitive_store_t::hit_medium(const medium_data_t& m, const ray_t& r, double t_min, double t_max, hit_record_t& rec) const {
+    // as constant_medium_t::hit
+    double t_enter, t_exit;
+    if(!primitive_interval(m.boundary, r, t_enter, t_exit)) {
+        return false;
+    }
+    t_enter = std::max(t_enter, t_min);
+    t_exit = std::min(t_exit, t_max);
+    if(t_enter >= t_exit) {
+        return false;
+    }
+    t_enter = std::max(t_enter, 0.0);
+
+    const double ray_length = length(r.direction());
+    const double distance_inside_boundary = (t_exit - t_enter) * ray_length;
+    const double hit_distance = m.neg_inv_density * log(random_double());
+    if(hit_distance > distance_inside_boundary) {
+        return false;
+    }
+
+    rec.t = t_enter + hit_distance / ray_length;
+    rec.p = r.at(rec.t);
+    rec.normal = dvec3_t(1, 0, 0);  // arbitrary
+    rec.front_face = true;          // also arbitrary
+    rec.uv = dvec2_t(0, 0);
+    rec.dpdu = rec.dpdv = dvec3_t(0, 0, 0);
+    rec.mat = m_materials[m.material];
+    rec.object = nullptr;
+    return true;
+}
+
+bool primitive_store_t::primitive_interval(primitive_ref_t ref, const ray_t& r, double& t_enter, double& t_exit) const {
+    switch(ref.kind) {
+        case kind_t::sphere: {
+            const sphere_data_t& s = m_spheres[ref.index];
+            const point3 center = s.moving ? s.center0 + ((r.time() - s.time0) / (s.time1 - s.time0)) * (s.center1 - s.center0) : s.center0;
+            const dvec3_t oc = r.origin() - center;
+            const double a = length2(r.direction());
+            const double half_b = dot(oc, r.direction());
+            const double c = length2(oc) - s.radius * s.radius;
+            const double discriminant = half_b * half_b - a * c;
+            if(discriminant <= 0) {
+                return false;
+            }
+            const double sqrtd = sqrt(discriminant);
+            t_enter = (-half_b - sqrtd) / a;
+            t_exit = (-half_b + sqrtd) / a;
+            return true;
+        }
+        case kind_t::box: {
+            const box_data_t& b = m_boxes[ref.index];
+            const ray_t local_ray = transformed(r, b.inverse);
+            t_enter = -infinity;
+            t_exit = infinity;
+            for(int a = 0; a < 3; a++) {
+                const double inv = 1.0 / local_ray.direction()[a];
+                double t0 = (-b.half_size[a] - local_ray.origin()[a]) * inv;
+                double t1 = (b.half_size[a] - local_ray.origin()[a]) * inv;
+                if(inv < 0.0) {
+                    std::swap(t0, t1);
+                }
+                t_enter = std::max(t_enter, t0);
+                t_exit = std::min(t_exit, t1);
+                if(t_exit <= t_enter) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case kind_t::instance: {
+            const instance_data_t& i = m_instances[ref.index];
+            return primitive_interval(i.source, transformed(r, i.inverse), t_enter, t_exit);
+        }
+        case kind_t::rect:
+            return m_rects[ref.index].source->interval(r, t_enter, t_exit);
+        case kind_t::medium:
+            return m_media[ref.index].source->interval(r, t_enter, t_exit);
+        case kind_t::other:
+            return m_others[ref.index]->interval(r, t_enter, t_exit);
+    }
+    return false;
+}
+
+double primitive_store_t::primitive_transmittance(primitive_ref_t ref, const ray_t& r, double t_min, double t_max) const {
+    switch(ref.kind) {
+        case kind_t::medium: {
+            // Beer-Lambert through the part of the boundary between t_min and t_max
+            const medium_data_t& m = m_media[ref.index];
+            double t_enter, t_exit;
+            if(!primitive_interval(m.boundary, r, t_enter, t_exit)) {
+                return 1.0;
+            }
+            t_enter = std::max(t_enter, t_min);
+            t_exit = std::min(t_exit, t_max);
+            if(t_enter >= t_exit) {
+                return 1.0;
+            }
+            return exp((t_exit - t_enter) * length(r.direction()) / m.neg_inv_density);
+        }
+        case kind_t::instance: {
+            const instance_data_t& i = m_instances[ref.index];
+            return primitive_transmittance(i.source, transformed(r, i.inverse), t_min, t_max);
+        }
+        case kind_t::other:
+            return m_others[ref.index]->transmittance(r, t_min, t_max);
+        default: {
+            hit_record_t rec{};
+            return hit_primitive(ref, r, t_min, t_max, rec) ? 0.0 : 1.0;
+        }
+    }
+}
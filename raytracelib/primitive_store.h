@@ -0,0 +1,136 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "hittable.h"
+
+/**
+ * \brief The scene's shapes compiled into one flat structure for tracing: an array
+ * per kind of shape (spheres, rects, boxes, instances, media) holding just what
+ * intersecting it needs, and a BVH in one array whose leaves refer to shapes by kind
+ * and index. Intersection switches on the kind rather than making a virtual call
+ * through a shared_ptr at every node and shape, and a box is one slab test rather
+ * than six rects behind a hittable_list_t.
+ *
+ * The hittable_t classes are still how scenes are made; this is built from them once
+ * they're all added (see scene_t::build) and gives the same hits. Shapes it has no
+ * kind for (grid media, lists nested in lists) are kept as they are and called
+ * through hittable_t, in the same tree.
+ */
+class primitive_store_t : public hittable_t {
+public:
+    enum class kind_t : uint8_t {
+        sphere,
+        rect,
+        box,
+        instance,
+        medium,
+        other
+    };
+
+    // a shape: which array, and where in it
+    struct primitive_ref_t {
+        kind_t kind = kind_t::other;
+        uint32_t index = 0;
+    };
+
+    primitive_store_t(const std::vector<shared_ptr<hittable_t>>& objects, double time0, double time1);
+
+    bool hit(const ray_t& r, double t_min, double t_max, hit_record_t& rec) const override;
+    bool bounding_box(double time0, double time1, aabb_t& output_box) const override;
+    [[nodiscard]] double transmittance(const ray_t& r, double t_min, double t_max) const override;
+
+    // how many shapes of a kind there are, including those only inside instances and media
+    [[nodiscard]] size_t count(kind_t kind) const;
+    [[nodiscard]] size_t node_count() const { return m_nodes.size(); }
+    [[nodiscard]] int depth() const { return m_depth; }
+
+protected:
+    struct sphere_data_t {
+        point3 center0;
+        point3 center1;
+        double time0, time1;
+        double radius;
+        bool moving;
+        uint32_t material;
+        const hittable_t* source;
+    };
+
+    // the rect's plane and axes in world space, so there's no ray to transform
+    struct rect_data_t {
+        point3 center;
+        dvec3_t normal;
+
+        // unit vectors along the rect's width and height
+        dvec3_t u_axis, v_axis;
+        double width, height;
+        uint32_t material;
+        const hittable_t* source;
+    };
+
+    struct box_data_t {
+        dmat4_t transform;
+        dmat4_t inverse;
+        dvec3_t half_size;
+        uint32_t material;
+    };
+
+    struct instance_data_t {
+        dmat4_t transform;
+        dmat4_t inverse;
+        primitive_ref_t source;
+    };
+
+    // a constant_medium_t
+    struct medium_data_t {
+        primitive_ref_t boundary;
+        double neg_inv_density;
+        uint32_t material;
+        const hittable_t* source;
+    };
+
+    struct node_t {
+        aabb_t box;
+
+        // leaves: the shapes are m_leaf_refs[first, first + count). Otherwise count is 0
+        // and the children are this node + 1 and first.
+        uint32_t first = 0;
+        uint16_t count = 0;
+
+        // the axis inner nodes were split along, to visit the nearer child first
+        uint8_t axis = 0;
+    };
+
+    // adds object's shapes to the arrays and returns a ref to it
+    primitive_ref_t add(const shared_ptr<hittable_t>& object);
+    uint32_t add_material(const shared_ptr<material_t>& material);
+
+    // builds the subtree over m_build[start, end) and returns its root
+    uint32_t build_node(size_t start, size_t end, int depth);
+
+    bool hit_primitive(primitive_ref_t ref, const ray_t& r, double t_min, double t_max, hit_record_t& rec) const;
+    bool hit_sphere(const sphere_data_t& s, const ray_t& r, double t_min, double t_max, hit_record_t& rec) const;
+    bool hit_rect(const rect_data_t& q, const ray_t& r, double t_min, double t_max, hit_record_t& rec) const;
+    bool hit_box(const box_data_t& b, const ray_t& r, double t_min, double t_max, hit_record_t& rec) const;
+    bool hit_medium(const medium_data_t& m, const ray_t& r, double t_min, double t_max, hit_record_t& rec) const;
+    bool primitive_interval(primitive_ref_t ref, const ray_t& r, double& t_enter, double& t_exit) const;
+    [[nodiscard]] double primitive_transmittance(primitive_ref_t ref, const ray_t& r, double t_min, double t_max) const;
+
+    std::vector<sphere_data_t> m_spheres;
+    std::vector<rect_data_t> m_rects;
+    std::vector<box_data_t> m_boxes;
+    std::vector<instance_data_t> m_instances;
+    std::vector<medium_data_t> m_media;
+    std::vector<const hittable_t*> m_others;
+
+    // what hit records point to, kept alive
+    std::vector<shared_ptr<material_t>> m_materials;
+    std::vector<shared_ptr<hittable_t>> m_objects;
+
+    std::vector<node_t> m_nodes;
+    std::vector<primitive_ref_t> m_leaf_refs;
+    int m_depth = 0;
+
+    // (ref, bounds) for each top level shape, only used while building
+    std::vector<std::pair<primitive_ref_t, aabb_t>> m_build;
+};
@@ -0,0 +1,170 @@
+#include "radiance_cache.h"
+
+#include <algorithm>
+#include <atomic>
+
+#ifdef THREADS
+#include <thread>
+#endif
+
+namespace {
+    // how many slots after its own a key may be put in, before a record is dropped
+    constexpr int max_probes = 8;
+
+    // grid coordinates get this many bits each in a key, and the level (of cell size)
+    // gets the rest. The smallest cells are 1 / 2^finest_bits of the scene across.
+    constexpr int coordinate_bits = 18;
+    constexpr int64_t max_coordinate = (int64_t(1) << coordinate_bits) - 1;
+    constexpr int finest_bits = 16;
+    constexpr int max_level = 15;
+
+    // mixes the bits of a key, so neighbouring cells land in unrelated slots
+    uint64_t hash(uint64_t k) {
+        k ^= k >> 30;
+        k *= 0xbf58476d1ce4e5b9ull;
+        k ^= k >> 27;
+        k *= 0x94d049bb133111ebull;
+        k ^= k >> 31;
+        return k;
+    }
+
+    // 0 to 5 for +x, -x, +y, -y, +z, -z: whichever normal is closest to
+    int facing(const dvec3_t& normal) {
+        const dvec3_t a = abs(normal);
+        const int axis = a.x >= a.y && a.x >= a.z ? 0 : (a.y >= a.z ? 1 : 2);
+        return axis * 2 + (normal[axis] < 0.0 ? 1 : 0);
+    }
+}
+
+radiance_cache_t::radiance_cache_t(const aabb_t& bounds, const camera_t& cam, radiance_cache_settings_t settings)
+    : m_settings(settings) {
+    const dvec3_t extent = bounds.max() - bounds.min();
+    m_cell = std::max(1e-9, std::max({extent.x, extent.y, extent.z}) / (1 << finest_bits));
+    m_origin = bounds.min() - dvec3_t(m_cell);
+    m_eye = cam.origin();
+    m_spread = cam.pixel_angle() * m_settings.cell_pixels;
+
+    size_t entries = 1;
+    while(entries * 2 * (sizeof(entry_t) + sizeof(uint32_t)) <= m_settings.max_bytes) {
+        entries *= 2;
+    }
+    m_entries.resize(entries);
+    m_claimed.resize(entries);
+}
+
+int radiance_cache_t::level(const point3& p) const {
+    const double size = length(p - m_eye) * m_spread;
+    if(!(size > m_cell)) {
+        return 0;
+    }
+    return std::min(max_level, static_cast<int>(ceil(log2(size / m_cell))));
+}
+
+double radiance_cache_t::cell_size(const point3& p) const {
+    return ldexp(m_cell, level(p));
+}
+
+uint64_t radiance_cache_t::key(const point3& p, const dvec3_t& normal) const {
+    const int l = level(p);
+    const dvec3_t cell = floor((p - m_origin) / ldexp(m_cell, l));
+    uint64_t k = static_cast<uint64_t>(l);
+    for(int axis = 0; axis < 3; axis++) {
+        const auto c = static_cast<int64_t>(std::clamp(cell[axis], 0.0, static_cast<double>(max_coordinate)));
+        k = (k << coordinate_bits) | static_cast<uint64_t>(c);
+    }
+    // the top bit keeps every key off 0, which marks a free entry
+    return k | static_cast<uint64_t>(facing(normal)) << (3 * coordinate_bits + 4) | (uint64_t(1) << 63);
+}
+
+void radiance_cache_t::record(const point3& p, const dvec3_t& normal, const color_t& radiance) {
+    if(!std::isfinite(radiance.r) || !std::isfinite(radiance.g) || !std::isfinite(radiance.b)) {
+        return;
+    }
+    const uint64_t k = key(p, normal);
+    const size_t mask = m_entries.size() - 1;
+    const size_t first = hash(k) & mask;
+    for(int probe = 0; probe < max_probes; probe++) {
+        entry_t& e = m_entries[(first + probe) & mask];
+        std::atomic_ref<uint64_t> entry_key(e.key);
+        uint64_t found = entry_key.load(std::memory_order_relaxed);
+        if(found == 0) {
+            // claim it, unless another thread just did (perhaps for the same cell)
+            if(entry_key.compare_exchange_strong(found, k, std::memory_order_relaxed)) {
+                found = k;
+                const uint32_t claimed = std::atomic_ref<uint32_t>(m_claimed_count).fetch_add(1, std::memory_order_relaxed);
+                m_claimed[claimed] = static_cast<uint32_t>((first + probe) & mask);
+            }
+        }
+        if(found != k) {
+            continue;
+        }
+        std::atomic_ref<float>(e.sum[0]).fetch_add(static_cast<float>(radiance.r), std::memory_order_relaxed);
+        std::atomic_ref<float>(e.sum[1]).fetch_add(static_cast<float>(radiance.g), std::memory_order_relaxed);
+        std::atomic_ref<float>(e.sum[2]).fetch_add(static_cast<float>(radiance.b), std::memory_order_relaxed);
+        std::atomic_ref<uint32_t>(e.count).fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    std::atomic_ref<uint64_t>(m_dropped).fetch_add(1, std::memory_order_relaxed);
+}
+
+bool radiance_cache_t::lookup(const point3& p, const dvec3_t& normal, color_t& radiance) const {
+    // along the surface only, as off it there's nothing recorded
+    dvec3_t jitter(random_double() - 0.5, random_double() - 0.5, random_double() - 0.5);
+    jitter -= dot(jitter, normal) * normal;
+    const uint64_t k = key(p + jitter * cell_size(p), normal);
+    const size_t mask = m_entries.size() - 1;
+    const size_t first = hash(k) & mask;
+    for(int probe = 0; probe < max_probes; probe++) {
+        // the totals only change in end_pass, so only the key needs an atomic read
+        const entry_t& e = m_entries[(first + probe) & mask];
+        const uint64_t found = std::atomic_ref<uint64_t>(const_cast<uint64_t&>(e.key)).load(std::memory_order_relaxed);
+        if(found == 0) {
+            return false;
+        }
+        if(found != k) {
+            continue;
+        }
+        if(e.total_count < m_settings.min_samples) {
+            return false;
+        }
+        const double scale = 1.0 / e.total_count;
+        radiance = color_t(e.total[0] * scale, e.total[1] * scale, e.total[2] * scale);
+        return true;
+    }
+    return false;
+}
+
+void radiance_cache_t::end_pass(int threads) {
+    const size_t claimed = m_claimed_count;
+    auto publish = [&](size_t first, size_t step) {
+        for(size_t i = first; i < claimed; i += step) {
+            entry_t& e = m_entries[m_claimed[i]];
+            if(e.count == 0) {
+                continue;
+            }
+            for(int c = 0; c < 3; c++) {
+                e.total[c] += e.sum[c];
+                e.sum[c] = 0.0f;
+            }
+            e.total_count += e.count;
+            e.count = 0;
+        }
+    };
+
+#ifdef THREADS
+    threads = std::clamp(threads, 1, static_cast<int>(std::max<size_t>(1, claimed)));
+    std::vector<std::thread> workers;
+    for(int t = 1; t < threads; t++) {
+        workers.emplace_back(publish, t, threads);
+    }
+    publish(0, threads);
+    for(auto& w : workers) {
+        w.join();
+    }
+#else
+    (void)threads;
+    publish(0, 1);
+#endif
+
+    m_passes++;
+}
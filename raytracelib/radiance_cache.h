@@ -0,0 +1,114 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "aabb.h"
+#include "camera.h"
+#include "color.h"
+#include "material.h"
+#include "types.h"
+
+/**
+ * \brief Limits for radiance_cache_t.
+ */
+struct radiance_cache_settings_t {
+    // cells are about this many pixels across where the camera sees them (and as big
+    // as they'd be at the same distance elsewhere), so there are as many cells as the
+    // image can tell apart, and each sees plenty of paths every pass
+    double cell_pixels = 8.0;
+
+    // a cell answers lookups once this many path vertices have been recorded in it
+    uint32_t min_samples = 8;
+
+    // the table is allocated up front at the largest power of two entries under this
+    size_t max_bytes = 32u << 20;
+};
+
+/**
+ * \brief Remembers how much light diffuse surfaces send back, so paths can stop at a
+ * surface the cache knows about instead of tracing the rest of the way. A hash table
+ * keyed by the cell of a grid over the scene and which way the surface faces (the
+ * nearest axis direction), so the cells only exist where there are surfaces. Cells
+ * double in size with distance from the camera, in steps, so they cover about the
+ * same number of pixels wherever they are.
+ *
+ * Paths record the light gathered at each diffuse surface they hit, and a pass ends
+ * with end_pass(), after which everything recorded so far is what lookups see. The
+ * paths that stop in the cache record too, so each pass adds another bounce of light.
+ * Recording takes no locks: entries are claimed and summed with atomics, and a record
+ * that can't find room near its slot is dropped.
+ */
+class radiance_cache_t {
+public:
+    radiance_cache_t(const aabb_t& bounds, const camera_t& cam, radiance_cache_settings_t settings = {});
+
+    /**
+     * \brief Records radiance leaving p (on a surface facing normal) towards a path.
+     * Thread safe against other record() and lookup() calls.
+     */
+    void record(const point3& p, const dvec3_t& normal, const color_t& radiance);
+
+    /**
+     * \brief The average radiance recorded near p before the last end_pass(). The
+     * point is jittered along the surface by up to half a cell first, which blurs the cell
+     * edges.
+     * \return false if the cell hasn't seen enough yet
+     */
+    bool lookup(const point3& p, const dvec3_t& normal, color_t& radiance) const;
+
+    /**
+     * \brief Makes everything recorded so far visible to lookup(). Must not run at the
+     * same time as anything else.
+     * \param threads how many threads to go through the table with
+     */
+    void end_pass(int threads);
+
+    /**
+     * \brief True for the materials paths record at and stop in the cache at.
+     */
+    [[nodiscard]] static bool caches(const material_t& mat) { return mat.is_diffuse(); }
+
+    [[nodiscard]] int passes() const { return m_passes; }
+    // the size of the cells around p
+    [[nodiscard]] double cell_size(const point3& p) const;
+    [[nodiscard]] size_t capacity() const { return m_entries.size(); }
+    [[nodiscard]] size_t entry_count() const { return m_claimed_count; }
+    [[nodiscard]] size_t memory_bytes() const {
+        return m_entries.capacity() * sizeof(entry_t) + m_claimed.capacity() * sizeof(uint32_t);
+    }
+
+    // records that found no room in the table
+    [[nodiscard]] uint64_t dropped() const { return m_dropped; }
+
+protected:
+    struct entry_t {
+        // the cell and facing, or 0 while the entry is free
+        uint64_t key = 0;
+
+        // recorded this pass, and before it
+        float sum[3] = {0, 0, 0};
+        uint32_t count = 0;
+        float total[3] = {0, 0, 0};
+        uint32_t total_count = 0;
+    };
+
+    // which power of two of m_cell the cells around p are
+    [[nodiscard]] int level(const point3& p) const;
+
+    [[nodiscard]] uint64_t key(const point3& p, const dvec3_t& normal) const;
+
+    point3 m_origin;
+    point3 m_eye;
+    double m_cell = 1.0;
+    double m_spread = 0.0;
+    radiance_cache_settings_t m_settings;
+    std::vector<entry_t> m_entries;
+
+    // the entries in use, in the order they were claimed, so end_pass() doesn't have
+    // to go through the whole table
+    std::vector<uint32_t> m_claimed;
+    uint32_t m_claimed_count = 0;
+
+    uint64_t m_dropped = 0;
+    int m_passes = 0;
+};
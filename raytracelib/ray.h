@@ -35,4 +35,27 @@ protected:
     dvec3_t m_orig;
     dvec3_t m_dir;
     double m_time;
+};
+
+/**
+ * \brief The rays beside a camera ray through the points one pixel across and one
+ * pixel up from it (ray differentials), for working out how much of a surface a pixel
+ * covers.
+ */
+struct ray_differential_t {
+    dvec3_t rx_origin;
+    dvec3_t rx_direction;
+    dvec3_t ry_origin;
+    dvec3_t ry_direction;
+
+    /**
+     * \brief Moves the rays towards r, to scale times as far from it. With several
+     * samples in a pixel, each only needs to cover its share of the pixel.
+     */
+    void scale(const ray_t& r, double scale) {
+        rx_origin = r.origin() + (rx_origin - r.origin()) * scale;
+        rx_direction = r.direction() + (rx_direction - r.direction()) * scale;
+        ry_origin = r.origin() + (ry_origin - r.origin()) * scale;
+        ry_direction = r.direction() + (ry_direction - r.direction()) * scale;
+    }
 };
\ No newline at end of file
@@ -1,22 +1,507 @@
 #include "raytrace.h"
 
-color_t ray_color(const ray_t& r, const scene_t& scene, const hittable_t& world, int depth) {
-    hit_record_t rec{};
-    
-    if(depth <= 0) {
-        return {0, 0, 0, 1};
+namespace {
+    thread_local uint64_t t_rays_traced = 0;
+    thread_local uint64_t t_path_segments = 0;
+}
+
+uint64_t rays_traced_on_thread() {
+    return t_rays_traced;
+}
+
+uint64_t path_segments_on_thread() {
+    return t_path_segments;
+}
+
+void reset_rays_traced_on_thread() {
+    t_rays_traced = 0;
+    t_path_segments = 0;
+}
+
+double mis_weight(double pdf, double other_pdf, mis_heuristic_t heuristic) {
+    switch(heuristic) {
+        case mis_heuristic_t::none:
+            return 1.0;
+        case mis_heuristic_t::balance:
+            return pdf / (pdf + other_pdf);
+        case mis_heuristic_t::power:
+            return (pdf * pdf) / (pdf * pdf + other_pdf * other_pdf);
+    }
+    return 1.0;
+}
+
+namespace {
+    // the normal the light tree weighs lights by, which media don't have
+    dvec3_t light_tree_normal(const hit_record_t& rec) {
+        return rec.mat->is_volumetric() ? dvec3_t(0, 0, 0) : rec.normal;
     }
 
-    if (!world.hit(r, 0.001, infinity, rec)) {
-        return scene.background;
+    /**
+     * \brief Picks one of the scene's lights to sample from p.
+     * \return the light's index, or -1 if there's nothing worth sampling
+     */
+    int pick_light(const scene_t& scene, bool use_tree, const point3& p, const dvec3_t& n, double& pmf) {
+        if(use_tree) {
+            return scene.light_tree.pick(p, n, random_double(), pmf);
+        }
+        pmf = 1.0 / static_cast<double>(scene.lights.size());
+        return static_cast<int>(std::min(scene.lights.size() - 1, static_cast<size_t>(random_double() * static_cast<double>(scene.lights.size()))));
     }
 
-    ray_t scattered;
-    color_t attenuation;
-    color_t emitted = rec.mat->emitted(rec.uv.x, rec.uv.y, rec.p);
+    // the probability pick_light returns light
+    double light_pick_pmf(const scene_t& scene, bool use_tree, const point3& p, const dvec3_t& n, int light) {
+        if(use_tree) {
+            return scene.light_tree.pmf(p, n, light);
+        }
+        return 1.0 / static_cast<double>(scene.lights.size());
+    }
+
+    // the chance next event estimation samples the environment rather than the other lights
+    double environment_pick_probability(const scene_t& scene) {
+        if(!scene.environment) {
+            return 0.0;
+        }
+        return scene.lights.empty() ? 1.0 : 0.5;
+    }
+
+    /**
+     * \brief The density the next direction from rec is picked with: the BSDF's, mixed
+     * with the guide's where there is one.
+     */
+    double direction_pdf(const ray_t& r_in, const hit_record_t& rec, const dvec3_t& direction,
+                         const directional_tree_t* guide, const render_settings_t& settings) {
+        const double bsdf_pdf = rec.mat->pdf(r_in, rec, direction);
+        if(!guide) {
+            return bsdf_pdf;
+        }
+        return settings.guiding_fraction * guide->pdf(direction) + (1.0 - settings.guiding_fraction) * bsdf_pdf;
+    }
+
+    /**
+     * \brief The light arriving at rec from a sampled point in direction, distance away
+     * (infinity for the environment), if nothing's in the way.
+     * \param pdf the density the direction was picked with, including picking the light
+     */
+    color_t shade_light_sample(const ray_t& r_in, const hit_record_t& rec, const scene_t& scene, const render_settings_t& settings,
+                               const dvec3_t& direction, double distance, const color_t& emitted, double pdf,
+                               const directional_tree_t* guide) {
+        const color_t f = rec.mat->eval(r_in, rec, direction);
+        if(f.r <= 0 && f.g <= 0 && f.b <= 0) {
+            return {0, 0, 0};
+        }
 
-    if (!rec.mat->scatter(r, rec, attenuation, scattered))
-        return emitted;
+        const double visible = shadow_transmittance(scene, rec.p, direction, distance, r_in.time());
+        if(visible <= 0.0) {
+            return {0, 0, 0};
+        }
+
+        const double weight = mis_weight(pdf, direction_pdf(r_in, rec, direction, guide, settings), settings.mis);
+        return f * emitted * (visible * weight / pdf);
+    }
+}
+
+double shadow_transmittance(const scene_t& scene, const point3& from, const dvec3_t& direction, double distance, double time) {
+    // stop just short of the light itself
+    t_rays_traced++;
+    const double t_max = distance == infinity ? infinity : distance * (1.0 - 1e-6);
+    return scene.root->transmittance(ray_t(from, direction, time), 0.001, t_max);
+}
+
+bool sample_light_point(const scene_t& scene, const render_settings_t& settings, const hit_record_t& rec, double time, light_point_t& point) {
+    const double environment_probability = environment_pick_probability(scene);
+    if(environment_probability > 0.0 && random_double() < environment_probability) {
+        environment_sample_t sample;
+        if(!scene.environment->sample(sample) || sample.pdf <= 0) {
+            return false;
+        }
+        point.environment = true;
+        point.p = sample.direction;
+        point.normal = -sample.direction;
+        point.emitted = sample.radiance;
+        point.pdf = sample.pdf * environment_probability;
+        return true;
+    }
+
+    if(scene.lights.empty()) {
+        return false;
+    }
+
+    double pick_pmf = 0.0;
+    const int index = pick_light(scene, settings.light_tree, rec.p, light_tree_normal(rec), pick_pmf);
+    if(index < 0) {
+        return false;
+    }
+
+    light_sample_t sample;
+    if(!scene.lights[index]->sample_light(rec.p, time, sample) || sample.pdf <= 0) {
+        return false;
+    }
+
+    // from a density over solid angle (as seen from rec) to one over the light's area
+    const dvec3_t to_light = sample.p - rec.p;
+    const double distance_squared = length2(to_light);
+    const double cosine = fabs(dot(sample.normal, to_light)) / sqrt(distance_squared);
+    if(cosine <= 0.0) {
+        return false;
+    }
+    point.environment = false;
+    point.p = sample.p;
+    point.normal = sample.normal;
+    point.emitted = sample.emitted;
+    point.pdf = sample.pdf * cosine / distance_squared * pick_pmf * (1.0 - environment_probability);
+    return true;
+}
+
+color_t sample_direct_light(const ray_t& r_in, const hit_record_t& rec, const scene_t& scene, const render_settings_t& settings,
+                            const directional_tree_t* guide) {
+    const double environment_probability = environment_pick_probability(scene);
+    if(environment_probability > 0.0 && random_double() < environment_probability) {
+        environment_sample_t sample;
+        if(!scene.environment->sample(sample) || sample.pdf <= 0) {
+            return {0, 0, 0};
+        }
+        return shade_light_sample(r_in, rec, scene, settings, sample.direction, infinity, sample.radiance, sample.pdf * environment_probability, guide);
+    }
+
+    if(scene.lights.empty()) {
+        return {0, 0, 0};
+    }
+
+    // pick a light, then a point on it
+    double pick_pmf = 0.0;
+    const int index = pick_light(scene, settings.light_tree, rec.p, light_tree_normal(rec), pick_pmf);
+    if(index < 0) {
+        return {0, 0, 0};
+    }
+    const hittable_t& light = *scene.lights[index];
+
+    light_sample_t sample;
+    if(!light.sample_light(rec.p, r_in.time(), sample) || sample.pdf <= 0) {
+        return {0, 0, 0};
+    }
+    const double light_pdf = sample.pdf * pick_pmf * (1.0 - environment_probability);
+
+    const dvec3_t to_light = sample.p - rec.p;
+    const double distance = length(to_light);
+    return shade_light_sample(r_in, rec, scene, settings, to_light / distance, distance, sample.emitted, light_pdf, guide);
+}
+
+namespace {
+    /**
+     * \brief Where a path has got to.
+     */
+    struct path_t {
+        ray_t ray;
+        color_t throughput {1, 1, 1};
+
+        // what the throughput was scaled by when the path was split, which roulette
+        // leaves out so split paths aren't killed off any more often than whole ones
+        double split_scale = 1.0;
+
+        // set when the previous surface sampled the lights directly, so the sampled
+        // lights' light has (partly, with MIS) been counted already. prev_pdf is the
+        // density the BSDF picked the current ray's direction with, and prev_normal is
+        // what the light tree weighed the lights by there.
+        bool prev_sampled_lights = false;
+        double prev_pdf = 0.0;
+        dvec3_t prev_normal {0, 0, 0};
+
+        // when set, the direct light at the first surface is left to a resampling pass
+        // (see ray_color_deferring_direct), which is recorded in first_hit.
+        // prev_deferred_direct means the pass has all of the light the current ray
+        // could find, so none of it is counted here.
+        bool defer_first_direct = false;
+        bool prev_deferred_direct = false;
+        primary_hit_t* first_hit = nullptr;
+
+        // where the path scattered, for recording into the guide once it's known how
+        // much light came back along each direction
+        struct vertex_t {
+            point3 p;
+            dvec3_t direction;
+            double pdf;
+
+            // the path throughput after the vertex, and the radiance gathered before it
+            color_t throughput;
+            color_t radiance;
+        };
+        path_guide_t* guide = nullptr;
+        std::vector<vertex_t> vertices;
+
+        // with a photon map, caustics are gathered at every diffuse surface, so light
+        // found after one by a chain of specular bounces has already been counted.
+        // caustic_gathered: the last non-specular bounce gathered; specular_since: and
+        // there's been a specular one since.
+        const photon_map_t* caustics = nullptr;
+        bool caustic_gathered = false;
+        bool specular_since = false;
+
+        // the diffuse surfaces the path gathered light at, for recording what each sent
+        // back along it into the radiance cache: the throughput the path arrived with,
+        // and the radiance gathered before it
+        struct cache_vertex_t {
+            point3 p;
+            dvec3_t normal;
+            color_t throughput;
+            color_t radiance;
+        };
+        radiance_cache_t* cache = nullptr;
+        std::vector<cache_vertex_t> cache_vertices;
+        int diffuse_bounces = 0;
+
+        // the camera ray's differentials, for filtering textures at the first hit
+        const ray_differential_t* differential = nullptr;
+
+        int bounce = 0;
+    };
+
+    color_t divide(const color_t& a, const color_t& b) {
+        auto d = [](double x, double y) { return y > 0.0 ? x / y : 0.0; };
+        return {d(a.r, b.r), d(a.g, b.g), d(a.b, b.b)};
+    }
+
+    /**
+     * \brief Picks the path's next direction at rec: from the material, or, where the
+     * guide has learnt something, from the guide settings.guiding_fraction of the time.
+     * s's pdf and weight are for the mix of the two, which is what was sampled.
+     */
+    bool sample_direction(const path_t& path, const hit_record_t& rec, const directional_tree_t* guide,
+                          const render_settings_t& settings, bsdf_sample_t& s) {
+        if(!guide) {
+            return rec.mat->sample(path.ray, rec, s);
+        }
+
+        if(random_double() < settings.guiding_fraction) {
+            double guide_pdf = 0.0;
+            s.direction = guide->sample(guide_pdf);
+            s.specular = false;
+            const double bsdf_pdf = rec.mat->pdf(path.ray, rec, s.direction);
+            s.pdf = settings.guiding_fraction * guide_pdf + (1.0 - settings.guiding_fraction) * bsdf_pdf;
+            if(s.pdf <= 0.0) {
+                return false;
+            }
+            s.weight = rec.mat->eval(path.ray, rec, s.direction) / s.pdf;
+            return true;
+        }
+
+        if(!rec.mat->sample(path.ray, rec, s)) {
+            return false;
+        }
+        if(!s.specular) {
+            const color_t f = s.weight * s.pdf;
+            s.pdf = settings.guiding_fraction * guide->pdf(s.direction) + (1.0 - settings.guiding_fraction) * s.pdf;
+            s.weight = f / s.pdf;
+        }
+        return true;
+    }
+
+    /**
+     * \brief Tells the guide how much light came back along each direction the path took.
+     */
+    void record_path(const path_t& path, const color_t& radiance) {
+        for(const auto& v : path.vertices) {
+            // the light arriving at the vertex along the direction is what was gathered
+            // after it, without the path throughput up to it
+            const color_t incident = divide(radiance - v.radiance, v.throughput);
+            path.guide->record(v.p, v.direction, static_cast<float>(luminance(incident) / v.pdf));
+        }
+    }
+
+    /**
+     * \brief Tells the radiance cache how much light each diffuse surface on the path
+     * sent back along it.
+     */
+    void record_cache(const path_t& path, const color_t& radiance) {
+        for(const auto& v : path.cache_vertices) {
+            path.cache->record(v.p, v.normal, divide(radiance - v.radiance, v.throughput));
+        }
+    }
+
+    /**
+     * \brief Gathers direct light at rec, then picks the path's next direction and
+     * plays Russian roulette with it. Or, far enough along, ends the path with what the
+     * radiance cache knows about rec.
+     * \return false if the path ends here
+     */
+    bool scatter_path(path_t& path, const hit_record_t& rec, color_t& radiance, const scene_t& scene, const render_settings_t& settings) {
+        const bool has_lights = !scene.lights.empty() || scene.environment;
+        const bool sample_lights = settings.next_event_estimation && has_lights && rec.mat->samples_lights();
+        const bool defer = sample_lights && path.bounce == 0 && path.defer_first_direct;
+
+        if(path.cache && radiance_cache_t::caches(*rec.mat)) {
+            color_t cached;
+            if(path.diffuse_bounces >= settings.radiance_cache_bounces && path.cache->lookup(rec.p, rec.normal, cached)) {
+                radiance += path.throughput * cached;
+                return false;
+            }
+            // a deferred first hit's total is missing its direct light
+            if(!defer) {
+                path.cache_vertices.push_back({rec.p, rec.normal, path.throughput, radiance});
+            }
+        }
+
+        if(defer) {
+            path.first_hit->ray = path.ray;
+            path.first_hit->rec = rec;
+            path.first_hit->deferred = true;
+        }
+
+        // the guide only helps where the material can be sampled in any direction
+        const directional_tree_t* guide = path.guide && rec.mat->samples_lights() ? path.guide->distribution(rec.p) : nullptr;
+        if(sample_lights && !defer) {
+            radiance += path.throughput * sample_direct_light(path.ray, rec, scene, settings, guide);
+        }
+        const bool gather_caustics = path.caustics && photon_map_t::receives(*rec.mat);
+        if(gather_caustics) {
+            radiance += path.throughput * path.caustics->estimate(path.ray, rec);
+        }
+
+        bsdf_sample_t s;
+        if (!sample_direction(path, rec, guide, settings, s)) {
+            return false;
+        }
+
+        path.throughput = path.throughput * s.weight;
+        if(s.specular) {
+            path.specular_since = true;
+        } else {
+            path.caustic_gathered = gather_caustics;
+            path.specular_since = false;
+            path.diffuse_bounces++;
+        }
+        path.prev_sampled_lights = sample_lights && !s.specular;
+        path.prev_deferred_direct = defer && !s.specular;
+        path.prev_pdf = s.pdf;
+        path.prev_normal = light_tree_normal(rec);
+        path.ray = ray_t(rec.p, s.direction, path.ray.time());
+        path.bounce++;
+
+        // past the minimum depth, dim paths are likely to stop, and the ones that survive
+        // are brightened to make up for the ones that didn't
+        if(settings.russian_roulette && path.bounce >= settings.roulette_min_depth) {
+            const double brightest = std::max({path.throughput.r, path.throughput.g, path.throughput.b}) / path.split_scale;
+            const double survive = std::min(brightest, 0.95);
+            if(random_double() >= survive) {
+                return false;
+            }
+            path.throughput = path.throughput / survive;
+        }
+
+        if(path.guide && !s.specular && rec.mat->samples_lights()) {
+            path.vertices.push_back({rec.p, s.direction, s.pdf, path.throughput, radiance});
+        }
+        return true;
+    }
+
+    color_t trace_path(path_t path, const scene_t& scene, const render_settings_t& settings) {
+        const hittable_t& world = *scene.root;
+        color_t radiance(0, 0, 0);
+
+        while(path.bounce < settings.max_bounces) {
+            hit_record_t rec{};
+
+            t_rays_traced++;
+            t_path_segments++;
+            // the photon map emits from the lights, the environment and the background
+            const bool caustic_counted = path.caustic_gathered && path.specular_since;
+
+            if (!world.hit(path.ray, 0.001, infinity, rec)) {
+                if(caustic_counted) {
+                    // the photon map has this
+                } else if(!scene.environment) {
+                    radiance += path.throughput * scene.background;
+                } else if(path.prev_deferred_direct) {
+                    // the resampling pass has this
+                } else if(!path.prev_sampled_lights) {
+                    radiance += path.throughput * scene.environment->radiance(path.ray.direction());
+                } else if(settings.mis != mis_heuristic_t::none) {
+                    // the environment was sampled directly at the last bounce too
+                    const double light_pdf = scene.environment->pdf(path.ray.direction()) * environment_pick_probability(scene);
+                    radiance += path.throughput * scene.environment->radiance(path.ray.direction()) * mis_weight(path.prev_pdf, light_pdf, settings.mis);
+                }
+                break;
+            }
+
+            if(path.bounce == 0 && path.differential) {
+                rec.set_uv_differentials(*path.differential);
+            }
+
+            if(rec.mat->is_emissive()) {
+                const color_t emitted = rec.mat->emitted(rec.uv.x, rec.uv.y, rec.p);
+                const int light = path.prev_sampled_lights ? scene.light_index(rec.object) : -1;
+                if(caustic_counted && scene.is_sampled_light(rec.object)) {
+                    // the photon map has this
+                } else if(light < 0) {
+                    radiance += path.throughput * emitted;
+                } else if(path.prev_deferred_direct) {
+                    // the resampling pass has this
+                } else if(settings.mis != mis_heuristic_t::none) {
+                    const ray_t& ray = path.ray;
+                    const double pick_pmf = light_pick_pmf(scene, settings.light_tree, ray.origin(), path.prev_normal, light);
+                    const double light_pdf = rec.object->light_pdf(ray.origin(), ray.direction(), ray.time()) * pick_pmf * (1.0 - environment_pick_probability(scene));
+                    radiance += path.throughput * emitted * mis_weight(path.prev_pdf, light_pdf, settings.mis);
+                }
+            }
+
+            // split at the first hit: several cheaper continuations share one (possibly
+            // expensive) camera ray and primary hit
+            const int splits = path.bounce == 0 ? settings.first_bounce_splits : 1;
+            if(splits > 1) {
+                for(int i = 0; i < splits; i++) {
+                    path_t branch = path;
+                    branch.split_scale = 1.0 / splits;
+                    branch.throughput = path.throughput * branch.split_scale;
+                    const size_t cache_vertices = branch.cache_vertices.size();
+                    if(scatter_path(branch, rec, radiance, scene, settings)) {
+                        // the branch gathers into a fresh total, so its guiding vertex
+                        // (recorded against this one) has to start from nothing too.
+                        // Its share of the light gathered here went into this total,
+                        // so the cache doesn't get this vertex from it.
+                        if(!branch.vertices.empty()) {
+                            branch.vertices.back().radiance = color_t(0, 0, 0);
+                        }
+                        branch.cache_vertices.resize(std::min(cache_vertices, branch.cache_vertices.size()));
+                        radiance += trace_path(branch, scene, settings);
+                    }
+                }
+                break;
+            }
+
+            if(!scatter_path(path, rec, radiance, scene, settings)) {
+                break;
+            }
+        }
+
+        if(!path.vertices.empty()) {
+            record_path(path, radiance);
+        }
+        if(!path.cache_vertices.empty()) {
+            record_cache(path, radiance);
+        }
+        return radiance;
+    }
+}
+
+color_t ray_color(const ray_t& r, const scene_t& scene, const render_settings_t& settings, path_guide_t* guide,
+                  const photon_map_t* caustics, radiance_cache_t* cache, const ray_differential_t* differential) {
+    path_t path;
+    path.ray = r;
+    path.guide = guide;
+    path.caustics = caustics;
+    path.cache = cache;
+    path.differential = differential;
+    return trace_path(path, scene, settings);
+}
 
-    return emitted + attenuation * ray_color(scattered, scene, world, depth-1);
+color_t ray_color_deferring_direct(const ray_t& r, const scene_t& scene, const render_settings_t& settings, primary_hit_t& primary,
+                                   const photon_map_t* caustics, radiance_cache_t* cache, const ray_differential_t* differential) {
+    primary.deferred = false;
+    path_t path;
+    path.ray = r;
+    path.caustics = caustics;
+    path.cache = cache;
+    path.differential = differential;
+    path.defer_first_direct = true;
+    path.first_hit = &primary;
+    return trace_path(path, scene, settings);
 }
@@ -10,13 +10,115 @@
 #include "sphere.h"
 #include "material.h"
 #include "scene.h"
+#include "film.h"
+#include "renderer.h"
+#include "path_guide.h"
+#include "photon_map.h"
+#include "radiance_cache.h"
 
 /**
- * \brief The main ray tracing function
- * \param r The ray to trace 
- * \param world The things to collide with
- * \param stack_depth How many bounces have we gone through
- * \param max_bounces The maximum number of bounces allowed
+ * \brief The main ray tracing function. Follows a path through the scene from r,
+ * up to settings.max_bounces long, and returns the light that arrives back along it.
+ * \param r The ray to trace
+ * \param scene The scene, which must have been built (see scene_t::build)
+ * \param settings the path tracing options (bounces, light sampling, roulette, splitting)
+ * \param guide if set, directions are sampled partly from what it has learnt (see
+ * settings.guiding_fraction), and the radiance the path finds is recorded into it
+ * \param caustics if set, diffuse surfaces gather light that came through glass and
+ * mirrors from it, and paths don't look for that light themselves
+ * \param cache if set, the light the path finds at diffuse surfaces is recorded into
+ * it, and past settings.radiance_cache_bounces diffuse bounces the path ends at the
+ * first surface the cache has an answer for
+ * \param differential if set, r's ray differentials, which textures at the first
+ * surface are filtered over
  * \return A color
  */
-color_t ray_color(const ray_t& r, const scene_t& scene, const hittable_t& world, int depth);
+color_t ray_color(const ray_t& r, const scene_t& scene, const render_settings_t& settings, path_guide_t* guide = nullptr,
+                  const photon_map_t* caustics = nullptr, radiance_cache_t* cache = nullptr,
+                  const ray_differential_t* differential = nullptr);
+
+/**
+ * \brief The first surface a camera ray hit, when its direct light is left to a
+ * separate pass.
+ */
+struct primary_hit_t {
+    ray_t ray;
+    hit_record_t rec;
+
+    // false if the ray didn't hit anything that samples lights (so there's nothing to add)
+    bool deferred = false;
+};
+
+/**
+ * \brief ray_color, except the direct light at the first surface (what next event
+ * estimation would have added there) is left out, for a resampling pass to add.
+ * \param primary where the first surface is recorded
+ * \param caustics, cache, differential as for ray_color
+ */
+color_t ray_color_deferring_direct(const ray_t& r, const scene_t& scene, const render_settings_t& settings, primary_hit_t& primary,
+                                   const photon_map_t* caustics = nullptr, radiance_cache_t* cache = nullptr,
+                                   const ray_differential_t* differential = nullptr);
+
+/**
+ * \brief A point on one of the scene's lights, or a direction towards the environment.
+ */
+struct light_point_t {
+    // the point, or the direction for the environment
+    point3 p;
+    dvec3_t normal;
+    color_t emitted;
+    bool environment = false;
+
+    // probability density of picking the point (including picking its light), per
+    // unit area on the light, or per unit solid angle for the environment
+    double pdf = 0.0;
+};
+
+/**
+ * \brief Picks a light point to light rec with, the way next event estimation does.
+ * \return false if nothing was picked
+ */
+bool sample_light_point(const scene_t& scene, const render_settings_t& settings, const hit_record_t& rec, double time, light_point_t& point);
+
+/**
+ * \brief Casts a shadow ray (counted in rays_traced_on_thread).
+ * \param distance how far away the light is (infinity for the environment)
+ * \return how much of the light gets through: 0 if a surface is in the way, and
+ * less than 1 through smoke and fog
+ */
+double shadow_transmittance(const scene_t& scene, const point3& from, const dvec3_t& direction, double distance, double time);
+
+/**
+ * \brief Next event estimation: picks one of the scene's lights (with the light tree
+ * or uniformly, see settings.light_tree), then a point on it, and returns the light it
+ * sends to rec (through rec's material) if nothing's in the way, weighted against
+ * BSDF sampling with settings.mis.
+ * \param guide the path guide's distribution at rec, if directions are guided there
+ * (it's part of what the light is weighted against)
+ */
+color_t sample_direct_light(const ray_t& r_in, const hit_record_t& rec, const scene_t& scene, const render_settings_t& settings,
+                            const directional_tree_t* guide = nullptr);
+
+/**
+ * \brief The multiple importance sampling weight for a sample taken with density pdf
+ * when the other technique would have picked it with other_pdf.
+ */
+double mis_weight(double pdf, double other_pdf, mis_heuristic_t heuristic);
+
+/**
+ * \brief The number of rays ray_color has cast on the calling thread since
+ * the last call to reset_rays_traced_on_thread. Used for rays/sec reporting.
+ */
+uint64_t rays_traced_on_thread();
+
+/**
+ * \brief The number of path segments (rays cast to extend a path, so not counting
+ * shadow rays) ray_color has traced on the calling thread. Divided by the number of
+ * camera samples that gives the average path length.
+ */
+uint64_t path_segments_on_thread();
+
+/**
+ * \brief Resets both rays_traced_on_thread and path_segments_on_thread.
+ */
+void reset_rays_traced_on_thread();
@@ -1,5 +1,6 @@
 #include "rect.h"
 #include <glm/gtc/quaternion.hpp>
+#include "material.h"
 
 rect_t::rect_t(double w, double h, dvec3_t center, glm::dquat rotation, const shared_ptr<material_t>& mat): m_width(w), m_height(h), m_material(mat), m_center(center), m_rotation(rotation) {
     calc_transform();
@@ -72,13 +73,94 @@ bool rect_t::hit(const ray_t& ray_original, double t_min, double t_max, hit_reco
     rec.t = t;
     auto outward_normal = tform * glm::vec4(0, 0, 1, 0);
     rec.set_face_normal(ray_original, outward_normal);
+    rec.dpdu = transform_vec(dvec3_t(x1-x0, 0, 0), tform);
+    rec.dpdv = transform_vec(dvec3_t(0, y1-y0, 0), tform);
     rec.mat = m_material;
+    rec.object = this;
     rec.p = world_point;
     return true;
 }
 
+bool rect_t::is_area_light() const {
+    return m_material && m_material->is_emissive() && area() > 0;
+}
+
+bool rect_t::sample_light(const point3& origin, double time, light_sample_t& sample) const {
+    const double u = random_double();
+    const double v = random_double();
+    const point3 local_point(
+        (u - 0.5) * m_width,
+        (v - 0.5) * m_height,
+        0.0);
+
+    sample.p = transform_point(local_point, m_cached_transform);
+    sample.normal = normalize(transform_vec(dvec3_t(0, 0, 1), m_cached_transform));
+    sample.uv = dvec2_t(u, v);
+
+    const dvec3_t to_light = sample.p - origin;
+    const double distance_squared = length2(to_light);
+    // rects emit from both sides, so it doesn't matter which way the normal faces
+    const double cosine = fabs(dot(sample.normal, to_light)) / sqrt(distance_squared);
+    if(cosine < 1e-8) {
+        return false;
+    }
+
+    // convert the 1 / area density into a density over solid angle
+    sample.pdf = distance_squared / (cosine * area());
+    sample.emitted = m_material->emitted(sample.uv.x, sample.uv.y, sample.p);
+    return true;
+}
+
+bool rect_t::is_specular() const {
+    return m_material && m_material->is_specular();
+}
+
+bool rect_t::sample_emission(double time, light_sample_t& sample) const {
+    if(!is_area_light()) {
+        return false;
+    }
+    const double u = random_double();
+    const double v = random_double();
+    sample.p = transform_point(point3((u - 0.5) * m_width, (v - 0.5) * m_height, 0.0), m_cached_transform);
+    sample.normal = normalize(transform_vec(dvec3_t(0, 0, 1), m_cached_transform));
+    if(random_double() < 0.5) {
+        sample.normal = -sample.normal;
+    }
+    sample.uv = dvec2_t(u, v);
+    sample.pdf = 0.5 / area();
+    sample.emitted = m_material->emitted(u, v, sample.p);
+    return true;
+}
+
 bool rect_t::bounding_box(double time0, double time1, aabb_t& output_box) const {
     //TODO: incorporate time
     output_box = m_cached_bb;
     return true;
 }
+
+double rect_t::light_pdf(const point3& origin, const dvec3_t& direction, double time) const {
+    const dvec3_t d = normalize(direction);
+    hit_record_t rec;
+    if(!hit(ray_t(origin, d, time), 0.001, infinity, rec)) {
+        return 0.0;
+    }
+    const double cosine = fabs(dot(rec.normal, d));
+    if(cosine < 1e-8) {
+        return 0.0;
+    }
+    return rec.t * rec.t / (cosine * area());
+}
+
+bool rect_t::light_bounds(light_bounds_t& bounds) const {
+    if(!is_area_light()) {
+        return false;
+    }
+    bounds.box = m_cached_bb;
+    bounds.axis = normalize(transform_vec(dvec3_t(0, 0, 1), m_cached_transform));
+    bounds.cos_theta_o = 1.0;
+    bounds.cos_theta_e = 0.0;
+    bounds.two_sided = true;
+    // pi * radiance * area for each side
+    bounds.power = 2.0 * g_pi * area() * m_material->average_emitted_luminance(m_center);
+    return true;
+}
@@ -13,6 +13,22 @@ public:
 
     virtual bool bounding_box(double time0, double time1, aabb_t& output_box) const override;
 
+    [[nodiscard]] bool is_area_light() const override;
+
+    // picks a point uniformly over the rect's area
+    bool sample_light(const point3& origin, double time, light_sample_t& sample) const override;
+    [[nodiscard]] double light_pdf(const point3& origin, const dvec3_t& direction, double time) const override;
+    bool light_bounds(light_bounds_t& bounds) const override;
+    [[nodiscard]] bool is_specular() const override;
+
+    // rects emit from both sides, so this picks a side too
+    bool sample_emission(double time, light_sample_t& sample) const override;
+
+    [[nodiscard]] double area() const { return m_width * m_height; }
+    [[nodiscard]] double width() const { return m_width; }
+    [[nodiscard]] double height() const { return m_height; }
+    [[nodiscard]] const shared_ptr<material_t>& material() const { return m_material; }
+
     dmat4_t transform() const { return m_cached_transform; }
     dmat4_t inverse_transform() const { return m_cached_inverse_transform; }
 
@@ -0,0 +1,425 @@
+#include "renderer.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "raytrace.h"
+#include "path_guide.h"
+#include "photon_map.h"
+#include "radiance_cache.h"
+#include "restir.h"
+
+namespace {
+    double now_seconds() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // how much of a pixel each camera sample filters textures over: the samples are
+    // spread over the pixel anyway, so with more of them each can cover less of it
+    double texture_footprint_scale(int samples_per_pixel) {
+        return std::max(0.125, 1.0 / sqrt(std::max(1, samples_per_pixel)));
+    }
+}
+
+const char* mis_heuristic_name(mis_heuristic_t heuristic) {
+    switch(heuristic) {
+        case mis_heuristic_t::none: return "none";
+        case mis_heuristic_t::balance: return "balance";
+        case mis_heuristic_t::power: return "power";
+    }
+    return "unknown";
+}
+
+bool renders_in_groups(const render_settings_t& settings) {
+    return (settings.restir && settings.next_event_estimation) || settings.path_guiding || settings.caustics ||
+           settings.radiance_cache;
+}
+
+renderer_t::renderer_t(const scene_t& scene, film_t& film, render_settings_t settings,
+                       render_callbacks_t callbacks, shared_ptr<cancel_token_t> cancel)
+    : m_scene(scene),
+      m_film(film),
+      m_settings(settings),
+      m_callbacks(std::move(callbacks)),
+      m_cancel(cancel ? std::move(cancel) : make_shared<cancel_token_t>()) {
+    m_settings.num_threads = std::max(1, m_settings.num_threads);
+    m_settings.tile_size = std::max(1, m_settings.tile_size);
+    m_settings.first_bounce_splits = std::max(1, m_settings.first_bounce_splits);
+    m_settings.restir_candidates = std::max(1, m_settings.restir_candidates);
+    m_settings.radiance_cache_bounces = std::max(1, m_settings.radiance_cache_bounces);
+    m_settings.restir = m_settings.restir && m_settings.next_event_estimation;
+    if(m_settings.restir) {
+        m_restir = make_unique<restir_t>(film.width(), film.height());
+    }
+
+    // guiding is for the paths ray_color traces, so it's left out of restir renders
+    aabb_t bounds;
+    if(m_settings.path_guiding && !m_settings.restir && m_scene.root && m_scene.root->bounding_box(0, 1, bounds)) {
+        path_guide_settings_t guide_settings;
+        guide_settings.max_bytes = static_cast<size_t>(std::max(1, m_settings.guiding_memory_mb)) << 20;
+        m_guide = make_unique<path_guide_t>(bounds, guide_settings);
+    }
+
+    if(m_settings.caustics) {
+        m_caustics = make_unique<photon_map_t>();
+    }
+
+    if(m_settings.radiance_cache && m_scene.root && m_scene.root->bounding_box(0, 1, bounds)) {
+        radiance_cache_settings_t cache_settings;
+        cache_settings.max_bytes = static_cast<size_t>(std::max(1, m_settings.radiance_cache_memory_mb)) << 20;
+        m_radiance_cache = make_unique<radiance_cache_t>(bounds, m_scene.cam, cache_settings);
+    }
+}
+
+renderer_t::~renderer_t() {
+#ifdef THREADS
+    cancel();
+    wait();
+#endif
+}
+
+render_stats_t renderer_t::render(const render_region_t& region) {
+#ifdef THREADS
+    start(region);
+    wait();
+#else
+    begin(region);
+    while(render_next_tile()) {}
+#endif
+    return stats();
+}
+
+#ifdef THREADS
+void renderer_t::start(const render_region_t& region) {
+    wait();
+    begin(region);
+
+    m_active_workers = m_settings.num_threads;
+    for(int i = 0; i < m_settings.num_threads; i++) {
+        m_threads.emplace_back(&renderer_t::worker, this);
+    }
+}
+
+void renderer_t::wait() {
+    for(auto& t : m_threads) {
+        if(t.joinable()) {
+            t.join();
+        }
+    }
+    m_threads.clear();
+}
+
+void renderer_t::worker() {
+    reset_rays_traced_on_thread();
+
+    while(!cancelled()) {
+        const int i = m_next_tile++;
+        if(i >= static_cast<int>(m_tiles.size())) {
+            break;
+        }
+        while(m_tiles_finished.load(std::memory_order_acquire) < m_tiles[i].wait_for && !cancelled()) {
+            std::this_thread::yield();
+        }
+        if(cancelled()) {
+            break;
+        }
+        begin_tile(m_tiles[i]);
+        render_tile(m_tiles[i]);
+        if(cancelled()) {
+            break;
+        }
+        finish_tile(m_tiles[i]);
+    }
+
+    m_rays += rays_traced_on_thread();
+    m_path_segments += path_segments_on_thread();
+
+    if(--m_active_workers == 0) {
+        m_end_time = now_seconds();
+    }
+}
+#endif
+
+void renderer_t::begin(const render_region_t& region) {
+    build_tiles(region);
+    m_next_tile = 0;
+    m_tiles_finished = 0;
+    m_pixels_total = std::max<int64_t>(1, region.area() * m_settings.samples_per_pixel);
+    m_pixels_done = 0;
+    m_rays = 0;
+    m_path_segments = 0;
+    m_samples = 0;
+    m_start_time = now_seconds();
+    m_end_time = 0.0;
+}
+
+bool renderer_t::render_next_tile() {
+    if(cancelled()) {
+        return false;
+    }
+
+    const int i = m_next_tile++;
+    if(i >= static_cast<int>(m_tiles.size())) {
+        return false;
+    }
+
+    const uint64_t rays_before = rays_traced_on_thread();
+    const uint64_t segments_before = path_segments_on_thread();
+    begin_tile(m_tiles[i]);
+    render_tile(m_tiles[i]);
+    m_rays += rays_traced_on_thread() - rays_before;
+    m_path_segments += path_segments_on_thread() - segments_before;
+
+    if(cancelled()) {
+        return false;
+    }
+    finish_tile(m_tiles[i]);
+
+    if(i + 1 >= static_cast<int>(m_tiles.size())) {
+        m_end_time = now_seconds();
+    }
+    return true;
+}
+
+void renderer_t::build_tiles(const render_region_t& region) {
+    m_tiles.clear();
+    if(region.empty()) {
+        return;
+    }
+
+    const int ts = m_settings.tile_size;
+    const int rows = (region.height() + ts - 1) / ts;
+    const int cols = (region.width() + ts - 1) / ts;
+
+    // row order: either straight down, or alternating top, bottom, second from top, ...
+    std::vector<int> row_order;
+    for(int r = 0; r < rows; r++) {
+        if(!m_settings.interlace) {
+            row_order.push_back(r);
+        } else {
+            row_order.push_back(r % 2 == 0 ? r / 2 : rows - 1 - r / 2);
+        }
+    }
+
+    std::vector<render_tile_t> layout;
+    for(const int r : row_order) {
+        for(int c = 0; c < cols; c++) {
+            render_tile_t tile;
+            tile.region.x0 = region.x0 + c * ts;
+            tile.region.y0 = region.y0 + r * ts;
+            tile.region.x1 = std::min(tile.region.x0 + ts, region.x1);
+            tile.region.y1 = std::min(tile.region.y0 + ts, region.y1);
+            tile.index = r * cols + c;
+            tile.samples = m_settings.samples_per_pixel;
+            layout.push_back(tile);
+        }
+    }
+
+    // with caustics, each group below traces a new pass of photons before it starts,
+    // and with the radiance cache it publishes what the group before it recorded
+    int photon_pass = m_caustics ? m_caustics->passes() : 0;
+    int cache_pass = m_radiance_cache ? m_radiance_cache->passes() : 0;
+
+    if(m_settings.restir) {
+        // every pass generates the whole region, then shades it
+        m_restir_region = region;
+        for(int pass = 0; pass < m_settings.samples_per_pixel; pass++) {
+            photon_pass += m_caustics ? 1 : 0;
+            cache_pass += m_radiance_cache ? 1 : 0;
+            for(const bool generate : {true, false}) {
+                const int wait_for = static_cast<int>(m_tiles.size());
+                for(render_tile_t tile : layout) {
+                    tile.samples = generate ? 0 : 1;
+                    tile.restir_generate = generate;
+                    tile.wait_for = wait_for;
+                    tile.photon_pass = photon_pass;
+                    tile.cache_pass = cache_pass;
+                    m_tiles.push_back(tile);
+                }
+            }
+        }
+        return;
+    }
+
+    if(m_guide) {
+        // iterations of 1, 2, 4, ... samples per pixel, with whatever's left over going
+        // to the last one once there isn't enough for another doubling. The guide is
+        // refined before each (and before the first too, if an earlier render left it
+        // something new).
+        int iteration = m_guide->iteration() + (m_guide->has_records() ? 1 : 0);
+        int remaining = m_settings.samples_per_pixel;
+        for(int n = 1; remaining > 0; n *= 2) {
+            const int samples = remaining < 3 * n ? remaining : n;
+            remaining -= samples;
+            photon_pass += m_caustics ? 1 : 0;
+            cache_pass += m_radiance_cache ? 1 : 0;
+            const int wait_for = static_cast<int>(m_tiles.size());
+            for(render_tile_t tile : layout) {
+                tile.samples = samples;
+                tile.wait_for = wait_for;
+                tile.guide_iteration = iteration;
+                tile.photon_pass = photon_pass;
+                tile.cache_pass = cache_pass;
+                m_tiles.push_back(tile);
+            }
+            iteration++;
+        }
+        return;
+    }
+
+    if(m_caustics || m_radiance_cache) {
+        // a pass of photons, or of the cache, per sample per pixel
+        for(int pass = 0; pass < m_settings.samples_per_pixel; pass++) {
+            photon_pass += m_caustics ? 1 : 0;
+            cache_pass += m_radiance_cache ? 1 : 0;
+            const int wait_for = static_cast<int>(m_tiles.size());
+            for(render_tile_t tile : layout) {
+                tile.samples = 1;
+                tile.wait_for = wait_for;
+                tile.photon_pass = photon_pass;
+                tile.cache_pass = cache_pass;
+                m_tiles.push_back(tile);
+            }
+        }
+        return;
+    }
+
+    m_tiles = std::move(layout);
+}
+
+void renderer_t::begin_tile(const render_tile_t& tile) {
+    const bool refine = m_guide && tile.guide_iteration > m_guide_iteration;
+    const bool trace_photons = m_caustics && tile.photon_pass > m_photon_pass;
+    const bool publish = m_radiance_cache && tile.cache_pass > m_cache_pass;
+    if(!refine && !trace_photons && !publish) {
+        return;
+    }
+
+    // the first thread to get here does the work, the rest wait for it
+    std::lock_guard<std::mutex> lock(m_group_mutex);
+    if(m_guide) {
+        while(m_guide->iteration() < tile.guide_iteration) {
+            m_guide->refine(m_settings.num_threads);
+        }
+        m_guide_iteration = m_guide->iteration();
+    }
+    if(m_caustics) {
+        if(m_caustics->passes() < tile.photon_pass) {
+            m_caustics->emit(m_scene, m_settings);
+        }
+        m_photon_pass = m_caustics->passes();
+    }
+    if(m_radiance_cache) {
+        if(m_radiance_cache->passes() < tile.cache_pass) {
+            m_radiance_cache->end_pass(m_settings.num_threads);
+        }
+        m_cache_pass = m_radiance_cache->passes();
+    }
+}
+
+void renderer_t::render_tile(const render_tile_t& tile) {
+    if(m_settings.restir) {
+        render_restir_tile(tile);
+        return;
+    }
+
+    const auto& cam = m_scene.cam;
+    const int spp = tile.samples;
+    const double inv_w = 1.0 / static_cast<double>(cam.width() - 1);
+    const double inv_h = 1.0 / static_cast<double>(cam.height() - 1);
+    const double differential_scale = texture_footprint_scale(m_settings.samples_per_pixel);
+
+    for(int y = tile.region.y0; y < tile.region.y1; y++) {
+        // the film's top row is the top of the camera's view, where v = 1
+        const int cam_y = (m_film.height() - 1) - y;
+
+        for(int x = tile.region.x0; x < tile.region.x1; x++) {
+            color_t pixel_color;
+            for(int s = 0; s < spp; s++) {
+                const double u = (x + random_double()) * inv_w;
+                const double v = (cam_y + random_double()) * inv_h;
+                ray_differential_t differential;
+                const ray_t r = cam.get_ray(u, v, differential);
+                differential.scale(r, differential_scale);
+                pixel_color += ray_color(r, m_scene, m_settings, m_guide.get(), m_caustics.get(), m_radiance_cache.get(),
+                                         m_settings.texture_filtering ? &differential : nullptr);
+            }
+            m_film.add(x, y, pixel_color, spp);
+        }
+
+        if(cancelled()) {
+            return;
+        }
+    }
+
+    m_samples += static_cast<uint64_t>(tile.region.area()) * spp;
+}
+
+void renderer_t::render_restir_tile(const render_tile_t& tile) {
+    const auto& cam = m_scene.cam;
+    const double inv_w = 1.0 / static_cast<double>(cam.width() - 1);
+    const double inv_h = 1.0 / static_cast<double>(cam.height() - 1);
+    const double differential_scale = texture_footprint_scale(m_settings.samples_per_pixel);
+
+    for(int y = tile.region.y0; y < tile.region.y1; y++) {
+        const int cam_y = (m_film.height() - 1) - y;
+
+        for(int x = tile.region.x0; x < tile.region.x1; x++) {
+            if(tile.restir_generate) {
+                const double u = (x + random_double()) * inv_w;
+                const double v = (cam_y + random_double()) * inv_h;
+                ray_differential_t differential;
+                const ray_t r = cam.get_ray(u, v, differential);
+                differential.scale(r, differential_scale);
+                m_restir->generate(m_scene, m_settings, x, y, r, m_caustics.get(), m_radiance_cache.get(),
+                                   m_settings.texture_filtering ? &differential : nullptr);
+            } else {
+                m_film.add(x, y, m_restir->shade(m_scene, m_settings, m_restir_region, x, y), 1);
+            }
+        }
+
+        if(cancelled()) {
+            return;
+        }
+    }
+
+    m_samples += static_cast<uint64_t>(tile.region.area()) * tile.samples;
+}
+
+void renderer_t::finish_tile(const render_tile_t& tile) {
+    if(tile.restir_generate) {
+        // nothing's reached the film yet
+        m_tiles_finished.fetch_add(1, std::memory_order_release);
+        return;
+    }
+    m_pixels_done += tile.region.area() * tile.samples;
+
+    if(m_callbacks.on_tile_complete) {
+        m_callbacks.on_tile_complete(tile);
+    }
+    if(m_callbacks.on_progress) {
+        m_callbacks.on_progress(progress());
+    }
+
+    // only once the callbacks are done with the tile's pixels, since the next group
+    // can start adding to them as soon as this group is finished
+    m_tiles_finished.fetch_add(1, std::memory_order_release);
+}
+
+double renderer_t::progress() const {
+    return static_cast<double>(m_pixels_done) / static_cast<double>(m_pixels_total);
+}
+
+bool renderer_t::done() const {
+    return (m_pixels_done >= m_pixels_total || cancelled()) && m_active_workers == 0;
+}
+
+render_stats_t renderer_t::stats() const {
+    render_stats_t s;
+    s.rays = m_rays;
+    s.path_segments = m_path_segments;
+    s.samples = m_samples;
+    const double end = m_end_time > 0.0 ? m_end_time.load() : now_seconds();
+    s.seconds = end - m_start_time;
+    return s;
+}
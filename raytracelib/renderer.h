@@ -0,0 +1,295 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef THREADS
+#include <thread>
+#endif
+
+#include "film.h"
+#include "scene.h"
+
+class restir_t;
+class path_guide_t;
+class photon_map_t;
+class radiance_cache_t;
+
+/**
+ * \brief Lets whoever started a render stop it early. Can be shared between renders
+ * (e.g. one token for "the program is quitting").
+ */
+class cancel_token_t {
+public:
+    void cancel() { m_cancelled = true; }
+    [[nodiscard]] bool cancelled() const { return m_cancelled; }
+
+protected:
+    std::atomic_bool m_cancelled = false;
+};
+
+/**
+ * \brief How light sampling and BSDF sampling are combined when both can find a light.
+ */
+enum class mis_heuristic_t {
+    none,       // only light sampling counts the sampled lights, BSDF samples that hit them are ignored
+    balance,    // weight each technique by its share of the summed pdfs
+    power       // the same with squared pdfs, which favours whichever technique is better
+};
+
+const char* mis_heuristic_name(mis_heuristic_t heuristic);
+
+struct render_settings_t {
+    int samples_per_pixel = 75;
+
+    // the maximum number of bounces a ray_t can go through
+    int max_bounces = 50;
+
+    // sample a point on a light at every diffuse bounce, instead of waiting for
+    // bounced rays to find the lights by chance
+    bool next_event_estimation = true;
+
+    // only used with next_event_estimation
+    mis_heuristic_t mis = mis_heuristic_t::power;
+
+    // pick which light to sample with the scene's light tree, by how much each light
+    // is likely to contribute, instead of uniformly. Only used with next_event_estimation.
+    bool light_tree = true;
+
+    // randomly end paths whose throughput has got low, once they're roulette_min_depth
+    // bounces long. Unbiased, it just stops spending time on paths that contribute little.
+    bool russian_roulette = true;
+    int roulette_min_depth = 3;
+
+    // continue every camera sample's first hit with this many paths. Worth it when camera
+    // rays are expensive compared to bounces (depth of field, motion blur, heavy geometry).
+    int first_bounce_splits = 1;
+
+    // light the first surface each pixel sees by reservoir resampling (see restir_t)
+    // instead of next event estimation: each sample per pixel becomes a pass that
+    // picks from restir_candidates light points, reuses what the pixel picked last
+    // pass (restir_temporal) and what restir_spatial_neighbors pixels within
+    // restir_radius picked, then casts one shadow ray. Unbiased like next event
+    // estimation, and close to converged at a handful of samples per pixel. Only used
+    // with next_event_estimation.
+    bool restir = false;
+    int restir_candidates = 16;
+    bool restir_temporal = true;
+    int restir_spatial_neighbors = 4;
+    int restir_radius = 16;
+
+    // learn where light comes from while rendering, and aim later samples there (see
+    // path_guide_t). A render's samples are split into iterations of 1, 2, 4, ...
+    // samples per pixel, and the guide is refined between them. guiding_fraction of
+    // the directions are picked by the guide where it has learnt something, the rest
+    // by the materials. The guide is kept under guiding_memory_mb.
+    bool path_guiding = false;
+    double guiding_fraction = 0.5;
+    int guiding_memory_mb = 64;
+
+    // light reaching diffuse surfaces through glass and mirrors comes from a photon map
+    // (see photon_map_t) instead of from paths that happen to find their way to a
+    // light. Every sample per pixel (every iteration with path guiding) gets a fresh
+    // pass of caustic_photons photons, and estimates use the caustic_nearest nearest
+    // within a radius that starts at caustic_radius (0 picks one from the photons)
+    // and shrinks each pass.
+    bool caustics = false;
+    int caustic_photons = 100000;
+    int caustic_nearest = 32;
+    double caustic_radius = 0.0;
+
+    // end paths in a radiance cache (see radiance_cache_t) once they've made
+    // radiance_cache_bounces diffuse bounces (at least 1) and reach a surface the cache
+    // has learnt, instead of tracing them on. Every sample per pixel (every iteration
+    // with path guiding) is a pass that records what its paths find for the next ones
+    // to look up. Biased, as light is blurred over the cache's cells, but paths get
+    // much shorter. The cache is kept under radiance_cache_memory_mb.
+    bool radiance_cache = false;
+    int radiance_cache_bounces = 1;
+    int radiance_cache_memory_mb = 32;
+
+    // filter image textures over each pixel's footprint at the first surface (found
+    // from the camera ray's ray differentials), in the mip level that matches it.
+    // Without, textures are read at full size, which aliases where they're shrunk.
+    bool texture_filtering = true;
+
+    int num_threads = 1;
+
+    // tiles are tile_size x tile_size pixels (smaller at the right and bottom edges)
+    int tile_size = 32;
+
+    // if this is turned on, tiles are handed out alternately from the top and the
+    // bottom of the region, which lets you see the general image a bit quicker.
+    bool interlace = false;
+};
+
+/**
+ * \brief True if a render with these settings comes in groups of tiles (see
+ * render_tile_t::wait_for), so later groups add to pixels earlier ones have finished.
+ */
+bool renders_in_groups(const render_settings_t& settings);
+
+struct render_tile_t {
+    render_region_t region;
+    int index;
+
+    // samples per pixel the tile adds to the film
+    int samples = 1;
+
+    // with restir, path guiding, caustics or the radiance cache, tiles come in groups
+    // (a phase of a pass, an iteration, a pass of photons or of the cache) that can't
+    // start until every tile before the group is finished. Other renders have one group.
+    int wait_for = 0;
+    bool restir_generate = false;
+    int guide_iteration = 0;
+    int photon_pass = 0;
+    int cache_pass = 0;
+};
+
+/**
+ * \brief Hooks for watching a render. These are called from the render threads,
+ * so they need to be thread safe.
+ */
+struct render_callbacks_t {
+    // called once a tile's samples have all been added to the film. A later group's
+    // tiles don't start until this has returned for every tile before them.
+    std::function<void(const render_tile_t&)> on_tile_complete;
+
+    // called after each tile with the fraction of the region that's done
+    std::function<void(double)> on_progress;
+};
+
+struct render_stats_t {
+    uint64_t rays = 0;
+    uint64_t samples = 0;
+    uint64_t path_segments = 0;
+    double seconds = 0.0;
+
+    // path segments per camera sample
+    [[nodiscard]] double average_path_length() const {
+        return samples > 0 ? static_cast<double>(path_segments) / static_cast<double>(samples) : 0.0;
+    }
+};
+
+/**
+ * \brief Renders a scene into a film. This is the one render loop shared by the
+ * GUI, rtcli and the tests.
+ *
+ * A render splits the region into tiles which the threads pull from a shared
+ * counter, so each tile (and the film pixels under it) is only touched by one
+ * thread. Calling render/start again adds another pass of samples to the film.
+ */
+class renderer_t {
+public:
+    renderer_t(const scene_t& scene, film_t& film, render_settings_t settings,
+               render_callbacks_t callbacks = {}, shared_ptr<cancel_token_t> cancel = nullptr);
+    ~renderer_t();
+
+    renderer_t(const renderer_t&) = delete;
+    renderer_t& operator=(const renderer_t&) = delete;
+
+    /**
+     * \brief Renders the region with settings().num_threads threads and returns when
+     * it's done (or cancelled).
+     */
+    render_stats_t render(const render_region_t& region);
+
+#ifdef THREADS
+    /**
+     * \brief Starts rendering the region in the background and returns straight away.
+     */
+    void start(const render_region_t& region);
+
+    /**
+     * \brief Blocks until the threads started by start() have finished.
+     */
+    void wait();
+#endif
+
+    /**
+     * \brief Sets up a render of the region without starting any threads. Call
+     * render_next_tile() to make progress (used by the single threaded build,
+     * which renders a bit at a time between frames).
+     */
+    void begin(const render_region_t& region);
+
+    /**
+     * \brief Renders one tile on the calling thread.
+     * \return false once there are no tiles left (or the render was cancelled)
+     */
+    bool render_next_tile();
+
+    void cancel() { m_cancel->cancel(); }
+    [[nodiscard]] bool cancelled() const { return m_cancel->cancelled(); }
+    [[nodiscard]] shared_ptr<cancel_token_t> cancel_token() const { return m_cancel; }
+
+    [[nodiscard]] double progress() const;
+    [[nodiscard]] bool done() const;
+    [[nodiscard]] render_stats_t stats() const;
+
+    [[nodiscard]] const render_settings_t& settings() const { return m_settings; }
+    [[nodiscard]] const std::vector<render_tile_t>& tiles() const { return m_tiles; }
+
+    // what path guiding has learnt so far, or null if it's off
+    [[nodiscard]] const path_guide_t* guide() const { return m_guide.get(); }
+
+    // the last pass of caustic photons, or null if caustics are off
+    [[nodiscard]] const photon_map_t* caustics() const { return m_caustics.get(); }
+
+    // what the radiance cache has learnt so far, or null if it's off
+    [[nodiscard]] const radiance_cache_t* radiance_cache() const { return m_radiance_cache.get(); }
+
+protected:
+    void build_tiles(const render_region_t& region);
+    void render_tile(const render_tile_t& tile);
+    void finish_tile(const render_tile_t& tile);
+    void render_restir_tile(const render_tile_t& tile);
+
+    // gets whatever a tile's group needs ready (refining the guide between iterations,
+    // tracing a new pass of photons, publishing what the cache's last pass recorded)
+    void begin_tile(const render_tile_t& tile);
+
+#ifdef THREADS
+    void worker();
+#endif
+
+    const scene_t& m_scene;
+    film_t& m_film;
+    render_settings_t m_settings;
+    render_callbacks_t m_callbacks;
+    shared_ptr<cancel_token_t> m_cancel;
+
+    std::vector<render_tile_t> m_tiles;
+    std::atomic_int m_next_tile = 0;
+    std::atomic_int m_tiles_finished = 0;
+    std::atomic<int64_t> m_pixels_total = 1;
+    std::atomic<int64_t> m_pixels_done = 0;
+    std::atomic<uint64_t> m_rays = 0;
+    std::atomic<uint64_t> m_path_segments = 0;
+    std::atomic<uint64_t> m_samples = 0;
+    std::atomic_int m_active_workers = 0;
+    double m_start_time = 0.0;
+    std::atomic<double> m_end_time = 0.0;
+
+    // kept between renders, so one pass can reuse the last one's picks
+    unique_ptr<restir_t> m_restir;
+    render_region_t m_restir_region;
+
+    unique_ptr<path_guide_t> m_guide;
+    std::atomic_int m_guide_iteration = 0;
+
+    unique_ptr<photon_map_t> m_caustics;
+    std::atomic_int m_photon_pass = 0;
+
+    unique_ptr<radiance_cache_t> m_radiance_cache;
+    std::atomic_int m_cache_pass = 0;
+
+    // held by the thread doing begin_tile's work for a group
+    std::mutex m_group_mutex;
+
+#ifdef THREADS
+    std::vector<std::thread> m_threads;
+#endif
+};
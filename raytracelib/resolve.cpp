@@ -0,0 +1,199 @@
+#include "resolve.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RESOLVE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // entries in the sRGB table, spread evenly over 0-1 in linear space
+    constexpr int lut_size = 4096;
+
+    // the table holds 8-bit values with 4 fractional bits, so the dither (or rounding)
+    // offset can be added before dropping down to 8 bits
+    constexpr int lut_fraction_bits = 4;
+
+    const std::array<uint16_t, lut_size>& srgb_lut() {
+        static const auto table = [] {
+            std::array<uint16_t, lut_size> t {};
+            for(int i = 0; i < lut_size; i++) {
+                const double v = static_cast<double>(i) / (lut_size - 1);
+                const double s = v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+                // 255 * 16 + 15 still rounds down to 255 after the shift
+                t[i] = static_cast<uint16_t>(std::lround(s * 255.0 * (1 << lut_fraction_bits)));
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    // 4x4 Bayer matrix, scaled to the 4 fractional bits of the table
+    constexpr uint8_t bayer4[4][4] = {
+        { 0,  8,  2, 10},
+        {12,  4, 14,  6},
+        { 3, 11,  1,  9},
+        {15,  7, 13,  5}
+    };
+
+    // adds half a step when not dithering, so quantizing rounds to nearest
+    constexpr uint8_t no_dither_row[4] = {8, 8, 8, 8};
+
+    // written so a NaN comes out as black and an infinity as white, same as the SSE version
+    float tonemap_scalar(float x, tonemap_t tonemap) {
+        x = x > 0.0f ? x : 0.0f;
+        switch(tonemap) {
+            case tonemap_t::clamp:
+                break;
+            case tonemap_t::reinhard:
+                x = x / (1.0f + x);
+                break;
+            case tonemap_t::aces:
+                x = (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+                break;
+        }
+        return x < 1.0f ? x : 1.0f;
+    }
+
+    uint8_t encode(float v, const std::array<uint16_t, lut_size>& lut, uint8_t dither) {
+        const int i = static_cast<int>(v * (lut_size - 1) + 0.5f);
+        return static_cast<uint8_t>((lut[i] + dither) >> lut_fraction_bits);
+    }
+
+    float exposure_scale(const resolve_settings_t& settings) {
+        return std::exp2(settings.exposure);
+    }
+
+    // writes one pixel of rgb + count into an RGBA8888 pixel ([a, b, g, r] in memory),
+    // unless it has no samples yet
+    void resolve_one(const glm::vec4& p, uint8_t* out, float scale, const resolve_settings_t& settings,
+                     const std::array<uint16_t, lut_size>& lut, uint8_t dither) {
+        if(!(p.a > 0.0f)) {
+            return;
+        }
+        const float inv = scale / p.a;
+        out[0] = 255;
+        out[1] = encode(tonemap_scalar(p.b * inv, settings.tonemap), lut, dither);
+        out[2] = encode(tonemap_scalar(p.g * inv, settings.tonemap), lut, dither);
+        out[3] = encode(tonemap_scalar(p.r * inv, settings.tonemap), lut, dither);
+    }
+
+#ifdef RESOLVE_SSE2
+    __m128 tonemap_sse(__m128 x, tonemap_t tonemap) {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        x = _mm_max_ps(x, zero);
+        switch(tonemap) {
+            case tonemap_t::clamp:
+                break;
+            case tonemap_t::reinhard:
+                x = _mm_div_ps(x, _mm_add_ps(one, x));
+                break;
+            case tonemap_t::aces: {
+                const __m128 num = _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.51f), x), _mm_set1_ps(0.03f)));
+                const __m128 den = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.43f), x), _mm_set1_ps(0.59f))), _mm_set1_ps(0.14f));
+                x = _mm_div_ps(num, den);
+                break;
+            }
+        }
+        return _mm_min_ps(x, one);
+    }
+
+    // resolves 4 pixels. The pixels are transposed so each register holds one channel
+    // of all four, and the tone mapping runs on all of them at once.
+    void resolve_four(const glm::vec4* src, uint8_t* out, __m128 scale, tonemap_t tonemap,
+                      const std::array<uint16_t, lut_size>& lut, const uint8_t* dither) {
+        __m128 r = _mm_loadu_ps(&src[0].r);
+        __m128 g = _mm_loadu_ps(&src[1].r);
+        __m128 b = _mm_loadu_ps(&src[2].r);
+        __m128 n = _mm_loadu_ps(&src[3].r);
+        _MM_TRANSPOSE4_PS(r, g, b, n);
+
+        // pixels without samples divide by zero, mask them out here and skip them below
+        const __m128 has_samples = _mm_cmpgt_ps(n, _mm_setzero_ps());
+        const int written = _mm_movemask_ps(has_samples);
+        if(written == 0) {
+            return;
+        }
+        const __m128 inv = _mm_and_ps(_mm_div_ps(scale, n), has_samples);
+
+        const __m128 lut_scale = _mm_set1_ps(static_cast<float>(lut_size - 1));
+        const __m128 half = _mm_set1_ps(0.5f);
+        alignas(16) int32_t ir[4], ig[4], ib[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(ir), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(tonemap_sse(_mm_mul_ps(r, inv), tonemap), lut_scale), half)));
+        _mm_store_si128(reinterpret_cast<__m128i*>(ig), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(tonemap_sse(_mm_mul_ps(g, inv), tonemap), lut_scale), half)));
+        _mm_store_si128(reinterpret_cast<__m128i*>(ib), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(tonemap_sse(_mm_mul_ps(b, inv), tonemap), lut_scale), half)));
+
+        for(int i = 0; i < 4; i++, out += 4) {
+            if(!(written & (1 << i))) {
+                continue;
+            }
+            out[0] = 255;
+            out[1] = static_cast<uint8_t>((lut[ib[i]] + dither[i]) >> lut_fraction_bits);
+            out[2] = static_cast<uint8_t>((lut[ig[i]] + dither[i]) >> lut_fraction_bits);
+            out[3] = static_cast<uint8_t>((lut[ir[i]] + dither[i]) >> lut_fraction_bits);
+        }
+    }
+#endif
+}
+
+const char* tonemap_name(tonemap_t tonemap) {
+    switch(tonemap) {
+        case tonemap_t::clamp: return "clamp";
+        case tonemap_t::reinhard: return "reinhard";
+        case tonemap_t::aces: return "aces";
+    }
+    return "unknown";
+}
+
+void resolve_pixels(const glm::vec4* src, int src_stride, int width, int height, int x0, int y0,
+                    uint8_t* dst, int dst_pitch, const resolve_settings_t& settings) {
+    const auto& lut = srgb_lut();
+    const float scale = exposure_scale(settings);
+
+    for(int y = 0; y < height; y++) {
+        const glm::vec4* in = src + static_cast<size_t>(y) * src_stride;
+        uint8_t* out = dst + static_cast<size_t>(y) * dst_pitch;
+
+        // the dither row, rotated so index 0 lines up with this row's first pixel
+        const uint8_t* pattern = settings.dither ? bayer4[(y0 + y) & 3] : no_dither_row;
+        uint8_t dither[4];
+        for(int i = 0; i < 4; i++) {
+            dither[i] = pattern[(x0 + i) & 3];
+        }
+
+        int x = 0;
+#ifdef RESOLVE_SSE2
+        const __m128 scale4 = _mm_set1_ps(scale);
+        for(; x + 4 <= width; x += 4) {
+            // x is a multiple of 4, so the pattern for these four pixels starts at dither[0]
+            resolve_four(in + x, out + x * 4, scale4, settings.tonemap, lut, dither);
+        }
+#endif
+        for(; x < width; x++) {
+            resolve_one(in[x], out + x * 4, scale, settings, lut, dither[x & 3]);
+        }
+    }
+}
+
+void resolve_film_region(const film_t& film, const render_region_t& region, uint8_t* dst, int dst_pitch,
+                         const resolve_settings_t& settings) {
+    if(region.empty()) {
+        return;
+    }
+    const glm::vec4* src = film.data() + static_cast<size_t>(region.y0) * film.width() + region.x0;
+    resolve_pixels(src, film.width(), region.width(), region.height(), region.x0, region.y0, dst, dst_pitch, settings);
+}
+
+void resolve_color(const color_t& color, uint8_t rgb[3], const resolve_settings_t& settings) {
+    const auto& lut = srgb_lut();
+    const glm::vec4 p(static_cast<float>(color.r), static_cast<float>(color.g), static_cast<float>(color.b), 1.0f);
+    uint8_t out[4];
+    resolve_one(p, out, exposure_scale(settings), settings, lut, no_dither_row[0]);
+    rgb[0] = out[3];
+    rgb[1] = out[2];
+    rgb[2] = out[1];
+}
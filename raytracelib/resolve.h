@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <glm/vec4.hpp>
+#include "film.h"
+
+/**
+ * \brief How linear radiance gets squeezed into the 0-1 range before it's encoded.
+ */
+enum class tonemap_t {
+    clamp,      // anything over 1 clips to white
+    reinhard,   // x / (1 + x), never clips but washes out a bit
+    aces        // Narkowicz's fit of the ACES filmic curve
+};
+
+const char* tonemap_name(tonemap_t tonemap);
+
+/**
+ * \brief Settings for turning accumulated film samples into displayable 8-bit pixels.
+ */
+struct resolve_settings_t {
+    tonemap_t tonemap = tonemap_t::clamp;
+
+    // in stops, so +1 doubles the brightness
+    float exposure = 0.0f;
+
+    // adds a 4x4 ordered dither before quantizing, which hides banding in dark gradients
+    bool dither = false;
+};
+
+/**
+ * \brief Tone maps and sRGB encodes a block of pixels into RGBA8888 bytes (alpha is
+ * always 255). Source pixels are rgb = sum of samples and a = sample count, like
+ * film_t stores them. A pixel with no samples isn't written, so a region shown while
+ * it's still being rendered keeps what was there until its pixels get samples.
+ *
+ * Works four pixels at a time with SSE where it's available, and the sRGB curve is a
+ * table lookup, so resolving a whole frame is cheap enough to do after every pass.
+ * \param src the top left source pixel
+ * \param src_stride pixels between rows of src
+ * \param x0,y0 where src sits in the image, so the dither pattern lines up across tiles
+ * \param dst where the top left pixel goes
+ * \param dst_pitch bytes between rows of dst
+ */
+void resolve_pixels(const glm::vec4* src, int src_stride, int width, int height, int x0, int y0,
+                    uint8_t* dst, int dst_pitch, const resolve_settings_t& settings = {});
+
+/**
+ * \brief resolve_pixels() for the film's pixels inside region.
+ * \param dst where the region's top left pixel goes
+ */
+void resolve_film_region(const film_t& film, const render_region_t& region, uint8_t* dst, int dst_pitch,
+                         const resolve_settings_t& settings = {});
+
+/**
+ * \brief Resolves a single linear color to 8-bit sRGB (r, g, b order). Slow path, for
+ * one-off pixels and the image writers.
+ */
+void resolve_color(const color_t& color, uint8_t rgb[3], const resolve_settings_t& settings = {});
@@ -0,0 +1,172 @@
+#include "restir.h"
+
+#include <algorithm>
+
+namespace {
+    // a pixel's reservoir from last pass counts for at most this many times the
+    // candidates it's merged with, so old picks fade out instead of piling up forever
+    constexpr double max_history = 20.0;
+
+    /**
+     * \brief The light point's unshadowed contribution at the surface, per unit light
+     * area (or solid angle for the environment), and its luminance, which is what the
+     * resampling aims for.
+     */
+    double target(const primary_hit_t& primary, const light_point_t& point, color_t& contribution) {
+        const hit_record_t& rec = primary.rec;
+        dvec3_t direction;
+        double geometry = 1.0;
+        if(point.environment) {
+            direction = point.p;
+        } else {
+            const dvec3_t to_light = point.p - rec.p;
+            const double distance_squared = length2(to_light);
+            if(distance_squared <= 0.0) {
+                return 0.0;
+            }
+            direction = to_light / sqrt(distance_squared);
+            geometry = fabs(dot(point.normal, direction)) / distance_squared;
+        }
+
+        contribution = rec.mat->eval(primary.ray, rec, direction) * point.emitted * geometry;
+        return std::max(0.0, luminance(contribution));
+    }
+
+    double target(const primary_hit_t& primary, const light_point_t& point) {
+        color_t contribution;
+        return target(primary, point, contribution);
+    }
+
+    /**
+     * \brief Whether two pixels' first surfaces are alike enough that one's light picks
+     * are likely to be good at the other. The MIS weights keep any reuse unbiased, this
+     * just saves merging picks that won't help.
+     */
+    bool similar(const hit_record_t& rec, const hit_record_t& other) {
+        return rec.mat == other.mat && dot(rec.normal, other.normal) > 0.9;
+    }
+}
+
+void restir_t::reservoir_t::update(const light_point_t& candidate, double weight, double candidate_count) {
+    count += candidate_count;
+    if(weight <= 0.0) {
+        return;
+    }
+    weight_sum += weight;
+    if(random_double() * weight_sum < weight) {
+        sample = candidate;
+    }
+}
+
+restir_t::restir_t(int width, int height)
+    : m_width(width), m_height(height), m_pixels(static_cast<size_t>(width) * height) {}
+
+restir_t::reservoir_t restir_t::combine(const std::vector<source_t>& sources, const primary_hit_t& primary) {
+    reservoir_t merged;
+    for(const source_t& source : sources) {
+        const reservoir_t& r = *source.reservoir;
+        if(r.contribution_weight <= 0.0) {
+            merged.update(r.sample, 0.0, source.count);
+            continue;
+        }
+
+        // the balance heuristic over every source's chance of having picked the sample
+        // (source counts standing in for how many candidates each resampled)
+        double own = 0.0, sum = 0.0;
+        for(const source_t& other : sources) {
+            const double p = other.count * target(*other.primary, r.sample);
+            sum += p;
+            if(&other == &source) {
+                own = p;
+            }
+        }
+        const double mis = sum > 0.0 ? own / sum : 0.0;
+        merged.update(r.sample, mis * target(primary, r.sample) * r.contribution_weight, source.count);
+    }
+
+    const double chosen = target(primary, merged.sample);
+    merged.contribution_weight = chosen > 0.0 ? merged.weight_sum / chosen : 0.0;
+    return merged;
+}
+
+void restir_t::generate(const scene_t& scene, const render_settings_t& settings, int x, int y, const ray_t& r,
+                        const photon_map_t* caustics, radiance_cache_t* cache, const ray_differential_t* differential) {
+    pixel_t& px = pixel(x, y);
+    px.rest = ray_color_deferring_direct(r, scene, settings, px.primary, caustics, cache, differential);
+    px.initial = reservoir_t();
+    if(!px.primary.deferred) {
+        px.final = reservoir_t();
+        return;
+    }
+
+    // resample the candidates towards the target, each weighted by target / source pdf
+    reservoir_t candidates;
+    for(int i = 0; i < settings.restir_candidates; i++) {
+        light_point_t point;
+        if(!sample_light_point(scene, settings, px.primary.rec, r.time(), point)) {
+            candidates.update(point, 0.0, 1.0);
+            continue;
+        }
+        candidates.update(point, target(px.primary, point) / point.pdf, 1.0);
+    }
+    const double chosen = target(px.primary, candidates.sample);
+    candidates.contribution_weight = chosen > 0.0 ? candidates.weight_sum / (candidates.count * chosen) : 0.0;
+
+    // then merge in last pass's pick, if it was made on much the same surface
+    const reservoir_t& previous = px.final;
+    if(!settings.restir_temporal || previous.count <= 0.0 || !similar(px.primary.rec, px.final_primary.rec)) {
+        px.initial = candidates;
+        return;
+    }
+    std::vector<source_t> sources {
+        {&candidates, &px.primary, candidates.count},
+        {&previous, &px.final_primary, std::min(previous.count, max_history * candidates.count)}
+    };
+    px.initial = combine(sources, px.primary);
+}
+
+color_t restir_t::shade(const scene_t& scene, const render_settings_t& settings, const render_region_t& region, int x, int y) {
+    pixel_t& px = pixel(x, y);
+    if(!px.primary.deferred) {
+        return px.rest;
+    }
+    const hit_record_t& rec = px.primary.rec;
+
+    // neighbours' picks, re-targeted at this pixel's surface. Light points are in
+    // area measure (and environment directions don't depend on where they're seen
+    // from), so nothing needs a change of variables.
+    std::vector<source_t> sources;
+    sources.reserve(settings.restir_spatial_neighbors + 1);
+    sources.push_back({&px.initial, &px.primary, px.initial.count});
+    const int radius = std::max(1, settings.restir_radius);
+    for(int i = 0; i < settings.restir_spatial_neighbors; i++) {
+        const int nx = x + static_cast<int>((random_double() * 2.0 - 1.0) * radius);
+        const int ny = y + static_cast<int>((random_double() * 2.0 - 1.0) * radius);
+        if((nx == x && ny == y) || !region.contains(nx, ny)) {
+            continue;
+        }
+        const pixel_t& neighbour = pixel(nx, ny);
+        if(!neighbour.primary.deferred || !similar(rec, neighbour.primary.rec)) {
+            continue;
+        }
+        sources.push_back({&neighbour.initial, &neighbour.primary, neighbour.initial.count});
+    }
+    reservoir_t merged = combine(sources, px.primary);
+
+    color_t direct(0, 0, 0);
+    color_t contribution;
+    if(merged.contribution_weight > 0.0 && target(px.primary, merged.sample, contribution) > 0.0) {
+        const light_point_t& point = merged.sample;
+        const dvec3_t to_light = point.environment ? point.p : point.p - rec.p;
+        const double distance = point.environment ? infinity : length(to_light);
+        // the reservoir is kept whether or not the pick turns out to be occluded: its
+        // target leaves visibility out, and dropping occluded picks would favour the
+        // lit ones in penumbrae
+        const dvec3_t direction = point.environment ? to_light : to_light / distance;
+        direct = contribution * (merged.contribution_weight * shadow_transmittance(scene, rec.p, direction, distance, px.primary.ray.time()));
+    }
+
+    px.final = merged;
+    px.final_primary = px.primary;
+    return px.rest + direct;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <vector>
+#include "raytrace.h"
+#include "renderer.h"
+
+/**
+ * \brief Direct lighting for the first surface each pixel sees, by reservoir resampling
+ * (ReSTIR). Each pass picks a light point per pixel by resampling a batch of cheap
+ * candidates (no rays), merges in what the pixel kept last pass (temporal reuse) and
+ * what a few neighbouring pixels picked this pass (spatial reuse), and only then casts
+ * one shadow ray. With a still camera the pool behind each pixel grows every pass, so
+ * direct lighting from many lights is close to converged at a few samples per pixel.
+ *
+ * A pass has two phases: generate() for every pixel of the region, then shade() for
+ * every pixel, since shade() reads the neighbours generate() left behind. Each pixel
+ * only writes its own slot, so pixels within a phase can run on any thread.
+ *
+ * Reservoirs are merged with MIS weights (each pick weighted by how likely every
+ * merged pixel was to have picked it), so reuse between surfaces that see the lights
+ * differently doesn't blow up into fireflies, and the estimate stays unbiased: the
+ * resampling target leaves visibility out, and the shadow ray puts it back.
+ * Everything after the first surface is ordinary path tracing.
+ */
+class restir_t {
+public:
+    restir_t(int width, int height);
+
+    [[nodiscard]] int width() const { return m_width; }
+    [[nodiscard]] int height() const { return m_height; }
+
+    /**
+     * \brief Traces the camera ray for the pixel (everything but the first surface's
+     * direct light) and resamples its candidate lights.
+     * \param caustics photons for the path to gather caustics from, if any
+     * \param cache the radiance cache for the path to record into and end in, if any
+     * \param differential r's ray differentials, for filtering textures, if any
+     */
+    void generate(const scene_t& scene, const render_settings_t& settings, int x, int y, const ray_t& r,
+                  const photon_map_t* caustics = nullptr, radiance_cache_t* cache = nullptr,
+                  const ray_differential_t* differential = nullptr);
+
+    /**
+     * \brief Merges in neighbours from the region, casts the shadow ray, and returns
+     * the pixel's sample.
+     */
+    color_t shade(const scene_t& scene, const render_settings_t& settings, const render_region_t& region, int x, int y);
+
+protected:
+    struct reservoir_t {
+        light_point_t sample;
+
+        // sum of the resampling weights, and how many candidates they came from
+        double weight_sum = 0.0;
+        double count = 0.0;
+
+        // unbiased contribution weight: what the chosen sample's target is scaled by
+        // to estimate the integral (0 if nothing was chosen)
+        double contribution_weight = 0.0;
+
+        void update(const light_point_t& candidate, double weight, double candidate_count);
+    };
+
+    struct pixel_t {
+        primary_hit_t primary;
+
+        // everything the path found apart from the first surface's direct light
+        color_t rest;
+
+        // this pass's candidates merged with last pass's reservoir
+        reservoir_t initial;
+
+        // what the pixel was shaded with (and keeps for the next pass), and the first
+        // surface it was picked for
+        reservoir_t final;
+        primary_hit_t final_primary;
+    };
+
+    /**
+     * \brief A reservoir to merge, and the surface it was resampled for.
+     */
+    struct source_t {
+        const reservoir_t* reservoir;
+        const primary_hit_t* primary;
+        double count;
+    };
+
+    /**
+     * \brief Merges the sources' picks into one reservoir for the surface.
+     */
+    static reservoir_t combine(const std::vector<source_t>& sources, const primary_hit_t& primary);
+
+    [[nodiscard]] pixel_t& pixel(int x, int y) { return m_pixels[static_cast<size_t>(y) * m_width + x]; }
+
+    int m_width;
+    int m_height;
+    std::vector<pixel_t> m_pixels;
+};
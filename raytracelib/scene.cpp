@@ -1,9 +1,59 @@
 #include "scene.h"
+#include "asset_cache.h"
 
 #include "box.h"
 #include "constant_medium.h"
+#include "grid_medium.h"
+#include "perlin.h"
 #include "rect.h"
 
+scene_t& scene_t::operator=(scene_t&& other) noexcept {
+    // the members would be assigned in the order they're declared, which would let go
+    // of the arena before the objects in it, so it's kept until they've gone (this has
+    // to list every member of scene_t)
+    const shared_ptr<scene_arena_t> previous = std::move(arena);
+    arena = std::move(other.arena);
+    entities = std::move(other.entities);
+    root = std::move(other.root);
+    lights = std::move(other.lights);
+    light_indices = std::move(other.light_indices);
+    light_tree = std::move(other.light_tree);
+    cam = std::move(other.cam);
+    background = other.background;
+    environment = std::move(other.environment);
+    return *this;
+}
+
+scene_t& scene_t::operator=(const scene_t& other) {
+    return *this = scene_t(other);
+}
+
+void scene_t::build() {
+    root = make_object<primitive_store_t>(entities.objects, 0, 1);
+
+    lights.clear();
+    light_indices.clear();
+    for(const auto& obj : entities.objects) {
+        if(obj->is_area_light()) {
+            light_indices[obj.get()] = static_cast<int>(lights.size());
+            lights.push_back(obj);
+        }
+    }
+    light_tree.build(lights);
+}
+
+bool scene_t::is_sampled_light(const hittable_t* obj) const {
+    return light_index(obj) >= 0;
+}
+
+int scene_t::light_index(const hittable_t* obj) const {
+    if(obj == nullptr) {
+        return -1;
+    }
+    const auto it = light_indices.find(obj);
+    return it != light_indices.end() ? it->second : -1;
+}
+
 scene_t random_scene(int image_width, int image_height) {
     
     constexpr point3 look_from(13,2,3);
@@ -27,9 +77,9 @@ scene_t random_scene(int image_width, int image_height) {
 
     scene_t scene {cam};
 
-    //auto ground_material = make_shared<lambertian_material_t>(color_t(0.5, 0.5, 0.5));
-    auto ground_material = make_shared<lambertian_material_t>(make_shared<checker_texture_t>(color_t(0, 0, 0), color_t(0.8, 0.8, 0.8)));
-    scene.entities.add(make_shared<sphere_t>(point3(0,-1000,0), 1000, ground_material));
+    //auto ground_material = make_object<lambertian_material_t>(color_t(0.5, 0.5, 0.5));
+    auto ground_material = make_object<lambertian_material_t>(make_object<checker_texture_t>(color_t(0, 0, 0), color_t(0.8, 0.8, 0.8)));
+    scene.entities.add(make_object<sphere_t>(point3(0,-1000,0), 1000, ground_material));
 
     for (int a = -11; a < 11; a++) {
         for (int b = -11; b < 11; b++) {
@@ -42,34 +92,34 @@ scene_t random_scene(int image_width, int image_height) {
                 if (choose_mat < 0.8) {
                     // diffuse
                     auto albedo = color_t::random() * color_t::random();
-                    sphere_material = make_shared<lambertian_material_t>(albedo);
+                    sphere_material = make_object<lambertian_material_t>(albedo);
                     auto center2 = center + dvec3_t(0, random_double(0, 0.5), 0);
-                    scene.entities.add(make_shared<sphere_t>(center, center2, 0.0, 1.0, 0.2, sphere_material));
+                    scene.entities.add(make_object<sphere_t>(center, center2, 0.0, 1.0, 0.2, sphere_material));
                 } else if (choose_mat < 0.95) {
                     // metal_material_t
                     auto albedo = color_t::random(0.5, 1);
                     auto fuzz = random_double(0, 0.5);
-                    sphere_material = make_shared<metal_material_t>(albedo, fuzz);
-                    scene.entities.add(make_shared<sphere_t>(center, 0.2, sphere_material));
+                    sphere_material = make_object<metal_material_t>(albedo, fuzz);
+                    scene.entities.add(make_object<sphere_t>(center, 0.2, sphere_material));
                 } else {
                     // glass
-                    sphere_material = make_shared<dielectric_material_t>(1.5);
-                    scene.entities.add(make_shared<sphere_t>(center, 0.2, sphere_material));
+                    sphere_material = make_object<dielectric_material_t>(1.5);
+                    scene.entities.add(make_object<sphere_t>(center, 0.2, sphere_material));
                 }
             }
         }
     }
 
-    auto material1 = make_shared<dielectric_material_t>(1.5);
-    scene.entities.add(make_shared<sphere_t>(point3(0, 1, 0), 1.0, material1));
+    auto material1 = make_object<dielectric_material_t>(1.5);
+    scene.entities.add(make_object<sphere_t>(point3(0, 1, 0), 1.0, material1));
 
-    auto material2 = make_shared<lambertian_material_t>(color_t(0.4, 0.2, 0.1));
-    scene.entities.add(make_shared<sphere_t>(point3(-4, 1, 0), 1.0, material2));
+    auto material2 = make_object<lambertian_material_t>(color_t(0.4, 0.2, 0.1));
+    scene.entities.add(make_object<sphere_t>(point3(-4, 1, 0), 1.0, material2));
 
-    auto material3 = make_shared<metal_material_t>(color_t(0.7, 0.6, 0.5), 0.0);
-    scene.entities.add(make_shared<sphere_t>(point3(4, 1, 0), 1.0, material3));
+    auto material3 = make_object<metal_material_t>(color_t(0.7, 0.6, 0.5), 0.0);
+    scene.entities.add(make_object<sphere_t>(point3(4, 1, 0), 1.0, material3));
 
-    scene.root = std::make_shared<bvh_node_t>(scene.entities, 0, 1);
+    scene.build();
     scene.background = {0.70, 0.80, 1.00};
     return scene;
 }
@@ -87,19 +137,19 @@ scene_t three_spheres_scene(int image_width, int image_height) {
     scene_t scene {cam};
 
 
-    auto material_ground = make_shared<lambertian_material_t>(color_t(0.8, 0.8, 0.0));
-    auto material_center = make_shared<lambertian_material_t>(color_t(0.1, 0.2, 0.5));
-    auto material_left   = make_shared<dielectric_material_t>(1.5);
-    auto material_right  = make_shared<metal_material_t>(color_t(0.8, 0.6, 0.2), 0.0);
+    auto material_ground = make_object<lambertian_material_t>(color_t(0.8, 0.8, 0.0));
+    auto material_center = make_object<lambertian_material_t>(color_t(0.1, 0.2, 0.5));
+    auto material_left   = make_object<dielectric_material_t>(1.5);
+    auto material_right  = make_object<metal_material_t>(color_t(0.8, 0.6, 0.2), 0.0);
 
-    scene.entities.add(make_shared<sphere_t>(point3( 0.0, -100.5, -1.0), 100.0, material_ground));
-    scene.entities.add(make_shared<sphere_t>(point3( 0.0,    0.0, -1.0),   0.5, material_center));
-    scene.entities.add(make_shared<sphere_t>(point3(-1.0,    0.0, -1.0),   0.5, material_left));
-    scene.entities.add(make_shared<sphere_t>(point3(-1.0,    0.0, -1.0), -0.45, material_left));
-    scene.entities.add(make_shared<sphere_t>(point3( 1.0,    0.0, -1.0),   0.5, material_right));
+    scene.entities.add(make_object<sphere_t>(point3( 0.0, -100.5, -1.0), 100.0, material_ground));
+    scene.entities.add(make_object<sphere_t>(point3( 0.0,    0.0, -1.0),   0.5, material_center));
+    scene.entities.add(make_object<sphere_t>(point3(-1.0,    0.0, -1.0),   0.5, material_left));
+    scene.entities.add(make_object<sphere_t>(point3(-1.0,    0.0, -1.0), -0.45, material_left));
+    scene.entities.add(make_object<sphere_t>(point3( 1.0,    0.0, -1.0),   0.5, material_right));
 
     scene.background = {0.70, 0.80, 1.00};
-    scene.root = std::make_shared<bvh_node_t>(scene.entities, 0, 1);
+    scene.build();
     return scene;
 }
 
@@ -114,13 +164,13 @@ scene_t earth_scene(int image_width, int image_height) {
         
     scene_t scene {cam};
 
-    auto earth_texture = make_shared<image_texture_t>("earthmap.jpg");
-    auto earth_surface = make_shared<lambertian_material_t>(earth_texture);
-    auto globe = make_shared<sphere_t>(point3(0,0,0), 2, earth_surface);
+    auto earth_texture = asset_cache_t::instance().image("earthmap.jpg");
+    auto earth_surface = make_object<lambertian_material_t>(earth_texture);
+    auto globe = make_object<sphere_t>(point3(0,0,0), 2, earth_surface);
 
     scene.entities.add(globe);
     scene.background = {0.70, 0.80, 1.00};
-    scene.root = std::make_shared<bvh_node_t>(scene.entities, 0, 1);
+    scene.build();
     return scene;
 }
 
@@ -135,12 +185,12 @@ scene_t two_perlin_spheres_scene(int image_width, int image_height) {
         
     scene_t scene {cam};
 
-    auto pertext = make_shared<noise_texture_t>(4);
-    scene.entities.add(make_shared<sphere_t>(point3(0,-1000,0), 1000, make_shared<lambertian_material_t>(pertext)));
-    scene.entities.add(make_shared<sphere_t>(point3(0, 2, 0), 2, make_shared<lambertian_material_t>(pertext)));
+    auto pertext = make_object<noise_texture_t>(4);
+    scene.entities.add(make_object<sphere_t>(point3(0,-1000,0), 1000, make_object<lambertian_material_t>(pertext)));
+    scene.entities.add(make_object<sphere_t>(point3(0, 2, 0), 2, make_object<lambertian_material_t>(pertext)));
 
     scene.background = {0.70, 0.80, 1.00};
-    scene.root = std::make_shared<bvh_node_t>(scene.entities, 0, 1);
+    scene.build();
     return scene;
 }
 
@@ -157,17 +207,17 @@ scene_t simple_light(int image_width, int image_height) {
 
     auto light_rotation = glm::angleAxis<float, glm::qualifier::defaultp>((float)degrees_to_radians(-90.0), {0.0f, 1.0f, 0.0f});
 
-    auto pertext = make_shared<noise_texture_t>(4);
-    scene.entities.add(make_shared<sphere_t>(point3(0,-1000,0), 1000, make_shared<lambertian_material_t>(pertext)));
-    scene.entities.add(make_shared<sphere_t>(point3(0, 2, 0), 2, make_shared<lambertian_material_t>(pertext)));
+    auto pertext = make_object<noise_texture_t>(4);
+    scene.entities.add(make_object<sphere_t>(point3(0,-1000,0), 1000, make_object<lambertian_material_t>(pertext)));
+    scene.entities.add(make_object<sphere_t>(point3(0, 2, 0), 2, make_object<lambertian_material_t>(pertext)));
 
-    auto difflight = make_shared<diffuse_light>(color_t(4,4,4));
+    auto difflight = make_object<diffuse_light>(color_t(4,4,4));
 
-    scene.entities.add(make_shared<rect_t>(3, 3, dvec3_t{3.0, 2.0f, 0}, light_rotation, difflight));
+    scene.entities.add(make_object<rect_t>(3, 3, dvec3_t{3.0, 2.0f, 0}, light_rotation, difflight));
     
 
     scene.background = {0.01, 0.02, 0.03};
-    scene.root = std::make_shared<bvh_node_t>(scene.entities, 0, 1);
+    scene.build();
     return scene;    
 }
 
@@ -182,14 +232,14 @@ scene_t simple_box(int image_width, int image_height) {
         
     scene_t scene {cam};
     auto box_rotation = glm::angleAxis<float, glm::qualifier::defaultp>((float)degrees_to_radians(-45.0), {0.0f, 1.0f, 0.0f});
-    auto ground_material = make_shared<lambertian_material_t>(make_shared<checker_texture_t>(color_t(0, 0, 0), color_t(0.8, 0.8, 0.8)));
-    auto pertext = make_shared<noise_texture_t>(4);
-    scene.entities.add(make_shared<sphere_t>(point3(0,-1000,0), 1000, ground_material));
-    scene.entities.add(make_shared<box_t>(point3(0, 2, 0), box_rotation, 4, 0.5, 2, make_shared<lambertian_material_t>(pertext)));
+    auto ground_material = make_object<lambertian_material_t>(make_object<checker_texture_t>(color_t(0, 0, 0), color_t(0.8, 0.8, 0.8)));
+    auto pertext = make_object<noise_texture_t>(4);
+    scene.entities.add(make_object<sphere_t>(point3(0,-1000,0), 1000, ground_material));
+    scene.entities.add(make_object<box_t>(point3(0, 2, 0), box_rotation, 4, 0.5, 2, make_object<lambertian_material_t>(pertext)));
     
 
     scene.background = {0.70, 0.80, 1.00};
-    scene.root = std::make_shared<bvh_node_t>(scene.entities, 0, 1);
+    scene.build();
     return scene;    
 }
 
@@ -204,14 +254,14 @@ scene_t box_test(int image_width, int image_height) {
         
     scene_t scene {cam};
     auto box_rotation = glm::angleAxis<float, glm::qualifier::defaultp>((float)degrees_to_radians(-45.0), {0.0f, 1.0f, 0.0f});
-    auto ground_material = make_shared<lambertian_material_t>(make_shared<checker_texture_t>(color_t(0, 0, 0), color_t(0.8, 0.8, 0.8)));
-    auto pertext = make_shared<noise_texture_t>(4);
-    scene.entities.add(make_shared<sphere_t>(point3(0,-1000,0), 1000, ground_material));
-    scene.entities.add(make_shared<box_t>(point3(0, 2, 0), box_rotation, 4, 0.5, 2, make_shared<lambertian_material_t>(pertext)));
+    auto ground_material = make_object<lambertian_material_t>(make_object<checker_texture_t>(color_t(0, 0, 0), color_t(0.8, 0.8, 0.8)));
+    auto pertext = make_object<noise_texture_t>(4);
+    scene.entities.add(make_object<sphere_t>(point3(0,-1000,0), 1000, ground_material));
+    scene.entities.add(make_object<box_t>(point3(0, 2, 0), box_rotation, 4, 0.5, 2, make_object<lambertian_material_t>(pertext)));
     
 
     scene.background = {0.70, 0.80, 1.00};
-    scene.root = std::make_shared<bvh_node_t>(scene.entities, 0, 1);
+    scene.build();
     return scene;    
 }
 
@@ -228,11 +278,11 @@ scene_t cornell_box(int image_width, int image_height) {
         
     scene_t scene {cam};
 
-    auto red   = make_shared<lambertian_material_t>(color_t(.65, .05, .05));
-    auto white = make_shared<lambertian_material_t>(color_t(.73, .73, .73));
-    auto green = make_shared<lambertian_material_t>(color_t(.12, .45, .15));
-    auto blue = make_shared<lambertian_material_t>(color_t(.12, .45, .85));
-    auto light = make_shared<diffuse_light>(color_t(15, 15, 15));
+    auto red   = make_object<lambertian_material_t>(color_t(.65, .05, .05));
+    auto white = make_object<lambertian_material_t>(color_t(.73, .73, .73));
+    auto green = make_object<lambertian_material_t>(color_t(.12, .45, .15));
+    auto blue = make_object<lambertian_material_t>(color_t(.12, .45, .85));
+    auto light = make_object<diffuse_light>(color_t(15, 15, 15));
     
     auto r90y = glm::angleAxis<double, glm::qualifier::defaultp>(degrees_to_radians(90.0), {0.0, 1.0, 0.0});
     auto r90x = glm::angleAxis<double, glm::qualifier::defaultp>(degrees_to_radians(90.0), {1.0, 0.0, 0.0});
@@ -240,20 +290,20 @@ scene_t cornell_box(int image_width, int image_height) {
     auto r15y = glm::angleAxis<double, glm::qualifier::defaultp>(degrees_to_radians(15.0), {0.0, 1.0, 0.0});
     auto rn15y = glm::angleAxis<double, glm::qualifier::defaultp>(degrees_to_radians(-15.0), {0.0, 1.0, 0.0});
 
-    scene.entities.add(make_shared<rect_t>(555, 555, dvec3_t{0, 0, -555.5}, glm::quat(), white));
-    scene.entities.add(make_shared<rect_t>(555, 555, dvec3_t{0, -277.5, -277.5}, r90x, white));
-    scene.entities.add(make_shared<rect_t>(555, 555, dvec3_t{0,  277.5, -277.5}, r90x, white));
-    scene.entities.add(make_shared<rect_t>(150, 150, dvec3_t{0,  277, -277.5}, r90x, light));
-    scene.entities.add(make_shared<rect_t>(555, 555, dvec3_t{-277.5, 0, -277.5}, r90y, red));
-    scene.entities.add(make_shared<rect_t>(555, 555, dvec3_t{ 277.5, 0, -277.5}, r90y, green));
+    scene.entities.add(make_object<rect_t>(555, 555, dvec3_t{0, 0, -555.5}, glm::quat(), white));
+    scene.entities.add(make_object<rect_t>(555, 555, dvec3_t{0, -277.5, -277.5}, r90x, white));
+    scene.entities.add(make_object<rect_t>(555, 555, dvec3_t{0,  277.5, -277.5}, r90x, white));
+    scene.entities.add(make_object<rect_t>(150, 150, dvec3_t{0,  277, -277.5}, r90x, light));
+    scene.entities.add(make_object<rect_t>(555, 555, dvec3_t{-277.5, 0, -277.5}, r90y, red));
+    scene.entities.add(make_object<rect_t>(555, 555, dvec3_t{ 277.5, 0, -277.5}, r90y, green));
 
     //add some boxes
-    scene.entities.add(make_shared<box_t>(dvec3_t{50, -277.5 + (150.0/2.0), -150}, rn15y, 150, 150, 150, white));
-    scene.entities.add(make_shared<box_t>(dvec3_t{-100, -277.5 + (250/2.0), -400}, r15y, 200, 250, 200, blue));
+    scene.entities.add(make_object<box_t>(dvec3_t{50, -277.5 + (150.0/2.0), -150}, rn15y, 150, 150, 150, white));
+    scene.entities.add(make_object<box_t>(dvec3_t{-100, -277.5 + (250/2.0), -400}, r15y, 200, 250, 200, blue));
     
 
     scene.background = {0.0, 0.0, 0.0};
-    scene.root = std::make_shared<bvh_node_t>(scene.entities, 0, 1);
+    scene.build();
     return scene;    
 }
 
@@ -268,11 +318,11 @@ scene_t cornell_smoke_box(int image_width, int image_height) {
         
     scene_t scene {cam};
 
-    auto red   = make_shared<lambertian_material_t>(color_t(.65, .05, .05));
-    auto white = make_shared<lambertian_material_t>(color_t(.73, .73, .73));
-    auto green = make_shared<lambertian_material_t>(color_t(.12, .45, .15));
-    auto blue = make_shared<lambertian_material_t>(color_t(.12, .45, .85));
-    auto light = make_shared<diffuse_light>(color_t(15, 15, 15));
+    auto red   = make_object<lambertian_material_t>(color_t(.65, .05, .05));
+    auto white = make_object<lambertian_material_t>(color_t(.73, .73, .73));
+    auto green = make_object<lambertian_material_t>(color_t(.12, .45, .15));
+    auto blue = make_object<lambertian_material_t>(color_t(.12, .45, .85));
+    auto light = make_object<diffuse_light>(color_t(15, 15, 15));
     
     auto r90y = glm::angleAxis<double, glm::qualifier::defaultp>(degrees_to_radians(90.0), {0.0, 1.0, 0.0});
     auto r90x = glm::angleAxis<double, glm::qualifier::defaultp>(degrees_to_radians(90.0), {1.0, 0.0, 0.0});
@@ -280,24 +330,67 @@ scene_t cornell_smoke_box(int image_width, int image_height) {
     auto r15y = glm::angleAxis<double, glm::qualifier::defaultp>(degrees_to_radians(15.0), {0.0, 1.0, 0.0});
     auto rn15y = glm::angleAxis<double, glm::qualifier::defaultp>(degrees_to_radians(-15.0), {0.0, 1.0, 0.0});
 
-    scene.entities.add(make_shared<rect_t>(555, 555, dvec3_t{0, 0, -555.5}, glm::quat(), white));
-    scene.entities.add(make_shared<rect_t>(555, 555, dvec3_t{0, -277.5, -277.5}, r90x, white));
-    scene.entities.add(make_shared<rect_t>(555, 555, dvec3_t{0,  277.5, -277.5}, r90x, white));
-    scene.entities.add(make_shared<rect_t>(150, 150, dvec3_t{0,  277, -277.5}, r90x, light));
-    scene.entities.add(make_shared<rect_t>(555, 555, dvec3_t{-277.5, 0, -277.5}, r90y, red));
-    scene.entities.add(make_shared<rect_t>(555, 555, dvec3_t{ 277.5, 0, -277.5}, r90y, green));
+    scene.entities.add(make_object<rect_t>(555, 555, dvec3_t{0, 0, -555.5}, glm::quat(), white));
+    scene.entities.add(make_object<rect_t>(555, 555, dvec3_t{0, -277.5, -277.5}, r90x, white));
+    scene.entities.add(make_object<rect_t>(555, 555, dvec3_t{0,  277.5, -277.5}, r90x, white));
+    scene.entities.add(make_object<rect_t>(150, 150, dvec3_t{0,  277, -277.5}, r90x, light));
+    scene.entities.add(make_object<rect_t>(555, 555, dvec3_t{-277.5, 0, -277.5}, r90y, red));
+    scene.entities.add(make_object<rect_t>(555, 555, dvec3_t{ 277.5, 0, -277.5}, r90y, green));
 
     //add some boxes
-    auto box1 = make_shared<box_t>(dvec3_t{0, 0, 0}, glm::quat(), 150, 150, 150, white);
+    auto box1 = make_object<box_t>(dvec3_t{0, 0, 0}, glm::quat(), 150, 150, 150, white);
     //scene.entities.add(box1);
-    scene.entities.add(make_shared<constant_medium_t>(box1, 0.01, color_t(0,0,0)));
+    scene.entities.add(make_object<constant_medium_t>(box1, 0.01, color_t(0,0,0)));
     
 
     scene.background = {0.0, 0.0, 0.0};
-    scene.root = std::make_shared<bvh_node_t>(scene.entities, 0, 1);
+    scene.build();
     return scene;    
 }
 
+scene_t cornell_grid_smoke(int image_width, int image_height) {
+    constexpr point3 look_from(0,0,800);
+    constexpr point3 look_at(0,0, 0);
+    constexpr dvec3_t vup(0,1,0);
+
+    camera_t cam {image_width, image_height, 40.0, look_from, look_at, vup, 0.0, glm::length(look_from-look_at)};
+
+    scene_t scene {cam};
+
+    auto red   = make_object<lambertian_material_t>(color_t(.65, .05, .05));
+    auto white = make_object<lambertian_material_t>(color_t(.73, .73, .73));
+    auto green = make_object<lambertian_material_t>(color_t(.12, .45, .15));
+    auto light = make_object<diffuse_light>(color_t(15, 15, 15));
+
+    auto r90y = glm::angleAxis<double, glm::qualifier::defaultp>(degrees_to_radians(90.0), {0.0, 1.0, 0.0});
+    auto r90x = glm::angleAxis<double, glm::qualifier::defaultp>(degrees_to_radians(90.0), {1.0, 0.0, 0.0});
+    auto rn15y = glm::angleAxis<double, glm::qualifier::defaultp>(degrees_to_radians(-15.0), {0.0, 1.0, 0.0});
+
+    scene.entities.add(make_object<rect_t>(555, 555, dvec3_t{0, 0, -555.5}, glm::quat(), white));
+    scene.entities.add(make_object<rect_t>(555, 555, dvec3_t{0, -277.5, -277.5}, r90x, white));
+    scene.entities.add(make_object<rect_t>(555, 555, dvec3_t{0,  277.5, -277.5}, r90x, white));
+    scene.entities.add(make_object<rect_t>(150, 150, dvec3_t{0,  277, -277.5}, r90x, light));
+    scene.entities.add(make_object<rect_t>(555, 555, dvec3_t{-277.5, 0, -277.5}, r90y, red));
+    scene.entities.add(make_object<rect_t>(555, 555, dvec3_t{ 277.5, 0, -277.5}, r90y, green));
+    scene.entities.add(make_object<box_t>(dvec3_t{120, -277.5 + (150.0/2.0), -200}, rn15y, 150, 150, 150, white));
+
+    // a plume of smoke rising from the floor and spreading out as it goes, thick and
+    // turbulent in the middle, with clear air all around it
+    const perlin_t& noise = *asset_cache_t::instance().perlin();
+    auto grid = make_object<density_grid_t>(64, 96, 64, [&](const dvec3_t& p) {
+        const double radius = 0.12 + 0.3 * p.y;
+        const double off_axis = glm::length(dvec2_t(p.x - 0.5, p.z - 0.5)) / radius;
+        const double fade = std::clamp((0.95 - p.y) * 8.0, 0.0, 1.0);
+        const double plume = std::max(0.0, 1.0 - off_axis) * fade;
+        return static_cast<float>(plume * std::max(0.0, 0.3 + noise.turb(p * 6.0)));
+    });
+    const aabb_t bounds(point3(-220, -277.5, -500), point3(180, 260, -100));
+    scene.entities.add(make_object<grid_medium_t>(bounds, grid, 0.06, color_t(0.8, 0.8, 0.8)));
+
+    scene.background = {0.0, 0.0, 0.0};
+    scene.build();
+    return scene;
+}
 
 scene_t all_test(int image_width, int image_height) {
 
@@ -312,7 +405,7 @@ scene_t all_test(int image_width, int image_height) {
         
     scene_t scene {cam};
     
-    auto ground = make_shared<lambertian_material_t>(color_t(0.48, 0.83, 0.53));
+    auto ground = make_object<lambertian_material_t>(color_t(0.48, 0.83, 0.53));
 
     const int boxes_per_side = 20;
     for (int i = 0; i < boxes_per_side; i++) {
@@ -322,19 +415,164 @@ scene_t all_test(int image_width, int image_height) {
             auto z0 = -1000.0 + j*w;
             auto y0 = 0;
             
-            scene.entities.add(make_shared<box_t>(point3(x0,y0,z0), glm::dquat(), 100,random_double(10, 150), 100, ground));
+            scene.entities.add(make_object<box_t>(point3(x0,y0,z0), glm::dquat(), 100,random_double(10, 150), 100, ground));
         }
     }
 
-    scene.entities.add(make_shared<sphere_t>(point3(260, 150, 45), 50, make_shared<dielectric_material_t>(1.5)));
-    scene.entities.add(make_shared<sphere_t>(
-        point3(0, 150, 145), 50, make_shared<metal_material_t>(color_t(0.8, 0.8, 0.9), 1.0)
+    scene.entities.add(make_object<sphere_t>(point3(260, 150, 45), 50, make_object<dielectric_material_t>(1.5)));
+    scene.entities.add(make_object<sphere_t>(
+        point3(0, 150, 145), 50, make_object<metal_material_t>(color_t(0.8, 0.8, 0.9), 1.0)
     ));
 
-    auto light = make_shared<diffuse_light>(color_t(7, 7, 7));
-    scene.entities.add(make_shared<rect_t>(300, 300, dvec3_t{0, 554, 0}, r90x, light));
+    auto light = make_object<diffuse_light>(color_t(7, 7, 7));
+    scene.entities.add(make_object<rect_t>(300, 300, dvec3_t{0, 554, 0}, r90x, light));
 
     scene.background = {0.0, 0.0, 0.0};
-    scene.root = std::make_shared<bvh_node_t>(scene.entities, 0, 1);
+    scene.build();
     return scene;
-}
\ No newline at end of file
+}
+
+scene_t glossy_lights(int image_width, int image_height) {
+    constexpr point3 look_from(0, 2, 15);
+    constexpr point3 look_at(0, 0.5, 0);
+    constexpr dvec3_t vup(0,1,0);
+    const auto dist_to_focus = glm::length(look_from-look_at);
+
+    camera_t cam {image_width, image_height, 30.0, look_from, look_at, vup, 0.0, dist_to_focus};
+    scene_t scene {cam};
+
+    scene.entities.add(make_object<sphere_t>(point3(0,-1000,0), 1000, make_object<lambertian_material_t>(color_t(0.3, 0.3, 0.3))));
+
+    // plates from nearly mirror-like (front) to rough (back), tilted to reflect the lights
+    const double roughness[] = {0.02, 0.06, 0.15, 0.35};
+    for(int i = 0; i < 4; i++) {
+        const double z = 2.0 - 1.6 * i;
+        const double y = 0.3 + 0.35 * i;
+        const glm::dquat tilt = glm::angleAxis(degrees_to_radians(-90.0 + 12.0 + 8.0 * i), dvec3_t(1, 0, 0));
+        scene.entities.add(make_object<rect_t>(8, 1.4, dvec3_t{0, y, z}, tilt, make_object<metal_material_t>(color_t(0.8, 0.8, 0.8), roughness[i])));
+    }
+
+    // lights from tiny and bright to big and dim, all giving off the same total power
+    const double radius[] = {0.05, 0.15, 0.45, 1.0};
+    const color_t tint[] = {{1.0, 0.4, 0.4}, {1.0, 0.9, 0.4}, {0.4, 1.0, 0.5}, {0.4, 0.6, 1.0}};
+    for(int i = 0; i < 4; i++) {
+        const double intensity = 0.8 / (radius[i] * radius[i]);
+        scene.entities.add(make_object<sphere_t>(point3(-3.75 + 2.5 * i, 5, -4), radius[i], make_object<diffuse_light>(tint[i] * intensity)));
+    }
+
+    scene.background = {0.0, 0.0, 0.0};
+    scene.build();
+    return scene;
+}
+
+scene_t display_wall(int image_width, int image_height) {
+    constexpr point3 look_from(0, 1.6, 9);
+    constexpr point3 look_at(0, 1.2, -1);
+    constexpr dvec3_t vup(0,1,0);
+    const auto dist_to_focus = glm::length(look_from-look_at);
+
+    camera_t cam {image_width, image_height, 40.0, look_from, look_at, vup, 0.0, dist_to_focus};
+    scene_t scene {cam};
+
+    scene.entities.add(make_object<sphere_t>(point3(0,-1000,0), 1000, make_object<lambertian_material_t>(color_t(0.5, 0.5, 0.5))));
+    scene.entities.add(make_object<sphere_t>(point3(-1.6, 0.6, 0.5), 0.6, make_object<lambertian_material_t>(color_t(0.8, 0.8, 0.8))));
+    scene.entities.add(make_object<sphere_t>(point3(1.4, 0.7, 1.0), 0.7, make_object<metal_material_t>(color_t(0.9, 0.9, 0.9), 0.2)));
+
+    // every pixel of the wall is its own light: a dim rainbow with one bright spot on it
+    constexpr int columns = 64;
+    constexpr int rows = 36;
+    constexpr double pitch = 0.1;
+    for(int y = 0; y < rows; y++) {
+        for(int x = 0; x < columns; x++) {
+            const double u = (x + 0.5) / columns;
+            const double v = (y + 0.5) / rows;
+            const color_t hue(
+                0.5 + 0.5 * cos(2.0 * g_pi * u),
+                0.5 + 0.5 * cos(2.0 * g_pi * (u - 1.0 / 3.0)),
+                0.5 + 0.5 * cos(2.0 * g_pi * (u - 2.0 / 3.0)));
+            const double spot = exp(-((u - 0.75) * (u - 0.75) + (v - 0.6) * (v - 0.6)) / 0.002);
+            const double brightness = 2.0 + 800.0 * spot;
+            const dvec3_t center((x - (columns - 1) * 0.5) * pitch, 0.5 + (y + 0.5) * pitch, -3.0);
+            scene.entities.add(make_object<rect_t>(pitch * 0.9, pitch * 0.9, center, glm::dquat(1, 0, 0, 0), make_object<diffuse_light>(hue * brightness)));
+        }
+    }
+
+    scene.background = {0.0, 0.0, 0.0};
+    scene.build();
+    return scene;
+}
+
+scene_t sunny_day(int image_width, int image_height) {
+    constexpr point3 look_from(0, 1.5, 7);
+    constexpr point3 look_at(0, 0.6, 0);
+    constexpr dvec3_t vup(0,1,0);
+    const auto dist_to_focus = glm::length(look_from-look_at);
+
+    camera_t cam {image_width, image_height, 35.0, look_from, look_at, vup, 0.0, dist_to_focus};
+    scene_t scene {cam};
+
+    scene.entities.add(make_object<sphere_t>(point3(0,-1000,0), 1000, make_object<lambertian_material_t>(color_t(0.45, 0.42, 0.38))));
+    scene.entities.add(make_object<sphere_t>(point3(-1.8, 0.7, 0), 0.7, make_object<lambertian_material_t>(color_t(0.7, 0.2, 0.15))));
+    scene.entities.add(make_object<sphere_t>(point3(0, 0.8, -0.6), 0.8, make_object<dielectric_material_t>(1.5)));
+    scene.entities.add(make_object<sphere_t>(point3(1.8, 0.7, 0.2), 0.7, make_object<metal_material_t>(color_t(0.85, 0.85, 0.9), 0.15)));
+
+    // a low sun off to the right, so the shadows are long
+    scene.environment = environment_map_t::sky(512, 256, dvec3_t(0.8, 0.45, -0.5));
+    scene.build();
+    return scene;
+}
+
+namespace {
+    struct named_scene_t {
+        const char* name;
+        scene_t (*build)(int image_width, int image_height);
+    };
+
+    const named_scene_t g_named_scenes[] = {
+        {"random_scene", random_scene},
+        {"three_spheres_scene", three_spheres_scene},
+        {"earth_scene", earth_scene},
+        {"two_perlin_spheres_scene", two_perlin_spheres_scene},
+        {"simple_light", simple_light},
+        {"simple_box", simple_box},
+        {"box_test", box_test},
+        {"cornell_box", cornell_box},
+        {"cornell_smoke_box", cornell_smoke_box},
+        {"cornell_grid_smoke", cornell_grid_smoke},
+        {"all_test", all_test},
+        {"glossy_lights", glossy_lights},
+        {"display_wall", display_wall},
+        {"sunny_day", sunny_day},
+    };
+}
+
+const std::vector<std::string>& scene_names() {
+    static const std::vector<std::string> names = [] {
+        std::vector<std::string> result;
+        for(const auto& s : g_named_scenes) {
+            result.emplace_back(s.name);
+        }
+        return result;
+    }();
+    return names;
+}
+
+std::optional<scene_t> make_scene(const std::string& name, int image_width, int image_height, bool in_arena) {
+    for(const auto& s : g_named_scenes) {
+        if(name != s.name) {
+            continue;
+        }
+        if(!in_arena) {
+            return s.build(image_width, image_height);
+        }
+        auto arena = make_shared<scene_arena_t>();
+        std::optional<scene_t> scene;
+        {
+            const arena_scope_t scope(arena.get());
+            scene = s.build(image_width, image_height);
+        }
+        scene->arena = std::move(arena);
+        return scene;
+    }
+    return std::nullopt;
+}
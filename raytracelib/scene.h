@@ -1,18 +1,71 @@
 #pragma once
 #include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "bvh_node.h"
 #include "camera.h"
+#include "environment.h"
 #include "hittable_list.h"
+#include "light_bvh.h"
 #include "material.h"
+#include "primitive_store.h"
+#include "scene_arena.h"
 #include "sphere.h"
 
 struct scene_t {
     scene_t(const camera_t& camera): cam(camera) {}
     scene_t(const camera_t& camera, const hittable_list_t& ents): entities(ents), cam(camera) {}
+
+    scene_t(const scene_t&) = default;
+    scene_t(scene_t&&) noexcept = default;
+    ~scene_t() = default;
+
+    // these let go of the objects this scene had before its arena
+    scene_t& operator=(scene_t&& other) noexcept;
+    scene_t& operator=(const scene_t& other);
+
+    /**
+     * \brief Compiles the entities into a primitive_store_t (with its BVH), collects the
+     * lights and builds the light tree over them. Call this once all the entities have
+     * been added. The store goes in the current arena, if any (see arena_scope_t).
+     */
+    void build();
+
+    /**
+     * \brief True if obj is in the light list (so next event estimation already
+     * accounts for the light it emits).
+     */
+    [[nodiscard]] bool is_sampled_light(const hittable_t* obj) const;
+
+    /**
+     * \brief Where obj is in the light list, or -1 if it isn't a light.
+     */
+    [[nodiscard]] int light_index(const hittable_t* obj) const;
+
+    // where the scene's objects are, if it was built in an arena (see make_scene), or
+    // null. Declared first so it goes after them. Copies of the scene share it.
+    shared_ptr<scene_arena_t> arena;
+
     hittable_list_t entities;
-    shared_ptr<bvh_node_t> root;
+    // what rays are traced against: the primitive store, or for comparisons a
+    // bvh_node_t over the entities
+    shared_ptr<hittable_t> root;
+
+    // every entity with an emissive material that can be sampled directly
+    std::vector<shared_ptr<hittable_t>> lights;
+    std::unordered_map<const hittable_t*, int> light_indices;
+
+    // for picking lights by how much they're likely to contribute
+    light_bvh_t light_tree;
+
     camera_t cam;
     color_t background = {0, 0, 0};
+
+    // if set, rays that leave the scene see this instead of background, and next event
+    // estimation samples it like any other light
+    shared_ptr<environment_map_t> environment;
 };
 
 
@@ -34,4 +87,43 @@ scene_t cornell_box(int image_width, int image_height);
 
 scene_t cornell_smoke_box(int image_width, int image_height);
 
-scene_t all_test(int image_width, int image_height);
\ No newline at end of file
+/**
+ * \brief The Cornell box with a plume of smoke rising in it, whose density varies
+ * through a voxel grid (see grid_medium_t) and is zero in most of the room.
+ */
+scene_t cornell_grid_smoke(int image_width, int image_height);
+
+scene_t all_test(int image_width, int image_height);
+
+/**
+ * \brief Metal plates of increasing roughness reflecting sphere lights of increasing
+ * size. Light sampling wins on the rough plates and small lights, BSDF sampling on
+ * the shiny plates and big lights, so it shows off what MIS does.
+ */
+scene_t glossy_lights(int image_width, int image_height);
+
+/**
+ * \brief A video wall made of a couple of thousand small emissive rects lighting a
+ * floor and a few spheres. Picking lights uniformly mostly finds dim pixels on the
+ * far side of the wall; the light tree doesn't.
+ */
+scene_t display_wall(int image_width, int image_height);
+
+/**
+ * \brief A few spheres outdoors, lit only by a sky environment map with a small,
+ * very bright sun in it.
+ */
+scene_t sunny_day(int image_width, int image_height);
+
+/**
+ * \brief The names accepted by make_scene (these match the scene function names).
+ */
+const std::vector<std::string>& scene_names();
+
+/**
+ * \brief Builds a scene by name, for tools that pick the scene at runtime.
+ * \param in_arena make the scene's objects in an arena it owns (see scene_arena_t),
+ * which is quicker to build and tear down, rather than on the heap one by one
+ * \return The scene, or nothing if the name isn't recognised
+ */
+std::optional<scene_t> make_scene(const std::string& name, int image_width, int image_height, bool in_arena = false);
@@ -0,0 +1,48 @@
+#include "scene_arena.h"
+
+void* scene_arena_t::upstream_t::do_allocate(size_t bytes, size_t alignment) {
+    this->bytes += bytes;
+    blocks++;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void scene_arena_t::upstream_t::do_deallocate(void* p, size_t bytes, size_t alignment) {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+scene_arena_t::scene_arena_t(size_t first_block_bytes)
+    : m_buffer(first_block_bytes, &m_upstream) {
+}
+
+void* scene_arena_t::allocate(size_t bytes, size_t alignment) {
+    void* p = m_buffer.allocate(bytes, alignment);
+    m_objects++;
+    m_bytes += bytes;
+    return p;
+}
+
+scene_arena_stats_t scene_arena_t::stats() const {
+    scene_arena_stats_t stats;
+    stats.objects = m_objects;
+    stats.bytes = m_bytes;
+    stats.reserved_bytes = m_upstream.bytes;
+    stats.blocks = m_upstream.blocks;
+    return stats;
+}
+
+scene_arena_t*& scene_arena_t::current_slot() {
+    thread_local scene_arena_t* current = nullptr;
+    return current;
+}
+
+scene_arena_t* scene_arena_t::current() {
+    return current_slot();
+}
+
+arena_scope_t::arena_scope_t(scene_arena_t* arena)
+    : m_previous(std::exchange(scene_arena_t::current_slot(), arena)) {
+}
+
+arena_scope_t::~arena_scope_t() {
+    scene_arena_t::current_slot() = m_previous;
+}
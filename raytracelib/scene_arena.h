@@ -0,0 +1,129 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <utility>
+
+using std::shared_ptr;
+
+/**
+ * \brief What a scene_arena_t holds.
+ */
+struct scene_arena_stats_t {
+    // objects allocated, and the bytes they asked for (with their shared_ptr control blocks)
+    size_t objects = 0;
+    size_t bytes = 0;
+
+    // taken from the heap, in blocks that grow as the arena fills
+    size_t reserved_bytes = 0;
+    size_t blocks = 0;
+};
+
+/**
+ * \brief Memory for a scene's shapes, materials, textures and BVH nodes, handed out
+ * one after the other from a few big blocks (a monotonic buffer), so they're laid out
+ * in the order the scene was built in and the whole lot goes back to the heap in a
+ * few frees rather than one per object.
+ *
+ * Objects are put in it with make_object while an arena_scope_t for it is open. They
+ * don't keep it alive, and freeing one does nothing: the memory goes with the arena,
+ * when the last scene holding it goes. So nothing may hold on to an object after
+ * that (scene_t lets go of its objects before its arena).
+ *
+ * Only one thread may be making objects in it at a time (scenes are built on one thread).
+ */
+class scene_arena_t {
+public:
+    explicit scene_arena_t(size_t first_block_bytes = 64u << 10);
+    scene_arena_t(const scene_arena_t&) = delete;
+    scene_arena_t& operator=(const scene_arena_t&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment);
+
+    // the memory comes back with the rest, when the arena goes
+    void deallocate(size_t) {}
+
+    [[nodiscard]] scene_arena_stats_t stats() const;
+
+    // the arena make_object puts objects in on this thread, if any (see arena_scope_t)
+    [[nodiscard]] static scene_arena_t* current();
+
+protected:
+    friend class arena_scope_t;
+
+    // counts what the monotonic buffer takes from the heap
+    class upstream_t : public std::pmr::memory_resource {
+    public:
+        size_t bytes = 0;
+        size_t blocks = 0;
+
+    protected:
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+        [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+    };
+
+    static scene_arena_t*& current_slot();
+
+    upstream_t m_upstream;
+    std::pmr::monotonic_buffer_resource m_buffer;
+
+    size_t m_objects = 0;
+    size_t m_bytes = 0;
+};
+
+/**
+ * \brief Makes make_object put objects in arena on this thread, until the scope ends
+ * (when the arena that was current before is current again).
+ */
+class arena_scope_t {
+public:
+    explicit arena_scope_t(scene_arena_t* arena);
+    ~arena_scope_t();
+    arena_scope_t(const arena_scope_t&) = delete;
+    arena_scope_t& operator=(const arena_scope_t&) = delete;
+
+private:
+    scene_arena_t* m_previous;
+};
+
+/**
+ * \brief A std allocator over a scene_arena_t, which has to outlive what it allocates.
+ */
+template<typename T>
+class arena_allocator_t {
+public:
+    using value_type = T;
+
+    explicit arena_allocator_t(scene_arena_t* arena) : m_arena(arena) {}
+
+    template<typename U>
+    arena_allocator_t(const arena_allocator_t<U>& other) : m_arena(other.arena()) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t n) noexcept {
+        m_arena->deallocate(n * sizeof(T));
+    }
+
+    [[nodiscard]] scene_arena_t* arena() const { return m_arena; }
+
+    template<typename U>
+    bool operator==(const arena_allocator_t<U>& other) const { return m_arena == other.arena(); }
+
+private:
+    scene_arena_t* m_arena;
+};
+
+/**
+ * \brief make_shared, in the current scene arena if there is one (see arena_scope_t).
+ */
+template<typename T, typename... args_t>
+shared_ptr<T> make_object(args_t&&... args) {
+    if(scene_arena_t* arena = scene_arena_t::current()) {
+        return std::allocate_shared<T>(arena_allocator_t<T>(arena), std::forward<args_t>(args)...);
+    }
+    return std::make_shared<T>(std::forward<args_t>(args)...);
+}
@@ -1,5 +1,6 @@
 #include "sphere.h"
 #include "ray.h"
+#include "material.h"
 
 using namespace glm;
 
@@ -42,8 +43,80 @@ bool sphere_t::hit(const ray_t& r, double t_min, double t_max, hit_record_t& rec
     const dvec3_t outward_normal = (rec.p - center(r.time())) / m_radius;
     rec.set_face_normal(r, outward_normal);
     rec.uv = get_sphere_uv(outward_normal);
+
+    // u goes around the y axis, v from the bottom to the top
+    const dvec3_t local = rec.p - center(r.time());
+    const double rho = std::max(1e-9 * m_radius, sqrt(local.x*local.x + local.z*local.z));
+    rec.dpdu = 2*g_pi * dvec3_t(local.z, 0, -local.x);
+    rec.dpdv = g_pi * dvec3_t(-local.x*local.y / rho, rho, -local.z*local.y / rho);
     rec.mat = m_mat;
+    rec.object = this;
+
+    return true;
+}
+
+bool sphere_t::interval(const ray_t& r, double& t_enter, double& t_exit) const {
+    const dvec3_t oc = r.origin() - center(r.time());
+    const auto a = length2(r.direction());
+    const auto half_b = dot(oc, r.direction());
+    const auto c = length2(oc) - m_radius*m_radius;
+
+    const auto discriminant = half_b*half_b - a*c;
+    if (discriminant <= 0) return false;
+    const auto sqrtd = sqrt(discriminant);
+    t_enter = (-half_b - sqrtd) / a;
+    t_exit = (-half_b + sqrtd) / a;
+    return true;
+}
+
+bool sphere_t::is_area_light() const {
+    return m_mat && m_mat->is_emissive() && m_radius > 0;
+}
+
+bool sphere_t::sample_light(const point3& origin, double time, light_sample_t& sample) const {
+    const point3 c = center(time);
+    const dvec3_t to_center = c - origin;
+    const double distance_squared = length2(to_center);
+    const double radius_squared = m_radius * m_radius;
+    if(distance_squared <= radius_squared) {
+        return false; // inside the light, it's all around us
+    }
 
+    // sample the cone of directions that hit the sphere uniformly
+    const double cos_theta_max = sqrt(1.0 - radius_squared / distance_squared);
+    if(1.0 - cos_theta_max < 1e-12) {
+        return false; // too far away to be worth sampling
+    }
+    const double z = 1.0 + random_double() * (cos_theta_max - 1.0);
+    const double phi = 2.0 * g_pi * random_double();
+    const double sin_theta = sqrt(std::max(0.0, 1.0 - z*z));
+    const dvec3_t direction = onb_t(to_center).local(cos(phi) * sin_theta, sin(phi) * sin_theta, z);
+
+    // the near intersection of that direction with the sphere
+    const double b = dot(direction, to_center);
+    const double t = b - sqrt(std::max(0.0, b*b - (distance_squared - radius_squared)));
+
+    sample.p = origin + t * direction;
+    sample.normal = (sample.p - c) / m_radius;
+    sample.uv = get_sphere_uv(sample.normal);
+    sample.pdf = 1.0 / (2.0 * g_pi * (1.0 - cos_theta_max));
+    sample.emitted = m_mat->emitted(sample.uv.x, sample.uv.y, sample.p);
+    return true;
+}
+
+bool sphere_t::is_specular() const {
+    return m_mat && m_mat->is_specular();
+}
+
+bool sphere_t::sample_emission(double time, light_sample_t& sample) const {
+    if(!is_area_light()) {
+        return false;
+    }
+    sample.normal = random_unit_vector();
+    sample.p = center(time) + m_radius * sample.normal;
+    sample.uv = get_sphere_uv(sample.normal);
+    sample.pdf = 1.0 / (4.0 * g_pi * m_radius * m_radius);
+    sample.emitted = m_mat->emitted(sample.uv.x, sample.uv.y, sample.p);
     return true;
 }
 
@@ -58,3 +131,34 @@ bool sphere_t::bounding_box(double time0, double time1, aabb_t& output_box) cons
     output_box = surrounding_box(box0, box1);
     return true;
 }
+
+double sphere_t::light_pdf(const point3& origin, const dvec3_t& direction, double time) const {
+    hit_record_t rec;
+    if(!hit(ray_t(origin, direction, time), 0.001, infinity, rec)) {
+        return 0.0;
+    }
+    const double distance_squared = length2(center(time) - origin);
+    const double radius_squared = m_radius * m_radius;
+    if(distance_squared <= radius_squared) {
+        return 0.0;
+    }
+    const double cos_theta_max = sqrt(1.0 - radius_squared / distance_squared);
+    if(1.0 - cos_theta_max < 1e-12) {
+        return 0.0;
+    }
+    return 1.0 / (2.0 * g_pi * (1.0 - cos_theta_max));
+}
+
+bool sphere_t::light_bounds(light_bounds_t& bounds) const {
+    if(!is_area_light()) {
+        return false;
+    }
+    bounding_box(0, 1, bounds.box);
+    // the normals point every which way
+    bounds.axis = dvec3_t(0, 0, 1);
+    bounds.cos_theta_o = -1.0;
+    bounds.cos_theta_e = 0.0;
+    bounds.two_sided = false;
+    bounds.power = g_pi * 4.0 * g_pi * m_radius * m_radius * m_mat->average_emitted_luminance(m_center0);
+    return true;
+}
@@ -15,6 +15,17 @@ public:
 
     virtual bool bounding_box(double time0, double time1, aabb_t& output_box) const override;
 
+    bool interval(const ray_t& r, double& t_enter, double& t_exit) const override;
+
+    [[nodiscard]] bool is_area_light() const override;
+
+    // picks a direction inside the cone the sphere covers as seen from origin
+    bool sample_light(const point3& origin, double time, light_sample_t& sample) const override;
+    [[nodiscard]] double light_pdf(const point3& origin, const dvec3_t& direction, double time) const override;
+    bool light_bounds(light_bounds_t& bounds) const override;
+    [[nodiscard]] bool is_specular() const override;
+    bool sample_emission(double time, light_sample_t& sample) const override;
+
     [[nodiscard]] point3 center() const { return m_center0; }
 
     [[nodiscard]] point3 center(double time) const {
@@ -29,6 +40,9 @@ public:
     }
 
     [[nodiscard]] double radius() const { return m_radius; }
+    [[nodiscard]] double time0() const { return m_time0; }
+    [[nodiscard]] double time1() const { return m_time1; }
+    [[nodiscard]] const shared_ptr<material_t>& material() const { return m_mat; }
 
 protected:
     point3 m_center0;
@@ -1,38 +1,370 @@
 #include "texture.h"
+#include "asset_cache.h"
 #include "stb_image_include.h"
 
-image_texture_t::image_texture_t(const char* filename) {
+#include <algorithm>
+#include <array>
+
+#ifdef THREADS
+#include <thread>
+#endif
+
+namespace {
+    // 8 bit sRGB to linear
+    const std::array<float, 256>& srgb_to_linear() {
+        static const std::array<float, 256> table = [] {
+            std::array<float, 256> t{};
+            for(int i = 0; i < 256; i++) {
+                const double c = i / 255.0;
+                t[i] = static_cast<float>(c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    uint8_t linear_to_srgb8(float c) {
+        const double s = c <= 0.0031308f ? c * 12.92 : 1.055 * pow(static_cast<double>(c), 1.0 / 2.4) - 0.055;
+        return static_cast<uint8_t>(std::clamp(s * 255.0 + 0.5, 0.0, 255.0));
+    }
+
+    // 565 to 8 bits a channel, the way GPUs expand them
+    std::array<int, 3> expand_565(uint32_t c) {
+        const int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+        return {(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)};
+    }
+
+    uint32_t quantize_565(const double rgb[3]) {
+        auto q = [](double v, int max) { return static_cast<uint32_t>(std::clamp(v / 255.0 * max + 0.5, 0.0, static_cast<double>(max))); };
+        return q(rgb[0], 31) << 11 | q(rgb[1], 63) << 5 | q(rgb[2], 31);
+    }
+
+    // the four colors a block picks from (the fourth is black when c0 <= c1)
+    std::array<std::array<int, 3>, 4> bc1_palette(uint32_t c0, uint32_t c1) {
+        const auto a = expand_565(c0);
+        const auto b = expand_565(c1);
+        std::array<std::array<int, 3>, 4> p {a, b, {}, {}};
+        for(int c = 0; c < 3; c++) {
+            if(c0 > c1) {
+                p[2][c] = (2 * a[c] + b[c]) / 3;
+                p[3][c] = (a[c] + 2 * b[c]) / 3;
+            } else {
+                p[2][c] = (a[c] + b[c]) / 2;
+                p[3][c] = 0;
+            }
+        }
+        return p;
+    }
+
+    // one color of bc1_palette, without working out the rest
+    std::array<int, 3> bc1_color(uint32_t c0, uint32_t c1, int index) {
+        if(index < 2) {
+            return expand_565(index == 0 ? c0 : c1);
+        }
+        const auto a = expand_565(c0);
+        const auto b = expand_565(c1);
+        if(c0 > c1) {
+            const int wa = index == 2 ? 2 : 1;
+            return {(wa * a[0] + (3 - wa) * b[0]) / 3, (wa * a[1] + (3 - wa) * b[1]) / 3, (wa * a[2] + (3 - wa) * b[2]) / 3};
+        }
+        if(index == 2) {
+            return {(a[0] + b[0]) / 2, (a[1] + b[1]) / 2, (a[2] + b[2]) / 2};
+        }
+        return {0, 0, 0};
+    }
+
+    /**
+     * \brief Compresses 16 sRGB texels (row by row): the endpoints are the extremes of
+     * the texels along the line they spread out along most (their principal axis),
+     * and each texel picks the nearest of the four colors.
+     */
+    uint64_t encode_bc1(const std::array<std::array<double, 3>, 16>& texels) {
+        double mean[3] = {0, 0, 0};
+        for(const auto& t : texels) {
+            for(int c = 0; c < 3; c++) {
+                mean[c] += t[c] / 16.0;
+            }
+        }
+        double cov[3][3] = {};
+        for(const auto& t : texels) {
+            for(int i = 0; i < 3; i++) {
+                for(int j = 0; j < 3; j++) {
+                    cov[i][j] += (t[i] - mean[i]) * (t[j] - mean[j]);
+                }
+            }
+        }
+
+        // a few rounds of power iteration find the principal axis well enough
+        double axis[3] = {1, 1, 1};
+        for(int iteration = 0; iteration < 6; iteration++) {
+            double next[3];
+            for(int i = 0; i < 3; i++) {
+                next[i] = cov[i][0] * axis[0] + cov[i][1] * axis[1] + cov[i][2] * axis[2];
+            }
+            const double len = std::max({std::abs(next[0]), std::abs(next[1]), std::abs(next[2])});
+            if(len <= 1e-9) {
+                break;
+            }
+            for(int i = 0; i < 3; i++) {
+                axis[i] = next[i] / len;
+            }
+        }
+
+        double lo = 0.0, hi = 0.0;
+        for(const auto& t : texels) {
+            const double d = (t[0] - mean[0]) * axis[0] + (t[1] - mean[1]) * axis[1] + (t[2] - mean[2]) * axis[2];
+            lo = std::min(lo, d);
+            hi = std::max(hi, d);
+        }
+        const double norm = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        double end0[3], end1[3];
+        for(int c = 0; c < 3; c++) {
+            end0[c] = mean[c] + axis[c] * hi / norm;
+            end1[c] = mean[c] + axis[c] * lo / norm;
+        }
+
+        uint32_t c0 = quantize_565(end0);
+        uint32_t c1 = quantize_565(end1);
+        if(c0 < c1) {
+            std::swap(c0, c1);
+        }
+        uint64_t indices = 0;
+        if(c0 != c1) {
+            const auto palette = bc1_palette(c0, c1);
+            for(int i = 0; i < 16; i++) {
+                int best = 0;
+                double best_distance = infinity;
+                for(int k = 0; k < 4; k++) {
+                    double distance = 0.0;
+                    for(int c = 0; c < 3; c++) {
+                        const double d = texels[i][c] - palette[k][c];
+                        distance += d * d;
+                    }
+                    if(distance < best_distance) {
+                        best_distance = distance;
+                        best = k;
+                    }
+                }
+                indices |= static_cast<uint64_t>(best) << (2 * i);
+            }
+        }
+        return c0 | static_cast<uint64_t>(c1) << 16 | indices << 32;
+    }
+
+    /**
+     * \brief Calls work(row) for every row in [0, rows), spread over the hardware's
+     * threads.
+     */
+    template<typename work_t>
+    void parallel_rows(int rows, const work_t& work) {
+        auto run = [&](int first, int step) {
+            for(int row = first; row < rows; row += step) {
+                work(row);
+            }
+        };
+#ifdef THREADS
+        const int threads = std::clamp(static_cast<int>(std::thread::hardware_concurrency()), 1, std::max(1, rows));
+        std::vector<std::thread> workers;
+        for(int t = 1; t < threads; t++) {
+            workers.emplace_back(run, t, threads);
+        }
+        run(0, threads);
+        for(auto& w : workers) {
+            w.join();
+        }
+#else
+        run(0, 1);
+#endif
+    }
+}
+
+double mip_level(int width, int height, int levels, const dvec2_t& duv_dx, const dvec2_t& duv_dy) {
+    const dvec2_t size(width, height);
+    const double footprint = std::max(glm::length(duv_dx * size), glm::length(duv_dy * size));
+    if(!(footprint > 1.0)) {
+        return 0.0;
+    }
+    return std::min(log2(footprint), static_cast<double>(levels - 1));
+}
+
+image_texture_t::image_texture_t(const char* filename, texture_format_t format)
+    : m_format(format) {
     auto components_per_pixel = bytes_per_pixel;
+    int width = 0, height = 0;
 
-    data = stbi_load(
-        filename, &width, &height, &components_per_pixel, components_per_pixel);
+    unsigned char* data = stbi_load(
+        filename, &width, &height, &components_per_pixel, bytes_per_pixel);
 
     if (!data) {
         std::cerr << "ERROR: Could not load texture image file '" << filename << "'.\n";
-        width = height = 0;
+        return;
     }
 
-    bytes_per_scanline = bytes_per_pixel * width;
+    const auto& linear = srgb_to_linear();
+    std::vector<float> rgb(static_cast<size_t>(width) * height * bytes_per_pixel);
+    for(size_t i = 0; i < rgb.size(); i++) {
+        rgb[i] = linear[data[i]];
+    }
+    stbi_image_free(data);
+
+    build(width, height, std::move(rgb));
+}
+
+image_texture_t::image_texture_t(int width, int height, const std::vector<float>& rgb, texture_format_t format)
+    : m_format(format) {
+    if(width <= 0 || height <= 0 || rgb.size() != static_cast<size_t>(width) * height * 3) {
+        std::cerr << "ERROR: image texture expects " << width << "x" << height << " RGB texels, got " << rgb.size() / 3 << "\n";
+        return;
+    }
+    build(width, height, rgb);
+}
+
+void image_texture_t::build(int width, int height, std::vector<float> rgb) {
+    while(true) {
+        level_t level;
+        level.width = width;
+        level.height = height;
+        store(level, rgb);
+        m_levels.push_back(std::move(level));
+
+        if(width == 1 && height == 1) {
+            break;
+        }
+
+        // each texel of the next level averages the 2x2 above it, except along an odd
+        // edge, where the last texel takes in the leftover row or column too (3 wide)
+        const int next_width = std::max(1, width / 2);
+        const int next_height = std::max(1, height / 2);
+        std::vector<float> next(static_cast<size_t>(next_width) * next_height * 3);
+        for(int y = 0; y < next_height; y++) {
+            const int y0 = std::min(2 * y, height - 1);
+            const int y1 = y == next_height - 1 ? height : y0 + 2;
+            for(int x = 0; x < next_width; x++) {
+                const int x0 = std::min(2 * x, width - 1);
+                const int x1 = x == next_width - 1 ? width : x0 + 2;
+                const float weight = 1.0f / static_cast<float>((x1 - x0) * (y1 - y0));
+                for(int c = 0; c < 3; c++) {
+                    float sum = 0.0f;
+                    for(int sy = y0; sy < y1; sy++) {
+                        for(int sx = x0; sx < x1; sx++) {
+                            sum += rgb[(static_cast<size_t>(sy) * width + sx) * 3 + c];
+                        }
+                    }
+                    next[(static_cast<size_t>(y) * next_width + x) * 3 + c] = sum * weight;
+                }
+            }
+        }
+        rgb = std::move(next);
+        width = next_width;
+        height = next_height;
+    }
+}
+
+void image_texture_t::store(level_t& level, const std::vector<float>& rgb) const {
+    const int width = level.width;
+    const int height = level.height;
+
+    if(m_format == texture_format_t::rgb_float) {
+        level.tiles_x = (width + tile_size - 1) / tile_size;
+        const int tiles_y = (height + tile_size - 1) / tile_size;
+        level.texels.assign(static_cast<size_t>(level.tiles_x) * tiles_y * tile_size * tile_size * 3, 0.0f);
+        for(int y = 0; y < height; y++) {
+            for(int x = 0; x < width; x++) {
+                const size_t tile = static_cast<size_t>(y / tile_size) * level.tiles_x + x / tile_size;
+                const size_t to = (tile * tile_size * tile_size + morton_index(x % tile_size, y % tile_size)) * 3;
+                const size_t from = (static_cast<size_t>(y) * width + x) * 3;
+                std::copy_n(rgb.begin() + from, 3, level.texels.begin() + to);
+            }
+        }
+        return;
+    }
+
+    // blocks past the image's edges repeat its edge texels
+    const int blocks_x = (width + 3) / 4;
+    const int blocks_y = (height + 3) / 4;
+    level.tiles_x = (blocks_x + tile_size - 1) / tile_size;
+    const int tiles_y = (blocks_y + tile_size - 1) / tile_size;
+    level.blocks.assign(static_cast<size_t>(level.tiles_x) * tiles_y * tile_size * tile_size, 0);
+    parallel_rows(blocks_y, [&](int by) {
+        std::array<std::array<double, 3>, 16> texels;
+        for(int bx = 0; bx < blocks_x; bx++) {
+            for(int i = 0; i < 16; i++) {
+                const int x = std::min(bx * 4 + i % 4, width - 1);
+                const int y = std::min(by * 4 + i / 4, height - 1);
+                for(int c = 0; c < 3; c++) {
+                    texels[i][c] = linear_to_srgb8(rgb[(static_cast<size_t>(y) * width + x) * 3 + c]);
+                }
+            }
+            const size_t tile = static_cast<size_t>(by / tile_size) * level.tiles_x + bx / tile_size;
+            level.blocks[tile * tile_size * tile_size + morton_index(bx % tile_size, by % tile_size)] = encode_bc1(texels);
+        }
+    });
+}
+
+color_t image_texture_t::texel(int level, int x, int y) const {
+    return texel(m_levels[std::clamp(level, 0, levels() - 1)], x, y);
+}
+
+color_t image_texture_t::texel(const level_t& l, int x, int y) const {
+    x = std::clamp(x, 0, l.width - 1);
+    y = std::clamp(y, 0, l.height - 1);
+
+    if(m_format == texture_format_t::bc1) {
+        // decode just this texel of its block
+        const int bx = x / 4, by = y / 4;
+        const size_t tile = static_cast<size_t>(by / tile_size) * l.tiles_x + bx / tile_size;
+        const uint64_t block = l.blocks[tile * tile_size * tile_size + morton_index(bx % tile_size, by % tile_size)];
+        const uint32_t c0 = block & 0xffff;
+        const uint32_t c1 = (block >> 16) & 0xffff;
+        const int index = static_cast<int>(block >> (32 + 2 * ((y % 4) * 4 + x % 4))) & 3;
+        const auto& linear = srgb_to_linear();
+        const std::array<int, 3> c = bc1_color(c0, c1, index);
+        return color_t(linear[c[0]], linear[c[1]], linear[c[2]]);
+    }
+
+    const size_t tile = static_cast<size_t>(y / tile_size) * l.tiles_x + x / tile_size;
+    const float* t = &l.texels[(tile * tile_size * tile_size + morton_index(x % tile_size, y % tile_size)) * 3];
+    return color_t(t[0], t[1], t[2]);
+}
+
+color_t image_texture_t::bilinear(const level_t& level, double u, double v) const {
+    return bilinear_lookup(level.width, level.height, u, v, [&](int x, int y) { return texel(level, x, y); });
 }
 
 color_t image_texture_t::value(double u, double v, const dvec3_t& p) const {
     // If we have no texture data, then return solid cyan as a debugging aid.
-    if (data == nullptr)
+    if (m_levels.empty())
         return color_t(0,1,1);
 
-    // Clamp input texture coordinates to [0,1] x [1,0]
-    u = glm::clamp(u, 0.0, 1.0);
-    v = 1.0 - glm::clamp(v, 0.0, 1.0);  // Flip V to image coordinates
+    return bilinear(m_levels[0], u, v);
+}
+
+color_t image_texture_t::filtered_value(double u, double v, const point3& p, const dvec2_t& duv_dx, const dvec2_t& duv_dy, const dvec3_t& dpdx, const dvec3_t& dpdy) const {
+    if (m_levels.empty())
+        return color_t(0,1,1);
 
-    auto i = static_cast<int>(u * width);
-    auto j = static_cast<int>(v * height);
+    const double lod = mip_level(width(), height(), levels(), duv_dx, duv_dy);
+    if(lod <= 0.0) {
+        return bilinear(m_levels[0], u, v);
+    }
+    const int fine = static_cast<int>(lod);
+    const int coarse = std::min(fine + 1, levels() - 1);
+    const double blend = lod - fine;
+    return bilinear(m_levels[fine], u, v) * (1.0 - blend) + bilinear(m_levels[coarse], u, v) * blend;
+}
 
-    // Clamp integer mapping, since actual coordinates should be less than 1.0
-    if (i >= width)  i = width-1;
-    if (j >= height) j = height-1;
+size_t image_texture_t::memory_bytes() const {
+    size_t bytes = 0;
+    for(const auto& level : m_levels) {
+        bytes += level.texels.capacity() * sizeof(float) + level.blocks.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
 
-    const auto color_scale = 1.0 / 255.0;
-    auto pixel = data + j*bytes_per_scanline + i*bytes_per_pixel;
+noise_texture_t::noise_texture_t()
+    : noise(asset_cache_t::instance().perlin()) {
+}
 
-    return color_t(color_scale*pixel[0], color_scale*pixel[1], color_scale*pixel[2]);
+noise_texture_t::noise_texture_t(double sc)
+    : noise(asset_cache_t::instance().perlin()), scale(sc) {
 }
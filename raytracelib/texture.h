@@ -1,12 +1,75 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
 #include "types.h"
 #include "color.h"
 #include "perlin.h"
+#include "scene_arena.h"
+
+/**
+ * \brief Where texel (x, y) of a tile is kept within it: Morton (Z) order, so texels
+ * near each other in the image are near each other in memory. x and y under 256.
+ */
+constexpr uint32_t morton_index(uint32_t x, uint32_t y) {
+    auto spread = [](uint32_t v) {
+        v &= 0xff;
+        v = (v | (v << 4)) & 0x0f0f;
+        v = (v | (v << 2)) & 0x3333;
+        v = (v | (v << 1)) & 0x5555;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
+
+/**
+ * \brief Interpolates between the four texels around (u, v) of a width x height image
+ * (v = 1 is its top row), which texel(x, y) reads (clamped to the edges by the caller).
+ */
+template<typename texel_t>
+color_t bilinear_lookup(int width, int height, double u, double v, const texel_t& texel) {
+    // texel centers are at +0.5
+    const double x = glm::clamp(u, 0.0, 1.0) * width - 0.5;
+    const double y = (1.0 - glm::clamp(v, 0.0, 1.0)) * height - 0.5;
+    const double x0 = floor(x);
+    const double y0 = floor(y);
+    const double fx = x - x0;
+    const double fy = y - y0;
+    const int i = static_cast<int>(x0);
+    const int j = static_cast<int>(y0);
+
+    return (texel(i, j) * (1.0 - fx) + texel(i + 1, j) * fx) * (1.0 - fy)
+         + (texel(i, j + 1) * (1.0 - fx) + texel(i + 1, j + 1) * fx) * fy;
+}
+
+/**
+ * \brief The mip level whose texels are as wide as the longer side of a footprint
+ * (see texture_t::filtered_value), between 0 and levels - 1. The fraction is how far
+ * to blend towards the next level.
+ */
+double mip_level(int width, int height, int levels, const dvec2_t& duv_dx, const dvec2_t& duv_dy);
 
 class texture_t {
     public:
         virtual color_t value(double u, double v, const point3& p) const = 0;
+
+        /**
+         * \brief The texture averaged over a pixel's footprint around (u, v), which
+         * duv_dx and duv_dy span (how far the coords move one pixel across and one up),
+         * and around p, which dpdx and dpdy span.
+         * Textures that can't be filtered ignore the footprint.
+         */
+        [[nodiscard]] virtual color_t filtered_value(double u, double v, const point3& p, const dvec2_t& duv_dx, const dvec2_t& duv_dy, const dvec3_t& dpdx, const dvec3_t& dpdy) const {
+            return value(u, v, p);
+        }
+
+        /**
+         * \brief True for textures that depend only on p and take some working out
+         * (procedural ones), which bake_textures can bake into a baked_texture_t.
+         */
+        [[nodiscard]] virtual bool bakeable() const { return false; }
 };
 
 class solid_color_t : public texture_t {
@@ -21,68 +84,166 @@ class solid_color_t : public texture_t {
             return color_value;
         }
 
+        [[nodiscard]] const color_t& color() const { return color_value; }
+
     private:
         color_t color_value;
 };
 
+/**
+ * \brief Alternates between two textures in 3D. The two can't be changed once it's made,
+ * as materials compile them into their texture programs.
+ */
 class checker_texture_t : public texture_t {
     public:
-        checker_texture_t() = default;
-
-        checker_texture_t(shared_ptr<texture_t> _even, shared_ptr<texture_t> _odd)
-            : even(_even), odd(_odd) {}
+        checker_texture_t(shared_ptr<const texture_t> _even, shared_ptr<const texture_t> _odd)
+            : m_even(std::move(_even)), m_odd(std::move(_odd)) {}
 
         checker_texture_t(color_t c1, color_t c2)
-            : even(make_shared<solid_color_t>(c1)) , odd(make_shared<solid_color_t>(c2)) {}
+            : m_even(make_object<solid_color_t>(c1)) , m_odd(make_object<solid_color_t>(c2)) {}
 
         virtual color_t value(double u, double v, const point3& p) const override {
-            auto sines = sin(10*p.x)*sin(10*p.y)*sin(10*p.z);
-            if (sines < 0)
-                return odd->value(u, v, p);
+            if (odd_at(p))
+                return m_odd->value(u, v, p);
             else
-                return even->value(u, v, p);
+                return m_even->value(u, v, p);
         }
 
-    public:
-        shared_ptr<texture_t> odd;
-        shared_ptr<texture_t> even;
+        // true where the odd texture shows
+        [[nodiscard]] static bool odd_at(const point3& p) {
+            auto sines = sin(10*p.x)*sin(10*p.y)*sin(10*p.z);
+            return sines < 0;
+        }
+
+        [[nodiscard]] bool bakeable() const override {
+            auto positional = [](const shared_ptr<const texture_t>& t) {
+                return t->bakeable() || dynamic_cast<const solid_color_t*>(t.get()) != nullptr;
+            };
+            return positional(m_even) && positional(m_odd);
+        }
+
+        [[nodiscard]] const shared_ptr<const texture_t>& even() const { return m_even; }
+        [[nodiscard]] const shared_ptr<const texture_t>& odd() const { return m_odd; }
+
+    protected:
+        shared_ptr<const texture_t> m_even;
+        shared_ptr<const texture_t> m_odd;
 };
 
+/**
+ * \brief How image_texture_t keeps its texels.
+ */
+enum class texture_format_t {
+    // linear RGB floats, 12 bytes a texel
+    rgb_float,
+
+    // BC1 (DXT1) blocks: each 4x4 texels are two RGB 565 endpoints (in sRGB) and a 2 bit
+    // pick per texel of one of them or one of two colors between them. Half a byte a
+    // texel, and lossy: a block can only hold colors along one line.
+    bc1
+};
+
+/**
+ * \brief An image, converted when it's loaded from 8 bit sRGB to linear float and to a
+ * pyramid of mip levels, each half the size of the one before. Filtered lookups blend
+ * bilinear lookups in the two levels nearest the footprint's size (trilinear), so a
+ * shrunk image is averaged rather than aliased, and reads the same few texels sample
+ * after sample. Each level is stored in tile_size^2 tiles with their texels in Morton
+ * (Z) order, so the texels around a lookup are close together in memory whichever way
+ * across the image it moves.
+ *
+ * With texture_format_t::bc1 the levels are compressed instead (in parallel, as the
+ * image is loaded), to tile_size^2 tiles of 4x4 texel blocks, and a lookup decodes
+ * just the texels it reads from their blocks.
+ */
 class image_texture_t : public texture_t {
-    public:
-        const static int bytes_per_pixel = 3;
+public:
+    const static int bytes_per_pixel = 3;
+    static constexpr int tile_size = 8;
 
-        image_texture_t()
-          : data(nullptr), width(0), height(0), bytes_per_scanline(0) {}
+    image_texture_t() = default;
 
-        image_texture_t(const char* filename);
+    image_texture_t(const char* filename, texture_format_t format = texture_format_t::rgb_float);
 
-        ~image_texture_t() {
-            delete data;
-        }
+    /**
+     * \brief An image from linear RGB texels, row by row from the top.
+     */
+    image_texture_t(int width, int height, const std::vector<float>& rgb, texture_format_t format = texture_format_t::rgb_float);
 
-        virtual color_t value(double u, double v, const dvec3_t& p) const override;
+    // bilinear in the full size image
+    color_t value(double u, double v, const dvec3_t& p) const override;
 
-    private:
-        unsigned char *data;
-        int width, height;
-        int bytes_per_scanline;
+    [[nodiscard]] color_t filtered_value(double u, double v, const point3& p, const dvec2_t& duv_dx, const dvec2_t& duv_dy, const dvec3_t& dpdx, const dvec3_t& dpdy) const override;
+
+    /**
+     * \brief A texel of a mip level (0 is the full size image), clamped to its edges.
+     */
+    [[nodiscard]] color_t texel(int level, int x, int y) const;
+
+    [[nodiscard]] int width() const { return m_levels.empty() ? 0 : m_levels[0].width; }
+    [[nodiscard]] int height() const { return m_levels.empty() ? 0 : m_levels[0].height; }
+    [[nodiscard]] int levels() const { return static_cast<int>(m_levels.size()); }
+
+    // the size of a mip level: half the one before, rounded down, and at least 1
+    [[nodiscard]] int level_width(int level) const { return m_levels[level].width; }
+    [[nodiscard]] int level_height(int level) const { return m_levels[level].height; }
+    [[nodiscard]] texture_format_t format() const { return m_format; }
+    [[nodiscard]] size_t memory_bytes() const;
+
+private:
+    struct level_t {
+        int width = 0;
+        int height = 0;
+
+        // tiles across, of texels or (bc1) of blocks
+        int tiles_x = 0;
+
+        // rgb, tile by tile
+        std::vector<float> texels;
+
+        // bc1 blocks, tile by tile
+        std::vector<uint64_t> blocks;
+    };
+
+    void build(int width, int height, std::vector<float> rgb);
+
+    // stores a level's rgb (row by row) in tiles, compressed if the format says so
+    void store(level_t& level, const std::vector<float>& rgb) const;
+
+    [[nodiscard]] color_t texel(const level_t& level, int x, int y) const;
+    [[nodiscard]] color_t bilinear(const level_t& level, double u, double v) const;
+
+    texture_format_t m_format = texture_format_t::rgb_float;
+    std::vector<level_t> m_levels;
 };
 
 class noise_texture_t : public texture_t {
     public:
-        noise_texture_t() = default;
-        noise_texture_t(double sc) : scale(sc) {}
+        // with the process' shared noise tables (seed 0)
+        noise_texture_t();
+        noise_texture_t(double sc);
+        noise_texture_t(shared_ptr<const perlin_t> tables, double sc) : noise(std::move(tables)), scale(sc) {}
 
         [[nodiscard]] virtual color_t value(double u, double v, const point3& p) const override {
             //basic perlin
-            //return color_t(1,1,1) * 0.5 * (1.0 + noise.noise(scale * p));
+            //return color_t(1,1,1) * 0.5 * (1.0 + noise->noise(scale * p));
+
+            return marble(p);
+        }
+
+        // leaves out the octaves of turbulence finer than the footprint
+        [[nodiscard]] color_t filtered_value(double u, double v, const point3& p, const dvec2_t& duv_dx, const dvec2_t& duv_dy, const dvec3_t& dpdx, const dvec3_t& dpdy) const override {
+            return marble(p, std::max(glm::length(dpdx), glm::length(dpdy)));
+        }
 
-            // marble like
-            return color_t(1,1,1) * 0.5 * (1 + sin(scale*p.z + 10*noise.turb(p)));
+        // marble like, with the octaves finer than footprint left out
+        [[nodiscard]] color_t marble(const point3& p, double footprint = 0.0) const {
+            return color_t(1,1,1) * 0.5 * (1 + sin(scale*p.z + 10*noise->turb(p, 7, footprint)));
         }
 
+        [[nodiscard]] bool bakeable() const override { return true; }
+
     public:
-        perlin_t noise;
+        shared_ptr<const perlin_t> noise;
         double scale=1.0;
 };
\ No newline at end of file
@@ -0,0 +1,292 @@
+#include "texture_bake.h"
+#include "texture_program.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+#ifdef THREADS
+#include <thread>
+#endif
+
+namespace {
+    // brick coords get this many bits each in a key
+    constexpr int coordinate_bits = 21;
+    constexpr int64_t coordinate_bias = int64_t(1) << (coordinate_bits - 1);
+    constexpr uint64_t coordinate_mask = (uint64_t(1) << coordinate_bits) - 1;
+
+    // mixes the bits of a key, so neighbouring bricks land in unrelated slots
+    uint64_t hash(uint64_t k) {
+        k ^= k >> 30;
+        k *= 0xbf58476d1ce4e5b9ull;
+        k ^= k >> 27;
+        k *= 0x94d049bb133111ebull;
+        k ^= k >> 31;
+        return k;
+    }
+
+    int floor_div(int a, int b) {
+        return a >= 0 ? a / b : -((-a + b - 1) / b);
+    }
+
+    // runs work(i) for i in [0, count), spread over threads
+    template<typename work_t>
+    void parallel_for(size_t count, int threads, const work_t& work) {
+        auto run = [&](size_t first, size_t step) {
+            for(size_t i = first; i < count; i += step) {
+                work(i);
+            }
+        };
+#ifdef THREADS
+        threads = static_cast<int>(std::clamp<size_t>(threads, 1, std::max<size_t>(1, count)));
+        std::vector<std::thread> workers;
+        for(int t = 1; t < threads; t++) {
+            workers.emplace_back(run, t, threads);
+        }
+        run(0, threads);
+        for(auto& w : workers) {
+            w.join();
+        }
+#else
+        run(0, 1);
+#endif
+    }
+}
+
+baked_texture_t::baked_texture_t(shared_ptr<const texture_t> source, double voxel_size, double tolerance)
+    : m_source(std::move(source)),
+      m_voxel_size(std::max(1e-9, voxel_size)),
+      m_inv_voxel_size(1.0 / m_voxel_size),
+      m_tolerance(tolerance) {
+}
+
+uint64_t baked_texture_t::key(const glm::ivec3& brick) {
+    return (uint64_t(1) << 63)
+         | ((static_cast<uint64_t>(brick.x + coordinate_bias) & coordinate_mask) << (2 * coordinate_bits))
+         | ((static_cast<uint64_t>(brick.y + coordinate_bias) & coordinate_mask) << coordinate_bits)
+         | (static_cast<uint64_t>(brick.z + coordinate_bias) & coordinate_mask);
+}
+
+const baked_texture_t::slot_t* baked_texture_t::find(uint64_t k) const {
+    if(m_slots.empty()) {
+        return nullptr;
+    }
+    const size_t mask = m_slots.size() - 1;
+    for(size_t i = hash(k) & mask;; i = (i + 1) & mask) {
+        const slot_t& slot = m_slots[i];
+        if(slot.key == k) {
+            return &slot;
+        }
+        if(slot.key == 0) {
+            return nullptr;
+        }
+    }
+}
+
+void baked_texture_t::bake(const std::vector<point3>& points, int threads, size_t max_bytes) {
+    // the bricks the points are in, and how many points each has
+    const double brick_scale = m_inv_voxel_size / brick_size;
+    std::map<uint64_t, std::pair<glm::ivec3, size_t>> seen;
+    for(const point3& p : points) {
+        const glm::ivec3 brick(floor(p * brick_scale));
+        auto& entry = seen[key(brick)];
+        entry.first = brick;
+        entry.second++;
+    }
+    std::vector<std::pair<glm::ivec3, size_t>> bricks;
+    bricks.reserve(seen.size());
+    for(const auto& [k, entry] : seen) {
+        bricks.push_back(entry);
+    }
+    constexpr size_t brick_bytes = samples_per_brick * 3 * sizeof(float);
+    const size_t budget = max_bytes / brick_bytes;
+    if(bricks.size() > budget) {
+        std::stable_sort(bricks.begin(), bricks.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+        bricks.resize(budget);
+    }
+
+    // each brick's samples, worked out in parallel
+    std::vector<float> samples(bricks.size() * samples_per_brick * 3);
+    std::vector<char> uniform(bricks.size(), 0);
+    const texture_program_t program(m_source);
+    parallel_for(bricks.size(), threads, [&](size_t b) {
+        float* brick = &samples[b * samples_per_brick * 3];
+        const glm::ivec3 origin = bricks[b].first * brick_size;
+        std::vector<texture_query_t> queries(samples_per_brick);
+        std::vector<color_t> colors(samples_per_brick);
+        size_t q = 0;
+        for(int z = 0; z < brick_samples; z++) {
+            for(int y = 0; y < brick_samples; y++) {
+                for(int x = 0; x < brick_samples; x++) {
+                    texture_query_t& query = queries[q++];
+                    query.p = dvec3_t(origin + glm::ivec3(x, y, z)) * m_voxel_size;
+                    query.dpdx = {m_voxel_size, 0, 0};
+                    query.dpdy = {0, m_voxel_size, 0};
+                }
+            }
+        }
+        program.evaluate(queries.data(), queries.size(), colors.data());
+        for(int i = 0; i < samples_per_brick; i++) {
+            brick[i * 3] = static_cast<float>(colors[i].r);
+            brick[i * 3 + 1] = static_cast<float>(colors[i].g);
+            brick[i * 3 + 2] = static_cast<float>(colors[i].b);
+        }
+
+        double mean[3] = {0, 0, 0};
+        for(int i = 0; i < samples_per_brick; i++) {
+            for(int c = 0; c < 3; c++) {
+                mean[c] += brick[i * 3 + c];
+            }
+        }
+        for(double& m : mean) {
+            m /= samples_per_brick;
+        }
+        bool flat = true;
+        for(int i = 0; i < samples_per_brick * 3 && flat; i++) {
+            flat = std::abs(brick[i] - mean[i % 3]) <= m_tolerance;
+        }
+        // kept in the brick's first sample
+        if(flat) {
+            uniform[b] = 1;
+            for(int c = 0; c < 3; c++) {
+                brick[c] = static_cast<float>(mean[c]);
+            }
+        }
+    });
+
+    // into the table, with the bricks that vary packed together
+    size_t capacity = 16;
+    while(capacity < bricks.size() * 2) {
+        capacity *= 2;
+    }
+    m_slots.assign(capacity, slot_t());
+    m_samples.clear();
+    m_brick_count = bricks.size();
+    m_uniform_count = 0;
+    for(size_t b = 0; b < bricks.size(); b++) {
+        const float* first = &samples[b * samples_per_brick * 3];
+        const uint64_t k = key(bricks[b].first);
+        size_t i = hash(k) & (capacity - 1);
+        while(m_slots[i].key != 0) {
+            i = (i + 1) & (capacity - 1);
+        }
+        slot_t& slot = m_slots[i];
+        slot.key = k;
+        if(uniform[b]) {
+            std::copy(first, first + 3, slot.value);
+            m_uniform_count++;
+        } else {
+            slot.offset = static_cast<int64_t>(m_samples.size());
+            m_samples.insert(m_samples.end(), first, first + samples_per_brick * 3);
+        }
+    }
+    m_samples.shrink_to_fit();
+}
+
+color_t baked_texture_t::value(double u, double v, const point3& p) const {
+    const dvec3_t g = p * m_inv_voxel_size;
+    const dvec3_t base = floor(g);
+    const glm::ivec3 cell(base);
+    const glm::ivec3 brick(floor_div(cell.x, brick_size), floor_div(cell.y, brick_size), floor_div(cell.z, brick_size));
+    const slot_t* slot = find(key(brick));
+    if(!slot) {
+        return m_source->value(u, v, p);
+    }
+    if(slot->offset < 0) {
+        return color_t(slot->value[0], slot->value[1], slot->value[2]);
+    }
+
+    const glm::ivec3 local = cell - brick * brick_size;
+    const dvec3_t w = g - base;
+    const float* samples = &m_samples[slot->offset];
+    color_t result(0, 0, 0);
+    for(int corner = 0; corner < 8; corner++) {
+        const int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+        const double weight = (dx ? w.x : 1.0 - w.x) * (dy ? w.y : 1.0 - w.y) * (dz ? w.z : 1.0 - w.z);
+        const float* s = samples + (((local.z + dz) * brick_samples + local.y + dy) * brick_samples + local.x + dx) * 3;
+        result += color_t(s[0], s[1], s[2]) * weight;
+    }
+    return result;
+}
+
+texture_bake_stats_t bake_textures(scene_t& scene, const texture_bake_settings_t& settings, int threads) {
+    const auto start = std::chrono::steady_clock::now();
+    const int width = scene.cam.width();
+    const int height = scene.cam.height();
+
+    // the surfaces the camera sees with bakeable textures: where, and how big a pixel
+    // is there, row by row in parallel
+    struct seen_t {
+        lambertian_material_t* material;
+        point3 p;
+        double footprint;
+    };
+    std::vector<std::vector<seen_t>> rows(height);
+    parallel_for(height, threads, [&](size_t row) {
+        const int y = static_cast<int>(row);
+        for(int x = 0; x < width; x++) {
+            const double s = (x + 0.5) / std::max(1, width - 1);
+            const double t = (y + 0.5) / std::max(1, height - 1);
+            ray_differential_t differential;
+            const ray_t r = scene.cam.get_ray(s, t, differential);
+            hit_record_t rec;
+            const bool hit = scene.root ? scene.root->hit(r, 0.001, infinity, rec) : scene.entities.hit(r, 0.001, infinity, rec);
+            if(!hit || !rec.mat) {
+                continue;
+            }
+            auto* material = dynamic_cast<lambertian_material_t*>(rec.mat.get());
+            if(!material || !material->albedo()->bakeable()) {
+                continue;
+            }
+            rec.set_uv_differentials(differential);
+            rows[row].push_back({material, rec.p, std::max(length(rec.dpdx), length(rec.dpdy))});
+        }
+    });
+
+    // by texture, since materials can share one
+    struct job_t {
+        std::vector<lambertian_material_t*> materials;
+        std::vector<point3> points;
+        std::vector<double> footprints;
+    };
+    std::map<const texture_t*, job_t> jobs;
+    for(const auto& row : rows) {
+        for(const seen_t& seen : row) {
+            job_t& job = jobs[seen.material->albedo().get()];
+            if(std::find(job.materials.begin(), job.materials.end(), seen.material) == job.materials.end()) {
+                job.materials.push_back(seen.material);
+            }
+            job.points.push_back(seen.p);
+            if(seen.footprint > 0.0) {
+                job.footprints.push_back(seen.footprint);
+            }
+        }
+    }
+
+    texture_bake_stats_t stats;
+    size_t budget = settings.max_bytes;
+    for(auto& [texture, job] : jobs) {
+        double voxel_size = settings.voxel_size;
+        if(!(voxel_size > 0.0)) {
+            if(job.footprints.empty()) {
+                continue;
+            }
+            auto median = job.footprints.begin() + job.footprints.size() / 2;
+            std::nth_element(job.footprints.begin(), median, job.footprints.end());
+            voxel_size = *median / std::max(1e-3, settings.voxels_per_pixel);
+        }
+
+        auto baked = make_shared<baked_texture_t>(job.materials.front()->albedo(), voxel_size, settings.tolerance);
+        baked->bake(job.points, threads, budget);
+        for(lambertian_material_t* material : job.materials) {
+            material->set_albedo(baked);
+        }
+        stats.textures++;
+        stats.bricks += baked->bricks();
+        stats.uniform_bricks += baked->uniform_bricks();
+        stats.bytes += baked->memory_bytes();
+        budget -= std::min(budget, baked->memory_bytes());
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
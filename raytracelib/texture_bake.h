@@ -0,0 +1,110 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "scene.h"
+#include "texture.h"
+
+/**
+ * \brief How finely bake_textures bakes, and how much memory it may use: the error
+ * against speed and memory trade off.
+ */
+struct texture_bake_settings_t {
+    // voxels are the median footprint of a pixel on the texture divided by this (more
+    // is sharper, and more bricks), unless voxel_size is set
+    double voxels_per_pixel = 2.0;
+    double voxel_size = 0.0;
+
+    // a brick whose texels are all within this of their average (in each channel) is
+    // kept as just the average
+    double tolerance = 0.0;
+
+    // bricks past this are left out (the most seen are baked first), and lookups there
+    // work out the texture as before
+    size_t max_bytes = 256u << 20;
+};
+
+/**
+ * \brief What bake_textures did.
+ */
+struct texture_bake_stats_t {
+    int textures = 0;
+    size_t bricks = 0;
+    size_t uniform_bricks = 0;
+    size_t bytes = 0;
+    double seconds = 0.0;
+};
+
+/**
+ * \brief A texture that depends only on p (see texture_t::bakeable), sampled ahead of
+ * time on a grid of voxel_size and interpolated between the samples (trilinear), so
+ * a lookup is a fetch from memory rather than working the texture out.
+ *
+ * The grid is sparse: it's kept in bricks of brick_size^3 cells, and only bricks that
+ * bake() was given points in exist. Each brick holds the samples at its cells' corners
+ * (so its far faces repeat its neighbours' near ones), which keeps every lookup in one
+ * brick. Bricks are found through an open addressing hash table. Lookups outside every
+ * brick go to the source texture.
+ */
+class baked_texture_t : public texture_t {
+public:
+    static constexpr int brick_size = 8;
+
+    /**
+     * \param tolerance see texture_bake_settings_t::tolerance
+     */
+    baked_texture_t(shared_ptr<const texture_t> source, double voxel_size, double tolerance = 0.0);
+
+    /**
+     * \brief Bakes the bricks around points, with the source prefiltered to the voxel
+     * size, in parallel. Must not run at the same time as lookups. Replaces anything
+     * baked before.
+     * \param max_bytes bricks past this are left out, those with the fewest points first
+     */
+    void bake(const std::vector<point3>& points, int threads, size_t max_bytes = SIZE_MAX);
+
+    color_t value(double u, double v, const point3& p) const override;
+
+    [[nodiscard]] const shared_ptr<const texture_t>& source() const { return m_source; }
+    [[nodiscard]] double voxel_size() const { return m_voxel_size; }
+    [[nodiscard]] size_t bricks() const { return m_brick_count; }
+    [[nodiscard]] size_t uniform_bricks() const { return m_uniform_count; }
+    [[nodiscard]] size_t memory_bytes() const {
+        return m_slots.capacity() * sizeof(slot_t) + m_samples.capacity() * sizeof(float);
+    }
+
+protected:
+    // samples along each side of a brick
+    static constexpr int brick_samples = brick_size + 1;
+    static constexpr int samples_per_brick = brick_samples * brick_samples * brick_samples;
+
+    struct slot_t {
+        // the brick's coords, or 0 while the slot is free
+        uint64_t key = 0;
+
+        // where the brick's samples start in m_samples, or -1 if they're all value
+        int64_t offset = -1;
+        float value[3] = {0, 0, 0};
+    };
+
+    [[nodiscard]] static uint64_t key(const glm::ivec3& brick);
+    [[nodiscard]] const slot_t* find(uint64_t key) const;
+
+    shared_ptr<const texture_t> m_source;
+    double m_voxel_size;
+    double m_inv_voxel_size;
+    double m_tolerance;
+
+    std::vector<slot_t> m_slots;
+    std::vector<float> m_samples;
+    size_t m_brick_count = 0;
+    size_t m_uniform_count = 0;
+};
+
+/**
+ * \brief Bakes the bakeable textures (checkers, noise) on the diffuse surfaces the
+ * camera sees into baked_texture_ts, and puts those in the materials instead. Finds
+ * the surfaces with a ray through the middle of every pixel. For static scenes, once
+ * they're built; must not run at the same time as a render of the scene.
+ */
+texture_bake_stats_t bake_textures(scene_t& scene, const texture_bake_settings_t& settings, int threads);
@@ -0,0 +1,302 @@
+#include "texture_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+struct texture_cache_counters_t {
+    std::atomic<uint64_t> requests {0};
+    std::atomic<uint64_t> hits {0};
+    std::atomic<uint64_t> tiles_loaded {0};
+    std::atomic<uint64_t> bytes_loaded {0};
+    std::atomic<uint64_t> evictions {0};
+};
+
+namespace {
+    constexpr char magic[4] = {'R', 'T', 'T', 'X'};
+    constexpr uint32_t version = 1;
+    constexpr int max_tile_size = 256;
+
+    std::atomic<uint64_t> g_next_cache_id {1};
+
+    bool valid_tile_size(int tile_size) {
+        return tile_size > 0 && tile_size <= max_tile_size && (tile_size & (tile_size - 1)) == 0;
+    }
+
+    // the file in the top 16 bits, then the level, then the tile within it
+    uint64_t tile_key(int file, int level, int tile_x, int tile_y, int tiles_x) {
+        const uint64_t tile = static_cast<uint64_t>(tile_y) * tiles_x + tile_x;
+        return static_cast<uint64_t>(file + 1) << 48 | static_cast<uint64_t>(level) << 40 | tile;
+    }
+
+    /**
+     * \brief The tiles a thread used last, so it only needs the shared table (and its
+     * lock) for the others.
+     */
+    struct handle_t {
+        uint64_t cache_id = 0;
+        uint64_t keys[texture_cache_t::handle_tiles] = {};
+        shared_ptr<const std::vector<float>> tiles[texture_cache_t::handle_tiles];
+
+        // counted here and added to the cache's totals on every miss, so lookups don't
+        // all write to the same few atomics
+        uint64_t requests = 0;
+        uint64_t hits = 0;
+        shared_ptr<texture_cache_counters_t> counters;
+
+        ~handle_t() {
+            flush();
+        }
+
+        void flush() {
+            if(counters) {
+                counters->requests.fetch_add(requests, std::memory_order_relaxed);
+                counters->hits.fetch_add(hits, std::memory_order_relaxed);
+            }
+            requests = 0;
+            hits = 0;
+        }
+
+        void reset(uint64_t id, const shared_ptr<texture_cache_counters_t>& new_counters) {
+            flush();
+            cache_id = id;
+            std::fill(std::begin(keys), std::end(keys), 0);
+            std::fill(std::begin(tiles), std::end(tiles), nullptr);
+            counters = new_counters;
+        }
+    };
+
+    thread_local handle_t t_handle;
+}
+
+texture_cache_t::texture_cache_t(size_t max_bytes)
+    : m_id(g_next_cache_id.fetch_add(1)),
+      m_max_bytes(max_bytes),
+      m_counters(make_shared<texture_cache_counters_t>()) {
+}
+
+texture_cache_t::~texture_cache_t() {
+    // this thread's handle would otherwise keep the tiles until it next reads
+    if(t_handle.cache_id == m_id) {
+        t_handle.reset(0, nullptr);
+    }
+}
+
+int texture_cache_t::open(const std::string& path) {
+    auto f = std::make_unique<open_file_t>();
+    f->stream.open(path, std::ios::binary);
+    char file_magic[4] = {};
+    uint32_t file_version = 0;
+    int32_t tile_size = 0, levels = 0;
+    f->stream.read(file_magic, sizeof(file_magic));
+    f->stream.read(reinterpret_cast<char*>(&file_version), sizeof(file_version));
+    f->stream.read(reinterpret_cast<char*>(&tile_size), sizeof(tile_size));
+    f->stream.read(reinterpret_cast<char*>(&levels), sizeof(levels));
+    if(!f->stream || memcmp(file_magic, magic, sizeof(magic)) != 0 || file_version != version || !valid_tile_size(tile_size) || levels <= 0 || levels > 32) {
+        std::cerr << "ERROR: '" << path << "' isn't a tiled texture file\n";
+        return -1;
+    }
+
+    file_t& layout = f->layout;
+    layout.path = path;
+    layout.tile_size = tile_size;
+    uint64_t offset = sizeof(file_magic) + sizeof(file_version) + sizeof(tile_size) + sizeof(levels) + levels * 2 * sizeof(int32_t);
+    for(int l = 0; l < levels; l++) {
+        int32_t size[2] = {};
+        f->stream.read(reinterpret_cast<char*>(size), sizeof(size));
+        file_t::level_t level;
+        level.width = size[0];
+        level.height = size[1];
+        level.tiles_x = (level.width + tile_size - 1) / tile_size;
+        level.offset = offset;
+        offset += static_cast<uint64_t>(level.tiles_x) * ((level.height + tile_size - 1) / tile_size) * layout.tile_bytes();
+        layout.levels.push_back(level);
+    }
+    if(!f->stream || layout.levels[0].width <= 0 || layout.levels[0].height <= 0) {
+        std::cerr << "ERROR: '" << path << "' isn't a tiled texture file\n";
+        return -1;
+    }
+
+    m_files.push_back(std::move(f));
+    return static_cast<int>(m_files.size()) - 1;
+}
+
+const float* texture_cache_t::tile(int file, int level, int tile_x, int tile_y) {
+    handle_t& h = t_handle;
+    if(h.cache_id != m_id) {
+        h.reset(m_id, m_counters);
+    }
+
+    const uint64_t key = tile_key(file, level, tile_x, tile_y, m_files[file]->layout.levels[level].tiles_x);
+    const size_t slot = (key ^ (key >> 17) ^ (key >> 40)) % handle_tiles;
+    h.requests++;
+    if(h.keys[slot] == key) {
+        h.hits++;
+        return h.tiles[slot]->data();
+    }
+
+    bool loaded = false;
+    h.tiles[slot] = fetch(key, file, level, tile_x, tile_y, loaded);
+    h.keys[slot] = key;
+    if(!loaded) {
+        h.hits++;
+    }
+    h.flush();
+    return h.tiles[slot]->data();
+}
+
+shared_ptr<const texture_cache_t::tile_t> texture_cache_t::fetch(uint64_t key, int file, int level, int tile_x, int tile_y, bool& loaded) {
+    {
+        std::lock_guard lock(m_mutex);
+        auto found = m_table.find(key);
+        if(found != m_table.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, found->second);
+            loaded = false;
+            return found->second->tile;
+        }
+    }
+
+    // read without holding the table's lock, so other threads' hits aren't held up by
+    // the disk. Two threads may read the same tile, and then the second copy is dropped.
+    shared_ptr<const tile_t> t = read_tile(file, level, tile_x, tile_y);
+    loaded = true;
+    const size_t bytes = t->size() * sizeof(float);
+    m_counters->tiles_loaded.fetch_add(1, std::memory_order_relaxed);
+    m_counters->bytes_loaded.fetch_add(bytes, std::memory_order_relaxed);
+
+    std::lock_guard lock(m_mutex);
+    auto found = m_table.find(key);
+    if(found != m_table.end()) {
+        m_lru.splice(m_lru.begin(), m_lru, found->second);
+        return found->second->tile;
+    }
+    m_lru.push_front({key, t});
+    m_table[key] = m_lru.begin();
+    m_resident_bytes += bytes;
+
+    // the tile just added stays, even if it's bigger than the whole budget
+    while(m_resident_bytes > m_max_bytes && m_lru.size() > 1) {
+        const entry_t& last = m_lru.back();
+        m_resident_bytes -= last.tile->size() * sizeof(float);
+        m_table.erase(last.key);
+        m_lru.pop_back();
+        m_counters->evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+    return t;
+}
+
+shared_ptr<const texture_cache_t::tile_t> texture_cache_t::read_tile(int file, int level, int tile_x, int tile_y) {
+    open_file_t& f = *m_files[file];
+    const file_t::level_t& l = f.layout.levels[level];
+    const size_t bytes = f.layout.tile_bytes();
+    auto t = make_shared<tile_t>(bytes / sizeof(float), 0.0f);
+
+    std::lock_guard lock(f.mutex);
+    f.stream.clear();
+    f.stream.seekg(static_cast<std::streamoff>(l.offset + (static_cast<uint64_t>(tile_y) * l.tiles_x + tile_x) * bytes));
+    f.stream.read(reinterpret_cast<char*>(t->data()), static_cast<std::streamsize>(bytes));
+    if(!f.stream) {
+        std::cerr << "ERROR: couldn't read a tile from '" << f.layout.path << "'\n";
+    }
+    return t;
+}
+
+texture_cache_stats_t texture_cache_t::stats() const {
+    texture_cache_stats_t s;
+    s.requests = m_counters->requests.load(std::memory_order_relaxed);
+    s.hits = m_counters->hits.load(std::memory_order_relaxed);
+    s.tiles_loaded = m_counters->tiles_loaded.load(std::memory_order_relaxed);
+    s.bytes_loaded = m_counters->bytes_loaded.load(std::memory_order_relaxed);
+    s.evictions = m_counters->evictions.load(std::memory_order_relaxed);
+    std::lock_guard lock(m_mutex);
+    s.resident_bytes = m_resident_bytes;
+    return s;
+}
+
+bool write_tiled_texture(const image_texture_t& image, const std::string& path, int tile_size) {
+    if(!valid_tile_size(tile_size) || image.levels() == 0) {
+        std::cerr << "ERROR: can't write '" << path << "' with " << tile_size << " texel tiles\n";
+        return false;
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    const int32_t levels = image.levels();
+    const int32_t size = tile_size;
+    out.write(magic, sizeof(magic));
+    out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    out.write(reinterpret_cast<const char*>(&levels), sizeof(levels));
+    for(int l = 0; l < levels; l++) {
+        const int32_t level_size[2] = {image.level_width(l), image.level_height(l)};
+        out.write(reinterpret_cast<const char*>(level_size), sizeof(level_size));
+    }
+
+    std::vector<float> tile(static_cast<size_t>(tile_size) * tile_size * 3);
+    for(int l = 0; l < levels; l++) {
+        const int width = image.level_width(l);
+        const int height = image.level_height(l);
+        for(int ty = 0; ty < (height + tile_size - 1) / tile_size; ty++) {
+            for(int tx = 0; tx < (width + tile_size - 1) / tile_size; tx++) {
+                for(int y = 0; y < tile_size; y++) {
+                    for(int x = 0; x < tile_size; x++) {
+                        // past the edges, the edge texels
+                        const color_t c = image.texel(l, tx * tile_size + x, ty * tile_size + y);
+                        float* t = &tile[morton_index(x, y) * 3];
+                        t[0] = static_cast<float>(c.r);
+                        t[1] = static_cast<float>(c.g);
+                        t[2] = static_cast<float>(c.b);
+                    }
+                }
+                out.write(reinterpret_cast<const char*>(tile.data()), static_cast<std::streamsize>(tile.size() * sizeof(float)));
+            }
+        }
+    }
+
+    if(!out) {
+        std::cerr << "ERROR: couldn't write '" << path << "'\n";
+        return false;
+    }
+    return true;
+}
+
+cached_texture_t::cached_texture_t(shared_ptr<texture_cache_t> cache, const std::string& path)
+    : m_cache(std::move(cache)) {
+    m_file = m_cache->open(path);
+}
+
+color_t cached_texture_t::texel(int level, int x, int y) const {
+    const texture_cache_t::file_t& f = m_cache->file(m_file);
+    const texture_cache_t::file_t::level_t& l = f.levels[std::clamp(level, 0, levels() - 1)];
+    x = std::clamp(x, 0, l.width - 1);
+    y = std::clamp(y, 0, l.height - 1);
+    const float* t = m_cache->tile(m_file, std::clamp(level, 0, levels() - 1), x / f.tile_size, y / f.tile_size);
+    t += morton_index(x % f.tile_size, y % f.tile_size) * 3;
+    return color_t(t[0], t[1], t[2]);
+}
+
+color_t cached_texture_t::bilinear(int level, double u, double v) const {
+    const texture_cache_t::file_t::level_t& l = m_cache->file(m_file).levels[level];
+    return bilinear_lookup(l.width, l.height, u, v, [&](int x, int y) { return texel(level, x, y); });
+}
+
+color_t cached_texture_t::value(double u, double v, const point3& p) const {
+    // solid cyan as a debugging aid, like image_texture_t
+    if (m_file < 0)
+        return color_t(0,1,1);
+
+    return bilinear(0, u, v);
+}
+
+color_t cached_texture_t::filtered_value(double u, double v, const point3& p, const dvec2_t& duv_dx, const dvec2_t& duv_dy, const dvec3_t& dpdx, const dvec3_t& dpdy) const {
+    if (m_file < 0)
+        return color_t(0,1,1);
+
+    const double lod = mip_level(width(), height(), levels(), duv_dx, duv_dy);
+    if(lod <= 0.0) {
+        return bilinear(0, u, v);
+    }
+    const int fine = static_cast<int>(lod);
+    const int coarse = std::min(fine + 1, levels() - 1);
+    const double blend = lod - fine;
+    return bilinear(fine, u, v) * (1.0 - blend) + bilinear(coarse, u, v) * blend;
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "texture.h"
+
+/**
+ * \brief What a texture_cache_t has done since it was made. Lookups are counted by
+ * each thread and added in now and then, so the counts can be a little behind.
+ */
+struct texture_cache_stats_t {
+    // tiles lookups asked for, and how many of them were already in memory (in the
+    // thread's handle or in the shared table)
+    uint64_t requests = 0;
+    uint64_t hits = 0;
+
+    uint64_t tiles_loaded = 0;
+    uint64_t bytes_loaded = 0;
+    uint64_t evictions = 0;
+
+    // what the shared table holds now
+    size_t resident_bytes = 0;
+
+    [[nodiscard]] double hit_rate() const { return requests > 0 ? static_cast<double>(hits) / requests : 0.0; }
+};
+
+struct texture_cache_counters_t;
+
+/**
+ * \brief Image textures kept on disk in a tiled format (see write_tiled_texture), with
+ * only the tiles lookups have needed lately in memory. A tile is read from its file
+ * the first time it's needed, and the least recently used tiles (across every file)
+ * are dropped once the ones in memory add up to more than max_bytes.
+ *
+ * Each thread reads tiles through its own handle, which holds on to the last few
+ * tiles it used, so most lookups don't touch the shared table or its lock. A handle
+ * keeps its tiles alive after the table drops them, so memory can go over the budget
+ * by that many tiles per thread.
+ */
+class texture_cache_t {
+public:
+    // how many tiles each thread's handle holds on to
+    static constexpr int handle_tiles = 16;
+
+    explicit texture_cache_t(size_t max_bytes);
+    ~texture_cache_t();
+
+    /**
+     * \brief How a tiled file is laid out.
+     */
+    struct file_t {
+        struct level_t {
+            int width = 0;
+            int height = 0;
+            int tiles_x = 0;
+
+            // where the level's first tile is in the file
+            uint64_t offset = 0;
+        };
+
+        std::string path;
+        int tile_size = 0;
+        std::vector<level_t> levels;
+
+        [[nodiscard]] size_t tile_bytes() const { return static_cast<size_t>(tile_size) * tile_size * 3 * sizeof(float); }
+    };
+
+    /**
+     * \brief Reads a tiled file's header (its tiles are read as they're needed). Must
+     * not run at the same time as tile().
+     * \return an id for tile(), or -1 if the file couldn't be read
+     */
+    int open(const std::string& path);
+
+    [[nodiscard]] const file_t& file(int id) const { return m_files[id]->layout; }
+
+    /**
+     * \brief The texels of a tile: tile_size^2 RGB floats, in Morton order (see
+     * morton_index). Read from the file if it isn't in memory. Thread safe. The
+     * pointer stays valid until the calling thread's next tile() call.
+     */
+    const float* tile(int file, int level, int tile_x, int tile_y);
+
+    [[nodiscard]] texture_cache_stats_t stats() const;
+    [[nodiscard]] size_t max_bytes() const { return m_max_bytes; }
+
+protected:
+    using tile_t = std::vector<float>;
+
+    struct open_file_t {
+        file_t layout;
+        std::ifstream stream;
+        std::mutex mutex;
+    };
+
+    struct entry_t {
+        uint64_t key;
+        shared_ptr<const tile_t> tile;
+    };
+
+    /**
+     * \brief A tile from the shared table, or read in and added to it.
+     * \param loaded set if it had to be read
+     */
+    shared_ptr<const tile_t> fetch(uint64_t key, int file, int level, int tile_x, int tile_y, bool& loaded);
+
+    shared_ptr<const tile_t> read_tile(int file, int level, int tile_x, int tile_y);
+
+    // tells thread handles apart from those of a cache that was here before
+    uint64_t m_id;
+    size_t m_max_bytes;
+    std::vector<std::unique_ptr<open_file_t>> m_files;
+
+    // the resident tiles, most recently used first
+    mutable std::mutex m_mutex;
+    std::list<entry_t> m_lru;
+    std::unordered_map<uint64_t, std::list<entry_t>::iterator> m_table;
+    size_t m_resident_bytes = 0;
+
+    shared_ptr<texture_cache_counters_t> m_counters;
+};
+
+/**
+ * \brief Writes image's mip levels to path in the tiled format texture_cache_t reads:
+ * a header, then every level's tiles in rows, each tile_size^2 texels in Morton order
+ * (padded out past the image's edges), in the machine's byte order.
+ * \param tile_size a power of two, up to 256
+ * \return false if the file couldn't be written
+ */
+bool write_tiled_texture(const image_texture_t& image, const std::string& path, int tile_size = 64);
+
+/**
+ * \brief An image texture read through a texture_cache_t rather than kept in memory,
+ * filtered the same way as image_texture_t.
+ */
+class cached_texture_t : public texture_t {
+public:
+    cached_texture_t(shared_ptr<texture_cache_t> cache, const std::string& path);
+
+    color_t value(double u, double v, const point3& p) const override;
+    [[nodiscard]] color_t filtered_value(double u, double v, const point3& p, const dvec2_t& duv_dx, const dvec2_t& duv_dy, const dvec3_t& dpdx, const dvec3_t& dpdy) const override;
+
+    // as image_texture_t::texel
+    [[nodiscard]] color_t texel(int level, int x, int y) const;
+
+    [[nodiscard]] int width() const { return m_file < 0 ? 0 : m_cache->file(m_file).levels[0].width; }
+    [[nodiscard]] int height() const { return m_file < 0 ? 0 : m_cache->file(m_file).levels[0].height; }
+    [[nodiscard]] int levels() const { return m_file < 0 ? 0 : static_cast<int>(m_cache->file(m_file).levels.size()); }
+
+private:
+    [[nodiscard]] color_t bilinear(int level, double u, double v) const;
+
+    shared_ptr<texture_cache_t> m_cache;
+    int m_file = -1;
+};
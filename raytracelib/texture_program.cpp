@@ -0,0 +1,110 @@
+#include "texture_program.h"
+
+#include <algorithm>
+
+namespace {
+    bool same_color(const color_t& a, const color_t& b) {
+        return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+    }
+}
+
+texture_program_t::texture_program_t()
+    : m_code(1) {
+}
+
+texture_program_t::texture_program_t(const shared_ptr<const texture_t>& texture)
+    : m_texture(texture) {
+    compile(texture.get());
+}
+
+void texture_program_t::compile(const texture_t* texture) {
+    const size_t at = m_code.size();
+    instruction_t& first = m_code.emplace_back();
+    first.texture = texture;
+
+    if(!texture) {
+        return;
+    }
+    if(auto solid = dynamic_cast<const solid_color_t*>(texture)) {
+        first.color = solid->color();
+        return;
+    }
+    if(dynamic_cast<const noise_texture_t*>(texture)) {
+        first.op = op_t::noise;
+        return;
+    }
+    if(dynamic_cast<const image_texture_t*>(texture)) {
+        first.op = op_t::image;
+        return;
+    }
+    auto checker = dynamic_cast<const checker_texture_t*>(texture);
+    if(!checker) {
+        first.op = op_t::call;
+        return;
+    }
+
+    // the even branch right after, then the odd one
+    compile(checker->even().get());
+    const size_t odd = m_code.size();
+    compile(checker->odd().get());
+    m_code[at].op = op_t::checker;
+    m_code[at].odd = static_cast<int32_t>(odd);
+
+    const bool constant_even = odd == at + 2 && m_code[at + 1].op == op_t::constant;
+    const bool constant_odd = m_code.size() == odd + 1 && m_code[odd].op == op_t::constant;
+    if(constant_even && constant_odd) {
+        const color_t even_color = m_code[at + 1].color;
+        const color_t odd_color = m_code[odd].color;
+        m_code.resize(at + 1);
+        m_code[at].op = same_color(even_color, odd_color) ? op_t::constant : op_t::checker_colors;
+        m_code[at].color = even_color;
+        m_code[at].odd_color = odd_color;
+    }
+}
+
+color_t texture_program_t::evaluate(double u, double v, const point3& p, const dvec2_t& duv_dx, const dvec2_t& duv_dy, const dvec3_t& dpdx, const dvec3_t& dpdy) const {
+    size_t i = 0;
+    while(true) {
+        const instruction_t& in = m_code[i];
+        switch(in.op) {
+            case op_t::constant:
+                return in.color;
+            case op_t::checker:
+                i = checker_texture_t::odd_at(p) ? static_cast<size_t>(in.odd) : i + 1;
+                break;
+            case op_t::checker_colors:
+                return checker_texture_t::odd_at(p) ? in.odd_color : in.color;
+            case op_t::noise:
+                return static_cast<const noise_texture_t*>(in.texture)->marble(p, std::max(glm::length(dpdx), glm::length(dpdy)));
+            case op_t::image:
+                return static_cast<const image_texture_t*>(in.texture)->image_texture_t::filtered_value(u, v, p, duv_dx, duv_dy, dpdx, dpdy);
+            case op_t::call:
+                return in.texture->filtered_value(u, v, p, duv_dx, duv_dy, dpdx, dpdy);
+        }
+    }
+}
+
+void texture_program_t::evaluate(const texture_query_t queries[], size_t count, color_t out[]) const {
+    const instruction_t& first = m_code[0];
+    switch(first.op) {
+        case op_t::constant:
+            std::fill(out, out + count, first.color);
+            return;
+        case op_t::checker_colors:
+            for(size_t i = 0; i < count; i++) {
+                out[i] = checker_texture_t::odd_at(queries[i].p) ? first.odd_color : first.color;
+            }
+            return;
+        case op_t::noise: {
+            const auto* noise = static_cast<const noise_texture_t*>(first.texture);
+            for(size_t i = 0; i < count; i++) {
+                out[i] = noise->marble(queries[i].p, std::max(glm::length(queries[i].dpdx), glm::length(queries[i].dpdy)));
+            }
+            return;
+        }
+        default:
+            for(size_t i = 0; i < count; i++) {
+                out[i] = evaluate(queries[i]);
+            }
+    }
+}
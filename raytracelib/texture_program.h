@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "texture.h"
+
+/**
+ * \brief A texture lookup: where, and the pixel's footprint around it (see
+ * texture_t::filtered_value).
+ */
+struct texture_query_t {
+    double u = 0.0;
+    double v = 0.0;
+    point3 p {0, 0, 0};
+    dvec2_t duv_dx {0, 0};
+    dvec2_t duv_dy {0, 0};
+    dvec3_t dpdx {0, 0, 0};
+    dvec3_t dpdy {0, 0, 0};
+};
+
+/**
+ * \brief A tree of textures (checkers of checkers of colours, say) compiled into a flat
+ * array of instructions, so a lookup steps along the array rather than chasing
+ * shared_ptrs through a virtual call at every node. Checkers become jumps to the
+ * branch that shows, solid colours become constants (a checker of two colours is one
+ * instruction, and of the same colour twice just that colour), and noise and image
+ * textures are called directly. Any other texture is called through texture_t as
+ * before.
+ *
+ * Compiled once, when the material is made; the program keeps the tree alive but
+ * doesn't see changes made to it afterwards.
+ */
+class texture_program_t {
+public:
+    // black
+    texture_program_t();
+    explicit texture_program_t(const shared_ptr<const texture_t>& texture);
+
+    [[nodiscard]] color_t evaluate(double u, double v, const point3& p, const dvec2_t& duv_dx, const dvec2_t& duv_dy, const dvec3_t& dpdx, const dvec3_t& dpdy) const;
+
+    [[nodiscard]] color_t evaluate(const texture_query_t& q) const {
+        return evaluate(q.u, q.v, q.p, q.duv_dx, q.duv_dy, q.dpdx, q.dpdy);
+    }
+
+    /**
+     * \brief Looks up count queries at once, into out.
+     */
+    void evaluate(const texture_query_t queries[], size_t count, color_t out[]) const;
+
+    // true if every lookup gives the same colour
+    [[nodiscard]] bool is_constant() const { return m_code.size() == 1 && m_code[0].op == op_t::constant; }
+    [[nodiscard]] size_t size() const { return m_code.size(); }
+    [[nodiscard]] const shared_ptr<const texture_t>& texture() const { return m_texture; }
+
+protected:
+    enum class op_t : uint8_t {
+        constant,           // color
+        checker,            // the even branch is next, the odd one at odd
+        checker_colors,     // color where even, odd_color where odd
+        noise,              // a noise_texture_t
+        image,              // an image_texture_t
+        call                // any other texture_t
+    };
+
+    struct instruction_t {
+        op_t op = op_t::constant;
+        int32_t odd = 0;
+        color_t color {0, 0, 0};
+        color_t odd_color {0, 0, 0};
+        const texture_t* texture = nullptr;
+    };
+
+    // appends texture's instructions, with any constants folded
+    void compile(const texture_t* texture);
+
+    std::vector<instruction_t> m_code;
+    shared_ptr<const texture_t> m_texture;
+};
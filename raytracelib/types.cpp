@@ -1,4 +1,27 @@
 #include "types.h"
+#include <atomic>
+
+namespace {
+    uint64_t splitmix64(uint64_t x) {
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+
+    std::atomic<uint64_t> g_seed_counter = 0;
+}
+
+uint64_t next_random_seed() {
+    const uint64_t seed = splitmix64(g_seed_counter++);
+    // xorshift gets stuck on zero
+    return seed != 0 ? seed : 0x2545F4914F6CDD1DULL;
+}
+
+void seed_random(uint64_t seed) {
+    seed = splitmix64(seed);
+    random_state() = seed != 0 ? seed : 0x2545F4914F6CDD1DULL;
+}
 
 dmat4_t create_transform_matrix(const dvec3_t& location, const dquat& rotation) {
     const dmat4_t translation_mat = glm::translate(glm::identity<dmat4_t>(), location);
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <algorithm>
 #include <iostream>
+#include <cstdint>
 #include <cstdlib>
 #include <memory>
 #include <cmath>
@@ -11,9 +13,32 @@
 #include <glm/vec3.hpp>
 #include <glm/gtx/norm.hpp>
 
+/**
+ * \brief Returns a fresh seed for a thread's random number generator. Seeds are
+ * handed out in the order threads first ask for a random number, so the main
+ * thread (which builds the scenes) always gets the same sequence.
+ */
+uint64_t next_random_seed();
+
+/**
+ * \brief Reseeds the calling thread's random number generator.
+ */
+void seed_random(uint64_t seed);
+
+// rand() goes through a lock shared by every thread in most C runtimes, which
+// serializes the render threads on it. Each thread gets its own xorshift64* state instead.
+inline uint64_t& random_state() {
+    thread_local uint64_t state = next_random_seed();
+    return state;
+}
+
 inline double random_double() {
     // Returns a random real in [0,1).
-    return rand() / (RAND_MAX + 1.0);
+    uint64_t& s = random_state();
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    return static_cast<double>((s * 0x2545F4914F6CDD1DULL) >> 11) * 0x1.0p-53;
 }
 
 inline double random_double(const double min, const double max) {
@@ -77,8 +102,23 @@ inline dvec3_t random_in_unit_sphere() {
 }
 
 inline dvec3_t random_unit_vector() {
-    auto p = random_vec3(-1, 1);
-    return glm::normalize(p);
+    // uniform over the sphere (normalizing a point in a cube isn't, it bunches up
+    // towards the cube's corners)
+    const double z = 1.0 - 2.0 * random_double();
+    const double r = sqrt(std::max(0.0, 1.0 - z*z));
+    const double phi = 2.0 * g_pi * random_double();
+    return {r * cos(phi), r * sin(phi), z};
+}
+
+/**
+ * \brief A direction around +z, with probability proportional to its cosine with +z.
+ */
+inline dvec3_t random_cosine_direction() {
+    const double r1 = random_double();
+    const double r2 = random_double();
+    const double phi = 2.0 * g_pi * r1;
+    const double s = sqrt(r2);
+    return {cos(phi) * s, sin(phi) * s, sqrt(std::max(0.0, 1.0 - r2))};
 }
 
 inline dvec3_t random_in_unit_disk() {
@@ -108,6 +148,24 @@ inline dvec3_t refract(const dvec3_t& uv, const dvec3_t& n, const double etai_ov
     return r_out_perp + r_out_parallel;
 }
 
+/**
+ * \brief An orthonormal basis built around w (usually a surface normal), for
+ * turning directions sampled around +z into world space.
+ */
+struct onb_t {
+    explicit onb_t(const dvec3_t& n) {
+        w = glm::normalize(n);
+        const dvec3_t a = fabs(w.x) > 0.9 ? dvec3_t(0, 1, 0) : dvec3_t(1, 0, 0);
+        v = glm::normalize(glm::cross(w, a));
+        u = glm::cross(w, v);
+    }
+
+    [[nodiscard]] dvec3_t local(double a, double b, double c) const { return a*u + b*v + c*w; }
+    [[nodiscard]] dvec3_t local(const dvec3_t& d) const { return local(d.x, d.y, d.z); }
+
+    dvec3_t u, v, w;
+};
+
 dmat4_t create_transform_matrix(const dvec3_t& location, const dquat& rotation);
 
 point3 transform_point(const point3& p, const dmat4_t& transform);
@@ -0,0 +1,53 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+
+worker_pool_t::worker_pool_t(int threads) {
+#ifdef THREADS
+    m_thread_count = threads > 0 ? threads : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    for(int t = 0; t < m_thread_count; t++) {
+        m_threads.emplace_back([this] { run(); });
+    }
+#else
+    m_thread_count = 1;
+#endif
+}
+
+worker_pool_t::~worker_pool_t() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for(auto& t : m_threads) {
+        t.join();
+    }
+}
+
+void worker_pool_t::enqueue(std::function<void()> task) {
+#ifdef THREADS
+    {
+        std::lock_guard lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_wake.notify_one();
+#else
+    task();
+#endif
+}
+
+void worker_pool_t::run() {
+    while(true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stopping || !m_tasks.empty(); });
+            if(m_tasks.empty()) {
+                return;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * \brief A few threads that run the tasks handed to them, in the order they were handed
+ * over, for work that's worth doing in the background (loading files, building
+ * tables). Without THREADS the tasks run straight away on the thread handing them over.
+ */
+class worker_pool_t {
+public:
+    /**
+     * \param threads how many threads to run, or 0 for one per hardware thread
+     */
+    explicit worker_pool_t(int threads = 0);
+
+    // finishes the tasks already handed over before returning
+    ~worker_pool_t();
+
+    worker_pool_t(const worker_pool_t&) = delete;
+    worker_pool_t& operator=(const worker_pool_t&) = delete;
+
+    /**
+     * \brief Runs fn on one of the pool's threads.
+     * \return what fn returns (or throws), once it has run
+     */
+    template<typename fn_t>
+    auto submit(fn_t fn) -> std::future<std::invoke_result_t<fn_t>> {
+        using result_t = std::invoke_result_t<fn_t>;
+        auto task = std::make_shared<std::packaged_task<result_t()>>(std::move(fn));
+        auto result = task->get_future();
+        enqueue([task] { (*task)(); });
+        return result;
+    }
+
+    [[nodiscard]] int threads() const { return m_thread_count; }
+
+protected:
+    void enqueue(std::function<void()> task);
+    void run();
+
+    int m_thread_count = 1;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<std::function<void()>> m_tasks;
+    bool m_stopping = false;
+    std::vector<std::thread> m_threads;
+};
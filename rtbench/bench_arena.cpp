@@ -0,0 +1,60 @@
+// Building and tearing down a scene with its objects in a scene arena and with each
+// on the heap by itself, and the time per sample of a render of each.
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "benchmarks.h"
+
+int bench_arena(int argc, char* argv[]) {
+    const std::string scene_name = string_arg(argc, argv, "scene", "all_test");
+    const int width = int_arg(argc, argv, "width", 128);
+    const int height = int_arg(argc, argv, "height", 128);
+    const int builds = int_arg(argc, argv, "builds", 20);
+    const int spp = int_arg(argc, argv, "spp", 4);
+    const auto hw = std::thread::hardware_concurrency();
+    const int threads = int_arg(argc, argv, "threads", hw > 0 ? static_cast<int>(hw) : 4);
+
+    if(!make_scene(scene_name, width, height)) {
+        std::cerr << "ERROR: unknown scene '" << scene_name << "'\n";
+        return 1;
+    }
+
+    std::cout << "arena: " << scene_name << " built and torn down " << builds << " times, then " << spp
+              << " spp at " << width << "x" << height << " on " << threads << " threads" << std::endl;
+
+    auto elapsed_ms = [](auto start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    for(const bool arenas : {false, true}) {
+        double build_ms = 0.0, teardown_ms = 0.0;
+        for(int i = 0; i < builds; i++) {
+            auto start = std::chrono::steady_clock::now();
+            auto scene = make_scene(scene_name, width, height, arenas);
+            build_ms += elapsed_ms(start);
+            start = std::chrono::steady_clock::now();
+            scene.reset();
+            teardown_ms += elapsed_ms(start);
+        }
+
+        auto scene = make_scene(scene_name, width, height, arenas);
+        render_settings_t settings;
+        settings.num_threads = threads;
+        settings.samples_per_pixel = spp;
+        film_t film(width, height);
+        renderer_t renderer(*scene, film, settings);
+        const render_stats_t stats = renderer.render(film.bounds());
+
+        std::cout << (arenas ? "arena" : "heap") << ": built in " << build_ms / builds << " ms, torn down in "
+                  << teardown_ms / builds << " ms, " << stats.seconds / spp * 1000.0 << " ms per sample";
+        if(scene->arena) {
+            const scene_arena_stats_t arena = scene->arena->stats();
+            std::cout << ", " << arena.objects << " objects, " << arena.bytes / 1024 << " KB in " << arena.blocks
+                      << " blocks (" << arena.reserved_bytes / 1024 << " KB)";
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,60 @@
+// Building a scene with the asset cache empty and again once it holds the scene's
+// textures and noise tables, and loading the earth texture in both formats one after
+// the other or side by side on the cache's threads.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "asset_cache.h"
+#include "benchmarks.h"
+
+int bench_assets(int argc, char* argv[]) {
+    const std::string scene_name = string_arg(argc, argv, "scene", "earth_scene");
+    const std::string image_path = string_arg(argc, argv, "image", "earthmap.jpg");
+    const int reloads = int_arg(argc, argv, "reloads", 10);
+
+    std::cout << "assets: building " << scene_name << " cold and " << reloads << " times warm, then loading "
+              << image_path << std::endl;
+
+    auto elapsed_ms = [](auto start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    asset_cache_t& assets = asset_cache_t::instance();
+    assets.clear();
+    auto start = std::chrono::steady_clock::now();
+    if(!make_scene(scene_name, 64, 64)) {
+        std::cerr << "ERROR: unknown scene '" << scene_name << "'\n";
+        return 1;
+    }
+    const double cold_ms = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < reloads; i++) {
+        make_scene(scene_name, 64, 64);
+    }
+    const double warm_ms = elapsed_ms(start) / std::max(1, reloads);
+    const asset_cache_stats_t stats = assets.stats();
+    std::cout << "scene: " << cold_ms << " ms cold, " << warm_ms << " ms warm, " << stats.hits << " of "
+              << stats.requests << " assets found in the cache" << std::endl;
+
+    // a cache of our own for each, so neither finds the other's loads
+    for(const bool side_by_side : {false, true}) {
+        asset_cache_t cache;
+        start = std::chrono::steady_clock::now();
+        if(side_by_side) {
+            cache.prefetch(image_path, texture_format_t::rgb_float);
+            cache.prefetch(image_path, texture_format_t::bc1);
+        }
+        const auto image = cache.image(image_path, texture_format_t::rgb_float);
+        cache.image(image_path, texture_format_t::bc1);
+        if(image->levels() == 0) {
+            return 1;
+        }
+        std::cout << (side_by_side ? "side by side: " : "one after the other: ") << elapsed_ms(start) << " ms, "
+                  << cache.stats().load_seconds * 1000.0 << " ms decoding" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,63 @@
+// Procedural textures (checkers, marble noise) worked out at every lookup, against
+// baked into sparse voxel bricks at a few resolutions: the bake's time and memory, and
+// the time per sample and noise of a render with them.
+
+#include <iostream>
+#include <thread>
+
+#include "benchmarks.h"
+#include "texture_bake.h"
+
+int bench_bake(int argc, char* argv[]) {
+    const std::string scene_name = string_arg(argc, argv, "scene", "two_perlin_spheres_scene");
+    const int width = int_arg(argc, argv, "width", 128);
+    const int height = int_arg(argc, argv, "height", 128);
+    const int reference_spp = int_arg(argc, argv, "reference-spp", 64);
+    const int spp = int_arg(argc, argv, "spp", 4);
+    const auto hw = std::thread::hardware_concurrency();
+    const int threads = int_arg(argc, argv, "threads", hw > 0 ? static_cast<int>(hw) : 4);
+
+    auto scene = make_scene(scene_name, width, height);
+    if(!scene) {
+        std::cerr << "ERROR: unknown scene '" << scene_name << "'\n";
+        return 1;
+    }
+
+    std::cout << "bake: " << scene_name << " at " << width << "x" << height << ", " << spp << " spp against a "
+              << reference_spp << " spp reference, " << threads << " threads" << std::endl;
+
+    render_settings_t settings;
+    settings.num_threads = threads;
+    settings.max_bounces = int_arg(argc, argv, "bounces", 8);
+
+    render_settings_t ref_settings = settings;
+    ref_settings.samples_per_pixel = reference_spp;
+    const std::vector<color_t> reference = render_reference(*scene, width, height, ref_settings);
+
+    auto render = [&](const scene_t& s) {
+        render_settings_t r = settings;
+        r.samples_per_pixel = spp;
+        film_t film(width, height);
+        renderer_t renderer(s, film, r);
+        const render_stats_t stats = renderer.render(film.bounds());
+        std::cout << stats.seconds / spp * 1000.0 << " ms per sample, rmse " << displayed_rmse(film, reference) << std::endl;
+    };
+
+    std::cout << "procedural: ";
+    render(*scene);
+
+    for(const double voxels_per_pixel : {0.5, 1.0, 2.0, 4.0}) {
+        // baking changes the scene's materials, so each gets a scene of its own
+        auto baked = make_scene(scene_name, width, height);
+        texture_bake_settings_t bake_settings;
+        bake_settings.voxels_per_pixel = voxels_per_pixel;
+        bake_settings.tolerance = 1.0 / 512;
+        const texture_bake_stats_t stats = bake_textures(*baked, bake_settings, threads);
+        std::cout << voxels_per_pixel << " voxels per pixel: " << stats.textures << " textures, " << stats.bricks << " bricks ("
+                  << stats.uniform_bricks << " uniform), " << stats.bytes / 1024 << " KB, baked in " << stats.seconds * 1000.0
+                  << " ms, ";
+        render(*baked);
+    }
+
+    return 0;
+}
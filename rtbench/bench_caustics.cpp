@@ -0,0 +1,62 @@
+// Caustics from a photon map. How long a pass of photons takes to trace (in
+// parallel) and how many of them end up as caustics, then the noise after the same
+// number of samples per pixel with plain path tracing and with the photon map.
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "benchmarks.h"
+#include "photon_map.h"
+
+int bench_caustics(int argc, char* argv[]) {
+    const std::string scene_name = string_arg(argc, argv, "scene", "sunny_day");
+    const int width = int_arg(argc, argv, "width", 96);
+    const int height = int_arg(argc, argv, "height", 54);
+    const int reference_spp = int_arg(argc, argv, "reference-spp", 1024);
+    const int spp = int_arg(argc, argv, "spp", 16);
+    const auto hw = std::thread::hardware_concurrency();
+    const int threads = int_arg(argc, argv, "threads", hw > 0 ? static_cast<int>(hw) : 4);
+
+    auto scene = make_scene(scene_name, width, height);
+    if(!scene) {
+        std::cerr << "ERROR: unknown scene '" << scene_name << "'\n";
+        return 1;
+    }
+
+    render_settings_t settings;
+    settings.num_threads = threads;
+    settings.max_bounces = int_arg(argc, argv, "bounces", 8);
+    settings.caustic_photons = int_arg(argc, argv, "photons", settings.caustic_photons);
+
+    {
+        photon_map_t photons;
+        const auto start = std::chrono::steady_clock::now();
+        photons.emit(*scene, settings);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "caustics: " << settings.caustic_photons << " photons in " << seconds * 1000.0 << " ms, "
+                  << photons.photon_count() << " kept (" << photons.memory_bytes() / 1024 << " KB), radius "
+                  << photons.radius() << std::endl;
+    }
+
+    std::cout << "caustics: " << scene_name << " at " << width << "x" << height << ", " << spp
+              << " spp against a " << reference_spp << " spp reference, " << threads << " threads" << std::endl;
+
+    render_settings_t ref_settings = settings;
+    ref_settings.samples_per_pixel = reference_spp;
+    const std::vector<color_t> reference = render_reference(*scene, width, height, ref_settings);
+
+    for(const bool caustics : {false, true}) {
+        render_settings_t s = settings;
+        s.caustics = caustics;
+        s.samples_per_pixel = spp;
+
+        film_t film(width, height);
+        renderer_t renderer(*scene, film, s);
+        const double seconds = renderer.render(film.bounds()).seconds;
+        std::cout << (caustics ? "photon map:" : "path tracing:") << " rmse " << displayed_rmse(film, reference) << ", "
+                  << seconds / spp * 1000.0 << " ms per sample" << std::endl;
+    }
+
+    return 0;
+}
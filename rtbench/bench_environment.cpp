@@ -0,0 +1,80 @@
+// Environment map lighting. How fast importance sampling the environment (through
+// its alias tables) picks a direction, and how the noise in a sunlit scene falls with
+// the sample count with and without it. Without it, only bounced rays that happen
+// to hit the sun see it.
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "benchmarks.h"
+
+int bench_environment(int argc, char* argv[]) {
+    const std::string scene_name = string_arg(argc, argv, "scene", "sunny_day");
+    const int width = int_arg(argc, argv, "width", 96);
+    const int height = int_arg(argc, argv, "height", 54);
+    const int reference_spp = int_arg(argc, argv, "reference-spp", 1024);
+    const int max_spp = int_arg(argc, argv, "max-spp", 64);
+    const int picks = int_arg(argc, argv, "picks", 1000000);
+    const auto hw = std::thread::hardware_concurrency();
+    const int threads = int_arg(argc, argv, "threads", hw > 0 ? static_cast<int>(hw) : 4);
+
+    auto scene = make_scene(scene_name, width, height);
+    if(!scene) {
+        std::cerr << "ERROR: unknown scene '" << scene_name << "'\n";
+        return 1;
+    }
+    if(!scene->environment) {
+        std::cerr << "ERROR: scene '" << scene_name << "' doesn't have an environment map\n";
+        return 1;
+    }
+
+    {
+        const auto start = std::chrono::steady_clock::now();
+        double sum = 0.0;
+        for(int i = 0; i < picks; i++) {
+            environment_sample_t s;
+            if(scene->environment->sample(s)) {
+                sum += s.pdf;
+            }
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "environment: " << scene->environment->width() << "x" << scene->environment->height() << " map, "
+                  << seconds / picks * 1e9 << " ns per sample (checksum " << sum / picks << ")" << std::endl;
+    }
+
+    std::cout << "environment: " << scene_name << " at " << width << "x" << height << " against a "
+              << reference_spp << " spp reference, " << threads << " threads" << std::endl;
+
+    render_settings_t settings;
+    settings.num_threads = threads;
+    settings.max_bounces = 8;
+
+    render_settings_t ref_settings = settings;
+    ref_settings.samples_per_pixel = reference_spp;
+    const std::vector<color_t> reference = render_reference(*scene, width, height, ref_settings);
+
+    for(const bool sample_environment : {false, true}) {
+        render_settings_t s = settings;
+        s.next_event_estimation = sample_environment;
+        s.samples_per_pixel = 1;
+
+        film_t film(width, height);
+        renderer_t renderer(*scene, film, s);
+
+        // double the samples each step, reporting the error as it goes
+        std::cout << (sample_environment ? "environment sampling:" : "bsdf sampling only:");
+        double seconds = 0.0;
+        int spp = 0;
+        for(int next = 1; next <= max_spp; next *= 2) {
+            while(spp < next) {
+                seconds += renderer.render(film.bounds()).seconds;
+                spp++;
+            }
+            std::cout << " " << spp << " spp rmse " << displayed_rmse(film, reference) << ",";
+        }
+        std::cout << " " << seconds << " s" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,133 @@
+// Measures how well render threads can publish finished tiles while the UI
+// thread keeps presenting the image. Compares the old scheme (one mutex for
+// every write and for the presenter's full frame copy) with image_buffer_t's
+// per tile seqlocks.
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "benchmarks.h"
+#include "image_buffer.h"
+
+namespace {
+
+struct framebuffer_result_t {
+    uint64_t tiles_written = 0;
+    uint64_t frames_presented = 0;
+    uint64_t tiles_presented = 0;
+};
+
+// the way image_buffer_t worked before: writers and the presenter all take one lock
+class locked_framebuffer_t {
+public:
+    locked_framebuffer_t(int width, int height): m_buffer(width, height), m_frame(static_cast<size_t>(width) * height * 4) {}
+
+    void write_region(const film_t& film, const render_region_t& region) {
+        std::lock_guard guard(m_mutex);
+        m_buffer.write_region(film, region);
+    }
+
+    void present() {
+        std::lock_guard guard(m_mutex);
+        memcpy(m_frame.data(), m_buffer.data(), m_frame.size());
+    }
+
+    [[nodiscard]] image_buffer_t& buffer() { return m_buffer; }
+
+private:
+    std::mutex m_mutex;
+    image_buffer_t m_buffer;
+    std::vector<uint8_t> m_frame;
+};
+
+template<typename write_fn_t, typename present_fn_t>
+framebuffer_result_t run(const image_buffer_t& layout, int num_threads, double seconds, write_fn_t write, present_fn_t present) {
+    std::atomic_bool stop = false;
+    std::atomic<uint64_t> tiles_written = 0;
+    framebuffer_result_t result;
+
+    std::vector<std::thread> writers;
+    for(int i = 0; i < num_threads; i++) {
+        writers.emplace_back([&, i] {
+            // thread i owns tiles i, i + num_threads, ... so no two threads share a tile
+            uint64_t written = 0;
+            while(!stop) {
+                for(int tile = i; tile < layout.tile_count() && !stop; tile += num_threads) {
+                    write(layout.tile_region(tile));
+                    written++;
+                }
+            }
+            tiles_written += written;
+        });
+    }
+
+    // present at roughly 60 fps, like the UI loop with vsync on
+    const auto start = std::chrono::steady_clock::now();
+    while(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() < seconds) {
+        result.tiles_presented += present();
+        result.frames_presented++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(16));
+    }
+
+    stop = true;
+    for(auto& t : writers) {
+        t.join();
+    }
+    result.tiles_written = tiles_written;
+    return result;
+}
+
+void report(const char* name, const framebuffer_result_t& r, double seconds, int tile_pixels) {
+    std::cout << name << ": "
+              << static_cast<double>(r.tiles_written) / seconds << " tiles/s written ("
+              << static_cast<double>(r.tiles_written) * tile_pixels / seconds / 1e6 << " Mpixels/s), "
+              << static_cast<double>(r.frames_presented) / seconds << " presents/s, "
+              << static_cast<double>(r.tiles_presented) / static_cast<double>(std::max<uint64_t>(1, r.frames_presented))
+              << " tiles copied per present" << std::endl;
+}
+
+}
+
+int bench_framebuffer(int argc, char* argv[]) {
+    const int num_threads = int_arg(argc, argv, "threads", 32);
+    const double seconds = int_arg(argc, argv, "seconds", 2);
+    const int width = int_arg(argc, argv, "width", 1920);
+    const int height = int_arg(argc, argv, "height", 1080);
+
+    film_t film(width, height);
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x++) {
+            film.add(x, y, color_t::random(), 1);
+        }
+    }
+
+    std::cout << "framebuffer: " << width << "x" << height << ", " << num_threads << " writer threads, "
+              << seconds << " s per run" << std::endl;
+
+    const int tile_pixels = image_buffer_t::default_tile_size * image_buffer_t::default_tile_size;
+
+    {
+        locked_framebuffer_t locked(width, height);
+        const auto result = run(locked.buffer(), num_threads, seconds,
+            [&](const render_region_t& r) { locked.write_region(film, r); },
+            [&] { locked.present(); return locked.buffer().tile_count(); });
+        report("global mutex", result, seconds, tile_pixels);
+    }
+
+    {
+        image_buffer_t buffer(width, height);
+        std::vector<uint8_t> presented(static_cast<size_t>(buffer.pitch()) * height);
+        std::vector<uint64_t> presented_epochs;
+        const auto result = run(buffer, num_threads, seconds,
+            [&](const render_region_t& r) { buffer.write_region(film, r); },
+            [&] { return buffer.sync_to(presented.data(), buffer.pitch(), presented_epochs); });
+        report("tile seqlocks", result, seconds, tile_pixels);
+    }
+
+    return 0;
+}
@@ -0,0 +1,57 @@
+// Path guiding. The noise after the same number of samples per pixel with and
+// without guiding (each a single render, so guiding learns over its iterations as it
+// would in rtcli), what a sample costs with each, and how many spatial cells and how
+// much memory the learnt guide ended up with.
+
+#include <iostream>
+#include <thread>
+
+#include "benchmarks.h"
+#include "path_guide.h"
+
+int bench_guiding(int argc, char* argv[]) {
+    const std::string scene_name = string_arg(argc, argv, "scene", "cornell_box");
+    const int width = int_arg(argc, argv, "width", 64);
+    const int height = int_arg(argc, argv, "height", 64);
+    const int reference_spp = int_arg(argc, argv, "reference-spp", 1024);
+    const int spp = int_arg(argc, argv, "spp", 64);
+    const auto hw = std::thread::hardware_concurrency();
+    const int threads = int_arg(argc, argv, "threads", hw > 0 ? static_cast<int>(hw) : 4);
+
+    auto scene = make_scene(scene_name, width, height);
+    if(!scene) {
+        std::cerr << "ERROR: unknown scene '" << scene_name << "'\n";
+        return 1;
+    }
+
+    std::cout << "guiding: " << scene_name << " at " << width << "x" << height << ", " << spp
+              << " spp against a " << reference_spp << " spp reference, " << threads << " threads" << std::endl;
+
+    render_settings_t settings;
+    settings.num_threads = threads;
+    settings.max_bounces = int_arg(argc, argv, "bounces", 16);
+
+    render_settings_t ref_settings = settings;
+    ref_settings.samples_per_pixel = reference_spp;
+    const std::vector<color_t> reference = render_reference(*scene, width, height, ref_settings);
+
+    for(const bool guiding : {false, true}) {
+        render_settings_t s = settings;
+        s.path_guiding = guiding;
+        s.samples_per_pixel = spp;
+
+        film_t film(width, height);
+        renderer_t renderer(*scene, film, s);
+        const double seconds = renderer.render(film.bounds()).seconds;
+
+        std::cout << (guiding ? "guided:" : "unguided:") << " rmse " << displayed_rmse(film, reference) << ", "
+                  << seconds / spp * 1000.0 << " ms per sample";
+        if(const path_guide_t* guide = renderer.guide()) {
+            std::cout << ", " << guide->iteration() << " refinements, " << guide->leaf_count() << " spatial cells, "
+                      << guide->memory_bytes() / 1024 << " KB";
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Light selection with many lights. First, what picking a light from the light tree
+// costs as the number of lights grows (it should grow with the tree's depth, not the
+// light count). Then the noise in a many-light scene at a fixed sample count, with
+// lights picked by the tree and uniformly.
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "benchmarks.h"
+#include "light_bvh.h"
+
+namespace {
+
+void bench_pick_cost(int picks) {
+    for(const int count : {16, 256, 4096, 65536}) {
+        // small lights of random brightness scattered through a cube
+        std::vector<shared_ptr<hittable_t>> lights;
+        for(int i = 0; i < count; i++) {
+            const point3 center(random_double(-10, 10), random_double(-10, 10), random_double(-10, 10));
+            lights.push_back(make_shared<sphere_t>(center, 0.05, make_shared<diffuse_light>(color_t::random(0.1, 4.0))));
+        }
+
+        const auto build_start = std::chrono::steady_clock::now();
+        light_bvh_t tree;
+        tree.build(lights);
+        const double build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - build_start).count();
+
+        std::vector<point3> points(1024);
+        for(auto& p : points) {
+            p = point3(random_double(-12, 12), random_double(-12, 12), random_double(-12, 12));
+        }
+
+        int found = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < picks; i++) {
+            double pmf;
+            found += tree.pick(points[i % points.size()], dvec3_t(0, 1, 0), random_double(), pmf) >= 0;
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << count << " lights: depth " << tree.depth() << ", built in " << build_seconds * 1e3 << " ms, "
+                  << seconds / picks * 1e9 << " ns per pick (" << found << " of " << picks << " found a light)" << std::endl;
+    }
+}
+
+}
+
+int bench_lights(int argc, char* argv[]) {
+    const std::string scene_name = string_arg(argc, argv, "scene", "display_wall");
+    const int width = int_arg(argc, argv, "width", 80);
+    const int height = int_arg(argc, argv, "height", 45);
+    const int spp = int_arg(argc, argv, "spp", 16);
+    const int reference_spp = int_arg(argc, argv, "reference-spp", 512);
+    const int picks = int_arg(argc, argv, "picks", 1000000);
+    const auto hw = std::thread::hardware_concurrency();
+    const int threads = int_arg(argc, argv, "threads", hw > 0 ? static_cast<int>(hw) : 4);
+
+    std::cout << "lights: picking from the light tree" << std::endl;
+    bench_pick_cost(picks);
+
+    auto scene = make_scene(scene_name, width, height);
+    if(!scene) {
+        std::cerr << "ERROR: unknown scene '" << scene_name << "'\n";
+        return 1;
+    }
+
+    std::cout << "lights: " << scene_name << " (" << scene->lights.size() << " lights) at " << width << "x" << height
+              << ", " << spp << " spp against a " << reference_spp << " spp reference, " << threads << " threads" << std::endl;
+
+    render_settings_t settings;
+    settings.num_threads = threads;
+    settings.max_bounces = 8;
+
+    render_settings_t ref_settings = settings;
+    ref_settings.samples_per_pixel = reference_spp;
+    const std::vector<color_t> reference = render_reference(*scene, width, height, ref_settings);
+
+    for(const bool light_tree : {false, true}) {
+        render_settings_t s = settings;
+        s.samples_per_pixel = spp;
+        s.light_tree = light_tree;
+
+        film_t film(width, height);
+        const render_stats_t stats = renderer_t(*scene, film, s).render(film.bounds());
+        std::cout << (light_tree ? "light tree" : "uniform") << ": " << stats.seconds << " s, rmse " << displayed_rmse(film, reference) << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+// The radiance cache. Paths ending in the cache after one or two diffuse bounces
+// against plain path tracing: the average path length, the time per sample, and the
+// noise against a path traced reference at the same samples per pixel.
+
+#include <iostream>
+#include <thread>
+
+#include "benchmarks.h"
+#include "radiance_cache.h"
+
+int bench_radiance_cache(int argc, char* argv[]) {
+    const std::string scene_name = string_arg(argc, argv, "scene", "cornell_box");
+    const int width = int_arg(argc, argv, "width", 96);
+    const int height = int_arg(argc, argv, "height", 96);
+    const int reference_spp = int_arg(argc, argv, "reference-spp", 1024);
+    const int spp = int_arg(argc, argv, "spp", 16);
+    const auto hw = std::thread::hardware_concurrency();
+    const int threads = int_arg(argc, argv, "threads", hw > 0 ? static_cast<int>(hw) : 4);
+
+    auto scene = make_scene(scene_name, width, height);
+    if(!scene) {
+        std::cerr << "ERROR: unknown scene '" << scene_name << "'\n";
+        return 1;
+    }
+
+    std::cout << "radiance cache: " << scene_name << " at " << width << "x" << height << ", " << spp
+              << " spp against a " << reference_spp << " spp reference, " << threads << " threads" << std::endl;
+
+    render_settings_t settings;
+    settings.num_threads = threads;
+    settings.max_bounces = int_arg(argc, argv, "bounces", settings.max_bounces);
+
+    render_settings_t ref_settings = settings;
+    ref_settings.samples_per_pixel = reference_spp;
+    const std::vector<color_t> reference = render_reference(*scene, width, height, ref_settings);
+
+    // 0 is plain path tracing
+    for(const int bounces : {0, 1, 2}) {
+        render_settings_t s = settings;
+        s.samples_per_pixel = spp;
+        s.radiance_cache = bounces > 0;
+        s.radiance_cache_bounces = bounces;
+
+        film_t film(width, height);
+        renderer_t renderer(*scene, film, s);
+        const render_stats_t stats = renderer.render(film.bounds());
+        if(bounces == 0) {
+            std::cout << "path tracing:";
+        } else {
+            std::cout << "cache after " << bounces << (bounces == 1 ? " bounce:" : " bounces:");
+        }
+        std::cout << " path length " << stats.average_path_length() << ", " << stats.seconds / spp * 1000.0
+                  << " ms per sample, rmse " << displayed_rmse(film, reference);
+        if(const radiance_cache_t* cache = renderer.radiance_cache()) {
+            std::cout << ", " << cache->entry_count() << " cells (" << cache->memory_bytes() / (1024 * 1024) << " MB table, "
+                      << cache->dropped() << " records dropped)";
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+// Measures how long it takes to turn the float film into 8-bit pixels for the
+// screen. Compares the old per pixel conversion (divide, three sqrts and a clamp
+// per pixel, in doubles) with resolve_pixels() and each of its tone mappers.
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "benchmarks.h"
+#include "resolve.h"
+
+namespace {
+
+// the conversion image_buffer_t used to do for every pixel
+void resolve_per_pixel(const film_t& film, uint8_t* dst, int dst_pitch) {
+    for(int y = 0; y < film.height(); y++) {
+        uint8_t* out = dst + y * dst_pitch;
+        for(int x = 0; x < film.width(); x++, out += 4) {
+            const color_t c = film.resolve(x, y);
+            out[0] = 255;
+            out[1] = static_cast<uint8_t>(glm::clamp(sqrt(c.b), 0.0, 0.999) * 256);
+            out[2] = static_cast<uint8_t>(glm::clamp(sqrt(c.g), 0.0, 0.999) * 256);
+            out[3] = static_cast<uint8_t>(glm::clamp(sqrt(c.r), 0.0, 0.999) * 256);
+        }
+    }
+}
+
+template<typename fn_t>
+void time_frames(const char* name, int frames, int pixels, fn_t resolve_frame) {
+    const auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < frames; i++) {
+        resolve_frame();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << seconds / frames * 1000.0 << " ms/frame, "
+              << static_cast<double>(pixels) * frames / seconds / 1e6 << " Mpixels/s" << std::endl;
+}
+
+}
+
+int bench_resolve(int argc, char* argv[]) {
+    const int width = int_arg(argc, argv, "width", 1920);
+    const int height = int_arg(argc, argv, "height", 1080);
+    const int frames = int_arg(argc, argv, "frames", 20);
+
+    // HDR-ish values with a few hundred samples each, like a progressive render part way through
+    film_t film(width, height);
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x++) {
+            film.add(x, y, color_t::random(0.0, 4.0) * 256.0, 256);
+        }
+    }
+
+    const int pitch = width * 4;
+    std::vector<uint8_t> frame(static_cast<size_t>(pitch) * height);
+
+    std::cout << "resolve: " << width << "x" << height << ", " << frames << " frames per run" << std::endl;
+
+    time_frames("per pixel (gamma 2)", frames, width * height, [&] { resolve_per_pixel(film, frame.data(), pitch); });
+
+    for(const tonemap_t t : {tonemap_t::clamp, tonemap_t::reinhard, tonemap_t::aces}) {
+        for(const bool dither : {false, true}) {
+            resolve_settings_t settings;
+            settings.tonemap = t;
+            settings.dither = dither;
+            const std::string name = std::string("resolve_pixels ") + tonemap_name(t) + (dither ? " + dither" : "");
+            time_frames(name.c_str(), frames, width * height, [&] {
+                resolve_film_region(film, film.bounds(), frame.data(), pitch, settings);
+            });
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+// Reservoir resampled direct lighting. The noise at 1 to 4 samples per pixel with
+// next event estimation against ReSTIR (where each sample is one pass that reuses the
+// last pass's and the neighbours' picks), and what a sample costs with each. Both are
+// unbiased, so both errors should keep falling as samples are added.
+
+#include <iostream>
+#include <thread>
+
+#include "benchmarks.h"
+
+int bench_restir(int argc, char* argv[]) {
+    const std::string scene_name = string_arg(argc, argv, "scene", "display_wall");
+    const int width = int_arg(argc, argv, "width", 96);
+    const int height = int_arg(argc, argv, "height", 54);
+    const int reference_spp = int_arg(argc, argv, "reference-spp", 512);
+    const int max_spp = int_arg(argc, argv, "max-spp", 16);
+    const auto hw = std::thread::hardware_concurrency();
+    const int threads = int_arg(argc, argv, "threads", hw > 0 ? static_cast<int>(hw) : 4);
+
+    auto scene = make_scene(scene_name, width, height);
+    if(!scene) {
+        std::cerr << "ERROR: unknown scene '" << scene_name << "'\n";
+        return 1;
+    }
+
+    std::cout << "restir: " << scene_name << " at " << width << "x" << height << " against a "
+              << reference_spp << " spp reference, " << threads << " threads" << std::endl;
+
+    render_settings_t settings;
+    settings.num_threads = threads;
+    settings.max_bounces = int_arg(argc, argv, "bounces", 8);
+
+    render_settings_t ref_settings = settings;
+    ref_settings.samples_per_pixel = reference_spp;
+    const std::vector<color_t> reference = render_reference(*scene, width, height, ref_settings);
+
+    for(const bool restir : {false, true}) {
+        render_settings_t s = settings;
+        s.restir = restir;
+        s.samples_per_pixel = 1;
+
+        film_t film(width, height);
+        renderer_t renderer(*scene, film, s);
+
+        // one pass at a time with the same renderer, so ReSTIR keeps its reservoirs
+        std::cout << (restir ? "restir:" : "next event estimation:");
+        double seconds = 0.0;
+        int spp = 0;
+        for(int next = 1; next <= max_spp; next *= 2) {
+            while(spp < next) {
+                seconds += renderer.render(film.bounds()).seconds;
+                spp++;
+            }
+            std::cout << " " << spp << " spp rmse " << displayed_rmse(film, reference) << ",";
+        }
+        std::cout << " " << seconds / spp * 1000.0 << " ms per sample" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+// Time-to-quality for the path termination options: how long each setup takes to
+// get a scene's error (against a long reference render) under a target. Russian
+// roulette and splitting change how much a sample costs and how noisy it is, so
+// the time to a fixed error is the number that matters, not samples per second.
+
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "benchmarks.h"
+#include "raytrace.h"
+
+namespace {
+
+struct roulette_config_t {
+    const char* name;
+    bool russian_roulette;
+    int roulette_min_depth;
+    int first_bounce_splits;
+};
+
+}
+
+int bench_roulette(int argc, char* argv[]) {
+    const std::string scene_name = string_arg(argc, argv, "scene", "cornell_box");
+    const int width = int_arg(argc, argv, "width", 48);
+    const int height = int_arg(argc, argv, "height", 48);
+    const int reference_spp = int_arg(argc, argv, "reference-spp", 2048);
+    const int pass_spp = int_arg(argc, argv, "pass-spp", 4);
+    const int max_spp = int_arg(argc, argv, "max-spp", 4096);
+    const double target = int_arg(argc, argv, "target-permille", 20) / 1000.0;
+    const auto hw = std::thread::hardware_concurrency();
+    const int threads = int_arg(argc, argv, "threads", hw > 0 ? static_cast<int>(hw) : 4);
+
+    auto scene = make_scene(scene_name, width, height);
+    if(!scene) {
+        std::cerr << "ERROR: unknown scene '" << scene_name << "'\n";
+        return 1;
+    }
+
+    render_settings_t settings;
+    settings.num_threads = threads;
+
+    std::cout << "roulette: " << scene_name << " at " << width << "x" << height << ", target rmse " << target
+              << ", " << reference_spp << " spp reference, " << threads << " threads" << std::endl;
+
+    // the reference doesn't use roulette, so it can't hide a bias in it
+    render_settings_t ref_settings = settings;
+    ref_settings.samples_per_pixel = reference_spp;
+    ref_settings.russian_roulette = false;
+    const std::vector<color_t> reference = render_reference(*scene, width, height, ref_settings);
+
+    const roulette_config_t configs[] = {
+        {"no roulette", false, 0, 1},
+        {"roulette from bounce 3", true, 3, 1},
+        {"roulette from bounce 1", true, 1, 1},
+        {"roulette from bounce 3, split 4", true, 3, 4},
+    };
+
+    for(const auto& config : configs) {
+        render_settings_t s = settings;
+        s.samples_per_pixel = pass_spp;
+        s.russian_roulette = config.russian_roulette;
+        s.roulette_min_depth = config.roulette_min_depth;
+        s.first_bounce_splits = config.first_bounce_splits;
+
+        film_t film(width, height);
+        renderer_t renderer(*scene, film, s);
+
+        // keep adding passes until the error is low enough
+        render_stats_t total;
+        double rmse = 1.0;
+        int spp = 0;
+        while(spp < max_spp) {
+            const render_stats_t pass = renderer.render(film.bounds());
+            total.seconds += pass.seconds;
+            total.rays += pass.rays;
+            total.samples += pass.samples;
+            total.path_segments += pass.path_segments;
+            spp += pass_spp;
+
+            rmse = displayed_rmse(film, reference);
+            if(rmse <= target) {
+                break;
+            }
+        }
+
+        std::cout << config.name << ": " << (rmse <= target ? "" : "did not reach target, ")
+                  << total.seconds << " s, " << spp << " spp, rmse " << rmse
+                  << ", average path length " << total.average_path_length()
+                  << ", " << static_cast<double>(total.rays) / total.seconds / 1e6 << " Mrays/s" << std::endl;
+    }
+
+    return 0;
+}
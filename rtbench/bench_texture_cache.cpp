@@ -0,0 +1,60 @@
+// A textured globe filling the view, with its texture read from a tiled file through
+// the texture cache at a range of memory budgets, against keeping the whole image in
+// memory: time per sample, tile hit rate and how much had to be read.
+
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+#include "benchmarks.h"
+#include "texture_cache.h"
+
+int bench_texture_cache(int argc, char* argv[]) {
+    const std::string image_path = string_arg(argc, argv, "image", "earthmap.jpg");
+    const int width = int_arg(argc, argv, "width", 128);
+    const int height = int_arg(argc, argv, "height", 128);
+    const int spp = int_arg(argc, argv, "spp", 8);
+    const int tile_size = int_arg(argc, argv, "tile", 64);
+    const auto hw = std::thread::hardware_concurrency();
+    const int threads = int_arg(argc, argv, "threads", hw > 0 ? static_cast<int>(hw) : 4);
+
+    auto image = make_shared<image_texture_t>(image_path.c_str());
+    if(image->levels() == 0) {
+        return 1;
+    }
+    const std::string tiled_path = (std::filesystem::temp_directory_path() / "rtbench_texture_cache.rttx").string();
+    if(!write_tiled_texture(*image, tiled_path, tile_size)) {
+        return 1;
+    }
+
+    std::cout << "texture_cache: " << image_path << " (" << image->width() << "x" << image->height() << ", "
+              << image->memory_bytes() / 1024 << " KB with its mip levels) in " << tile_size << "x" << tile_size
+              << " tiles, " << width << "x" << height << ", " << spp << " spp, " << threads << " threads" << std::endl;
+
+    render_settings_t settings;
+    settings.num_threads = threads;
+    settings.samples_per_pixel = spp;
+    settings.max_bounces = int_arg(argc, argv, "bounces", 8);
+
+    auto render = [&](const shared_ptr<const texture_t>& texture) {
+        const scene_t scene = textured_globe_scene(width, height, texture);
+        film_t film(width, height);
+        renderer_t renderer(scene, film, settings);
+        return renderer.render(film.bounds());
+    };
+
+    const render_stats_t resident = render(image);
+    std::cout << "in memory: " << resident.seconds / spp * 1000.0 << " ms per sample" << std::endl;
+
+    for(const int budget_kb : {256, 1024, 4096, 16384}) {
+        auto cache = make_shared<texture_cache_t>(static_cast<size_t>(budget_kb) * 1024);
+        const render_stats_t stats = render(make_shared<cached_texture_t>(cache, tiled_path));
+        const texture_cache_stats_t cs = cache->stats();
+        std::cout << budget_kb << " KB budget: " << stats.seconds / spp * 1000.0 << " ms per sample, hit rate "
+                  << cs.hit_rate() * 100.0 << "%, " << cs.bytes_loaded / 1024 << " KB loaded (" << cs.tiles_loaded
+                  << " tiles, " << cs.evictions << " evicted)" << std::endl;
+    }
+
+    std::filesystem::remove(tiled_path);
+    return 0;
+}
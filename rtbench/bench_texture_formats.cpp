@@ -0,0 +1,53 @@
+// The earth texture kept as linear floats and block compressed (BC1): how long each
+// takes to load, how much memory it takes, and the time per sample and noise of a
+// high resolution render of a globe with it on.
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "benchmarks.h"
+
+int bench_texture_formats(int argc, char* argv[]) {
+    const std::string image_path = string_arg(argc, argv, "image", "earthmap.jpg");
+    const int width = int_arg(argc, argv, "width", 512);
+    const int height = int_arg(argc, argv, "height", 512);
+    const int reference_spp = int_arg(argc, argv, "reference-spp", 32);
+    const int spp = int_arg(argc, argv, "spp", 4);
+    const auto hw = std::thread::hardware_concurrency();
+    const int threads = int_arg(argc, argv, "threads", hw > 0 ? static_cast<int>(hw) : 4);
+
+    std::cout << "texture_formats: " << image_path << " on a globe at " << width << "x" << height << ", " << spp
+              << " spp against a " << reference_spp << " spp reference, " << threads << " threads" << std::endl;
+
+    render_settings_t settings;
+    settings.num_threads = threads;
+    settings.max_bounces = int_arg(argc, argv, "bounces", 8);
+
+    std::vector<color_t> reference;
+    for(const texture_format_t format : {texture_format_t::rgb_float, texture_format_t::bc1}) {
+        const auto start = std::chrono::steady_clock::now();
+        auto texture = make_shared<image_texture_t>(image_path.c_str(), format);
+        const double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if(texture->levels() == 0) {
+            return 1;
+        }
+        if(reference.empty()) {
+            render_settings_t ref_settings = settings;
+            ref_settings.samples_per_pixel = reference_spp;
+            reference = render_reference(textured_globe_scene(width, height, texture), width, height, ref_settings);
+        }
+
+        render_settings_t s = settings;
+        s.samples_per_pixel = spp;
+        const scene_t scene = textured_globe_scene(width, height, texture);
+        film_t film(width, height);
+        renderer_t renderer(scene, film, s);
+        const render_stats_t stats = renderer.render(film.bounds());
+        std::cout << (format == texture_format_t::bc1 ? "bc1: " : "float: ") << texture->memory_bytes() / 1024 << " KB, loaded in "
+                  << load_ms << " ms, " << stats.seconds / spp * 1000.0 << " ms per sample, rmse "
+                  << displayed_rmse(film, reference) << std::endl;
+    }
+
+    return 0;
+}
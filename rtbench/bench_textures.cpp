@@ -0,0 +1,53 @@
+// A shrunk image texture (the globe in earth_scene, a few dozen pixels across). The
+// time per sample and noise against a reference, with textures read at full size
+// and with them filtered over each pixel's footprint in their mip levels.
+
+#include <iostream>
+#include <thread>
+
+#include "benchmarks.h"
+
+int bench_textures(int argc, char* argv[]) {
+    const std::string scene_name = string_arg(argc, argv, "scene", "earth_scene");
+    const int width = int_arg(argc, argv, "width", 64);
+    const int height = int_arg(argc, argv, "height", 64);
+    const int reference_spp = int_arg(argc, argv, "reference-spp", 256);
+    const int max_spp = int_arg(argc, argv, "spp", 16);
+    const auto hw = std::thread::hardware_concurrency();
+    const int threads = int_arg(argc, argv, "threads", hw > 0 ? static_cast<int>(hw) : 4);
+
+    auto scene = make_scene(scene_name, width, height);
+    if(!scene) {
+        std::cerr << "ERROR: unknown scene '" << scene_name << "'\n";
+        return 1;
+    }
+
+    std::cout << "textures: " << scene_name << " at " << width << "x" << height << ", 1 to " << max_spp
+              << " spp against a " << reference_spp << " spp reference, " << threads << " threads" << std::endl;
+
+    render_settings_t settings;
+    settings.num_threads = threads;
+    settings.max_bounces = int_arg(argc, argv, "bounces", 8);
+
+    // every sample point-samples the texture, so many samples average it exactly
+    render_settings_t ref_settings = settings;
+    ref_settings.samples_per_pixel = reference_spp;
+    ref_settings.texture_filtering = false;
+    const std::vector<color_t> reference = render_reference(*scene, width, height, ref_settings);
+
+    for(int spp = 1; spp <= max_spp; spp *= 4) {
+        for(const bool filtering : {false, true}) {
+            render_settings_t s = settings;
+            s.samples_per_pixel = spp;
+            s.texture_filtering = filtering;
+
+            film_t film(width, height);
+            renderer_t renderer(*scene, film, s);
+            const render_stats_t stats = renderer.render(film.bounds());
+            std::cout << spp << " spp, " << (filtering ? "filtered:" : "full size:") << " " << stats.seconds / spp * 1000.0
+                      << " ms per sample, rmse " << displayed_rmse(film, reference) << std::endl;
+        }
+    }
+
+    return 0;
+}
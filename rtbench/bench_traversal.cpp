@@ -0,0 +1,73 @@
+// Tracing against the primitive store (flat arrays of shapes and a flat BVH) and
+// against the tree of bvh_node_ts over the hittables it's built from: build time,
+// camera rays per second, and time per sample of a whole render.
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+#include "benchmarks.h"
+
+int bench_traversal(int argc, char* argv[]) {
+    const std::string scene_name = string_arg(argc, argv, "scene", "cornell_box");
+    const int width = int_arg(argc, argv, "width", 128);
+    const int height = int_arg(argc, argv, "height", 128);
+    const int rays_per_pixel = int_arg(argc, argv, "rays", 16);
+    const int spp = int_arg(argc, argv, "spp", 4);
+    const auto hw = std::thread::hardware_concurrency();
+    const int threads = int_arg(argc, argv, "threads", hw > 0 ? static_cast<int>(hw) : 4);
+
+    auto scene = make_scene(scene_name, width, height);
+    if(!scene) {
+        std::cerr << "ERROR: unknown scene '" << scene_name << "'\n";
+        return 1;
+    }
+
+    std::cout << "traversal: " << scene_name << " (" << scene->entities.objects.size() << " entities) at " << width << "x"
+              << height << ", " << rays_per_pixel << " camera rays a pixel, " << spp << " spp renders on " << threads
+              << " threads" << std::endl;
+
+    auto elapsed_ms = [](auto start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    // the same rays for both
+    std::vector<ray_t> rays;
+    rays.reserve(static_cast<size_t>(width) * height * rays_per_pixel);
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x++) {
+            for(int i = 0; i < rays_per_pixel; i++) {
+                rays.push_back(scene->cam.get_ray((x + random_double()) / (width - 1), (y + random_double()) / (height - 1)));
+            }
+        }
+    }
+
+    auto run = [&](const char* name, const std::function<shared_ptr<hittable_t>()>& build) {
+        auto start = std::chrono::steady_clock::now();
+        scene->root = build();
+        const double build_ms = elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
+        size_t hits = 0;
+        for(const ray_t& r : rays) {
+            hit_record_t rec{};
+            hits += scene->root->hit(r, 0.001, infinity, rec) ? 1 : 0;
+        }
+        const double trace_ms = elapsed_ms(start);
+
+        render_settings_t settings;
+        settings.num_threads = threads;
+        settings.samples_per_pixel = spp;
+        film_t film(width, height);
+        renderer_t renderer(*scene, film, settings);
+        const render_stats_t stats = renderer.render(film.bounds());
+
+        std::cout << name << ": built in " << build_ms << " ms, " << rays.size() / trace_ms / 1000.0 << " Mrays/s ("
+                  << hits << " hits), " << stats.seconds / spp * 1000.0 << " ms per sample" << std::endl;
+    };
+
+    run("bvh_node_t", [&] { return make_shared<bvh_node_t>(scene->entities, 0, 1); });
+    run("primitive_store_t", [&] { return make_shared<primitive_store_t>(scene->entities.objects, 0, 1); });
+    return 0;
+}
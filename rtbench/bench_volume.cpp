@@ -0,0 +1,72 @@
+// Heterogeneous smoke. How much of the density grid needed storing, then the time per
+// sample and noise rendering it with a majorant per brick against one majorant for
+// the whole grid (so every step is as short as the densest voxel needs).
+
+#include <iostream>
+#include <thread>
+
+#include "benchmarks.h"
+#include "grid_medium.h"
+
+int bench_volume(int argc, char* argv[]) {
+    const std::string scene_name = string_arg(argc, argv, "scene", "cornell_grid_smoke");
+    const int width = int_arg(argc, argv, "width", 64);
+    const int height = int_arg(argc, argv, "height", 64);
+    const int reference_spp = int_arg(argc, argv, "reference-spp", 256);
+    const int spp = int_arg(argc, argv, "spp", 16);
+    const auto hw = std::thread::hardware_concurrency();
+    const int threads = int_arg(argc, argv, "threads", hw > 0 ? static_cast<int>(hw) : 4);
+
+    auto scene = make_scene(scene_name, width, height);
+    if(!scene) {
+        std::cerr << "ERROR: unknown scene '" << scene_name << "'\n";
+        return 1;
+    }
+
+    std::vector<shared_ptr<grid_medium_t>> media;
+    for(const auto& obj : scene->entities.objects) {
+        if(auto medium = std::dynamic_pointer_cast<grid_medium_t>(obj)) {
+            media.push_back(medium);
+        }
+    }
+    if(media.empty()) {
+        std::cerr << "ERROR: scene '" << scene_name << "' has no grid media\n";
+        return 1;
+    }
+    for(const auto& medium : media) {
+        const density_grid_t& grid = medium->grid();
+        const glm::ivec3 size = grid.size();
+        const glm::ivec3 bricks = grid.bricks();
+        const size_t dense = static_cast<size_t>(size.x) * size.y * size.z * sizeof(float);
+        std::cout << "volume: " << size.x << "x" << size.y << "x" << size.z << " voxels, " << grid.stored_bricks() << " of "
+                  << bricks.x * bricks.y * bricks.z << " bricks stored, " << grid.memory_bytes() / 1024 << " KB ("
+                  << dense / 1024 << " KB dense)" << std::endl;
+    }
+
+    std::cout << "volume: " << scene_name << " at " << width << "x" << height << ", " << spp
+              << " spp against a " << reference_spp << " spp reference, " << threads << " threads" << std::endl;
+
+    render_settings_t settings;
+    settings.num_threads = threads;
+    settings.max_bounces = int_arg(argc, argv, "bounces", 16);
+
+    render_settings_t ref_settings = settings;
+    ref_settings.samples_per_pixel = reference_spp;
+    const std::vector<color_t> reference = render_reference(*scene, width, height, ref_settings);
+
+    for(const bool majorant_grid : {false, true}) {
+        for(const auto& medium : media) {
+            medium->set_majorant_grid(majorant_grid);
+        }
+        render_settings_t s = settings;
+        s.samples_per_pixel = spp;
+
+        film_t film(width, height);
+        renderer_t renderer(*scene, film, s);
+        const render_stats_t stats = renderer.render(film.bounds());
+        std::cout << (majorant_grid ? "majorant per brick:" : "one majorant:") << " " << stats.seconds / spp * 1000.0
+                  << " ms per sample, rmse " << displayed_rmse(film, reference) << std::endl;
+    }
+
+    return 0;
+}
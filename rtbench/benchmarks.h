@@ -0,0 +1,93 @@
+#pragma once
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "raytrace.h"
+
+// Each benchmark gets the arguments that came after its name on the command
+// line and returns the process exit code.
+
+int bench_framebuffer(int argc, char* argv[]);
+int bench_resolve(int argc, char* argv[]);
+int bench_roulette(int argc, char* argv[]);
+int bench_lights(int argc, char* argv[]);
+int bench_environment(int argc, char* argv[]);
+int bench_restir(int argc, char* argv[]);
+int bench_guiding(int argc, char* argv[]);
+int bench_caustics(int argc, char* argv[]);
+int bench_radiance_cache(int argc, char* argv[]);
+int bench_volume(int argc, char* argv[]);
+int bench_textures(int argc, char* argv[]);
+int bench_texture_cache(int argc, char* argv[]);
+int bench_texture_formats(int argc, char* argv[]);
+int bench_assets(int argc, char* argv[]);
+int bench_bake(int argc, char* argv[]);
+int bench_traversal(int argc, char* argv[]);
+int bench_arena(int argc, char* argv[]);
+
+/**
+ * \brief Looks for "--name value" in the arguments, returning default_value if it's not there.
+ */
+inline int int_arg(int argc, char* argv[], const std::string& name, int default_value) {
+    for(int i = 0; i + 1 < argc; i++) {
+        if(argv[i] == "--" + name) {
+            return std::stoi(argv[i + 1]);
+        }
+    }
+    return default_value;
+}
+
+/**
+ * \brief A globe with texture on it, filling most of the view.
+ */
+inline scene_t textured_globe_scene(int width, int height, const shared_ptr<const texture_t>& texture) {
+    camera_t cam {width, height, 30.0, {0, 1, 7}, {0, 0, 0}, {0, 1, 0}, 0.0, 7.0};
+    scene_t scene {cam};
+    scene.entities.add(make_shared<sphere_t>(point3(0, 0, 0), 2, make_shared<lambertian_material_t>(texture)));
+    scene.background = {0.70, 0.80, 1.00};
+    scene.build();
+    return scene;
+}
+
+/**
+ * \brief Renders scene with settings and returns the resolved pixels, row by row.
+ */
+inline std::vector<color_t> render_reference(const scene_t& scene, int width, int height, const render_settings_t& settings) {
+    film_t film(width, height);
+    renderer_t(scene, film, settings).render(film.bounds());
+    std::vector<color_t> pixels(static_cast<size_t>(width) * height);
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x++) {
+            pixels[static_cast<size_t>(y) * width + x] = film.resolve(x, y);
+        }
+    }
+    return pixels;
+}
+
+/**
+ * \brief RMSE between the film and a reference, with both clamped to 1 first. That's
+ * the error of what's on screen, so a few fireflies don't swamp everything else.
+ */
+inline double displayed_rmse(const film_t& film, const std::vector<color_t>& reference) {
+    double sum = 0.0;
+    for(int y = 0; y < film.height(); y++) {
+        for(int x = 0; x < film.width(); x++) {
+            const color_t c = film.resolve(x, y);
+            const color_t& r = reference[static_cast<size_t>(y) * film.width() + x];
+            const double dr = std::min(c.r, 1.0) - std::min(r.r, 1.0);
+            const double dg = std::min(c.g, 1.0) - std::min(r.g, 1.0);
+            const double db = std::min(c.b, 1.0) - std::min(r.b, 1.0);
+            sum += dr*dr + dg*dg + db*db;
+        }
+    }
+    return sqrt(sum / (3.0 * film.width() * film.height()));
+}
+
+inline std::string string_arg(int argc, char* argv[], const std::string& name, const std::string& default_value) {
+    for(int i = 0; i + 1 < argc; i++) {
+        if(argv[i] == "--" + name) {
+            return argv[i + 1];
+        }
+    }
+    return default_value;
+}
@@ -0,0 +1,62 @@
+// Micro benchmarks for the pieces of the renderer that are hard to measure
+// through a whole render. Run "rtbench <benchmark> [options]".
+
+#include <iostream>
+#include <string>
+
+#include "benchmarks.h"
+
+namespace {
+
+struct benchmark_t {
+    const char* name;
+    const char* description;
+    int (*run)(int argc, char* argv[]);
+};
+
+const benchmark_t g_benchmarks[] = {
+    {"framebuffer", "render threads writing tiles while the UI presents (--threads, --seconds, --width, --height)", bench_framebuffer},
+    {"resolve", "converting the float film to 8-bit screen pixels (--width, --height, --frames)", bench_resolve},
+    {"roulette", "time to reach an error target with and without Russian roulette and splitting (--scene, --target-permille, --threads)", bench_roulette},
+    {"lights", "cost of picking a light against the number of lights, and noise with and without the light tree (--scene, --spp, --threads)", bench_lights},
+    {"environment", "environment map sampling cost, and noise against samples per pixel with and without it (--scene, --max-spp, --threads)", bench_environment},
+    {"restir", "noise at a few samples per pixel with next event estimation and with ReSTIR (--scene, --bounces, --max-spp, --threads)", bench_restir},
+    {"guiding", "noise at equal samples per pixel with and without path guiding, and the guide's size (--scene, --spp, --threads)", bench_guiding},
+    {"caustics", "photon pass cost, and noise at equal samples per pixel with and without the caustic photon map (--scene, --spp, --photons, --threads)", bench_caustics},
+    {"radiance_cache", "path length, time per sample and noise with paths ending in the radiance cache after 1 or 2 bounces (--scene, --spp, --threads)", bench_radiance_cache},
+    {"volume", "grid smoke storage, and time per sample and noise with a majorant per brick or one for the whole grid (--scene, --spp, --threads)", bench_volume},
+    {"textures", "time per sample and noise of a shrunk image texture, read at full size or filtered over each pixel (--scene, --spp, --threads)", bench_textures},
+    {"texture_cache", "time per sample, tile hit rate and bytes read with a texture read through the texture cache at several budgets (--image, --tile, --spp, --threads)", bench_texture_cache},
+    {"texture_formats", "memory, load time, time per sample and noise of the earth texture as floats and block compressed (--image, --spp, --threads)", bench_texture_formats},
+    {"assets", "time to build a scene with the asset cache empty and holding its assets, and to load an image's formats one after the other or side by side (--scene, --image, --reloads)", bench_assets},
+    {"bake", "bake time and memory, and time per sample and noise, of procedural textures worked out per lookup and baked at several resolutions (--scene, --spp, --threads)", bench_bake},
+    {"traversal", "build time, camera rays per second and time per sample tracing against the primitive store and against the tree of bvh_node_ts (--scene, --rays, --spp, --threads)", bench_traversal},
+    {"arena", "time to build and tear down a scene, and time per sample, with its objects in a scene arena and each on the heap (--scene, --builds, --spp, --threads)", bench_arena},
+};
+
+void print_usage(const char* program) {
+    std::cout << "usage: " << program << " <benchmark> [options]\n\nbenchmarks:\n";
+    for(const auto& b : g_benchmarks) {
+        std::cout << "  " << b.name << ": " << b.description << "\n";
+    }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if(argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const std::string name = argv[1];
+    for(const auto& b : g_benchmarks) {
+        if(name == b.name) {
+            return b.run(argc - 2, argv + 2);
+        }
+    }
+
+    std::cerr << "ERROR: unknown benchmark '" << name << "'\n";
+    print_usage(argv[0]);
+    return 1;
+}
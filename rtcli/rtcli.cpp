@@ -0,0 +1,329 @@
+// Headless renderer. Renders one of the built in scenes straight to an image
+// file, without SDL, ImGui or a display, so it can run on render boxes.
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "raytrace.h"
+#include "image_io.h"
+#include "texture_bake.h"
+
+namespace {
+
+struct cli_options_t {
+    std::string scene = "all_test";
+    std::string output = "render.png";
+    std::string environment;
+    int width = 960;
+    int height = 540;
+    int samples_per_pixel = 75;
+    int max_bounces = 50;
+    int num_threads = 0;
+    bool next_event_estimation = true;
+    mis_heuristic_t mis = mis_heuristic_t::power;
+    bool light_tree = true;
+    bool restir = false;
+    bool path_guiding = false;
+    bool caustics = false;
+    int radiance_cache_bounces = 0;
+    bool texture_filtering = true;
+    double bake_voxels_per_pixel = 0.0;
+    bool arena = true;
+    bool russian_roulette = true;
+    int roulette_min_depth = 3;
+    int first_bounce_splits = 1;
+    resolve_settings_t resolve;
+};
+
+void print_usage(const char* program) {
+    std::cout
+        << "usage: " << program << " [options]\n"
+        << "  --scene <name>      scene to render (default all_test)\n"
+        << "  --width <px>        image width (default 960)\n"
+        << "  --height <px>       image height (default 540)\n"
+        << "  --spp <n>           samples per pixel (default 75)\n"
+        << "  --bounces <n>       maximum bounces per path (default 50)\n"
+        << "  --threads <n>       render threads (default: all hardware threads)\n"
+        << "  --output <file>     .png or .pfm output (default render.png)\n"
+        << "  --env <file>        light the scene with a lat-long environment map (e.g. an .hdr)\n"
+        << "  --tonemap <name>    clamp, reinhard or aces, for .png output (default clamp)\n"
+        << "  --exposure <stops>  exposure adjustment for .png output (default 0)\n"
+        << "  --dither            dither .png output\n"
+        << "  --no-nee            don't sample lights directly (for comparisons)\n"
+        << "  --mis <name>        none, balance or power heuristic (default power)\n"
+        << "  --no-light-tree     pick lights to sample uniformly (for comparisons)\n"
+        << "  --restir            light first hits by reservoir resampling (ReSTIR)\n"
+        << "  --guide             learn where light comes from while rendering, and aim bounces at it\n"
+        << "  --caustics          light through glass and mirrors from a photon map\n"
+        << "  --cache <n>         end paths in a radiance cache after n diffuse bounces (default off)\n"
+        << "  --no-tex-filter     read textures at full size instead of filtering them per pixel\n"
+        << "  --bake <n>          bake procedural textures into voxels n times finer than a pixel (default off)\n"
+        << "  --no-arena          build the scene's objects each on the heap rather than in an arena\n"
+        << "  --no-rr             don't end dim paths early with Russian roulette\n"
+        << "  --rr-depth <n>      bounces before Russian roulette starts (default 3)\n"
+        << "  --split <n>         paths to continue each camera sample's first hit with (default 1)\n"
+        << "  --list-scenes       print the available scene names\n";
+}
+
+bool parse_int(const std::string& flag, const char* value, int min, int& out) {
+    try {
+        out = std::stoi(value);
+    } catch(const std::exception&) {
+        std::cerr << "ERROR: " << flag << " expects a number, got '" << value << "'\n";
+        return false;
+    }
+    if(out < min) {
+        std::cerr << "ERROR: " << flag << " must be at least " << min << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool parse_tonemap(const char* value, tonemap_t& out) {
+    for(const tonemap_t t : {tonemap_t::clamp, tonemap_t::reinhard, tonemap_t::aces}) {
+        if(std::string(value) == tonemap_name(t)) {
+            out = t;
+            return true;
+        }
+    }
+    std::cerr << "ERROR: unknown tone mapper '" << value << "' (use clamp, reinhard or aces)\n";
+    return false;
+}
+
+bool parse_mis(const char* value, mis_heuristic_t& out) {
+    for(const mis_heuristic_t h : {mis_heuristic_t::none, mis_heuristic_t::balance, mis_heuristic_t::power}) {
+        if(std::string(value) == mis_heuristic_name(h)) {
+            out = h;
+            return true;
+        }
+    }
+    std::cerr << "ERROR: unknown heuristic '" << value << "' (use none, balance or power)\n";
+    return false;
+}
+
+bool parse_args(int argc, char* argv[], cli_options_t& options) {
+    for(int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+
+        if(arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            exit(0);
+        }
+
+        if(arg == "--list-scenes") {
+            for(const auto& name : scene_names()) {
+                std::cout << name << "\n";
+            }
+            exit(0);
+        }
+
+        if(arg == "--dither") {
+            options.resolve.dither = true;
+            continue;
+        }
+
+        if(arg == "--no-nee") {
+            options.next_event_estimation = false;
+            continue;
+        }
+
+        if(arg == "--no-light-tree") {
+            options.light_tree = false;
+            continue;
+        }
+
+        if(arg == "--restir") {
+            options.restir = true;
+            continue;
+        }
+
+        if(arg == "--guide") {
+            options.path_guiding = true;
+            continue;
+        }
+
+        if(arg == "--caustics") {
+            options.caustics = true;
+            continue;
+        }
+
+        if(arg == "--no-tex-filter") {
+            options.texture_filtering = false;
+            continue;
+        }
+
+        if(arg == "--no-arena") {
+            options.arena = false;
+            continue;
+        }
+
+        if(arg == "--no-rr") {
+            options.russian_roulette = false;
+            continue;
+        }
+
+        if(i + 1 >= argc) {
+            std::cerr << "ERROR: missing value for " << arg << "\n";
+            return false;
+        }
+
+        const char* value = argv[++i];
+        bool ok = true;
+        if(arg == "--scene") {
+            options.scene = value;
+        } else if(arg == "--output" || arg == "-o") {
+            options.output = value;
+        } else if(arg == "--env") {
+            options.environment = value;
+        } else if(arg == "--width") {
+            ok = parse_int(arg, value, 1, options.width);
+        } else if(arg == "--height") {
+            ok = parse_int(arg, value, 1, options.height);
+        } else if(arg == "--spp") {
+            ok = parse_int(arg, value, 1, options.samples_per_pixel);
+        } else if(arg == "--bounces") {
+            ok = parse_int(arg, value, 1, options.max_bounces);
+        } else if(arg == "--threads") {
+            ok = parse_int(arg, value, 1, options.num_threads);
+        } else if(arg == "--rr-depth") {
+            ok = parse_int(arg, value, 0, options.roulette_min_depth);
+        } else if(arg == "--split") {
+            ok = parse_int(arg, value, 1, options.first_bounce_splits);
+        } else if(arg == "--cache") {
+            ok = parse_int(arg, value, 1, options.radiance_cache_bounces);
+        } else if(arg == "--mis") {
+            ok = parse_mis(value, options.mis);
+        } else if(arg == "--tonemap") {
+            ok = parse_tonemap(value, options.resolve.tonemap);
+        } else if(arg == "--bake") {
+            try {
+                options.bake_voxels_per_pixel = std::stod(value);
+            } catch(const std::exception&) {
+                std::cerr << "ERROR: " << arg << " expects a number, got '" << value << "'\n";
+                ok = false;
+            }
+        } else if(arg == "--exposure") {
+            try {
+                options.resolve.exposure = std::stof(value);
+            } catch(const std::exception&) {
+                std::cerr << "ERROR: " << arg << " expects a number, got '" << value << "'\n";
+                ok = false;
+            }
+        } else {
+            std::cerr << "ERROR: unknown option " << arg << "\n";
+            return false;
+        }
+
+        if(!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    cli_options_t options;
+    if(!parse_args(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if(options.num_threads == 0) {
+        const auto hw = std::thread::hardware_concurrency();
+        options.num_threads = hw > 0 ? static_cast<int>(hw) : 4;
+    }
+
+    const auto build_start = std::chrono::steady_clock::now();
+    auto maybe_scene = make_scene(options.scene, options.width, options.height, options.arena);
+    if(!maybe_scene) {
+        std::cerr << "ERROR: unknown scene '" << options.scene << "' (try --list-scenes)\n";
+        return 1;
+    }
+    if(!options.environment.empty()) {
+        maybe_scene->environment = environment_map_t::load(options.environment);
+        if(!maybe_scene->environment) {
+            return 1;
+        }
+    }
+    if(options.bake_voxels_per_pixel > 0.0) {
+        texture_bake_settings_t bake_settings;
+        bake_settings.voxels_per_pixel = options.bake_voxels_per_pixel;
+        const texture_bake_stats_t baked = bake_textures(*maybe_scene, bake_settings, options.num_threads);
+        std::cout << "baked " << baked.textures << " textures into " << baked.bricks << " bricks ("
+                  << baked.bytes / 1024 << " KB) in " << baked.seconds << " s" << std::endl;
+    }
+    const scene_t scn = std::move(*maybe_scene);
+    const auto build_end = std::chrono::steady_clock::now();
+
+    const int width = options.width;
+    const int height = options.height;
+    film_t film(width, height);
+
+    std::cout << "rendering " << options.scene << " at " << width << "x" << height
+              << ", " << options.samples_per_pixel << " spp, " << options.max_bounces << " bounces, "
+              << options.num_threads << " threads" << std::endl;
+
+    render_settings_t settings;
+    settings.samples_per_pixel = options.samples_per_pixel;
+    settings.max_bounces = options.max_bounces;
+    settings.num_threads = options.num_threads;
+    settings.next_event_estimation = options.next_event_estimation;
+    settings.mis = options.mis;
+    settings.light_tree = options.light_tree;
+    settings.restir = options.restir;
+    settings.path_guiding = options.path_guiding;
+    settings.caustics = options.caustics;
+    settings.radiance_cache = options.radiance_cache_bounces > 0;
+    settings.radiance_cache_bounces = std::max(1, options.radiance_cache_bounces);
+    settings.texture_filtering = options.texture_filtering;
+    settings.russian_roulette = options.russian_roulette;
+    settings.roulette_min_depth = options.roulette_min_depth;
+    settings.first_bounce_splits = options.first_bounce_splits;
+
+    renderer_t renderer(scn, film, settings);
+    renderer.start(film.bounds());
+
+    int last_reported = -1;
+    while(!renderer.done()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        const int percent = static_cast<int>(renderer.progress() * 100);
+        if(percent != last_reported) {
+            std::cout << "\r" << percent << "%" << std::flush;
+            last_reported = percent;
+        }
+    }
+    renderer.wait();
+
+    const render_stats_t stats = renderer.stats();
+    const double build_seconds = std::chrono::duration<double>(build_end - build_start).count();
+
+    std::cout << "\r100%" << std::endl;
+    std::cout << "scene build: " << build_seconds << " s" << std::endl;
+    if(scn.arena) {
+        const scene_arena_stats_t arena = scn.arena->stats();
+        std::cout << "scene arena: " << arena.objects << " objects, " << arena.bytes / 1024 << " KB in "
+                  << arena.blocks << " blocks (" << arena.reserved_bytes / 1024 << " KB)" << std::endl;
+    }
+    std::cout << "render:      " << stats.seconds << " s" << std::endl;
+    std::cout << "rays:        " << stats.rays << " (" << (static_cast<double>(stats.rays) / stats.seconds) / 1e6 << " Mrays/s)" << std::endl;
+    std::cout << "path length: " << stats.average_path_length() << " segments per sample" << std::endl;
+
+    std::vector<color_t> pixels(static_cast<size_t>(width) * height);
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x++) {
+            pixels[static_cast<size_t>(y) * width + x] = film.resolve(x, y);
+        }
+    }
+
+    if(!write_image(options.output, width, height, pixels.data(), options.resolve)) {
+        return 1;
+    }
+    std::cout << "wrote " << options.output << std::endl;
+
+    return 0;
+}
@@ -1,9 +1,30 @@
 #include <gtest/gtest.h>
+#include <filesystem>
+#include <thread>
 
 #include "raytracelib/ray.h"
 #include "raytracelib/sphere.h"
 #include "raytracelib/material.h"
 #include "raytracelib/rect.h"
+#include "raytracelib/renderer.h"
+#include "raytracelib/image_buffer.h"
+#include "raytracelib/dirty_tiles.h"
+#include "raytracelib/resolve.h"
+#include "raytracelib/raytrace.h"
+#include "raytracelib/light_bvh.h"
+#include "raytracelib/alias_table.h"
+#include "raytracelib/environment.h"
+#include "raytracelib/radiance_cache.h"
+#include "raytracelib/grid_medium.h"
+#include "raytracelib/box.h"
+#include "raytracelib/constant_medium.h"
+#include "raytracelib/texture_cache.h"
+#include "raytracelib/asset_cache.h"
+#include "raytracelib/texture_bake.h"
+#include "raytracelib/texture_program.h"
+#include "raytracelib/primitive_store.h"
+#include "raytracelib/instance.h"
+#include "raytracelib/image_io.h"
 
 using namespace glm;
 
@@ -78,4 +99,1190 @@ TEST(RectTest, RayAtOrigin) {
 
     bool was_hit = rect.hit(r, 0.0001, infinity,  record);
     ASSERT_TRUE(was_hit);
-}
\ No newline at end of file
+}
+
+// a scene where every camera ray misses (the only sphere is behind the camera)
+scene_t background_only_scene(int width, int height) {
+    camera_t cam {width, height, 40.0, {0, 0, 0}, {0, 0, -1}, {0, 1, 0}, 0.0, 1.0};
+    scene_t scene {cam};
+    scene.entities.add(make_shared<sphere_t>(point3(0, 0, 10), 1.0, make_shared<lambertian_material_t>(color_t{1, 1, 1})));
+    scene.build();
+    scene.background = {0.5, 0.25, 1.0};
+    return scene;
+}
+
+TEST(RendererTest, RendersRegionIntoFilm) {
+    const scene_t scene = background_only_scene(16, 8);
+    film_t film(16, 8);
+
+    render_settings_t settings;
+    settings.samples_per_pixel = 3;
+    settings.num_threads = 2;
+    settings.tile_size = 4;
+
+    std::atomic_int tiles_completed = 0;
+    render_callbacks_t callbacks;
+    callbacks.on_tile_complete = [&](const render_tile_t&) { tiles_completed++; };
+
+    renderer_t renderer(scene, film, settings, callbacks);
+    const auto stats = renderer.render(film.bounds());
+
+    EXPECT_EQ(tiles_completed, 8);
+    EXPECT_EQ(stats.samples, 16u * 8u * 3u);
+    EXPECT_DOUBLE_EQ(stats.average_path_length(), 1.0);
+    EXPECT_TRUE(renderer.done());
+    EXPECT_DOUBLE_EQ(renderer.progress(), 1.0);
+
+    for(int y = 0; y < film.height(); y++) {
+        for(int x = 0; x < film.width(); x++) {
+            EXPECT_EQ(film.samples(x, y), 3);
+            EXPECT_TRUE(double_eq(film.resolve(x, y).b, 1.0));
+        }
+    }
+
+    // a second pass adds to the same film
+    renderer.render({0, 0, 4, 4});
+    EXPECT_EQ(film.samples(0, 0), 6);
+    EXPECT_EQ(film.samples(4, 4), 3);
+}
+
+TEST(RendererTest, CancelledRenderDoesNothing) {
+    const scene_t scene = background_only_scene(16, 8);
+    film_t film(16, 8);
+
+    auto token = make_shared<cancel_token_t>();
+    token->cancel();
+
+    renderer_t renderer(scene, film, {}, {}, token);
+    renderer.render(film.bounds());
+
+    EXPECT_TRUE(renderer.done());
+    EXPECT_EQ(film.samples(0, 0), 0);
+}
+
+TEST(ImageBufferTest, SyncCopiesOnlyPublishedTiles) {
+    image_buffer_t buffer(64, 40, 32);
+    ASSERT_EQ(buffer.tile_count(), 4);
+
+    film_t film(64, 40);
+    film.add(40, 35, color_t{1, 1, 1}, 1);
+
+    std::vector<uint8_t> presented(buffer.pitch() * buffer.height());
+    std::vector<uint64_t> epochs;
+    EXPECT_EQ(buffer.sync_to(presented.data(), buffer.pitch(), epochs), 0);
+
+    buffer.write_region(film, {32, 32, 64, 40});
+    std::vector<int> copied;
+    EXPECT_EQ(buffer.sync_to(presented.data(), buffer.pitch(), epochs, &copied), 1);
+    ASSERT_EQ(copied.size(), 1u);
+    EXPECT_EQ(copied[0], 3);
+    EXPECT_EQ(presented[35 * buffer.pitch() + 40 * 4 + 3], 255); // red channel
+
+    // nothing new since the last sync
+    EXPECT_EQ(buffer.sync_to(presented.data(), buffer.pitch(), epochs), 0);
+
+    buffer.publish_all();
+    EXPECT_EQ(buffer.sync_to(presented.data(), buffer.pitch(), epochs), 4);
+}
+
+TEST(DirtyTilesTest, TakeMergesRowsAndClears) {
+    // 3x2 tiles of 32, the right column and bottom row are partial
+    dirty_tiles_t dirty(80, 40, 32);
+    dirty.mark({0, 0, 32, 32});
+    dirty.mark({32, 0, 64, 32});
+    dirty.mark({64, 32, 80, 40});
+
+    const auto regions = dirty.take();
+    ASSERT_EQ(regions.size(), 2u);
+    EXPECT_EQ(regions[0].x0, 0);
+    EXPECT_EQ(regions[0].x1, 64);
+    EXPECT_EQ(regions[0].y1, 32);
+    EXPECT_EQ(regions[1].x0, 64);
+    EXPECT_EQ(regions[1].y0, 32);
+    EXPECT_EQ(regions[1].x1, 80);
+    EXPECT_EQ(regions[1].y1, 40);
+
+    EXPECT_TRUE(dirty.take().empty());
+}
+
+TEST(ResolveTest, FourWideAndSinglePixelPathsAgree) {
+    // 7 pixels: the first 4 go through the vectorized path, the rest one at a time
+    std::vector<glm::vec4> pixels;
+    for(int i = 0; i < 7; i++) {
+        const float v = 0.15f * static_cast<float>(i);
+        pixels.emplace_back(v * 3.0f, v * 1.5f, v * 0.5f, 3.0f);
+    }
+
+    for(const tonemap_t t : {tonemap_t::clamp, tonemap_t::reinhard, tonemap_t::aces}) {
+        resolve_settings_t settings;
+        settings.tonemap = t;
+
+        uint8_t out[7 * 4];
+        resolve_pixels(pixels.data(), 7, 7, 1, 0, 0, out, 7 * 4, settings);
+
+        for(int i = 0; i < 7; i++) {
+            uint8_t rgb[3];
+            const glm::vec4& p = pixels[i];
+            resolve_color(color_t{p.r / p.a, p.g / p.a, p.b / p.a}, rgb, settings);
+            EXPECT_EQ(out[i * 4 + 0], 255);
+            EXPECT_EQ(out[i * 4 + 3], rgb[0]) << tonemap_name(t) << " pixel " << i;
+            EXPECT_EQ(out[i * 4 + 2], rgb[1]) << tonemap_name(t) << " pixel " << i;
+            EXPECT_EQ(out[i * 4 + 1], rgb[2]) << tonemap_name(t) << " pixel " << i;
+        }
+    }
+}
+
+TEST(ResolveTest, ToneMappingAndExposure) {
+    uint8_t rgb[3];
+
+    // sRGB: linear 0.5 is about 188, not the 181 gamma 2 gives
+    resolve_color(color_t{0.0, 0.5, 1.0}, rgb);
+    EXPECT_EQ(rgb[0], 0);
+    EXPECT_EQ(rgb[1], 188);
+    EXPECT_EQ(rgb[2], 255);
+
+    // one stop brighter takes 0.25 to 0.5
+    resolve_settings_t brighter;
+    brighter.exposure = 1.0f;
+    resolve_color(color_t{0.25, 0.25, 0.25}, rgb, brighter);
+    EXPECT_EQ(rgb[0], 188);
+
+    // reinhard keeps detail above 1.0 instead of clipping it
+    resolve_settings_t reinhard;
+    reinhard.tonemap = tonemap_t::reinhard;
+    uint8_t rgb_bright[3];
+    resolve_color(color_t{2.0, 4.0, 0.0}, rgb, reinhard);
+    resolve_color(color_t{4.0, 8.0, 0.0}, rgb_bright, reinhard);
+    EXPECT_LT(rgb[0], rgb_bright[0]);
+    EXPECT_LT(rgb[1], 255);
+
+    // pixels without samples are left as they were, on both the four wide and single
+    // pixel paths
+    std::vector<glm::vec4> pixels(5, glm::vec4(1.0f, 1.0f, 1.0f, 0.0f));
+    pixels[1].a = 1.0f;
+    uint8_t out[5 * 4];
+    std::fill(std::begin(out), std::end(out), uint8_t{7});
+    resolve_pixels(pixels.data(), 5, 5, 1, 0, 0, out, 5 * 4, brighter);
+    for(int i = 0; i < 5; i++) {
+        EXPECT_EQ(out[i * 4 + 3], i == 1 ? 255 : 7) << "pixel " << i;
+    }
+}
+
+TEST(LightTest, SceneCollectsEmissiveShapes) {
+    const scene_t scene = cornell_box(16, 16);
+    ASSERT_EQ(scene.lights.size(), 1u);
+    EXPECT_TRUE(scene.is_sampled_light(scene.lights[0].get()));
+    EXPECT_FALSE(scene.is_sampled_light(nullptr));
+}
+
+TEST(LightTest, RectSamplesMatchTheirDensity) {
+    const auto light = make_shared<diffuse_light>(color_t{4, 4, 4});
+    const rect_t rect(2, 2, {0, 0, 0}, dquat(), light);
+    ASSERT_TRUE(rect.is_area_light());
+
+    const point3 origin(0, 0, 3);
+    for(int i = 0; i < 16; i++) {
+        light_sample_t s;
+        ASSERT_TRUE(rect.sample_light(origin, 0, s));
+        EXPECT_LE(fabs(s.p.x), 1.0);
+        EXPECT_LE(fabs(s.p.y), 1.0);
+        EXPECT_TRUE(double_eq(s.p.z, 0.0));
+        EXPECT_TRUE(double_eq(s.emitted.r, 4.0));
+
+        const dvec3_t d = s.p - origin;
+        const double cosine = fabs(d.z) / length(d);
+        EXPECT_TRUE(double_eq(s.pdf, length2(d) / (cosine * 4.0)));
+    }
+}
+
+TEST(LightTest, SphereSamplesAreOnTheVisibleCap) {
+    const auto light = make_shared<diffuse_light>(color_t{1, 1, 1});
+    const sphere_t sphere({0, 0, 0}, 1, light);
+
+    const point3 origin(0, 0, 4);
+    const double cos_theta_max = sqrt(1.0 - 1.0 / 16.0);
+    for(int i = 0; i < 16; i++) {
+        light_sample_t s;
+        ASSERT_TRUE(sphere.sample_light(origin, 0, s));
+        EXPECT_TRUE(double_eq(length(s.p), 1.0));
+        EXPECT_GT(dot(s.normal, origin - s.p), 0.0);
+        EXPECT_TRUE(double_eq(s.pdf, 1.0 / (2.0 * g_pi * (1.0 - cos_theta_max))));
+    }
+
+    light_sample_t inside;
+    EXPECT_FALSE(sphere.sample_light({0, 0, 0.5}, 0, inside));
+}
+
+TEST(LightTreeTest, PicksMatchTheirPmf) {
+    // a mix of spheres and rects facing every which way
+    std::vector<shared_ptr<hittable_t>> lights;
+    for(int i = 0; i < 6; i++) {
+        const point3 c(random_double(-4, 4), random_double(-4, 4), random_double(-4, 4));
+        const auto mat = make_shared<diffuse_light>(color_t::random(0.5, 4.0));
+        if(i % 2 == 0) {
+            lights.push_back(make_shared<sphere_t>(c, 0.3, mat));
+        } else {
+            const glm::dquat rotation = glm::angleAxis(random_double(0, g_pi), normalize(dvec3_t(random_double(-1, 1), 1, random_double(-1, 1))));
+            lights.push_back(make_shared<rect_t>(0.5, 0.5, c, rotation, mat));
+        }
+    }
+
+    light_bvh_t tree;
+    tree.build(lights);
+    ASSERT_EQ(tree.node_count(), 11u);
+
+    const point3 p(0.5, -6, 0.25);
+    const dvec3_t n(0, 1, 0);
+    double total = 0.0;
+    for(int i = 0; i < 6; i++) {
+        total += tree.pmf(p, n, i);
+    }
+    EXPECT_NEAR(total, 1.0, 1e-9);
+
+    constexpr int picks = 20000;
+    int counts[6] = {};
+    for(int i = 0; i < picks; i++) {
+        double pmf = 0.0;
+        const int light = tree.pick(p, n, random_double(), pmf);
+        ASSERT_GE(light, 0);
+        EXPECT_NEAR(pmf, tree.pmf(p, n, light), 1e-9);
+        counts[light]++;
+    }
+    for(int i = 0; i < 6; i++) {
+        EXPECT_NEAR(static_cast<double>(counts[i]) / picks, tree.pmf(p, n, i), 0.02);
+    }
+}
+
+TEST(LightTreeTest, PrefersCloseAndBrightLights) {
+    const auto dim = make_shared<diffuse_light>(color_t{1, 1, 1});
+    const auto bright = make_shared<diffuse_light>(color_t{8, 8, 8});
+    const std::vector<shared_ptr<hittable_t>> lights = {
+        make_shared<sphere_t>(point3(-2, 2, 0), 0.2, dim),
+        make_shared<sphere_t>(point3(20, 20, 0), 0.2, dim),
+        make_shared<sphere_t>(point3(2, 2, 0), 0.2, bright),
+    };
+
+    light_bvh_t tree;
+    tree.build(lights);
+
+    const point3 p(0, 0, 0);
+    const dvec3_t n(0, 1, 0);
+    EXPECT_GT(tree.pmf(p, n, 0), tree.pmf(p, n, 1));
+    EXPECT_GT(tree.pmf(p, n, 2), tree.pmf(p, n, 0));
+    EXPECT_EQ(tree.pmf(p, n, 3), 0.0);
+}
+
+TEST(AliasTableTest, PicksInProportionToWeight) {
+    const alias_table_t table({1.0, 0.0, 3.0, 4.0});
+    ASSERT_EQ(table.size(), 4u);
+    EXPECT_DOUBLE_EQ(table.total(), 8.0);
+    EXPECT_DOUBLE_EQ(table.pmf(0), 0.125);
+    EXPECT_DOUBLE_EQ(table.pmf(1), 0.0);
+
+    constexpr int picks = 40000;
+    int counts[4] = {};
+    for(int i = 0; i < picks; i++) {
+        double pmf = 0.0;
+        const int index = table.sample(random_double(), pmf);
+        EXPECT_DOUBLE_EQ(pmf, table.pmf(index));
+        counts[index]++;
+    }
+    EXPECT_EQ(counts[1], 0);
+    for(int i = 0; i < 4; i++) {
+        EXPECT_NEAR(static_cast<double>(counts[i]) / picks, table.pmf(i), 0.01);
+    }
+}
+
+TEST(EnvironmentTest, SamplesMatchPdfAndRadiance) {
+    const auto env = environment_map_t::sky(64, 32, dvec3_t(1, 1, 0), 5.0, 500.0);
+
+    const dvec2_t uv(0.3, 0.7);
+    const dvec2_t round_trip = environment_map_t::direction_to_uv(environment_map_t::uv_to_direction(uv));
+    EXPECT_NEAR(round_trip.x, uv.x, 1e-9);
+    EXPECT_NEAR(round_trip.y, uv.y, 1e-9);
+
+    // every direction has some light, so 1 / pdf averages out to the whole sphere
+    constexpr int samples = 20000;
+    double solid_angle = 0.0;
+    int towards_sun = 0;
+    for(int i = 0; i < samples; i++) {
+        environment_sample_t s;
+        ASSERT_TRUE(env->sample(s));
+        EXPECT_NEAR(s.pdf, env->pdf(s.direction), s.pdf * 1e-6);
+        EXPECT_TRUE(double_eq(s.radiance.r, env->radiance(s.direction).r));
+        solid_angle += 1.0 / s.pdf;
+        towards_sun += dot(s.direction, normalize(dvec3_t(1, 1, 0))) > cos(degrees_to_radians(6.0));
+    }
+    EXPECT_NEAR(solid_angle / samples, 4.0 * g_pi, 4.0 * g_pi * 0.05);
+
+    // the sun covers well under 1% of the sky but gives off most of the light
+    EXPECT_GT(towards_sun, samples / 2);
+}
+
+// a hit on the top of a floor, seen from above at an angle
+hit_record_t floor_hit(const ray_t& r, const shared_ptr<material_t>& mat) {
+    hit_record_t rec{};
+    rec.p = point3(0, 0, 0);
+    rec.set_face_normal(r, dvec3_t(0, 1, 0));
+    rec.mat = mat;
+    return rec;
+}
+
+TEST(MaterialTest, SamplesAgreeWithEvalAndPdf) {
+    const ray_t r(point3(-1, 1, 0), dvec3_t(1, -1, 0));
+    const shared_ptr<material_t> materials[] = {
+        make_shared<lambertian_material_t>(color_t{0.5, 0.6, 0.7}),
+        make_shared<metal_material_t>(color_t{0.9, 0.8, 0.7}, 0.3),
+        make_shared<metal_material_t>(color_t{0.9, 0.8, 0.7}, 0.05),
+    };
+
+    for(const auto& mat : materials) {
+        const hit_record_t rec = floor_hit(r, mat);
+        ASSERT_TRUE(mat->samples_lights());
+
+        int taken = 0;
+        for(int i = 0; i < 64; i++) {
+            bsdf_sample_t s;
+            if(!mat->sample(r, rec, s)) {
+                continue;
+            }
+            taken++;
+            EXPECT_FALSE(s.specular);
+            EXPECT_GT(s.direction.y, 0.0);
+            EXPECT_NEAR(s.pdf, mat->pdf(r, rec, s.direction), 1e-6 * s.pdf);
+
+            // weight is f * cos / pdf
+            const color_t f = mat->eval(r, rec, s.direction);
+            EXPECT_NEAR(s.weight.r, f.r / s.pdf, 1e-6);
+            EXPECT_NEAR(s.weight.b, f.b / s.pdf, 1e-6);
+        }
+        EXPECT_GT(taken, 32);
+    }
+}
+
+TEST(MaterialTest, SmoothMetalIsSpecular) {
+    const ray_t r(point3(-1, 1, 0), dvec3_t(1, -1, 0));
+    const auto mirror = make_shared<metal_material_t>(color_t{1, 1, 1}, 0.0);
+    const hit_record_t rec = floor_hit(r, mirror);
+
+    bsdf_sample_t s;
+    ASSERT_TRUE(mirror->sample(r, rec, s));
+    EXPECT_TRUE(s.specular);
+    EXPECT_FALSE(mirror->samples_lights());
+    const dvec3_t d = normalize(s.direction);
+    EXPECT_TRUE(double_eq(d.x, sqrt(0.5)));
+    EXPECT_TRUE(double_eq(d.y, sqrt(0.5)));
+}
+
+TEST(MaterialTest, MisWeightsSumToOne) {
+    for(const auto h : {mis_heuristic_t::balance, mis_heuristic_t::power}) {
+        EXPECT_TRUE(double_eq(mis_weight(0.3, 2.0, h) + mis_weight(2.0, 0.3, h), 1.0));
+    }
+    EXPECT_TRUE(double_eq(mis_weight(0.3, 2.0, mis_heuristic_t::none), 1.0));
+}
+
+TEST(RouletteTest, RouletteAndSplittingStayUnbiased) {
+    // a huge grey ground under a white sky: looking straight down, the ground
+    // reflects half the sky, and every bounce after the first escapes
+    camera_t cam {8, 8, 40.0, {0, 1, 0}, {0, 0, 0}, {0, 0, -1}, 0.0, 1.0};
+    scene_t scene {cam};
+    scene.entities.add(make_shared<sphere_t>(point3(0, -100000, 0), 100000, make_shared<lambertian_material_t>(color_t{0.5, 0.5, 0.5})));
+    scene.background = {1, 1, 1};
+    scene.build();
+
+    const ray_t down({0, 1, 0}, {0, -1, 0});
+    const int samples = 20000;
+
+    for(const int splits : {1, 3}) {
+        render_settings_t settings;
+        settings.russian_roulette = true;
+        settings.roulette_min_depth = 0;
+        settings.first_bounce_splits = splits;
+
+        reset_rays_traced_on_thread();
+        double sum = 0.0;
+        for(int i = 0; i < samples; i++) {
+            sum += ray_color(down, scene, settings).r;
+        }
+        EXPECT_NEAR(sum / samples, 0.5, 0.02) << splits << " splits";
+
+        // with roulette from the start, some paths end at the ground
+        EXPECT_LT(static_cast<double>(path_segments_on_thread()) / samples, 2.0 * splits);
+    }
+}
+
+TEST(RestirTest, MatchesNextEventEstimation) {
+    // looking down at the ground under a dim and a bright light, with a ball casting
+    // shadows from both
+    camera_t cam {12, 12, 60.0, {0, 3, 0.01}, {0, 0, 0}, {0, 1, 0}, 0.0, 3.0};
+    scene_t scene {cam};
+    scene.entities.add(make_shared<sphere_t>(point3(0, -100000, 0), 100000, make_shared<lambertian_material_t>(color_t{0.5, 0.5, 0.5})));
+    scene.entities.add(make_shared<sphere_t>(point3(0.3, 0.5, 0), 0.4, make_shared<lambertian_material_t>(color_t{0.8, 0.8, 0.8})));
+    const dquat facing_down = angleAxis(g_pi / 2.0, dvec3_t(1, 0, 0));
+    scene.entities.add(make_shared<rect_t>(0.5, 0.5, point3(-1, 4, 0), facing_down, make_shared<diffuse_light>(color_t{40, 40, 40})));
+    scene.entities.add(make_shared<rect_t>(0.2, 0.2, point3(1.5, 3, -0.5), facing_down, make_shared<diffuse_light>(color_t{600, 400, 200})));
+    scene.background = {0, 0, 0};
+    scene.build();
+
+    auto average = [&](const render_settings_t& settings, int passes) {
+        film_t film(12, 12);
+        renderer_t renderer(scene, film, settings);
+        for(int i = 0; i < passes; i++) {
+            renderer.render(film.bounds());
+        }
+        double sum = 0.0;
+        for(int y = 0; y < 12; y++) {
+            for(int x = 0; x < 12; x++) {
+                sum += luminance(film.resolve(x, y));
+            }
+        }
+        return sum / 144.0;
+    };
+
+    render_settings_t settings;
+    settings.max_bounces = 3;
+    settings.samples_per_pixel = 512;
+    const double expected = average(settings, 1);
+    ASSERT_GT(expected, 0.1);
+
+    // one sample per render, so the reservoirs carry over between them too
+    settings.restir = true;
+    settings.samples_per_pixel = 1;
+    EXPECT_NEAR(average(settings, 256), expected, 0.03 * expected);
+
+    settings.restir_temporal = false;
+    settings.restir_spatial_neighbors = 0;
+    settings.samples_per_pixel = 256;
+    EXPECT_NEAR(average(settings, 1), expected, 0.03 * expected);
+}
+
+TEST(PathGuideTest, DirectionalTreeSamplesItsPdf) {
+    // most of the light from one small patch of sky, a little from everywhere else
+    directional_tree_t recorded;
+    const dvec3_t bright = normalize(dvec3_t(0.3, -0.2, 0.9));
+    for(int i = 0; i < 20000; i++) {
+        recorded.record(bright, 1.0f);
+        recorded.record(random_unit_vector(), 0.05f);
+    }
+    // refining lays out a tree from where the energy was; record into it again
+    directional_tree_t tree = recorded.refined(0.01, 16, 1000);
+    ASSERT_GT(tree.node_count(), 4u);
+    for(int i = 0; i < 20000; i++) {
+        tree.record(bright, 1.0f);
+        tree.record(random_unit_vector(), 0.05f);
+    }
+
+    // sample() reports the pdf that pdf() gives, and the pdf integrates to 1 over
+    // the sphere (so 1/pdf averages to 4 pi)
+    double inverse_sum = 0.0;
+    int near_bright = 0;
+    const int n = 100000;
+    for(int i = 0; i < n; i++) {
+        double pdf = 0.0;
+        const dvec3_t d = tree.sample(pdf);
+        ASSERT_GT(pdf, 0.0);
+        EXPECT_NEAR(tree.pdf(d), pdf, 1e-6 * pdf);
+        inverse_sum += 1.0 / pdf;
+        if(dot(d, bright) > 0.99) {
+            near_bright++;
+        }
+    }
+    EXPECT_NEAR(inverse_sum / n, 4.0 * g_pi, 0.05 * 4.0 * g_pi);
+    EXPECT_GT(near_bright, n / 2);
+}
+
+TEST(PathGuideTest, MatchesUnguided) {
+    // a floor and ceiling lit by a small panel above a baffle, so the floor only gets
+    // light that bounced off the ceiling
+    camera_t cam {12, 12, 60.0, {0, 1, 2.9}, {0, 1, 0}, {0, 1, 0}, 0.0, 3.0};
+    scene_t scene {cam};
+    auto white = make_shared<lambertian_material_t>(color_t{0.7, 0.7, 0.7});
+    const dquat facing_up = angleAxis(-g_pi / 2.0, dvec3_t(1, 0, 0));
+    const dquat facing_down = angleAxis(g_pi / 2.0, dvec3_t(1, 0, 0));
+    scene.entities.add(make_shared<rect_t>(3, 3, point3(0, 0, 0), facing_up, white));
+    scene.entities.add(make_shared<rect_t>(3, 3, point3(0, 2, 0), facing_down, white));
+    scene.entities.add(make_shared<rect_t>(1, 1, point3(0.9, 1.0, 0), facing_up, white));
+    scene.entities.add(make_shared<rect_t>(0.6, 0.6, point3(0.9, 1.1, 0), facing_up, make_shared<diffuse_light>(color_t{15, 15, 15})));
+    scene.background = {0, 0, 0};
+    scene.build();
+
+    auto average = [&](const render_settings_t& settings) {
+        film_t film(12, 12);
+        renderer_t renderer(scene, film, settings);
+        renderer.render(film.bounds());
+        double sum = 0.0;
+        for(int y = 0; y < 12; y++) {
+            for(int x = 0; x < 12; x++) {
+                sum += luminance(film.resolve(x, y));
+            }
+        }
+        return sum / 144.0;
+    };
+
+    render_settings_t settings;
+    settings.max_bounces = 4;
+    settings.samples_per_pixel = 1024;
+    const double expected = average(settings);
+    ASSERT_GT(expected, 0.05);
+
+    // guiding only changes which directions get sampled, not what they add up to
+    settings.path_guiding = true;
+    EXPECT_NEAR(average(settings), expected, 0.05 * expected);
+}
+
+TEST(PhotonMapTest, CausticsMatchPathTracing) {
+    // a light under a mirror, so the floor the camera sees gets light straight from it
+    // and, as a caustic, light off the mirror
+    camera_t cam {12, 12, 60.0, {1.2, 0.8, 0.01}, {1.2, 0, 0}, {0, 1, 0}, 0.0, 1.0};
+    scene_t scene {cam};
+    const dquat facing_up = angleAxis(-g_pi / 2.0, dvec3_t(1, 0, 0));
+    const dquat facing_down = angleAxis(g_pi / 2.0, dvec3_t(1, 0, 0));
+    scene.entities.add(make_shared<rect_t>(6, 6, point3(0, 0, 0), facing_up, make_shared<lambertian_material_t>(color_t{0.7, 0.7, 0.7})));
+    scene.entities.add(make_shared<rect_t>(3, 3, point3(0, 2, 0), facing_down, make_shared<metal_material_t>(color_t{0.9, 0.9, 0.9}, 0.0)));
+    scene.entities.add(make_shared<rect_t>(0.5, 0.5, point3(0, 1, 0), facing_up, make_shared<diffuse_light>(color_t{10, 10, 10})));
+    scene.background = {0, 0, 0};
+    scene.build();
+
+    auto average = [&](const render_settings_t& settings) {
+        film_t film(12, 12);
+        renderer_t renderer(scene, film, settings);
+        renderer.render(film.bounds());
+        if(settings.caustics) {
+            EXPECT_GT(renderer.caustics()->photon_count(), 0u);
+            EXPECT_EQ(renderer.caustics()->passes(), settings.samples_per_pixel);
+        }
+        double sum = 0.0;
+        for(int y = 0; y < 12; y++) {
+            for(int x = 0; x < 12; x++) {
+                sum += luminance(film.resolve(x, y));
+            }
+        }
+        return sum / 144.0;
+    };
+
+    render_settings_t settings;
+    settings.max_bounces = 8;
+    settings.samples_per_pixel = 512;
+    const double expected = average(settings);
+    ASSERT_GT(expected, 0.1);
+
+    settings.caustics = true;
+    settings.caustic_photons = 10000;
+    settings.samples_per_pixel = 16;
+    // each side scatters by about 1.3% from run to run, so their ratio by about 2%
+    EXPECT_NEAR(average(settings), expected, 0.07 * expected);
+}
+
+TEST(PhotonMapTest, GlassBoxCausticsMatchPathTracing) {
+    // a light over a glass box: photons have to be aimed at the box and refract through
+    // it the way paths do, or the light it sends onto the floor (which paths leave to
+    // the photon map) comes out wrong
+    camera_t cam {12, 12, 60.0, {0, 2.5, 3.0}, {0, 0, 0}, {0, 1, 0}, 0.0, 1.0};
+    scene_t scene {cam};
+    const dquat facing_up = angleAxis(-g_pi / 2.0, dvec3_t(1, 0, 0));
+    const dquat facing_down = angleAxis(g_pi / 2.0, dvec3_t(1, 0, 0));
+    auto glass = make_shared<box_t>(dvec3_t(0, 1.0, 0), dquat(), 1.2, 1.2, 1.2, make_shared<dielectric_material_t>(1.5));
+    EXPECT_TRUE(glass->is_specular());
+
+    // its faces point out, so rays from outside go in
+    hit_record_t rec{};
+    ASSERT_TRUE(glass->hit(ray_t(point3(0, 3, 0), dvec3_t(0, -1, 0), 0.0), 0.001, infinity, rec));
+    EXPECT_TRUE(rec.front_face);
+    EXPECT_NEAR(rec.normal.y, 1.0, 1e-6);
+
+    scene.entities.add(make_shared<rect_t>(6, 6, point3(0, 0, 0), facing_up, make_shared<lambertian_material_t>(color_t{0.7, 0.7, 0.7})));
+    scene.entities.add(glass);
+    scene.entities.add(make_shared<rect_t>(2, 2, point3(0, 3, 0), facing_down, make_shared<diffuse_light>(color_t{10, 10, 10})));
+    scene.background = {0, 0, 0};
+    scene.build();
+
+    auto average = [&](const render_settings_t& settings) {
+        film_t film(12, 12);
+        renderer_t renderer(scene, film, settings);
+        renderer.render(film.bounds());
+        if(settings.caustics) {
+            EXPECT_GT(renderer.caustics()->photon_count(), 0u);
+        }
+        double sum = 0.0;
+        for(int y = 0; y < 12; y++) {
+            for(int x = 0; x < 12; x++) {
+                sum += luminance(film.resolve(x, y));
+            }
+        }
+        return sum / 144.0;
+    };
+
+    render_settings_t settings;
+    settings.max_bounces = 8;
+    settings.samples_per_pixel = 512;
+    const double expected = average(settings);
+    ASSERT_GT(expected, 0.1);
+
+    settings.caustics = true;
+    settings.caustic_photons = 5000;
+    settings.samples_per_pixel = 32;
+    // each side scatters by about 1.5% from run to run, their ratio by about 2%
+    EXPECT_NEAR(average(settings), expected, 0.08 * expected);
+}
+
+TEST(RadianceCacheTest, LooksUpWhatLastPassRecorded) {
+    const camera_t cam {16, 16, 60.0, {0, 0, 10}, {0, 0, 0}, {0, 1, 0}, 0.0, 1.0};
+    radiance_cache_t cache(aabb_t({-1, -1, -1}, {1, 1, 1}), cam);
+    const dvec3_t up(0, 0, 1);
+    for(int i = 0; i < 4096; i++) {
+        const point3 p(random_double(-1, 1), random_double(-1, 1), 0);
+        cache.record(p, up, i % 2 == 0 ? color_t{1, 2, 3} : color_t{3, 2, 1});
+    }
+
+    const point3 p(0.1, 0.2, 0);
+    color_t radiance;
+    EXPECT_FALSE(cache.lookup(p, up, radiance));
+    cache.end_pass(2);
+    EXPECT_EQ(cache.passes(), 1);
+    EXPECT_GT(cache.entry_count(), 0u);
+    for(int i = 0; i < 16; i++) {
+        ASSERT_TRUE(cache.lookup(p, up, radiance));
+        EXPECT_NEAR(radiance.r, 2.0, 0.2);
+        EXPECT_NEAR(radiance.g, 2.0, 1e-6);
+        EXPECT_NEAR(radiance.b, 2.0, 0.2);
+    }
+
+    // the other side of the surface is a different entry
+    EXPECT_FALSE(cache.lookup(p, -up, radiance));
+}
+
+TEST(RadianceCacheTest, ShortensPathsAndMatchesPathTracing) {
+    // inside the Cornell box, looking at the back wall, so every path bounces around the room
+    scene_t scene = cornell_box(16, 16);
+    scene.cam = camera_t {16, 16, 70.0, {0, 0, -20}, {0, 0, -555}, {0, 1, 0}, 0.0, 1.0};
+
+    auto render = [&](const render_settings_t& settings, render_stats_t& stats) {
+        film_t film(16, 16);
+        renderer_t renderer(scene, film, settings);
+        stats = renderer.render(film.bounds());
+        double sum = 0.0;
+        for(int y = 0; y < 16; y++) {
+            for(int x = 0; x < 16; x++) {
+                sum += luminance(film.resolve(x, y));
+            }
+        }
+        return sum / 256.0;
+    };
+
+    render_settings_t settings;
+    settings.samples_per_pixel = 128;
+    render_stats_t traced;
+    const double expected = render(settings, traced);
+    ASSERT_GT(expected, 0.05);
+
+    // the cache's cells are shared by many pixels, and so are their errors, so the
+    // image as a whole is further out than the same number of independent samples
+    settings.radiance_cache = true;
+    settings.samples_per_pixel = 32;
+    render_stats_t cached;
+    EXPECT_NEAR(render(settings, cached), expected, 0.06 * expected);
+    EXPECT_LT(cached.average_path_length(), 0.85 * traced.average_path_length());
+}
+
+TEST(GridMediumTest, StoresOnlyBricksWithDetail) {
+    // a ball of smoke in one corner of the grid (touching 8 of its 64 bricks), and
+    // nothing elsewhere
+    auto ball = [](const dvec3_t& p) { return length(p - dvec3_t(0.2)) < 0.15 ? 1.0f : 0.0f; };
+    const density_grid_t grid(32, 32, 32, ball);
+    EXPECT_LE(grid.stored_bricks(), 8u);
+    EXPECT_GT(grid.stored_bricks(), 0u);
+    EXPECT_FLOAT_EQ(grid.max(), 1.0f);
+
+    for(int i = 0; i < 1000; i++) {
+        const int x = random_int(0, 31), y = random_int(0, 31), z = random_int(0, 31);
+        EXPECT_EQ(grid.voxel(x, y, z), ball((dvec3_t(x, y, z) + 0.5) / 32.0));
+
+        // nothing in a brick is denser than its majorant
+        const dvec3_t p = random_vec3(0.0, 32.0);
+        const glm::ivec3 brick = glm::ivec3(floor(p / 8.0));
+        EXPECT_LE(grid.lookup(p), grid.brick_max(brick.x, brick.y, brick.z));
+    }
+}
+
+TEST(GridMediumTest, TrackingMatchesBeerLambert) {
+    // density rising from 0 to 2 across a unit box
+    auto grid = make_shared<density_grid_t>(16, 16, 16, [](const dvec3_t& p) { return static_cast<float>(p.x); });
+    grid_medium_t medium(aabb_t({0, 0, 0}, {1, 1, 1}), grid, 2.0, color_t{1, 1, 1});
+
+    double optical_depth = 0.0;
+    constexpr int steps = 10000;
+    for(int i = 0; i < steps; i++) {
+        optical_depth += grid->lookup(dvec3_t((i + 0.5) / steps * 16.0, 8.0, 8.0)) * 2.0 / steps;
+    }
+    const double expected = exp(-optical_depth);
+
+    for(const bool majorant_grid : {true, false}) {
+        medium.set_majorant_grid(majorant_grid);
+        // the direction's length mustn't matter
+        for(const double speed : {1.0, 2.5}) {
+            const ray_t r({-1, 0.5, 0.5}, {speed, 0, 0});
+            constexpr int samples = 20000;
+            double ratio = 0.0;
+            int escaped = 0;
+            for(int i = 0; i < samples; i++) {
+                ratio += medium.transmittance(r, 0.0, infinity);
+                hit_record_t rec{};
+                if(!medium.hit(r, 0.0, infinity, rec)) {
+                    escaped++;
+                } else {
+                    EXPECT_GE(rec.p.x, 0.0);
+                    EXPECT_LE(rec.p.x, 1.0);
+                }
+            }
+            EXPECT_NEAR(ratio / samples, expected, 0.01);
+            EXPECT_NEAR(static_cast<double>(escaped) / samples, expected, 0.015);
+        }
+    }
+}
+
+TEST(IntervalTest, ConvexShapesMatchTwoHits) {
+    auto mat = make_shared<lambertian_material_t>(color_t{0.5, 0.5, 0.5});
+    const sphere_t sphere({0.5, 0.2, 0}, 1.0, mat);
+    const box_t box({0, 0.3, -0.2}, glm::angleAxis(0.6, normalize(dvec3_t(1, 2, 3))), 1.0, 2.0, 0.5, mat);
+
+    // the same rays whichever tests ran before
+    seed_random(1);
+    for(const hittable_t* shape : {static_cast<const hittable_t*>(&sphere), static_cast<const hittable_t*>(&box)}) {
+        // aimed somewhere in the shape's bounding box, so most hit and some only graze
+        aabb_t bounds;
+        ASSERT_TRUE(shape->bounding_box(0, 1, bounds));
+        int hits = 0;
+        for(int i = 0; i < 1000; i++) {
+            const point3 origin = random_vec3(-3.0, 3.0);
+            const point3 target = bounds.min() + (bounds.max() - bounds.min()) * random_vec3(0.0, 1.0);
+            const ray_t r(origin, target - origin);
+            double enter = 0.0, exit = 0.0, expected_enter = 0.0, expected_exit = 0.0;
+            const bool expected = shape->hittable_t::interval(r, expected_enter, expected_exit);
+            if(shape->interval(r, enter, exit) != expected) {
+                // only a graze can go either way
+                EXPECT_LT(std::abs(exit - enter), 1e-3);
+                continue;
+            }
+            if(expected) {
+                hits++;
+                EXPECT_NEAR(enter, expected_enter, 1e-4);
+                EXPECT_NEAR(exit, expected_exit, 1e-4);
+            }
+        }
+        EXPECT_GT(hits, 300);
+    }
+}
+
+TEST(IntervalTest, ConstantMediumMatchesBeerLambert) {
+    auto boundary = make_shared<sphere_t>(dvec3_t(0, 0, 0), 1.0, make_shared<lambertian_material_t>(color_t{1, 1, 1}));
+    const constant_medium_t medium(boundary, 0.5, color_t{1, 1, 1});
+    const double expected = exp(-0.5 * 2.0);
+
+    // the direction's length mustn't matter
+    for(const double speed : {1.0, 2.5}) {
+        const ray_t r({-2, 0, 0}, {speed, 0, 0});
+        EXPECT_NEAR(medium.transmittance(r, 0.0, infinity), expected, 1e-9);
+        constexpr int samples = 20000;
+        int escaped = 0;
+        for(int i = 0; i < samples; i++) {
+            hit_record_t rec{};
+            if(!medium.hit(r, 0.0, infinity, rec)) {
+                escaped++;
+            }
+        }
+        EXPECT_NEAR(static_cast<double>(escaped) / samples, expected, 0.015);
+    }
+}
+
+TEST(ImageTextureTest, MipLevelsAverageTheImage) {
+    // a checkerboard of single texels
+    constexpr int width = 16, height = 8;
+    std::vector<float> rgb;
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x++) {
+            const float c = (x + y) % 2 ? 1.0f : 0.0f;
+            rgb.insert(rgb.end(), {c, c, c});
+        }
+    }
+    const image_texture_t texture(width, height, rgb);
+    ASSERT_EQ(texture.levels(), 5);
+
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x++) {
+            EXPECT_EQ(texture.texel(0, x, y).r, (x + y) % 2 ? 1.0 : 0.0);
+        }
+    }
+    for(int level = 1; level < texture.levels(); level++) {
+        EXPECT_FLOAT_EQ(texture.texel(level, 0, 0).g, 0.5f);
+    }
+
+    // texel centers read back exactly, with no footprint or a footprint under a texel
+    const double u = 3.5 / width, v = 1.0 - 2.5 / height;
+    EXPECT_DOUBLE_EQ(texture.value(u, v, {0, 0, 0}).r, 1.0);
+    EXPECT_DOUBLE_EQ(texture.filtered_value(u, v, {0, 0, 0}, {0.5 / width, 0}, {0, 0.5 / height}, {0, 0, 0}, {0, 0, 0}).r, 1.0);
+
+    // a footprint of several texels averages them
+    EXPECT_NEAR(texture.filtered_value(u, v, {0, 0, 0}, {4.0 / width, 0}, {0, 4.0 / height}, {0, 0, 0}, {0, 0, 0}).r, 0.5, 1e-6);
+
+    // at odd sizes the leftover column and row go into the last texel, not nowhere
+    std::vector<float> edge;
+    for(int y = 0; y < 3; y++) {
+        for(int x = 0; x < 5; x++) {
+            const float c = x == 4 ? 1.0f : 0.0f;
+            edge.insert(edge.end(), {c, c, c});
+        }
+    }
+    const image_texture_t odd(5, 3, edge);
+    ASSERT_EQ(odd.levels(), 3);
+    EXPECT_EQ(odd.level_width(1), 2);
+    EXPECT_EQ(odd.level_height(1), 1);
+    EXPECT_FLOAT_EQ(odd.texel(1, 0, 0).r, 0.0f);
+    EXPECT_FLOAT_EQ(odd.texel(1, 1, 0).r, 1.0f / 3.0f);
+}
+
+TEST(ImageTextureTest, Bc1StaysCloseToTheImage) {
+    // a gradient, which a block's line of colors follows closely
+    constexpr int width = 256, height = 192;
+    std::vector<float> rgb;
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x++) {
+            const float t = static_cast<float>(x + y) / (width + height);
+            rgb.insert(rgb.end(), {t, 0.5f * t + 0.2f, 0.25f});
+        }
+    }
+    const image_texture_t full(width, height, rgb);
+    const image_texture_t compressed(width, height, rgb, texture_format_t::bc1);
+    ASSERT_EQ(compressed.levels(), full.levels());
+    EXPECT_LT(compressed.memory_bytes() * 16, full.memory_bytes());
+
+    // on the coarse levels a block spans so much of the gradient that four colors
+    // can't follow it, so just the fine ones
+    double worst = 0.0;
+    for(int level = 0; level < 2; level++) {
+        for(int y = 0; y < height >> level; y++) {
+            for(int x = 0; x < width >> level; x++) {
+                const color_t a = full.texel(level, x, y), b = compressed.texel(level, x, y);
+                worst = std::max({worst, std::abs(a.r - b.r), std::abs(a.g - b.g), std::abs(a.b - b.b)});
+            }
+        }
+    }
+    // 565 endpoints are only within about 4/255 (in sRGB) of the colors they're for
+    EXPECT_LT(worst, 0.04);
+
+    // a block of two colors (that 565 holds exactly) comes back exactly
+    const image_texture_t two_colors(4, 4, std::vector<float>(48, 1.0f), texture_format_t::bc1);
+    EXPECT_DOUBLE_EQ(two_colors.texel(0, 1, 2).g, 1.0);
+}
+
+TEST(ImageTextureTest, RayDifferentialsGiveThePixelFootprint) {
+    constexpr int size = 100;
+    const camera_t cam(size, size, 40.0, {0, 0, 5}, {0, 0, 0}, {0, 1, 0}, 0.0, 5.0);
+    const rect_t rect(2.0, 2.0, {0, 0, 0}, glm::dquat(1, 0, 0, 0), make_shared<lambertian_material_t>(color_t{1, 1, 1}));
+
+    const double s = 0.45, t = 0.55;
+    ray_differential_t differential;
+    const ray_t r = cam.get_ray(s, t, differential);
+    hit_record_t rec{};
+    ASSERT_TRUE(rect.hit(r, 0.001, infinity, rec));
+    rec.set_uv_differentials(differential);
+
+    // the same as where the rays through the next pixels across and up land
+    hit_record_t across{}, up{};
+    ASSERT_TRUE(rect.hit(cam.get_ray(s + 1.0 / (size - 1), t), 0.001, infinity, across));
+    ASSERT_TRUE(rect.hit(cam.get_ray(s, t + 1.0 / (size - 1)), 0.001, infinity, up));
+    EXPECT_NEAR(rec.duv_dx.x, across.uv.x - rec.uv.x, 1e-6);
+    EXPECT_NEAR(rec.duv_dx.y, across.uv.y - rec.uv.y, 1e-6);
+    EXPECT_NEAR(rec.duv_dy.x, up.uv.x - rec.uv.x, 1e-6);
+    EXPECT_NEAR(rec.duv_dy.y, up.uv.y - rec.uv.y, 1e-6);
+    EXPECT_GT(rec.duv_dx.x, 0.0);
+}
+
+TEST(TextureCacheTest, TiledFileReadsBackUnderBudget) {
+    constexpr int width = 40, height = 24;
+    std::vector<float> rgb(width * height * 3);
+    for(auto& c : rgb) {
+        c = static_cast<float>(random_double());
+    }
+    const image_texture_t image(width, height, rgb);
+    const std::string path = (std::filesystem::temp_directory_path() / "test_texture_cache.rttx").string();
+    ASSERT_TRUE(write_tiled_texture(image, path, 8));
+
+    // room for 4 of the 8x8 tiles, of the 15 in the full size level
+    constexpr size_t tile_bytes = 8 * 8 * 3 * sizeof(float);
+    auto cache = make_shared<texture_cache_t>(4 * tile_bytes);
+    const cached_texture_t texture(cache, path);
+    ASSERT_EQ(texture.width(), width);
+    ASSERT_EQ(texture.levels(), image.levels());
+
+    for(int i = 0; i < 2000; i++) {
+        const int level = random_int(0, image.levels() - 1);
+        const int x = random_int(0, width - 1), y = random_int(0, height - 1);
+        const color_t cached = texture.texel(level, x, y), expected = image.texel(level, x, y);
+        EXPECT_EQ(cached.r, expected.r);
+        EXPECT_EQ(cached.b, expected.b);
+        if(cache->stats().resident_bytes > 4 * tile_bytes) {
+            ADD_FAILURE() << "over budget";
+            break;
+        }
+    }
+    const double u = random_double(), v = random_double();
+    EXPECT_NEAR(texture.value(u, v, {0, 0, 0}).g, image.value(u, v, {0, 0, 0}).g, 1e-6);
+
+    // most tiles had to be read over and over, as only 4 fit
+    const texture_cache_stats_t stats = cache->stats();
+    EXPECT_GT(stats.evictions, 0u);
+    EXPECT_GT(stats.bytes_loaded, 4 * tile_bytes);
+    EXPECT_EQ(stats.bytes_loaded, stats.tiles_loaded * tile_bytes);
+    EXPECT_GT(stats.hit_rate(), 0.0);
+    EXPECT_LT(stats.hit_rate(), 1.0);
+    std::filesystem::remove(path);
+}
+
+TEST(AssetCacheTest, LoadsEachAssetOnce) {
+    constexpr int width = 16, height = 8;
+    std::vector<uint8_t> rgb(width * height * 3);
+    for(auto& c : rgb) {
+        c = static_cast<uint8_t>(random_int(0, 255));
+    }
+    const std::string path = (std::filesystem::temp_directory_path() / "test_asset_cache.png").string();
+    ASSERT_TRUE(write_png(path, width, height, rgb.data()));
+
+    // everyone asking at once shares the one load
+    asset_cache_t cache(2);
+    std::vector<shared_ptr<const image_texture_t>> loaded(8);
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i < loaded.size(); i++) {
+        threads.emplace_back([&, i] { loaded[i] = cache.image(path); });
+    }
+    for(auto& t : threads) {
+        t.join();
+    }
+    ASSERT_EQ(loaded[0]->width(), width);
+    for(const auto& texture : loaded) {
+        EXPECT_EQ(texture, loaded[0]);
+    }
+    EXPECT_NE(cache.image(path, texture_format_t::bc1), loaded[0]);
+
+    // the same seed gives the same tables, and the same noise as tables made apart
+    const auto noise = cache.perlin(7);
+    EXPECT_EQ(cache.perlin(7), noise);
+    EXPECT_NE(cache.perlin(8), noise);
+    const perlin_t fresh(7);
+    const point3 p(random_double(), random_double(), random_double());
+    EXPECT_EQ(noise->turb(p * 3.0), fresh.turb(p * 3.0));
+
+    asset_cache_stats_t stats = cache.stats();
+    EXPECT_EQ(stats.images_loaded, 2u);
+    EXPECT_EQ(stats.noise_tables_built, 2u);
+    EXPECT_EQ(stats.requests, 12u);
+    EXPECT_EQ(stats.hits, 8u);
+
+    // a missing file isn't kept, so it's tried again
+    const std::string missing = path + ".missing";
+    EXPECT_EQ(cache.image(missing)->levels(), 0);
+    EXPECT_EQ(cache.image(missing)->levels(), 0);
+    EXPECT_EQ(cache.stats().images_loaded, 4u);
+
+    cache.clear();
+    EXPECT_NE(cache.image(path), loaded[0]);
+    std::filesystem::remove(path);
+}
+
+TEST(PerlinTest, TurbulenceDropsOctavesFinerThanTheFootprint) {
+    const perlin_t noise(3);
+    for(int i = 0; i < 100; i++) {
+        const point3 p = random_vec3(-50, 50);
+        double sum = 0.0, weight = 1.0;
+        for(int octave = 0; octave < 7; octave++) {
+            sum += weight * noise.noise(p * static_cast<double>(1 << octave));
+            weight *= 0.5;
+        }
+        EXPECT_NEAR(noise.turb(p), fabs(sum), 1e-5);
+
+        // a quarter of a cell across keeps the first two octaves, and a whole cell none
+        EXPECT_NEAR(noise.turb(p, 7, 0.25), fabs(noise.noise(p) + 0.5 * noise.noise(p * 2.0)), 1e-5);
+        EXPECT_EQ(noise.turb(p, 7, 1.0), 0.0);
+    }
+
+    const noise_texture_t texture(4);
+    const point3 p = random_vec3(-5, 5);
+    EXPECT_NEAR(texture.filtered_value(0, 0, p, {0, 0}, {0, 0}, {0, 0, 0}, {0, 0, 0}).r, texture.value(0, 0, p).r, 1e-12);
+}
+
+TEST(TextureBakeTest, BakedTexturesMatchTheSourceAtTheirSamples) {
+    constexpr double voxel = 0.01;
+    auto checker = make_shared<checker_texture_t>(color_t(0.2, 0.3, 0.1), color_t(0.9, 0.8, 0.7));
+    ASSERT_TRUE(checker->bakeable());
+    std::vector<point3> points;
+    for(int i = 0; i < 200; i++) {
+        points.emplace_back(random_double(), 0.05, random_double());
+    }
+    baked_texture_t baked(checker, voxel);
+    baked.bake(points, 2);
+    // the squares are bigger than a brick, so only some have an edge through them
+    EXPECT_GT(baked.uniform_bricks(), 0u);
+    EXPECT_LT(baked.uniform_bricks(), baked.bricks());
+
+    for(const point3& p : points) {
+        const point3 sample = glm::round(p / voxel) * voxel;
+        EXPECT_NEAR(baked.value(0, 0, sample).g, checker->value(0, 0, sample).g, 1e-6);
+    }
+    // away from the bricks it's the source
+    EXPECT_EQ(baked.value(0, 0, {50, 50, 50}).r, checker->value(0, 0, {50, 50, 50}).r);
+
+    // a texture that's the same everywhere is one value a brick
+    baked_texture_t flat(make_shared<checker_texture_t>(color_t(0.5, 0.5, 0.5), color_t(0.5, 0.5, 0.5)), voxel, 1e-4);
+    flat.bake(points, 2);
+    EXPECT_EQ(flat.uniform_bricks(), flat.bricks());
+    EXPECT_LT(flat.memory_bytes(), baked.memory_bytes());
+    EXPECT_NEAR(flat.value(0, 0, points[0]).b, 0.5, 1e-6);
+
+    // the scene's marble is swapped for a baked copy
+    auto scene = make_scene("two_perlin_spheres_scene", 32, 32);
+    ASSERT_TRUE(scene);
+    const texture_bake_stats_t stats = bake_textures(*scene, {}, 2);
+    EXPECT_EQ(stats.textures, 1);
+    EXPECT_GT(stats.bricks, 0u);
+    hit_record_t rec;
+    ASSERT_TRUE(scene->root->hit(scene->cam.get_ray(0.5, 0.5), 0.001, infinity, rec));
+    auto* material = dynamic_cast<lambertian_material_t*>(rec.mat.get());
+    ASSERT_NE(material, nullptr);
+    EXPECT_NE(dynamic_cast<const baked_texture_t*>(material->albedo().get()), nullptr);
+}
+
+TEST(TextureProgramTest, CompiledTexturesMatchTheTree) {
+    // a checker of one colour twice is just that colour
+    auto grey = make_shared<solid_color_t>(color_t(0.5, 0.5, 0.5));
+    texture_program_t folded(make_shared<checker_texture_t>(grey, grey));
+    EXPECT_TRUE(folded.is_constant());
+    EXPECT_EQ(folded.size(), 1u);
+
+    // and of two colours, one instruction
+    auto checker = make_shared<checker_texture_t>(color_t(0.2, 0.3, 0.1), color_t(0.9, 0.8, 0.7));
+    texture_program_t two(checker);
+    EXPECT_EQ(two.size(), 1u);
+    EXPECT_FALSE(two.is_constant());
+
+    // checkers of checkers and noise
+    auto nested = make_shared<checker_texture_t>(checker, make_shared<checker_texture_t>(make_shared<noise_texture_t>(4.0), grey));
+    texture_program_t program(nested);
+    std::vector<texture_query_t> queries(100);
+    for(auto& q : queries) {
+        q.p = point3(random_double(-3, 3), random_double(-3, 3), random_double(-3, 3));
+    }
+    std::vector<color_t> batch(queries.size());
+    program.evaluate(queries.data(), queries.size(), batch.data());
+    for(size_t i = 0; i < queries.size(); i++) {
+        const color_t expected = nested->value(0, 0, queries[i].p);
+        const color_t single = program.evaluate(queries[i]);
+        EXPECT_NEAR(single.r, expected.r, 1e-12);
+        EXPECT_NEAR(single.g, expected.g, 1e-12);
+        EXPECT_EQ(batch[i].b, single.b);
+        EXPECT_EQ(two.evaluate(queries[i]).r, checker->value(0, 0, queries[i].p).r);
+    }
+
+    // materials given a new texture shade with it, not with what they compiled first
+    diffuse_light light(color_t(1, 1, 1));
+    light.set_emit(make_shared<solid_color_t>(color_t(4, 4, 4)));
+    EXPECT_EQ(light.emitted(0, 0, {0, 0, 0}).r, 4.0);
+    isotropic_material_t fog(color_t(1, 1, 1));
+    fog.set_albedo(grey);
+    hit_record_t rec;
+    EXPECT_NEAR(fog.eval(ray_t({0, 0, 0}, {1, 0, 0}), rec, {0, 1, 0}).g, 0.5 / (4.0 * g_pi), 1e-12);
+}
+
+TEST(PrimitiveStoreTest, HitsMatchTheHittables) {
+    auto white = make_shared<lambertian_material_t>(color_t(0.7, 0.7, 0.7));
+    auto red = make_shared<lambertian_material_t>(color_t(0.7, 0.1, 0.1));
+    const dquat turned = angleAxis(0.4, normalize(dvec3_t(1, 2, 3)));
+    hittable_list_t list;
+    list.add(make_shared<sphere_t>(point3(0, 0, 0), 1.0, white));
+    list.add(make_shared<sphere_t>(point3(3, 0, 0), point3(3, 1, 0), 0.0, 1.0, 0.5, red));
+    list.add(make_shared<rect_t>(2, 3, point3(0, 0, -3), turned, red));
+    list.add(make_shared<box_t>(point3(-3, 0, 0), turned, 1.0, 2.0, 1.5, white));
+    list.add(make_shared<box_t>(point3(0, 3, 0), dquat(), 1.0, 0.5, 2.0, red));
+    list.add(make_shared<instance_t>(make_shared<sphere_t>(point3(0, 0, 0), 0.5, red), glm::translate(dmat4_t(1.0), dvec3_t(0, -3, 0))));
+    const primitive_store_t store(list.objects, 0, 1);
+    EXPECT_EQ(store.count(primitive_store_t::kind_t::sphere), 3u);
+    EXPECT_EQ(store.count(primitive_store_t::kind_t::box), 2u);
+    EXPECT_EQ(store.count(primitive_store_t::kind_t::other), 0u);
+
+    // the same rays whichever tests ran before
+    seed_random(1);
+    int hits = 0;
+    for(int i = 0; i < 2000; i++) {
+        const point3 origin = random_unit_vector() * 8.0;
+        const point3 target(random_double(-4, 4), random_double(-4, 4), random_double(-4, 4));
+        const ray_t r(origin, target - origin, random_double());
+        hit_record_t expected, rec;
+        const bool hit = list.hit(r, 0.001, infinity, expected);
+        ASSERT_EQ(store.hit(r, 0.001, infinity, rec), hit);
+        if(!hit) {
+            continue;
+        }
+        hits++;
+        // the hittables transform rays in single precision, which loses about 1e-5 at
+        // this distance from the origin
+        constexpr double tolerance = 1e-4;
+        EXPECT_NEAR(rec.t, expected.t, tolerance);
+        EXPECT_NEAR(distance(rec.p, expected.p), 0.0, tolerance);
+        EXPECT_NEAR(distance(rec.normal, expected.normal), 0.0, tolerance);
+        EXPECT_NEAR(rec.uv.x, expected.uv.x, tolerance);
+        EXPECT_NEAR(rec.uv.y, expected.uv.y, tolerance);
+        EXPECT_NEAR(distance(rec.dpdu, expected.dpdu), 0.0, tolerance);
+        EXPECT_NEAR(distance(rec.dpdv, expected.dpdv), 0.0, tolerance);
+        EXPECT_EQ(rec.front_face, expected.front_face);
+        EXPECT_EQ(rec.mat, expected.mat);
+        EXPECT_EQ(store.transmittance(r, 0.001, infinity), 0.0);
+    }
+    EXPECT_GT(hits, 200);
+
+    // from inside a box, its far side
+    hit_record_t rec;
+    ASSERT_TRUE(store.hit(ray_t(point3(0, 3, 0), dvec3_t(0, 0, 1)), 0.001, infinity, rec));
+    EXPECT_NEAR(rec.t, 1.0, 1e-9);
+
+    // through a medium, Beer-Lambert
+    hittable_list_t smoke;
+    smoke.add(make_shared<constant_medium_t>(make_shared<box_t>(point3(0, 0, 0), dquat(), 2.0, 2.0, 2.0, white), 0.5, color_t(1, 1, 1)));
+    const primitive_store_t smoke_store(smoke.objects, 0, 1);
+    EXPECT_EQ(smoke_store.count(primitive_store_t::kind_t::medium), 1u);
+    EXPECT_NEAR(smoke_store.transmittance(ray_t(point3(-5, 0, 0), dvec3_t(1, 0, 0)), 0.001, infinity), exp(-1.0), 1e-9);
+}
+
+TEST(SceneArenaTest, ScenesAreBuiltInTheirArena) {
+    auto scene = make_scene("all_test", 16, 16, true);
+    ASSERT_TRUE(scene && scene->arena);
+    const scene_arena_stats_t stats = scene->arena->stats();
+    EXPECT_GT(stats.objects, 1000u);
+    EXPECT_GT(stats.bytes, 0u);
+    EXPECT_GE(stats.reserved_bytes, stats.bytes);
+    EXPECT_LT(stats.blocks, 32u);
+
+    // laid out one after the other, in build order
+    auto first = std::dynamic_pointer_cast<box_t>(scene->entities.objects[1]);
+    auto second = std::dynamic_pointer_cast<box_t>(scene->entities.objects[2]);
+    ASSERT_TRUE(first && second);
+    const auto gap = reinterpret_cast<const char*>(second.get()) - reinterpret_cast<const char*>(first.get());
+    EXPECT_GT(gap, 0);
+    EXPECT_LT(gap, 8192);
+    first.reset();
+    second.reset();
+
+    // copies share the arena, and assigning another scene over one lets go of its
+    // objects before its arena
+    scene_t copy = *scene;
+    scene.reset();
+    EXPECT_EQ(copy.arena->stats().objects, stats.objects);
+    copy = *make_scene("cornell_box", 16, 16, true);
+    ASSERT_TRUE(copy.arena);
+    EXPECT_LT(copy.arena->stats().objects, stats.objects);
+    hit_record_t rec;
+    EXPECT_TRUE(copy.root->hit(copy.cam.get_ray(0.5, 0.5), 0.001, infinity, rec));
+
+    // outside a scope, objects go on the heap, as do scenes made without an arena
+    EXPECT_EQ(scene_arena_t::current(), nullptr);
+    auto heap = make_scene("cornell_box", 16, 16);
+    ASSERT_TRUE(heap);
+    EXPECT_EQ(heap->arena, nullptr);
+}
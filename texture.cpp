@@ -1,4 +1,5 @@
 #include "texture.h"
+#include <cstring>
 
 streaming_image_texture_t::streaming_image_texture_t(SDL_Renderer* renderer, int width, int height):
     m_width(width),
@@ -6,6 +7,8 @@ streaming_image_texture_t::streaming_image_texture_t(SDL_Renderer* renderer, int
     m_buffer(std::make_unique<image_buffer_t>(width, height)),
     m_renderer(renderer) {
 
+    m_presented.resize(static_cast<size_t>(m_buffer->pitch()) * m_height);
+
     m_texture = SDL_CreateTexture(
         renderer, 
         SDL_PIXELFORMAT_RGBA8888, 
@@ -31,14 +34,39 @@ streaming_image_texture_t::~streaming_image_texture_t() {
 }
 
 void streaming_image_texture_t::update_texture_sync() {
-#ifdef THREADS
-    std::lock_guard guard(*m_buffer->mutex());
-#endif
+    std::vector<int> changed;
+    if(m_buffer->sync_to(m_presented.data(), m_buffer->pitch(), m_presented_epochs, &changed) == 0) {
+        return;
+    }
+
+    const auto regions = merge_tile_rows(changed, m_buffer->tiles_x(), m_buffer->tile_size(), m_width, m_height);
+    for(const auto& region : regions) {
+        upload_region(region, m_presented.data() + region.y0 * m_buffer->pitch() + region.x0 * 4, m_buffer->pitch());
+    }
+}
+
+void streaming_image_texture_t::update_texture_from_film(const film_t& film, dirty_tiles_t& dirty, const resolve_settings_t& settings) {
+    for(const auto& region : dirty.take()) {
+        const SDL_Rect rect {region.x0, region.y0, region.width(), region.height()};
+        uint8_t* pixels;
+        int pitch;
+        SDL_LockTexture(m_texture, &rect, reinterpret_cast<void**>(&pixels), &pitch);
+        resolve_film_region(film, region, pixels, pitch, settings);
+        SDL_UnlockTexture(m_texture);
+    }
+}
+
+void streaming_image_texture_t::upload_region(const render_region_t& region, const uint8_t* src, int src_pitch) {
+    const SDL_Rect rect {region.x0, region.y0, region.width(), region.height()};
     uint8_t* pixels;
     int pitch;
-    // SDL_LockTexture is a bit faster than SDL_UpdateTexture for writes
-    SDL_LockTexture(m_texture, nullptr, reinterpret_cast<void**>(&pixels), &pitch);
-    memcpy(pixels, m_buffer->data(), m_width*m_height*4);
+    // SDL_LockTexture is a bit faster than SDL_UpdateTexture for writes. Locking
+    // just the changed rectangle keeps the cost proportional to what changed.
+    SDL_LockTexture(m_texture, &rect, reinterpret_cast<void**>(&pixels), &pitch);
+    const size_t row_bytes = static_cast<size_t>(region.width()) * 4;
+    for(int y = 0; y < region.height(); y++) {
+        memcpy(pixels + y * pitch, src + y * src_pitch, row_bytes);
+    }
     SDL_UnlockTexture(m_texture);
 }
 
@@ -48,20 +76,18 @@ void streaming_image_texture_t::present() {
 
 void streaming_image_texture_t::resize(int width, int height) {
 
-    const image_buffer_t old_data(*m_buffer);
+    const auto old_data = std::move(m_buffer);
 
     m_width = width;
     m_height = height;
     SDL_DestroyTexture(m_texture);
     m_buffer = make_unique<image_buffer_t>(width, height);
 
-    for(int iy = 0; iy < height; iy++) {
-        for(int ix = 0; ix < width; ix ++) {
-            double x = static_cast<double>(ix) / width;
-            double y = static_cast<double>(iy) / height;
-            m_buffer->write_raw(ix, iy, old_data.read(x, y));
-        }    
-    }
+    m_buffer->resample_from(*old_data);
+    m_buffer->publish_all();
+
+    m_presented.assign(static_cast<size_t>(m_buffer->pitch()) * m_height, 0);
+    m_presented_epochs.clear();
     
     m_texture = SDL_CreateTexture(
         m_renderer, 
@@ -4,6 +4,7 @@
 #include <SDL.h>
 #include <SDL_render.h>
 #include "raytracelib/image_buffer.h"
+#include "raytracelib/dirty_tiles.h"
 
 class streaming_image_texture_t {
 public:
@@ -23,17 +24,34 @@ public:
     [[nodiscard]] int width() const { return m_width; }
     [[nodiscard]] int height() const { return m_height; }
 
+    /**
+     * \brief Uploads any tiles of image() that have changed since the last update,
+     * locking only those parts of the texture. Doesn't block the render threads
+     * (see image_buffer_t::sync_to).
+     */
     void update_texture_sync();
 
+    /**
+     * \brief Resolves the dirty tiles of the film straight into the locked texture,
+     * skipping image() entirely. Only safe for tiles nothing is writing to any more.
+     */
+    void update_texture_from_film(const film_t& film, dirty_tiles_t& dirty, const resolve_settings_t& settings = {});
+
     void present();
 
     void resize(int width, int height);
 
 protected:
+    void upload_region(const render_region_t& region, const uint8_t* src, int src_pitch);
+
     int m_width;
     int m_height;
     unique_ptr<image_buffer_t> m_buffer;
 
+    // the last consistent snapshot of m_buffer, and the tile epochs it's up to date with
+    std::vector<uint8_t> m_presented;
+    std::vector<uint64_t> m_presented_epochs;
+
     SDL_Renderer* m_renderer;
     SDL_Texture* m_texture;
     uint32_t m_format;